@@ -0,0 +1,137 @@
+/*
+ *   File name: AggregateInfo.cpp
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QObject>
+
+#include "AggregateInfo.h"
+#include "DirInfo.h"
+#include "Exception.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+AggregateInfo::AggregateInfo( DirTree * tree,
+			      DirInfo * parent )
+    : FileInfo( tree, parent ),
+      _count( 0 ),
+      _oldestMtime( 0 )
+{
+    _name = aggregateName();
+    _mode = S_IFREG;
+    _links = 1;
+
+    if ( parent )
+    {
+	_device = parent->device();
+	_uid	= parent->uid();
+	_gid	= parent->gid();
+    }
+
+    for ( int i=0; i < HistogramBuckets; ++i )
+	_histogram[ i ] = 0;
+}
+
+
+AggregateInfo::~AggregateInfo()
+{
+
+}
+
+
+void AggregateInfo::add( const FileInfo * file )
+{
+    CHECK_PTR( file );
+
+    // size() and allocatedSize() already take hard links into account
+
+    _size	   += file->size();
+    _allocatedSize += file->allocatedSize();
+    _blocks	   += file->blocks();
+
+    time_t mtime = file->mtime();
+
+    if ( _count == 0 || mtime > _mtime )
+	_mtime = mtime;
+
+    if ( _count == 0 || mtime < _oldestMtime )
+	_oldestMtime = mtime;
+
+    _histogram[ bucket( file->size() ) ]++;
+    _count++;
+}
+
+
+void AggregateInfo::setSums( FileCount count,
+			     FileSize  size,
+			     FileSize  allocatedSize,
+			     FileSize  blocks,
+			     time_t    oldestMtime,
+			     time_t    newestMtime )
+{
+    _count	   = count;
+    _size	   = size;
+    _allocatedSize = allocatedSize;
+    _blocks	   = blocks;
+    _oldestMtime   = oldestMtime;
+    _mtime	   = newestMtime;
+}
+
+
+FileCount AggregateInfo::histogram( int bucket ) const
+{
+    if ( bucket < 0 || bucket >= HistogramBuckets )
+	return 0;
+
+    return _histogram[ bucket ];
+}
+
+
+void AggregateInfo::setHistogram( int bucket, FileCount count )
+{
+    if ( bucket >= 0 && bucket < HistogramBuckets )
+	_histogram[ bucket ] = count;
+}
+
+
+int AggregateInfo::bucket( FileSize size )
+{
+    int	     bucket = 0;
+    FileSize limit  = 1024;
+
+    while ( size >= limit && bucket < HistogramBuckets - 1 )
+    {
+	++bucket;
+	limit *= 2;
+    }
+
+    return bucket;
+}
+
+
+FileSize AggregateInfo::bucketStart( int bucket )
+{
+    if ( bucket <= 0 )
+	return 0;
+
+    return 512LL << qMin( bucket, HistogramBuckets - 1 );
+}
+
+
+QString AggregateInfo::aggregateName()
+{
+    return QObject::tr( "<Aggregated Files>" );
+}
+
+
+QString AggregateInfo::storedName( const FileInfo * item )
+{
+    return item->isAggregate() ? QString( "<Aggregated Files>" ) : item->name();
+}
@@ -0,0 +1,173 @@
+/*
+ *   File name: AggregateInfo.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef AggregateInfo_h
+#define AggregateInfo_h
+
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    // Forward declarations
+    class DirTree;
+    class DirInfo;
+
+    /**
+     * Pseudo entry that stands for a number of files of a directory that
+     * were not read as individual FileInfo nodes, but only counted.
+     *
+     * In "aggregated leaf mode" (see DirTree::setAggregation()), regular
+     * files below a size threshold (or all regular files in directories
+     * below a depth threshold) are folded into one such entry per directory
+     * instead of creating a FileInfo for each of them. That saves a lot of
+     * memory for trees with millions of small files, but of course those
+     * files are no longer available individually. Refreshing the directory
+     * reads them again as normal files.
+     *
+     * Like any other file, it is stored in the dot entry of its directory
+     * (if there is one).
+     *
+     * It behaves like a regular file with the sums of all aggregated files:
+     * size(), allocatedSize() and blocks() are the totals, mtime() is the
+     * latest mtime. The number of aggregated files is count(); since this
+     * entry itself counts as one file, the total...() item counts return
+     * count() - 1.
+     **/
+    class AggregateInfo: public FileInfo
+    {
+    public:
+
+	/**
+	 * Number of buckets of the size histogram.
+	 **/
+	enum { HistogramBuckets = 8 };
+
+	/**
+	 * Constructor.
+	 **/
+	AggregateInfo( DirTree * tree,
+		       DirInfo * parent = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~AggregateInfo();
+
+	/**
+	 * Add a file to the sums. The file is only used to get its values;
+	 * it is not stored anywhere.
+	 *
+	 * This must not be used any more once this entry is inserted into a
+	 * directory: The parent's sums are not updated.
+	 **/
+	void add( const FileInfo * file );
+
+	/**
+	 * Set all sums at once. This is used when reading the sums from a
+	 * cache file or a SubtreeStore.
+	 **/
+	void setSums( FileCount count,
+		      FileSize	size,
+		      FileSize	allocatedSize,
+		      FileSize	blocks,
+		      time_t	oldestMtime,
+		      time_t	newestMtime );
+
+	/**
+	 * Return the number of aggregated files.
+	 **/
+	FileCount count() const { return _count; }
+
+	/**
+	 * Return the modification time of the oldest aggregated file.
+	 **/
+	time_t oldestMtime() const { return _oldestMtime; }
+
+	/**
+	 * Return the modification time of the newest aggregated file.
+	 * This is the same as mtime().
+	 **/
+	time_t newestMtime() const { return _mtime; }
+
+	/**
+	 * Return the number of aggregated files in histogram bucket 'bucket'
+	 * (0 .. HistogramBuckets-1).
+	 **/
+	FileCount histogram( int bucket ) const;
+
+	/**
+	 * Set the number of aggregated files in histogram bucket 'bucket'.
+	 **/
+	void setHistogram( int bucket, FileCount count );
+
+	/**
+	 * Return the histogram bucket for a file of size 'size': Bucket 0 is
+	 * for files below 1 kB, each of the following buckets covers twice
+	 * the size of the previous one; the last bucket takes everything
+	 * above.
+	 **/
+	static int bucket( FileSize size );
+
+	/**
+	 * Return the lower size limit of histogram bucket 'bucket'.
+	 **/
+	static FileSize bucketStart( int bucket );
+
+	/**
+	 * (Translated) user-visible string for an aggregate entry.
+	 **/
+	static QString aggregateName();
+
+	/**
+	 * Return the name of 'item' for cache files and digests: For an
+	 * aggregate, this is the untranslated name, so they don't depend on
+	 * the language of the user; for anything else, it is just its name.
+	 **/
+	static QString storedName( const FileInfo * item );
+
+	/**
+	 * Returns true if this is an AggregateInfo object.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual bool isAggregate() const Q_DECL_OVERRIDE
+	    { return true; }
+
+	/**
+	 * Item counts: All aggregated files except this entry itself.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual FileCount totalItems()		Q_DECL_OVERRIDE { return _count - 1; }
+	virtual FileCount totalFiles()		Q_DECL_OVERRIDE { return _count - 1; }
+	virtual FileCount totalNonDirItems()	Q_DECL_OVERRIDE { return _count - 1; }
+	virtual FileCount totalUnignoredItems() Q_DECL_OVERRIDE { return _count - 1; }
+
+	/**
+	 * Return the modification time of the oldest aggregated file.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual time_t oldestFileMtime() Q_DECL_OVERRIDE { return _oldestMtime; }
+
+
+    protected:
+
+	FileCount	_count;
+	time_t		_oldestMtime;
+	FileCount	_histogram[ HistogramBuckets ];
+
+    };	// class AggregateInfo
+
+}	// namespace QDirStat
+
+
+#endif // ifndef AggregateInfo_h
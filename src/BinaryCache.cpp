@@ -0,0 +1,432 @@
+/*
+ *   File name: BinaryCache.cpp
+ *   Summary:	Binary, memory-mappable QDirStat cache file format
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy(), memcmp(), memset()
+
+#include "BinaryCache.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "AggregateInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define ENTRY_BUFFER_SIZE	( 1024 * 1024 )
+
+
+using namespace QDirStat;
+
+
+BinaryCacheWriter::BinaryCacheWriter( const QString & fileName, DirTree * tree ):
+    _entryCount( 0 ),
+    _withUidGidPerm( true )
+{
+    _ok = writeCache( fileName, tree );
+}
+
+
+BinaryCacheWriter::~BinaryCacheWriter()
+{
+    // NOP
+}
+
+
+bool BinaryCacheWriter::writeCache( const QString & fileName, DirTree * tree )
+{
+    if ( ! tree )
+	return false;
+
+    FileInfo * firstToplevel = tree->firstToplevel();
+
+    if ( ! firstToplevel )
+	return false;
+
+    _file.setFileName( fileName );
+
+    if ( ! _file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    _withUidGidPerm = firstToplevel->hasUid();
+
+    // Reserve the space for the header; it is written again with the
+    // positions of all tables when everything else is written.
+
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+    writePadded( (const char *) &header, sizeof( header ) );
+
+    header.entriesOffset = _file.pos();
+    writeTree( tree->root()->firstChild(), BinaryCacheNoParent );
+    flushEntries();
+
+    header.aggregatesOffset = _file.pos();
+    writePadded( (const char *) _aggregates.constData(),
+		 _aggregates.size() * sizeof( BinaryCacheAggregate ) );
+
+    header.dirsOffset = _file.pos();
+    writePadded( (const char *) _dirs.constData(),
+		 _dirs.size() * sizeof( BinaryCacheDir ) );
+
+    header.stringsOffset = _file.pos();
+    writePadded( _strings.constData(), _strings.size() );
+
+    memcpy( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) );
+    header.version	  = BINARY_CACHE_VERSION;
+    header.byteOrder	  = BINARY_CACHE_BYTE_ORDER;
+    header.flags	  = _withUidGidPerm ? BinaryCacheUidGidPerm : 0;
+    header.entrySize	  = sizeof( BinaryCacheEntry );
+    header.entryCount	  = _entryCount;
+    header.aggregateCount = _aggregates.size();
+    header.dirCount	  = _dirs.size();
+    header.stringsSize	  = _strings.size();
+
+    _file.seek( 0 );
+    _file.write( (const char *) &header, sizeof( header ) );
+
+    bool ok = _file.error() == QFile::NoError;
+
+    if ( ! ok )
+	logError() << "Error writing " << fileName << ": " << _file.errorString() << endl;
+
+    _file.close();
+
+    _strings.clear();
+    _stringOffsets.clear();
+    _aggregates.clear();
+    _dirs.clear();
+
+    return ok;
+}
+
+
+void BinaryCacheWriter::writeTree( FileInfo * item, quint32 parent )
+{
+    if ( ! item )
+	return;
+
+    quint32 childrenParent = parent;
+    int	    dirPos	   = -1;
+
+    if ( ! item->isDotEntry() )
+    {
+	// Only the toplevel entry has its complete path as its name
+
+	QString name  = parent == BinaryCacheNoParent ? item->url() : AggregateInfo::storedName( item );
+	quint32 index = writeEntry( item, name, parent );
+
+	if ( item->isDirInfo() )
+	{
+	    BinaryCacheDir dir;
+	    dir.entry	   = index;
+	    dir.subtreeEnd = index + 1;
+
+	    dirPos = _dirs.size();
+	    _dirs << dir;
+	    childrenParent = index;
+	}
+    }
+
+    // The files of a directory go first, then its subdirectories, just
+    // like in the text format. The children of the dot entry belong to its
+    // parent.
+
+    if ( item->dotEntry() )
+	writeTree( item->dotEntry(), childrenParent );
+
+    FileInfo * child = item->firstChild();
+
+    while ( child )
+    {
+	writeTree( child, childrenParent );
+	child = child->next();
+    }
+
+    if ( dirPos >= 0 )
+	_dirs[ dirPos ].subtreeEnd = _entryCount;
+}
+
+
+quint32 BinaryCacheWriter::writeEntry( FileInfo *	 item,
+				       const QString & name,
+				       quint32		 parent )
+{
+    BinaryCacheEntry entry;
+    memset( &entry, 0, sizeof( entry ) );
+
+    entry.parent = parent;
+    entry.mode	 = _withUidGidPerm ? item->mode() : ( item->mode() & S_IFMT );
+    entry.uid	 = _withUidGidPerm ? item->uid() : 0;
+    entry.gid	 = _withUidGidPerm ? item->gid() : 0;
+    entry.links	 = item->links();
+    entry.size	 = item->rawByteSize();
+    entry.blocks = -1;
+    entry.mtime	 = item->mtime();
+
+    if ( item->isSparseFile() )
+    {
+	entry.flags |= BinaryCacheSparse;
+	entry.blocks = item->blocks();
+    }
+
+    if ( item->isAggregate() )
+    {
+	AggregateInfo * aggregate = static_cast<AggregateInfo *>( item );
+
+	entry.flags |= BinaryCacheAggregate;
+	entry.blocks = aggregate->blocks();
+
+	BinaryCacheAggregate sums;
+	memset( &sums, 0, sizeof( sums ) );
+
+	sums.entry	   = _entryCount;
+	sums.count	   = aggregate->count();
+	sums.allocatedSize = aggregate->rawAllocatedSize();
+	sums.oldestMtime   = aggregate->oldestMtime();
+
+	for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+	    sums.histogram[ i ] = aggregate->histogram( i );
+
+	_aggregates << sums;
+    }
+
+    addName( entry, name );
+    _entries.append( (const char *) &entry, sizeof( entry ) );
+
+    if ( _entries.size() >= ENTRY_BUFFER_SIZE )
+	flushEntries();
+
+    return _entryCount++;
+}
+
+
+void BinaryCacheWriter::addName( BinaryCacheEntry & entry, const QString & name )
+{
+    QByteArray utf8 = name.toUtf8();
+    QHash<QString, quint32>::const_iterator it = _stringOffsets.constFind( name );
+
+    if ( it != _stringOffsets.constEnd() )
+    {
+	entry.nameOffset = it.value();
+    }
+    else
+    {
+	entry.nameOffset = _strings.size();
+	_strings.append( utf8 );
+	_stringOffsets.insert( name, entry.nameOffset );
+    }
+
+    entry.nameLen = utf8.size();
+}
+
+
+void BinaryCacheWriter::flushEntries()
+{
+    writePadded( _entries.constData(), _entries.size() );
+    _entries.clear();
+}
+
+
+bool BinaryCacheWriter::writePadded( const char * data, qint64 size )
+{
+    static const char zeroes[ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    if ( size > 0 && _file.write( data, size ) != size )
+	return false;
+
+    int padding = ( 8 - size % 8 ) % 8;
+
+    return padding == 0 || _file.write( zeroes, padding ) == padding;
+}
+
+
+
+
+BinaryCacheReader::BinaryCacheReader( const QString & fileName ):
+    _file( fileName ),
+    _data( 0 ),
+    _size( 0 ),
+    _header( 0 ),
+    _entryTable( 0 ),
+    _entryCount( 0 ),
+    _aggregateTable( 0 ),
+    _aggregateCount( 0 ),
+    _dirTable( 0 ),
+    _dirCount( 0 ),
+    _strings( 0 ),
+    _stringsSize( 0 )
+{
+    if ( ! _file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	return;
+    }
+
+    _size = _file.size();
+
+    if ( _size < (qint64) sizeof( BinaryCacheHeader ) )
+    {
+	logError() << fileName << " is not a binary cache file" << endl;
+	return;
+    }
+
+    uchar * data = _file.map( 0, _size );
+
+    if ( ! data )
+    {
+	logError() << "Can't map " << fileName << ": " << _file.errorString() << endl;
+	return;
+    }
+
+    const BinaryCacheHeader * header = (const BinaryCacheHeader *) data;
+    QString problem;
+
+    if ( memcmp( header->magic, BINARY_CACHE_MAGIC, sizeof( header->magic ) ) != 0 )
+	problem = "not a binary cache file";
+    else if ( header->byteOrder != BINARY_CACHE_BYTE_ORDER )
+	problem = "written on a machine with a different byte order";
+    else if ( header->version != BINARY_CACHE_VERSION )
+	problem = QString( "unsupported version %1" ).arg( header->version );
+    else if ( header->entrySize != sizeof( BinaryCacheEntry ) )
+	problem = "unexpected entry size";
+    else if ( header->entryCount	 >= BinaryCacheNoParent ||
+	      header->aggregateCount >= BinaryCacheNoParent ||
+	      header->dirCount	 >= BinaryCacheNoParent ||
+	      ! checkTable( header->entriesOffset,    header->entryCount,     sizeof( BinaryCacheEntry	   ) ) ||
+	      ! checkTable( header->aggregatesOffset, header->aggregateCount, sizeof( BinaryCacheAggregate ) ) ||
+	      ! checkTable( header->dirsOffset,	      header->dirCount,	      sizeof( BinaryCacheDir	   ) ) ||
+	      ! checkTable( header->stringsOffset,    header->stringsSize,    1 ) )
+    {
+	problem = "corrupt table positions";
+    }
+
+    if ( ! problem.isEmpty() )
+    {
+	logError() << fileName << ": " << problem << endl;
+	_file.unmap( data );
+	return;
+    }
+
+    _data	    = data;
+    _header	    = header;
+    _entryTable	    = (const BinaryCacheEntry *)     ( data + header->entriesOffset	);
+    _entryCount	    = header->entryCount;
+    _aggregateTable = (const BinaryCacheAggregate *) ( data + header->aggregatesOffset );
+    _aggregateCount = header->aggregateCount;
+    _dirTable	    = (const BinaryCacheDir *)	     ( data + header->dirsOffset	);
+    _dirCount	    = header->dirCount;
+    _strings	    = (const char *)		     ( data + header->stringsOffset	);
+    _stringsSize    = header->stringsSize;
+
+    logDebug() << "Mapped " << fileName << ": " << _entryCount << " entries" << endl;
+}
+
+
+BinaryCacheReader::~BinaryCacheReader()
+{
+    if ( _data )
+	_file.unmap( _data );
+}
+
+
+bool BinaryCacheReader::isBinaryCache( const QString & fileName )
+{
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    char magic[ 16 ];
+
+    return file.read( magic, sizeof( magic ) ) == sizeof( magic ) &&
+	memcmp( magic, BINARY_CACHE_MAGIC, sizeof( magic ) ) == 0;
+}
+
+
+bool BinaryCacheReader::withUidGidPerm() const
+{
+    return _header && ( _header->flags & BinaryCacheUidGidPerm );
+}
+
+
+bool BinaryCacheReader::checkTable( quint64 offset, quint64 count, quint64 itemSize ) const
+{
+    quint64 size = _size;
+
+    return offset % 8 == 0 &&
+	offset >= sizeof( BinaryCacheHeader ) &&
+	offset <= size &&
+	count  <= ( size - offset ) / itemSize;
+}
+
+
+QString BinaryCacheReader::name( const BinaryCacheEntry & entry ) const
+{
+    if ( entry.nameOffset > _stringsSize ||
+	 entry.nameLen	  > _stringsSize - entry.nameOffset )
+    {
+	return QString();
+    }
+
+    return QString::fromUtf8( _strings + entry.nameOffset, entry.nameLen );
+}
+
+
+const BinaryCacheAggregate * BinaryCacheReader::aggregate( quint32 index ) const
+{
+    // Binary search: The aggregate table is sorted by entry index
+
+    quint32 low  = 0;
+    quint32 high = _aggregateCount;
+
+    while ( low < high )
+    {
+	quint32 mid = low + ( high - low ) / 2;
+
+	if ( _aggregateTable[ mid ].entry < index )
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    if ( low < _aggregateCount && _aggregateTable[ low ].entry == index )
+	return &_aggregateTable[ low ];
+
+    return 0;
+}
+
+
+quint32 BinaryCacheReader::subtreeEnd( quint32 index ) const
+{
+    // Binary search: The directory index is sorted by entry index
+
+    quint32 low  = 0;
+    quint32 high = _dirCount;
+
+    while ( low < high )
+    {
+	quint32 mid = low + ( high - low ) / 2;
+
+	if ( _dirTable[ mid ].entry < index )
+	    low = mid + 1;
+	else
+	    high = mid;
+    }
+
+    if ( low < _dirCount && _dirTable[ low ].entry == index )
+    {
+	quint32 end = _dirTable[ low ].subtreeEnd;
+
+	if ( end > index && end <= _entryCount )
+	    return end;
+    }
+
+    return index + 1;
+}
@@ -0,0 +1,311 @@
+/*
+ *   File name: BinaryCache.h
+ *   Summary:	Binary, memory-mappable QDirStat cache file format
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BinaryCache_h
+#define BinaryCache_h
+
+
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QByteArray>
+
+#include "FileInfo.h"
+
+
+#define BINARY_CACHE_SUFFIX	".qdbin"
+#define BINARY_CACHE_MAGIC	"QDirStatBinCache"	// 16 bytes, no trailing 0
+#define BINARY_CACHE_VERSION	1
+#define BINARY_CACHE_BYTE_ORDER	0x01020304
+
+// Header flags
+
+#define BinaryCacheUidGidPerm	0x01
+
+// Entry flags
+
+#define BinaryCacheSparse	0x01
+#define BinaryCacheAggregate	0x02
+
+// Parent index of the toplevel directory
+
+#define BinaryCacheNoParent	0xFFFFFFFF
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class AggregateInfo;
+
+
+    /**
+     * Header at the start of a binary cache file.
+     *
+     * All offsets are relative to the start of the file, and all tables
+     * start at a multiple of 8 bytes, so a memory-mapped file can be used
+     * directly without copying anything. The file is written in the byte
+     * order of the machine that wrote it; a reader with a different byte
+     * order rejects it (see 'byteOrder').
+     **/
+    struct BinaryCacheHeader
+    {
+	char	magic[ 16 ];		// BINARY_CACHE_MAGIC
+	quint32 version;		// BINARY_CACHE_VERSION
+	quint32 byteOrder;		// BINARY_CACHE_BYTE_ORDER
+	quint32 flags;			// BinaryCacheUidGidPerm
+	quint32 entrySize;		// sizeof( BinaryCacheEntry )
+	quint64 entryCount;
+	quint64 entriesOffset;
+	quint64 aggregateCount;
+	quint64 aggregatesOffset;
+	quint64 dirCount;
+	quint64 dirsOffset;
+	quint64 stringsSize;
+	quint64 stringsOffset;
+    };
+
+
+    /**
+     * One item (directory, file, symlink, special file, aggregate) in the
+     * entry table. The entries are in the same order as in the text
+     * format: Each directory is followed by its files and then by its
+     * subdirectories with their subtrees, recursively.
+     *
+     * The name is a reference into the string table (UTF-8, not
+     * 0-terminated) where each name is only stored once. The name of the
+     * first (toplevel) entry is its complete path.
+     **/
+    struct BinaryCacheEntry
+    {
+	quint32 parent;		// Index of the parent or BinaryCacheNoParent
+	quint32 nameOffset;	// In the string table
+	quint32 nameLen;	// In bytes
+	quint32 mode;
+	quint32 uid;
+	quint32 gid;
+	quint32 links;
+	quint32 flags;		// BinaryCacheSparse, BinaryCacheAggregate
+	qint64	size;
+	qint64	blocks;		// Only meaningful for sparse files and aggregates
+	qint64	mtime;
+    };
+
+
+    /**
+     * The additional sums of an aggregate entry. The aggregate table is
+     * sorted by entry index.
+     **/
+    struct BinaryCacheAggregate
+    {
+	quint32 entry;		// Index in the entry table
+	quint32 reserved;
+	qint64	count;
+	qint64	allocatedSize;
+	qint64	oldestMtime;
+	qint64	histogram[ 8 ];	// AggregateInfo::HistogramBuckets
+    };
+
+
+    /**
+     * One directory in the directory index. The index is sorted by entry
+     * index. The subtree of the directory consists of all entries from
+     * 'entry' up to, but not including, 'subtreeEnd', so a reader can skip
+     * a complete subtree (e.g. an excluded directory) without looking at
+     * any of its entries.
+     **/
+    struct BinaryCacheDir
+    {
+	quint32 entry;
+	quint32 subtreeEnd;
+    };
+
+
+
+    /**
+     * Writer for the binary cache file format.
+     *
+     * The entries are written sequentially while traversing the tree; the
+     * string table, the aggregates and the directory index are collected
+     * in memory and written after the entries, and finally the header with
+     * the table positions is written again at the start of the file.
+     **/
+    class BinaryCacheWriter
+    {
+    public:
+
+	/**
+	 * Write 'tree' to binary cache file 'fileName'.
+	 *
+	 * Check BinaryCacheWriter::ok() to see if writing the cache file went
+	 * OK.
+	 **/
+	BinaryCacheWriter( const QString & fileName, DirTree * tree );
+
+	/**
+	 * Destructor
+	 **/
+	virtual ~BinaryCacheWriter();
+
+	/**
+	 * Returns true if writing the cache file went OK.
+	 **/
+	bool ok() const { return _ok; }
+
+
+    protected:
+
+	/**
+	 * Write the cache file. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool writeCache( const QString & fileName, DirTree * tree );
+
+	/**
+	 * Write 'item' recursively with parent entry 'parent'.
+	 **/
+	void writeTree( FileInfo * item, quint32 parent );
+
+	/**
+	 * Write the entry for 'item' with name 'name' and parent entry
+	 * 'parent' without recursion. Returns the index of the new entry.
+	 **/
+	quint32 writeEntry( FileInfo * item, const QString & name, quint32 parent );
+
+	/**
+	 * Add 'name' to the string table unless it is already there and
+	 * store its position in 'entry'.
+	 **/
+	void addName( BinaryCacheEntry & entry, const QString & name );
+
+	/**
+	 * Write the buffered entries to the file.
+	 **/
+	void flushEntries();
+
+	/**
+	 * Write 'size' bytes from 'data' at the current file position and
+	 * pad with zeroes to the next multiple of 8 bytes.
+	 **/
+	bool writePadded( const char * data, qint64 size );
+
+
+	//
+	// Data members
+	//
+
+	QFile				_file;
+	QByteArray			_entries;
+	quint32				_entryCount;
+	QByteArray			_strings;
+	QHash<QString, quint32>		_stringOffsets;
+	QVector<BinaryCacheAggregate>	_aggregates;
+	QVector<BinaryCacheDir>		_dirs;
+	bool				_withUidGidPerm;
+	bool				_ok;
+    };
+
+
+
+    /**
+     * Low-level reader for the binary cache file format: This maps the
+     * file into memory and provides access to its tables. CacheReader uses
+     * this to build the tree if the cache file is in the binary format.
+     **/
+    class BinaryCacheReader
+    {
+    public:
+
+	/**
+	 * Constructor: Open and map 'fileName' and check the header.
+	 *
+	 * Check BinaryCacheReader::ok() if that went OK.
+	 **/
+	BinaryCacheReader( const QString & fileName );
+
+	/**
+	 * Destructor
+	 **/
+	virtual ~BinaryCacheReader();
+
+	/**
+	 * Return 'true' if 'fileName' is a binary cache file, i.e. if it
+	 * starts with BINARY_CACHE_MAGIC.
+	 **/
+	static bool isBinaryCache( const QString & fileName );
+
+	/**
+	 * Returns true if the file could be mapped and its header is valid.
+	 **/
+	bool ok() const { return _data != 0; }
+
+	/**
+	 * Return 'true' if the entries have UID, GID and permissions.
+	 **/
+	bool withUidGidPerm() const;
+
+	/**
+	 * Return the number of entries.
+	 **/
+	quint32 entryCount() const { return _entryCount; }
+
+	/**
+	 * Return entry no. 'index'. 'index' must be less than entryCount().
+	 **/
+	const BinaryCacheEntry & entry( quint32 index ) const
+	    { return _entryTable[ index ]; }
+
+	/**
+	 * Return the name of 'entry' or an empty string if it is invalid.
+	 **/
+	QString name( const BinaryCacheEntry & entry ) const;
+
+	/**
+	 * Return the aggregate sums for entry no. 'index' or 0 if there are
+	 * none.
+	 **/
+	const BinaryCacheAggregate * aggregate( quint32 index ) const;
+
+	/**
+	 * Return the index of the first entry after the subtree of directory
+	 * entry no. 'index'. For anything that is not in the directory index,
+	 * this is simply the next entry.
+	 **/
+	quint32 subtreeEnd( quint32 index ) const;
+
+
+    protected:
+
+	/**
+	 * Check if the table with 'count' items of 'itemSize' bytes each at
+	 * 'offset' is completely inside the mapped file.
+	 **/
+	bool checkTable( quint64 offset, quint64 count, quint64 itemSize ) const;
+
+
+	//
+	// Data members
+	//
+
+	QFile				_file;
+	uchar *				_data;
+	qint64				_size;
+	const BinaryCacheHeader *	_header;
+	const BinaryCacheEntry *	_entryTable;
+	quint32				_entryCount;
+	const BinaryCacheAggregate *	_aggregateTable;
+	quint32				_aggregateCount;
+	const BinaryCacheDir *		_dirTable;
+	quint32				_dirCount;
+	const char *			_strings;
+	quint64				_stringsSize;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BinaryCache_h
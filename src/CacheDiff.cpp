@@ -0,0 +1,944 @@
+/*
+ *   File name: CacheDiff.cpp
+ *   Summary:	Compare two QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// strncmp()
+#include <algorithm>	// std::sort()
+
+#include <QElapsedTimer>
+#include <QTextStream>
+
+#include "CacheDiff.h"
+#include "CacheFile.h"
+#include "CacheIndex.h"
+#include "DirTreeCache.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "FileInfo.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+
+
+#define GROWTH_HUE		0	// red
+#define SHRINK_HUE		120	// green
+#define MIN_SATURATION		48
+#define MAX_SATURATION		176
+
+
+using namespace QDirStat;
+
+
+/**
+ * Return the size of cache item 'item' like FileInfo::size() would: For
+ * a sparse file only its allocated blocks, for a file with multiple hard
+ * links only its share. This is also how the directory index has the sums.
+ **/
+static FileSize itemSize( const CacheItem & item )
+{
+    FileSize size = item.size;
+
+    if ( item.blocks >= 0 && ! item.isAggregate )	// Sparse file
+	size = item.blocks * STD_BLOCK_SIZE;
+
+    if ( item.links > 1 && S_ISREG( item.mode ) )
+	size /= item.links;
+
+    return size;
+}
+
+
+namespace QDirStat
+{
+    /**
+     * One cache file that is read one entry at a time for CacheDiff.
+     **/
+    class CacheDiffStream
+    {
+    public:
+
+	CacheDiffStream( const QString & fileName ):
+	    _fileName( fileName ),
+	    _withUidGidPerm( true ),
+	    _lineNo( 0 ),
+	    _error( false ),
+	    _haveDir( false ),
+	    _haveEntry( false ),
+	    _haveLookahead( false )
+	{
+	    _entry.isDir = false;
+	    _entry.size	 = 0;
+	    _entry.items = 0;
+	}
+
+	/**
+	 * Open the file and check its header. Return 'true' if OK, 'false'
+	 * upon error.
+	 **/
+	bool open();
+
+	/**
+	 * Read the next entry. Return 'false' at the end of the file or
+	 * upon error.
+	 *
+	 * The files of each directory are returned sorted by name, no matter
+	 * in which order they are in the file, so files from other writers
+	 * (e.g. the qdirstat-cache-writer script) can be compared, too. The
+	 * directories themselves have to be in the order of QDirStat.
+	 **/
+	bool next();
+
+	/**
+	 * Return the entry from the last next().
+	 **/
+	const CacheDiffEntry & entry() const { return _entry; }
+
+	/**
+	 * Return 'true' if there was an error.
+	 **/
+	bool error() const { return _error; }
+
+    protected:
+
+	/**
+	 * Read the next entry from the file into 'entry'. Return 'false' at
+	 * the end of the file or upon error.
+	 **/
+	bool readEntry( CacheDiffEntry & entry );
+
+	/**
+	 * Read the next directory with all its files, or a single file with
+	 * an absolute path, into _pending.
+	 **/
+	void readPending();
+
+	static bool entryLessThan( const CacheDiffEntry & a, const CacheDiffEntry & b )
+	    { return CacheDiff::compare( a, b ) < 0; }
+
+
+	QString		_fileName;
+	CacheFile	_cache;
+	bool		_withUidGidPerm;
+	int		_lineNo;
+	bool		_error;
+	bool		_haveDir;
+	bool		_haveEntry;
+	bool		_haveLookahead;
+
+	CacheItem	_item;
+	CacheDiffEntry	_entry;
+	CacheDiffEntry	_previous;
+	CacheDiffEntry	_lookahead;
+	QList<CacheDiffEntry> _pending;
+	QStringList	_currentDir;
+
+	char		_buffer[ MAX_CACHE_LINE_LEN ];
+	char *		_fields[ MAX_FIELDS_PER_LINE ];
+    };
+
+}	// namespace QDirStat
+
+
+bool CacheDiffStream::open()
+{
+    if ( ! _cache.openRead( _fileName ) )
+    {
+	logError() << "Can't open " << _fileName << endl;
+	_error = true;
+
+	return false;
+    }
+
+    if ( ! _cache.gets( _buffer, sizeof( _buffer ) ) ||
+	 ( strncmp( _buffer, "[qdirstat ", 10 ) != 0 &&
+	   strncmp( _buffer, "[kdirstat ", 10 ) != 0	) )
+    {
+	logError() << _fileName << ": Not a QDirStat cache file" << endl;
+	_error = true;
+
+	return false;
+    }
+
+    _withUidGidPerm = CacheReader::parseNumber( _buffer + 10 ) >= 2;
+    _lineNo = 1;
+
+    return true;
+}
+
+
+bool CacheDiffStream::next()
+{
+    if ( _error )
+	return false;
+
+    if ( _pending.isEmpty() )
+	readPending();
+
+    if ( _pending.isEmpty() )
+	return false;
+
+    _previous = _entry;
+    _entry    = _pending.takeFirst();
+
+    if ( _haveEntry && CacheDiff::compare( _previous, _entry ) >= 0 )
+    {
+	logError() << _fileName << ":" << _lineNo
+		   << ": Directories not in the order of QDirStat; write this cache file again to compare it"
+		   << endl;
+	_error = true;
+
+	return false;
+    }
+
+    _haveEntry = true;
+
+    return true;
+}
+
+
+void CacheDiffStream::readPending()
+{
+    CacheDiffEntry entry;
+
+    if ( _haveLookahead )
+    {
+	entry	       = _lookahead;
+	_haveLookahead = false;
+    }
+    else if ( ! readEntry( entry ) )
+    {
+	return;
+    }
+
+    _pending << entry;
+
+    if ( ! entry.isDir )
+	return;
+
+    // The files of a directory directly follow its line. Only they are
+    // kept in memory, so this never needs more than the largest directory.
+
+    while ( readEntry( entry ) )
+    {
+	if ( entry.isDir || entry.dirPath != _pending.first().dirPath )
+	{
+	    _lookahead	   = entry;
+	    _haveLookahead = true;
+	    break;
+	}
+
+	_pending << entry;
+    }
+
+    std::sort( _pending.begin() + 1, _pending.end(), entryLessThan );
+}
+
+
+bool CacheDiffStream::readEntry( CacheDiffEntry & entry )
+{
+    if ( _error )
+	return false;
+
+    int expectedFields = _withUidGidPerm ? 7 : 4;
+
+    while ( _cache.gets( _buffer, sizeof( _buffer ) ) )
+    {
+	++_lineNo;
+
+	char * line = CacheReader::skipWhiteSpace( _buffer );
+	CacheReader::killTrailingWhiteSpace( line );
+
+	if ( *line == 0 || *line == '#' )	// empty or comment line
+	    continue;
+
+	int fieldsCount = CacheReader::splitFields( line, _fields );
+
+	if ( fieldsCount < expectedFields )
+	{
+	    logError() << _fileName << ":" << _lineNo << ": Syntax error" << endl;
+	    continue;
+	}
+
+	CacheReader::parseItem( _fields, fieldsCount, _withUidGidPerm, _item );
+
+	entry.isDir = _item.isDir;
+	entry.size  = itemSize( _item );
+	entry.items = _item.isAggregate ? _item.count : 1;
+
+	if ( _item.isDir )
+	{
+	    _currentDir = CacheReader::buildPath( _item.path, _item.name ).split( '/', Qt::SkipEmptyParts );
+	    _haveDir	= true;
+
+	    entry.dirPath = _currentDir;
+	    entry.name.clear();
+	}
+	else if ( _item.absolutePath )
+	{
+	    entry.dirPath = _item.path.split( '/', Qt::SkipEmptyParts );
+	    entry.name	  = _item.name;
+	}
+	else
+	{
+	    if ( ! _haveDir )
+	    {
+		logError() << _fileName << ":" << _lineNo << ": No directory for "
+			   << _item.name << endl;
+		_error = true;
+
+		return false;
+	    }
+
+	    // All files of a directory share its path components
+
+	    entry.dirPath = _currentDir;
+	    entry.name	  = _item.name;
+	}
+
+	return true;
+    }
+
+    return false;
+}
+
+
+
+
+CacheDiff::CacheDiff():
+    _output( 0 ),
+    _dirStatesEpoch( 0 )
+{
+    _total.kind	    = CacheDiffItem::Changed;
+    _total.isDir    = true;
+    _total.oldSize  = 0;
+    _total.newSize  = 0;
+    _total.oldItems = 0;
+    _total.newItems = 0;
+}
+
+
+CacheDiff::~CacheDiff()
+{
+    // NOP
+}
+
+
+bool CacheDiff::diff( const QString & oldFileName, const QString & newFileName )
+{
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+
+    _items.clear();
+    _changedPaths.clear();
+    _dirStates.clear();
+    _stack.clear();
+
+    _total.oldSize  = 0;
+    _total.newSize  = 0;
+    _total.oldItems = 0;
+    _total.newItems = 0;
+
+    // With the directory index and the subtree digests of both files,
+    // only what changed needs to be read at all.
+
+    CacheIndex oldIndex;
+    CacheIndex newIndex;
+
+    bool indexed = oldIndex.open( oldFileName ) &&
+		   newIndex.open( newFileName ) &&
+		   canDiffIndexed( oldIndex, newIndex );
+
+    bool ok = indexed ?
+	diffIndexed( oldIndex, newIndex ) :
+	diffStreams( oldFileName, newFileName );
+
+    if ( ok )
+    {
+	indexChanges();
+
+	logInfo() << "Compared " << oldFileName << " with " << newFileName
+		  << ( indexed ? " using the directory index" : "" )
+		  << " in " << formatMillisec( stopWatch.elapsed() ) << endl;
+    }
+
+    return ok;
+}
+
+
+bool CacheDiff::diffStreams( const QString & oldFileName,
+			     const QString & newFileName )
+{
+    CacheDiffStream oldStream( oldFileName );
+    CacheDiffStream newStream( newFileName );
+
+    if ( ! oldStream.open() || ! newStream.open() )
+	return false;
+
+    bool haveOld = oldStream.next();
+    bool haveNew = newStream.next();
+
+    while ( ( haveOld || haveNew ) && ! oldStream.error() && ! newStream.error() )
+    {
+	int order = ! haveOld ? 1 : ! haveNew ? -1 :
+	    compare( oldStream.entry(), newStream.entry() );
+
+	if ( order < 0 )
+	{
+	    process( &oldStream.entry(), 0 );
+	    haveOld = oldStream.next();
+	}
+	else if ( order > 0 )
+	{
+	    process( 0, &newStream.entry() );
+	    haveNew = newStream.next();
+	}
+	else
+	{
+	    process( &oldStream.entry(), &newStream.entry() );
+	    haveOld = oldStream.next();
+	    haveNew = newStream.next();
+	}
+    }
+
+    while ( ! _stack.isEmpty() )
+	popDir();
+
+    return ! oldStream.error() && ! newStream.error();
+}
+
+
+bool CacheDiff::canDiffIndexed( const CacheIndex & oldIndex,
+				const CacheIndex & newIndex )
+{
+    CacheDirEntry oldToplevel;
+    CacheDirEntry newToplevel;
+
+    if ( ! oldIndex.readDir( 0, oldToplevel ) || ! newIndex.readDir( 0, newToplevel ) )
+	return false;
+
+    // Only QDirStat versions that write the children sorted by name also
+    // write digests, so the directories of the index are in that order.
+
+    if ( oldToplevel.item.digest == 0 || newToplevel.item.digest == 0 )
+	return false;
+
+    return CacheReader::buildPath( oldToplevel.item.path, oldToplevel.item.name ) ==
+	CacheReader::buildPath( newToplevel.item.path, newToplevel.item.name );
+}
+
+
+bool CacheDiff::diffIndexed( CacheIndex & oldIndex, CacheIndex & newIndex )
+{
+    CacheDirEntry oldToplevel;
+    CacheDirEntry newToplevel;
+
+    oldIndex.readDir( 0, oldToplevel );
+    newIndex.readDir( 0, newToplevel );
+
+    QString path = CacheReader::buildPath( oldToplevel.item.path, oldToplevel.item.name );
+
+    _total.oldSize  = oldToplevel.totalSize;
+    _total.newSize  = newToplevel.totalSize;
+    _total.oldItems = oldToplevel.totalItems + 1;
+    _total.newItems = newToplevel.totalItems + 1;
+
+    return diffDirs( oldIndex, 0, oldToplevel,
+		     newIndex, 0, newToplevel,
+		     path.split( '/', Qt::SkipEmptyParts ) );
+}
+
+
+/**
+ * Read directory 'dirNo' of 'index' into 'entry_ret' unless 'dirNo' is -1.
+ * Return 'false' upon error.
+ **/
+static bool readIndexDir( const CacheIndex & index, int dirNo, CacheDirEntry & entry_ret )
+{
+    if ( dirNo < 0 || index.readDir( dirNo, entry_ret ) )
+	return true;
+
+    logError() << index.fileName() << ": Invalid directory index entry " << dirNo << endl;
+
+    return false;
+}
+
+
+bool CacheDiff::diffDirs( CacheIndex &		oldIndex,
+			  int			oldDirNo,
+			  const CacheDirEntry & oldDir,
+			  CacheIndex &		newIndex,
+			  int			newDirNo,
+			  const CacheDirEntry & newDir,
+			  const QStringList &	dirPath )
+{
+    if ( oldDir.item.digest != 0 && oldDir.item.digest == newDir.item.digest )
+	return true;	// Nothing changed below this directory
+
+    // The files of both directories, sorted by name
+
+    QVector<CacheItem> oldFiles;
+    QVector<CacheItem> newFiles;
+
+    if ( ! oldIndex.readFiles( oldDirNo, oldFiles ) ||
+	 ! newIndex.readFiles( newDirNo, newFiles ) )
+    {
+	return false;
+    }
+
+    int oldPos = 0;
+    int newPos = 0;
+
+    while ( oldPos < oldFiles.size() || newPos < newFiles.size() )
+    {
+	int order = oldPos == oldFiles.size() ? 1 : newPos == newFiles.size() ? -1 :
+	    oldFiles.at( oldPos ).name.compare( newFiles.at( newPos ).name );
+
+	if ( order < 0 )
+	{
+	    const CacheItem & oldFile = oldFiles.at( oldPos++ );
+
+	    report( CacheDiffItem::Removed, false, buildPath( dirPath, oldFile.name ),
+		    itemSize( oldFile ), 0, oldFile.isAggregate ? oldFile.count : 1, 0 );
+	}
+	else if ( order > 0 )
+	{
+	    const CacheItem & newFile = newFiles.at( newPos++ );
+
+	    report( CacheDiffItem::Added, false, buildPath( dirPath, newFile.name ),
+		    0, itemSize( newFile ), 0, newFile.isAggregate ? newFile.count : 1 );
+	}
+	else
+	{
+	    const CacheItem & oldFile = oldFiles.at( oldPos++ );
+	    const CacheItem & newFile = newFiles.at( newPos++ );
+
+	    if ( itemSize( oldFile ) != itemSize( newFile ) )
+	    {
+		report( CacheDiffItem::Changed, false, buildPath( dirPath, newFile.name ),
+			itemSize( oldFile ), itemSize( newFile ),
+			oldFile.isAggregate ? oldFile.count : 1,
+			newFile.isAggregate ? newFile.count : 1 );
+	    }
+	}
+    }
+
+    // The subdirectories of both directories, also sorted by name. Added
+    // and removed ones are reported with the sums from the index.
+
+    CacheDirEntry oldSubDir;
+    CacheDirEntry newSubDir;
+    int oldSubDirNo = oldIndex.firstSubDir( oldDirNo );
+    int newSubDirNo = newIndex.firstSubDir( newDirNo );
+
+    if ( ! readIndexDir( oldIndex, oldSubDirNo, oldSubDir ) ||
+	 ! readIndexDir( newIndex, newSubDirNo, newSubDir ) )
+    {
+	return false;
+    }
+
+    while ( oldSubDirNo >= 0 || newSubDirNo >= 0 )
+    {
+	int order = oldSubDirNo < 0 ? 1 : newSubDirNo < 0 ? -1 :
+	    oldSubDir.item.name.compare( newSubDir.item.name );
+
+	if ( order < 0 )
+	{
+	    report( CacheDiffItem::Removed, true,
+		    buildPath( dirPath, oldSubDir.item.name ),
+		    oldSubDir.totalSize, 0, oldSubDir.totalItems + 1, 0 );
+	}
+	else if ( order > 0 )
+	{
+	    report( CacheDiffItem::Added, true,
+		    buildPath( dirPath, newSubDir.item.name ),
+		    0, newSubDir.totalSize, 0, newSubDir.totalItems + 1 );
+	}
+	else if ( ! diffDirs( oldIndex, oldSubDirNo, oldSubDir,
+			      newIndex, newSubDirNo, newSubDir,
+			      QStringList( dirPath ) << oldSubDir.item.name ) )
+	{
+	    return false;
+	}
+
+	if ( order <= 0 )
+	{
+	    oldSubDirNo = oldIndex.nextSubDir( oldSubDirNo );
+
+	    if ( ! readIndexDir( oldIndex, oldSubDirNo, oldSubDir ) )
+		return false;
+	}
+
+	if ( order >= 0 )
+	{
+	    newSubDirNo = newIndex.nextSubDir( newSubDirNo );
+
+	    if ( ! readIndexDir( newIndex, newSubDirNo, newSubDir ) )
+		return false;
+	}
+    }
+
+    // Like popDir(): The directory itself after everything below it
+
+    if ( oldDir.totalSize != newDir.totalSize || oldDir.totalItems != newDir.totalItems )
+    {
+	report( CacheDiffItem::Changed, true, buildPath( dirPath ),
+		oldDir.totalSize,      newDir.totalSize,
+		oldDir.totalItems + 1, newDir.totalItems + 1 );
+    }
+
+    return true;
+}
+
+
+void CacheDiff::process( const CacheDiffEntry * oldEntry,
+			 const CacheDiffEntry * newEntry )
+{
+    const CacheDiffEntry * entry = oldEntry ? oldEntry : newEntry;
+
+    if ( entry->isDir )
+    {
+	popUntilAncestor( entry->dirPath, false );
+
+	DirNode dir;
+	dir.dirPath  = entry->dirPath;
+	dir.inOld    = oldEntry != 0;
+	dir.inNew    = newEntry != 0;
+	dir.oldSize  = oldEntry ? oldEntry->size  : 0;
+	dir.newSize  = newEntry ? newEntry->size  : 0;
+	dir.oldItems = oldEntry ? oldEntry->items : 0;
+	dir.newItems = newEntry ? newEntry->items : 0;
+
+	_stack.append( dir );
+
+	return;
+    }
+
+    // Everything else belongs to the directory on top of the stack
+
+    if ( _stack.isEmpty() || _stack.last().dirPath != entry->dirPath )
+	popUntilAncestor( entry->dirPath, true );
+
+    if ( _stack.isEmpty() )
+	return;	  // Not in any directory
+
+    DirNode & dir = _stack.last();
+
+    if ( oldEntry )
+    {
+	dir.oldSize  += oldEntry->size;
+	dir.oldItems += oldEntry->items;
+    }
+
+    if ( newEntry )
+    {
+	dir.newSize  += newEntry->size;
+	dir.newItems += newEntry->items;
+    }
+
+    // Inside a new or removed subtree, only its toplevel directory is
+    // reported.
+
+    if ( ! dir.inOld || ! dir.inNew )
+	return;
+
+    if ( ! oldEntry )
+    {
+	report( CacheDiffItem::Added, false, buildPath( entry->dirPath, entry->name ),
+		0, newEntry->size, 0, newEntry->items );
+    }
+    else if ( ! newEntry )
+    {
+	report( CacheDiffItem::Removed, false, buildPath( entry->dirPath, entry->name ),
+		oldEntry->size, 0, oldEntry->items, 0 );
+    }
+    else if ( oldEntry->size != newEntry->size )
+    {
+	report( CacheDiffItem::Changed, false, buildPath( entry->dirPath, entry->name ),
+		oldEntry->size, newEntry->size, oldEntry->items, newEntry->items );
+    }
+}
+
+
+void CacheDiff::popUntilAncestor( const QStringList & dirPath, bool inclusive )
+{
+    while ( ! _stack.isEmpty() )
+    {
+	const QStringList & top = _stack.last().dirPath;
+	int len = top.size();
+	bool isAncestor = inclusive ? len <= dirPath.size() : len < dirPath.size();
+
+	// From the end: That is where different paths usually differ
+
+	for ( int i = len - 1; isAncestor && i >= 0; --i )
+	    isAncestor = top.at( i ) == dirPath.at( i );
+
+	if ( isAncestor )
+	    return;
+
+	popDir();
+    }
+}
+
+
+void CacheDiff::popDir()
+{
+    DirNode dir = _stack.takeLast();
+    bool parentInBoth = _stack.isEmpty() || ( _stack.last().inOld && _stack.last().inNew );
+
+    if ( dir.inOld && dir.inNew )
+    {
+	if ( dir.oldSize != dir.newSize || dir.oldItems != dir.newItems )
+	{
+	    report( CacheDiffItem::Changed, true, buildPath( dir.dirPath ),
+		    dir.oldSize, dir.newSize, dir.oldItems, dir.newItems );
+	}
+    }
+    else if ( parentInBoth )
+    {
+	report( dir.inNew ? CacheDiffItem::Added : CacheDiffItem::Removed,
+		true, buildPath( dir.dirPath ),
+		dir.oldSize, dir.newSize, dir.oldItems, dir.newItems );
+    }
+
+    if ( _stack.isEmpty() )
+    {
+	_total.oldSize	+= dir.oldSize;
+	_total.newSize	+= dir.newSize;
+	_total.oldItems += dir.oldItems;
+	_total.newItems += dir.newItems;
+    }
+    else
+    {
+	DirNode & parent = _stack.last();
+
+	parent.oldSize	+= dir.oldSize;
+	parent.newSize	+= dir.newSize;
+	parent.oldItems += dir.oldItems;
+	parent.newItems += dir.newItems;
+    }
+}
+
+
+void CacheDiff::report( CacheDiffItem::Kind kind,
+			bool		    isDir,
+			const QString &	    path,
+			FileSize	    oldSize,
+			FileSize	    newSize,
+			FileCount	    oldItems,
+			FileCount	    newItems )
+{
+    CacheDiffItem item;
+    item.kind	  = kind;
+    item.isDir	  = isDir;
+    item.path	  = path;
+    item.oldSize  = oldSize;
+    item.newSize  = newSize;
+    item.oldItems = oldItems;
+    item.newItems = newItems;
+
+    if ( _output )
+	write( *_output, item );
+    else
+	_items.insert( path, item );
+}
+
+
+int CacheDiff::compare( const CacheDiffEntry & a, const CacheDiffEntry & b )
+{
+    // Compare the path components one by one: The last component of a
+    // file is not a directory, and files come before directories.
+
+    int lenA = a.dirPath.size() + ( a.isDir ? 0 : 1 );
+    int lenB = b.dirPath.size() + ( b.isDir ? 0 : 1 );
+    int len  = qMin( lenA, lenB );
+    int i    = 0;
+
+    // The files of a directory share its path components
+
+    if ( a.dirPath.size() == b.dirPath.size() &&
+	 a.dirPath.constData() == b.dirPath.constData() )
+    {
+	i = a.dirPath.size();
+    }
+
+    for ( ; i < len; ++i )
+    {
+	bool dirA = i < lenA - 1 || a.isDir;
+	bool dirB = i < lenB - 1 || b.isDir;
+
+	if ( dirA != dirB )
+	    return dirA ? 1 : -1;
+
+	const QString & nameA = i < a.dirPath.size() ? a.dirPath.at( i ) : a.name;
+	const QString & nameB = i < b.dirPath.size() ? b.dirPath.at( i ) : b.name;
+
+	int result = nameA.compare( nameB );
+
+	if ( result != 0 )
+	    return result;
+    }
+
+    return lenA - lenB;
+}
+
+
+QString CacheDiff::buildPath( const QStringList & dirPath, const QString & name )
+{
+    QString path = "/" + dirPath.join( '/' );
+
+    if ( ! name.isEmpty() )
+    {
+	if ( ! dirPath.isEmpty() )
+	    path += '/';
+
+	path += name;
+    }
+
+    return path;
+}
+
+
+void CacheDiff::indexChanges()
+{
+    _changedPaths.clear();
+
+    foreach ( const QString & itemPath, _items.keys() )
+    {
+	QString path = itemPath;
+
+	while ( ! _changedPaths.contains( path ) )
+	{
+	    _changedPaths.insert( path );
+	    int pos = path.lastIndexOf( '/' );
+
+	    if ( pos < 0 || path.size() < 2 )
+		break;
+
+	    path.truncate( qMax( pos, 1 ) );	// Keep "/" for the root directory
+	}
+    }
+}
+
+
+CacheDiff::DirState CacheDiff::dirState( const DirInfo * dir ) const
+{
+    // The directories are cached by their address: Drop them all when
+    // anything in the tree changed, so none of them can be deleted in the
+    // meantime.
+
+    quint32 epoch = dir->tree() ? dir->tree()->epoch() : 0;
+
+    if ( epoch != _dirStatesEpoch )
+    {
+	_dirStates.clear();
+	_dirStatesEpoch = epoch;
+    }
+
+    QHash<const DirInfo *, DirState>::const_iterator cached = _dirStates.constFind( dir );
+
+    if ( cached != _dirStates.constEnd() )
+	return cached.value();
+
+    DirState state;
+
+    // Only the toplevel directory of a new subtree is in the items, so
+    // everything below it inherits its color.
+
+    if ( dir->parent() )
+	state.addedColor = dirState( dir->parent() ).addedColor;
+
+    if ( ! state.addedColor.isValid() )
+    {
+	QString path = dir->url();
+	QHash<QString, CacheDiffItem>::const_iterator it = _items.constFind( path );
+
+	if ( it != _items.constEnd() && it.value().kind == CacheDiffItem::Added )
+	    state.addedColor = color( it.value() );
+	else
+	    state.changed = _changedPaths.contains( path );
+    }
+
+    _dirStates.insert( dir, state );
+
+    return state;
+}
+
+
+QColor CacheDiff::color( FileInfo * item ) const
+{
+    if ( ! item || _items.isEmpty() )
+	return QColor();
+
+    // Dot entries and attics are not in the cache files; they belong to
+    // their parent directory.
+
+    const DirInfo * dir = item->isDirInfo() ? item->toDirInfo() : item->parent();
+
+    while ( dir && dir->isPseudoDir() )
+	dir = dir->parent();
+
+    if ( dir )
+    {
+	DirState state = dirState( dir );
+
+	if ( state.addedColor.isValid() )
+	    return state.addedColor;
+
+	if ( ! state.changed || item->isPseudoDir() )
+	    return QColor();
+    }
+
+    QHash<QString, CacheDiffItem>::const_iterator it = _items.constFind( item->url() );
+
+    return it != _items.constEnd() ? color( it.value() ) : QColor();
+}
+
+
+QColor CacheDiff::color( const CacheDiffItem & item )
+{
+    if ( item.kind != CacheDiffItem::Changed )
+    {
+	return QColor::fromHsv( item.kind == CacheDiffItem::Added ? GROWTH_HUE : SHRINK_HUE,
+				MAX_SATURATION, 255 );
+    }
+
+    FileSize delta = item.sizeDelta();
+
+    if ( delta == 0 )
+	return QColor();
+
+    double relative   = item.oldSize > 0 ? (double) qAbs( delta ) / item.oldSize : 1.0;
+    int	   saturation = MIN_SATURATION +
+	(int) ( ( MAX_SATURATION - MIN_SATURATION ) * qMin( relative, 1.0 ) );
+
+    return QColor::fromHsv( delta > 0 ? GROWTH_HUE : SHRINK_HUE, saturation, 255 );
+}
+
+
+static QString signedNumber( qint64 number )
+{
+    return number > 0 ? "+" + QString::number( number ) : QString::number( number );
+}
+
+
+void CacheDiff::write( QTextStream & stream, const CacheDiffItem & item )
+{
+    const char * kind = "M";
+
+    if ( item.kind == CacheDiffItem::Added )
+	kind = "+";
+    else if ( item.kind == CacheDiffItem::Removed )
+	kind = "-";
+
+    stream << kind << '\t'
+	   << ( item.isDir ? "D" : "F" ) << '\t'
+	   << signedNumber( item.sizeDelta()  ) << '\t'
+	   << signedNumber( item.itemsDelta() ) << '\t'
+	   << item.oldSize << '\t'
+	   << item.newSize << '\t'
+	   << item.path << '\n';
+}
@@ -0,0 +1,311 @@
+/*
+ *   File name: CacheDiff.h
+ *   Summary:	Compare two QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheDiff_h
+#define CacheDiff_h
+
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QColor>
+
+#include "FileSize.h"
+
+
+class QTextStream;
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class CacheIndex;
+    struct CacheDirEntry;
+
+
+    /**
+     * One difference between two cache files.
+     **/
+    struct CacheDiffItem
+    {
+	enum Kind
+	{
+	    Changed,	// In both files, but with different sums
+	    Added,	// Only in the new file, with everything below it
+	    Removed	// Only in the old file, with everything below it
+	};
+
+	Kind		kind;
+	bool		isDir;
+	QString		path;
+	FileSize	oldSize;	// Total size for directories
+	FileSize	newSize;
+	FileCount	oldItems;	// Total items for directories
+	FileCount	newItems;
+
+	FileSize  sizeDelta()  const { return newSize  - oldSize;  }
+	FileCount itemsDelta() const { return newItems - oldItems; }
+    };
+
+
+    /**
+     * One entry of a cache file as the diff sees it: Only its position in
+     * the tree and what it adds to the sums of its parent.
+     **/
+    struct CacheDiffEntry
+    {
+	QStringList	dirPath;	// Path components of the directory:
+					// The entry itself for directories,
+					// its parent for everything else
+	QString		name;		// Not for directories
+	bool		isDir;
+	FileSize	size;
+	FileCount	items;
+    };
+
+
+    /**
+     * Compare two cache files: For each directory the change of its total
+     * size and total items and which subtrees were added or removed, and
+     * which files changed their size.
+     *
+     * Both files are read side by side, one line at a time, like a merge
+     * join on the paths: This needs the directories in the same order in
+     * both files, i.e. the order in which QDirStat and the
+     * qdirstat-cache-writer script write them (see
+     * CacheWriter::sortedChildren()). The files of each directory are
+     * sorted while reading, so they can be in any order. This only keeps
+     * the directories from the toplevel to the current line and the files
+     * of one directory in memory, no matter how large the files are.
+     *
+     * Cache files with the directories in any other order, e.g. from older
+     * versions of QDirStat, are rejected.
+     *
+     * If both files have a directory index with subtree digests (see
+     * DirInfo::digest()), only the index is read, and the files of a
+     * directory only if its digest changed: Subtrees with the same digest
+     * in both files are skipped completely.
+     *
+     * Sizes are counted like in the tree: Sparse files with their
+     * allocated size, files with multiple hard links with their share.
+     **/
+    class CacheDiff
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheDiff();
+
+	/**
+	 * Destructor.
+	 **/
+	~CacheDiff();
+
+	/**
+	 * Write each difference to 'stream' as soon as it is found instead of
+	 * keeping it in items(). The stream is not owned by this class.
+	 **/
+	void setOutput( QTextStream * stream ) { _output = stream; }
+
+	/**
+	 * Compare cache file 'oldFileName' with 'newFileName'.
+	 *
+	 * Return 'true' if OK, 'false' if either file can't be read or if
+	 * its directories are not in the required order.
+	 **/
+	bool diff( const QString & oldFileName, const QString & newFileName );
+
+	/**
+	 * Return the differences by path unless they were written to an
+	 * output stream.
+	 **/
+	const QHash<QString, CacheDiffItem> & items() const { return _items; }
+
+	/**
+	 * Return the sums of all toplevel directories of both files. The
+	 * path is empty.
+	 **/
+	const CacheDiffItem & total() const { return _total; }
+
+	/**
+	 * Return the color that shows how 'item' of the current tree changed
+	 * or an invalid color if it didn't change.
+	 *
+	 * This is called for each tile of the treemap, so it looks up each
+	 * directory only once (see dirState()): The URL of a file is only
+	 * needed if anything in its directory changed.
+	 **/
+	QColor color( FileInfo * item ) const;
+
+	/**
+	 * Return the color for 'item': Red for growth, green for shrinking,
+	 * the more saturated the larger the change relative to the old size.
+	 **/
+	static QColor color( const CacheDiffItem & item );
+
+	/**
+	 * Compare two cache entries in the order of the cache file: Each
+	 * directory comes before everything below it, and in each directory
+	 * the files come before the subdirectories, each sorted by name.
+	 *
+	 * Return a negative number if 'a' comes first, a positive number if
+	 * 'b' comes first, 0 if they are the same.
+	 **/
+	static int compare( const CacheDiffEntry & a, const CacheDiffEntry & b );
+
+	/**
+	 * Write 'item' as one tab-separated line to 'stream':
+	 *
+	 *   kind  type  size_delta  items_delta  old_size  new_size  path
+	 *
+	 * 'kind' is "M" (modified), "+" (added) or "-" (removed), 'type' is
+	 * "D" for directories and "F" for everything else.
+	 **/
+	static void write( QTextStream & stream, const CacheDiffItem & item );
+
+
+    protected:
+
+	/**
+	 * Compare the two files line by line.
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool diffStreams( const QString & oldFileName,
+			  const QString & newFileName );
+
+	/**
+	 * Return 'true' if both files have a directory index with subtree
+	 * digests for the same toplevel directory, i.e. if diffIndexed() can
+	 * be used for them.
+	 **/
+	static bool canDiffIndexed( const CacheIndex & oldIndex,
+				    const CacheIndex & newIndex );
+
+	/**
+	 * Compare the two files with their directory indexes.
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool diffIndexed( CacheIndex & oldIndex, CacheIndex & newIndex );
+
+	/**
+	 * Compare directory 'oldDirNo' of 'oldIndex' with directory
+	 * 'newDirNo' of 'newIndex' and everything below them unless their
+	 * digests are the same. Both directories have path components
+	 * 'dirPath'. Return 'false' upon error.
+	 **/
+	bool diffDirs( CacheIndex &	     oldIndex,
+		       int		     oldDirNo,
+		       const CacheDirEntry & oldDir,
+		       CacheIndex &	     newIndex,
+		       int		     newDirNo,
+		       const CacheDirEntry & newDir,
+		       const QStringList &   dirPath );
+
+	/**
+	 * Process the next entry of the old file, the new file or both if
+	 * it is in both.
+	 **/
+	void process( const CacheDiffEntry * oldEntry,
+		      const CacheDiffEntry * newEntry );
+
+	/**
+	 * Finish directories until the top of the stack is an ancestor of
+	 * a directory with path components 'dirPath' (or the directory
+	 * itself if 'inclusive' is 'true').
+	 **/
+	void popUntilAncestor( const QStringList & dirPath, bool inclusive );
+
+	/**
+	 * Finish the directory on top of the stack: Report it and add its
+	 * sums to its parent.
+	 **/
+	void popDir();
+
+	/**
+	 * Report one difference.
+	 **/
+	void report( CacheDiffItem::Kind kind,
+		     bool		 isDir,
+		     const QString &	 path,
+		     FileSize		 oldSize,
+		     FileSize		 newSize,
+		     FileCount		 oldItems,
+		     FileCount		 newItems );
+
+	/**
+	 * Return the path for 'dirPath' and optional 'name'.
+	 **/
+	static QString buildPath( const QStringList & dirPath,
+				  const QString &     name = QString() );
+
+	/**
+	 * Store the paths of all differences and of all their ancestors in
+	 * _changedPaths.
+	 **/
+	void indexChanges();
+
+
+	/**
+	 * What color() needs to know about a directory of the current tree.
+	 **/
+	struct DirState
+	{
+	    DirState(): changed( false ) {}
+
+	    bool   changed;	// Anything in it or below it changed
+	    QColor addedColor;	// Valid if it is in a new subtree
+	};
+
+	/**
+	 * Return the state of 'dir'. This is cached until the tree changes.
+	 **/
+	DirState dirState( const DirInfo * dir ) const;
+
+
+	/**
+	 * One directory from the toplevel down to the current entry with
+	 * the sums of everything below it that was processed so far.
+	 **/
+	struct DirNode
+	{
+	    QStringList dirPath;
+	    bool	inOld;
+	    bool	inNew;
+	    FileSize	oldSize;
+	    FileSize	newSize;
+	    FileCount	oldItems;
+	    FileCount	newItems;
+	};
+
+
+	//
+	// Data members
+	//
+
+	QTextStream *			_output;
+	QHash<QString, CacheDiffItem>	_items;
+	QSet<QString>			_changedPaths;
+
+	mutable QHash<const DirInfo *, DirState> _dirStates;
+	mutable quint32			_dirStatesEpoch;
+
+	CacheDiffItem			_total;
+	QVector<DirNode>		_stack;
+
+    };	// class CacheDiff
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheDiff_h
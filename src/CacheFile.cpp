@@ -0,0 +1,624 @@
+/*
+ *   File name: CacheFile.cpp
+ *   Summary:	Compressed file access for the QDirStat cache reader / writer
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdarg.h>	// va_list
+#include <string.h>	// memchr(), memcpy(), memset()
+
+#include <QFile>
+
+#include "CacheFile.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+CacheFile::CacheFile():
+    _compression( Gzip ),
+    _gzFile( 0 ),
+    _file( 0 ),
+    _writing( false ),
+    _error( false ),
+    _eof( false ),
+    _compressedOffset( 0 ),
+    _uncompressedOffset( 0 ),
+    _inPos( 0 ),
+    _inSize( 0 ),
+    _outPos( 0 ),
+    _outSize( 0 )
+#if HAVE_ZSTD
+    , _cctx( 0 )
+    , _dctx( 0 )
+#endif
+{
+
+}
+
+
+CacheFile::~CacheFile()
+{
+    close();
+}
+
+
+bool CacheFile::haveZstd()
+{
+#if HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+CacheFile::Compression CacheFile::detectCompression( const QString & fileName )
+{
+    QFile file( fileName );
+
+    if ( file.open( QIODevice::ReadOnly ) )
+    {
+	QByteArray magic = file.read( 4 );
+
+	if ( magic == QByteArray( "\x28\xb5\x2f\xfd", 4 ) )
+	    return Zstd;
+    }
+
+    return Gzip;    // zlib can also read uncompressed files
+}
+
+
+bool CacheFile::openRead( const QString & fileName )
+{
+    close();
+
+    _fileName		= fileName;
+    _compression	= detectCompression( fileName );
+    _writing		= false;
+    _error		= false;
+    _eof		= false;
+
+    if ( _compression == Zstd )
+    {
+#if HAVE_ZSTD
+	_file = fopen( fileName.toUtf8(), "rb" );
+
+	if ( ! _file )
+	{
+	    logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	    return false;
+	}
+
+	_dctx = ZSTD_createDCtx();
+	CHECK_PTR( _dctx );
+
+	_in.resize ( ZSTD_DStreamInSize()  );
+	_out.resize( ZSTD_DStreamOutSize() );
+	_inPos	 = _inSize  = 0;
+	_outPos	 = _outSize = 0;
+
+	return true;
+#else
+	logError() << fileName << " is compressed with zstd, "
+		   << "but this QDirStat was built without zstd support" << endl;
+	return false;
+#endif
+    }
+
+    _gzFile = gzopen( fileName.toUtf8(), "r" );
+
+    if ( ! _gzFile )
+    {
+	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheFile::openWrite( const QString & fileName,
+			   Compression	   compression,
+			   int		   level,
+			   bool		   append )
+{
+    close();
+
+    _fileName		= fileName;
+    _compression	= compression;
+    _writing		= true;
+    _error		= false;
+    _eof		= false;
+    _compressedOffset	= 0;
+    _uncompressedOffset = 0;
+
+    if ( compression == Zstd )
+    {
+#if HAVE_ZSTD
+	_file = fopen( fileName.toUtf8(), append ? "ab" : "wb" );
+
+	if ( ! _file )
+	{
+	    logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	    return false;
+	}
+
+	_cctx = ZSTD_createCCtx();
+	CHECK_PTR( _cctx );
+
+	ZSTD_CCtx_setParameter( _cctx, ZSTD_c_compressionLevel,
+				level < 0 ? ZSTD_CLEVEL_DEFAULT : level );
+	ZSTD_CCtx_setParameter( _cctx, ZSTD_c_enableLongDistanceMatching, 1 );
+	ZSTD_CCtx_setParameter( _cctx, ZSTD_c_checksumFlag, 1 );
+
+	_in.reserve( ZSTD_CStreamInSize() );
+	_out.resize( ZSTD_CStreamOutSize() );
+
+	return true;
+#else
+	logError() << "Can't write " << fileName
+		   << ": This QDirStat was built without zstd support" << endl;
+	return false;
+#endif
+    }
+
+    QByteArray mode = append ? "ab" : "wb";
+
+    if ( level >= 0 && level <= 9 )
+	mode += QByteArray::number( level );
+
+    _gzFile = gzopen( fileName.toUtf8(), mode.constData() );
+
+    if ( ! _gzFile )
+    {
+	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheFile::close()
+{
+    if ( ! isOpen() )
+	return true;
+
+    if ( _gzFile )
+    {
+	if ( gzclose( _gzFile ) != Z_OK && _writing )
+	    _error = true;
+
+	_gzFile = 0;
+    }
+
+#if HAVE_ZSTD
+    if ( _cctx )
+    {
+	if ( _file )
+	    compressPending( ZSTD_e_end );
+
+	ZSTD_freeCCtx( _cctx );
+	_cctx = 0;
+    }
+
+    if ( _dctx )
+    {
+	ZSTD_freeDCtx( _dctx );
+	_dctx = 0;
+    }
+#endif
+
+    if ( _file )
+    {
+	if ( fclose( _file ) != 0 && _writing )
+	    _error = true;
+
+	_file = 0;
+    }
+
+    if ( _error && _writing )
+	logError() << "Error writing " << _fileName << endl;
+
+    _in.clear();
+    _out.clear();
+
+    return ! _error;
+}
+
+
+void CacheFile::printf( const char * format, ... )
+{
+    char    buffer[ 4096 ];
+    va_list args;
+
+    va_start( args, format );
+    int len = vsnprintf( buffer, sizeof( buffer ), format, args );
+    va_end( args );
+
+    if ( len < 0 )
+	return;
+
+    if ( len < (int) sizeof( buffer ) )
+    {
+	write( buffer, len );
+    }
+    else // Very long line: Format it again into a buffer that is large enough
+    {
+	QByteArray line( len + 1, 0 );
+
+	va_start( args, format );
+	vsnprintf( line.data(), line.size(), format, args );
+	va_end( args );
+
+	write( line.constData(), len );
+    }
+}
+
+
+void CacheFile::putChar( char c )
+{
+    write( &c, 1 );
+}
+
+
+void CacheFile::write( const char * data, int size )
+{
+    if ( size <= 0 )
+	return;
+
+    _uncompressedOffset += size;
+
+    if ( _gzFile )
+    {
+	if ( gzwrite( _gzFile, data, size ) != size )
+	    _error = true;
+
+	return;
+    }
+
+#if HAVE_ZSTD
+    if ( _cctx )
+    {
+	_in.append( data, size );
+
+	if ( (size_t) _in.size() >= ZSTD_CStreamInSize() )
+	    compressPending( ZSTD_e_continue );
+    }
+#endif
+}
+
+
+void CacheFile::finishFrame()
+{
+    if ( _gzFile )
+	gzflush( _gzFile, Z_FINISH );	// The next write starts a new gzip member
+
+#if HAVE_ZSTD
+    if ( _cctx )
+	compressPending( ZSTD_e_end );	// The next write starts a new frame
+#endif
+}
+
+
+qint64 CacheFile::compressedOffset()
+{
+    if ( _gzFile )
+	return gzoffset( _gzFile );
+
+    return _compressedOffset;
+}
+
+
+qint64 CacheFile::uncompressedOffset()
+{
+    return _uncompressedOffset;
+}
+
+
+char * CacheFile::gets( char * buffer, int size )
+{
+    if ( _gzFile )
+	return gzgets( _gzFile, buffer, size );
+
+    int len = 0;
+
+#if HAVE_ZSTD
+    while ( _dctx && len < size - 1 )
+    {
+	if ( _outPos >= _outSize && ! fillOutput() )
+	    break;
+
+	const char * start   = _out.constData() + _outPos;
+	size_t	     avail   = qMin( _outSize - _outPos, (size_t) ( size - 1 - len ) );
+	const char * newline = (const char *) memchr( start, '\n', avail );
+	size_t	     count   = newline ? newline - start + 1 : avail;
+
+	memcpy( buffer + len, start, count );
+	len	+= count;
+	_outPos += count;
+
+	if ( newline )
+	    break;
+    }
+#endif
+
+    if ( size > 0 )
+	buffer[ len ] = 0;
+
+    return len > 0 ? buffer : 0;
+}
+
+
+bool CacheFile::eof()
+{
+    if ( _gzFile )
+	return gzeof( _gzFile );
+
+    return _eof || ! isOpen();
+}
+
+
+void CacheFile::rewind()
+{
+    if ( _gzFile )
+    {
+	gzrewind( _gzFile );
+	return;
+    }
+
+#if HAVE_ZSTD
+    if ( _dctx && _file )
+    {
+	::rewind( _file );
+	ZSTD_DCtx_reset( _dctx, ZSTD_reset_session_only );
+
+	_inPos	= _inSize  = 0;
+	_outPos = _outSize = 0;
+	_eof	= false;
+    }
+#endif
+}
+
+
+#if HAVE_ZSTD
+
+void CacheFile::compressPending( ZSTD_EndDirective mode )
+{
+    ZSTD_inBuffer input = { _in.constData(), (size_t) _in.size(), 0 };
+    bool done = false;
+
+    while ( ! done )
+    {
+	ZSTD_outBuffer output = { _out.data(), (size_t) _out.size(), 0 };
+	size_t remaining = ZSTD_compressStream2( _cctx, &output, &input, mode );
+
+	if ( ZSTD_isError( remaining ) )
+	{
+	    logError() << _fileName << ": " << ZSTD_getErrorName( remaining ) << endl;
+	    _error = true;
+	    break;
+	}
+
+	if ( output.pos > 0 && fwrite( _out.constData(), 1, output.pos, _file ) != output.pos )
+	    _error = true;
+
+	_compressedOffset += output.pos;
+	done = mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+    }
+
+    _in.resize( 0 );
+}
+
+
+bool CacheFile::fillOutput()
+{
+    while ( ! _eof )
+    {
+	if ( _inPos >= _inSize )
+	{
+	    _inSize = fread( _in.data(), 1, _in.size(), _file );
+	    _inPos  = 0;
+
+	    if ( _inSize == 0 )
+	    {
+		_eof = true;
+		return false;
+	    }
+	}
+
+	ZSTD_inBuffer  input  = { _in.constData(), _inSize, _inPos };
+	ZSTD_outBuffer output = { _out.data(), (size_t) _out.size(), 0 };
+
+	size_t result = ZSTD_decompressStream( _dctx, &output, &input );
+	_inPos = input.pos;
+
+	if ( ZSTD_isError( result ) )
+	{
+	    logError() << _fileName << ": " << ZSTD_getErrorName( result ) << endl;
+	    _error = true;
+	    _eof   = true;
+	    return false;
+	}
+
+	if ( output.pos > 0 )
+	{
+	    _outPos  = 0;
+	    _outSize = output.pos;
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+#endif	// HAVE_ZSTD
+
+
+bool CacheFile::decompressFrame( Compression	    compression,
+				 const QByteArray & compressed,
+				 QByteArray &	    text_ret )
+{
+    char buffer[ 64 * 1024 ];
+    text_ret.clear();
+
+    if ( compression == Zstd )
+    {
+#if HAVE_ZSTD
+	ZSTD_DCtx * dctx = ZSTD_createDCtx();
+	CHECK_PTR( dctx );
+
+	ZSTD_inBuffer input  = { compressed.constData(), (size_t) compressed.size(), 0 };
+	size_t	      result = 1;
+
+	while ( result != 0 )	// 0: The frame is complete
+	{
+	    ZSTD_outBuffer output = { buffer, sizeof( buffer ), 0 };
+	    result = ZSTD_decompressStream( dctx, &output, &input );
+
+	    if ( ZSTD_isError( result ) )
+		break;
+
+	    text_ret.append( buffer, output.pos );
+
+	    if ( result != 0 && input.pos == input.size && output.pos < output.size )
+		break;	// Truncated
+	}
+
+	ZSTD_freeDCtx( dctx );
+
+	return result == 0;
+#else
+	return false;
+#endif
+    }
+
+    z_stream stream;
+    memset( &stream, 0, sizeof( stream ) );
+
+    if ( inflateInit2( &stream, 16 + MAX_WBITS ) != Z_OK )	// gzip format
+	return false;
+
+    stream.next_in  = (Bytef *) compressed.constData();
+    stream.avail_in = compressed.size();
+
+    int result = Z_OK;
+
+    while ( result == Z_OK )
+    {
+	stream.next_out	 = (Bytef *) buffer;
+	stream.avail_out = sizeof( buffer );
+
+	result = inflate( &stream, Z_NO_FLUSH );
+
+	if ( result == Z_OK || result == Z_STREAM_END )
+	    text_ret.append( buffer, sizeof( buffer ) - stream.avail_out );
+    }
+
+    inflateEnd( &stream );
+
+    return result == Z_STREAM_END;
+}
+
+
+QByteArray CacheFile::offsetTrailer( Compression compression, qint64 offset )
+{
+    QByteArray trailer;
+
+    if ( compression == Zstd )
+    {
+	// A skippable frame with 12 bytes of content
+
+	const uchar header[] =
+	{
+	    0x50, 0x2a, 0x4d, 0x18,	// Skippable frame magic
+	    12, 0, 0, 0,		// Frame size
+	    'Q', 'D', 8, 0		// ID and size of the offset
+	};
+
+	trailer.append( (const char *) header, sizeof( header ) );
+    }
+    else
+    {
+	// An empty gzip member with the offset in the "extra" header field
+
+	const uchar header[] =
+	{
+	    0x1f, 0x8b,			// gzip magic
+	    0x08,			// Compression method: deflate
+	    0x04,			// Flags: FEXTRA
+	    0, 0, 0, 0,			// mtime
+	    0,				// Extra flags
+	    0xff,			// OS: unknown
+	    12, 0,			// Length of the extra field
+	    'Q', 'D', 8, 0		// Subfield ID and length
+	};
+
+	trailer.append( (const char *) header, sizeof( header ) );
+    }
+
+    for ( int i=0; i < 8; ++i )	// little endian
+	trailer.append( (char) ( ( offset >> ( 8 * i ) ) & 0xff ) );
+
+    if ( compression == Gzip )
+    {
+	const uchar end[] =
+	{
+	    0x03, 0x00,			// Empty deflate stream
+	    0, 0, 0, 0,			// CRC32
+	    0, 0, 0, 0			// Uncompressed size
+	};
+
+	trailer.append( (const char *) end, sizeof( end ) );
+    }
+
+    return trailer;
+}
+
+
+int CacheFile::offsetTrailerSize( Compression compression )
+{
+    return offsetTrailer( compression, 0 ).size();
+}
+
+
+qint64 CacheFile::readOffsetTrailer( const QString & fileName,
+				     Compression     compression )
+{
+    QByteArray expected = offsetTrailer( compression, 0 );
+    int	       size	= expected.size();
+    int	       pos	= compression == Zstd ? 12 : 16;    // of the offset
+    QFile      file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) ||
+	 file.size() < size ||
+	 ! file.seek( file.size() - size ) )
+    {
+	return -1;
+    }
+
+    QByteArray trailer = file.read( size );
+
+    // Everything except the offset must be exactly what offsetTrailer()
+    // writes
+
+    if ( trailer.size()	     != size			 ||
+	 trailer.left( pos ) != expected.left( pos )	 ||
+	 trailer.mid( pos + 8 ) != expected.mid( pos + 8 ) )
+    {
+	return -1;
+    }
+
+    qint64 offset = 0;
+
+    for ( int i = 7; i >= 0; --i )
+	offset = ( offset << 8 ) | (uchar) trailer.at( pos + i );
+
+    return offset;
+}
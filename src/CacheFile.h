@@ -0,0 +1,249 @@
+/*
+ *   File name: CacheFile.h
+ *   Summary:	Compressed file access for the QDirStat cache reader / writer
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheFile_h
+#define CacheFile_h
+
+
+#include <stdio.h>	// FILE
+#include <zlib.h>	// gzFile
+
+#include <QString>
+#include <QByteArray>
+
+#if HAVE_ZSTD
+#  include <zstd.h>
+#endif
+
+
+#define ZSTD_CACHE_SUFFIX	".zst"
+#define GZIP_CACHE_SUFFIX	".gz"
+
+
+namespace QDirStat
+{
+    /**
+     * A compressed cache file, either with gzip (using zlib) or, if
+     * QDirStat was built with HAVE_ZSTD, with zstd.
+     *
+     * This provides the few stdio-like operations that CacheWriter and
+     * CacheReader need, independent of the compression. A file consists of
+     * one or more frames (gzip members or zstd frames) that can be
+     * decompressed independently of each other (see finishFrame() and
+     * decompressFrame()).
+     *
+     * When reading, the compression is detected from the file content, so
+     * the file name doesn't matter. gzip files may also be uncompressed
+     * plain text files.
+     **/
+    class CacheFile
+    {
+    public:
+
+	enum Compression
+	{
+	    Gzip,
+	    Zstd
+	};
+
+	/**
+	 * Constructor. Use openRead() or openWrite() to open a file.
+	 **/
+	CacheFile();
+
+	/**
+	 * Destructor. This closes the file if it is still open.
+	 **/
+	virtual ~CacheFile();
+
+	/**
+	 * Return 'true' if QDirStat was built with zstd support.
+	 **/
+	static bool haveZstd();
+
+	/**
+	 * Return the compression of an existing file from its first bytes.
+	 **/
+	static Compression detectCompression( const QString & fileName );
+
+	/**
+	 * Open 'fileName' for reading. Return 'true' if OK, 'false' upon
+	 * error.
+	 **/
+	bool openRead( const QString & fileName );
+
+	/**
+	 * Open 'fileName' for writing with 'compression'. 'level' is the
+	 * compression level or -1 for the default of that compression.
+	 * For zstd, this also enables long distance matching: Cache files
+	 * repeat the same path components over and over again.
+	 *
+	 * If 'append' is 'true', an existing file is kept, and everything
+	 * is written to a new frame at its end. compressedOffset() starts
+	 * at 0 anyway.
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool openWrite( const QString & fileName,
+			Compression	compression,
+			int		level  = -1,
+			bool		append = false );
+
+	/**
+	 * Close the file. When writing, this writes all remaining data.
+	 * Return 'false' if there was a write error, 'true' otherwise.
+	 **/
+	bool close();
+
+	/**
+	 * Return 'true' if the file is open.
+	 **/
+	bool isOpen() const { return _gzFile || _file; }
+
+	/**
+	 * Return the compression of this file.
+	 **/
+	Compression compression() const { return _compression; }
+
+	/**
+	 * Write a formatted string.
+	 **/
+	void printf( const char * format, ... );
+
+	/**
+	 * Write one character.
+	 **/
+	void putChar( char c );
+
+	/**
+	 * Write 'size' bytes from 'data'.
+	 **/
+	void write( const char * data, int size );
+
+	/**
+	 * Finish the current frame: Everything that was written so far can
+	 * be decompressed without anything that is written afterwards, and
+	 * compressedOffset() is the start of the next frame.
+	 **/
+	void finishFrame();
+
+	/**
+	 * Return the current position in the compressed file.
+	 **/
+	qint64 compressedOffset();
+
+	/**
+	 * Return the number of uncompressed bytes written so far.
+	 **/
+	qint64 uncompressedOffset();
+
+	/**
+	 * Read one line into 'buffer' like gzgets() / fgets(): At most
+	 * 'size' - 1 bytes up to and including the next newline, terminated
+	 * with a 0 byte. Return 'buffer' or 0 at the end of the file or upon
+	 * error.
+	 **/
+	char * gets( char * buffer, int size );
+
+	/**
+	 * Return 'true' if a read operation tried to read past the end of the
+	 * file.
+	 **/
+	bool eof();
+
+	/**
+	 * Go back to the start of the file for reading it again.
+	 **/
+	void rewind();
+
+	/**
+	 * Decompress one complete frame with 'compression' from 'compressed'
+	 * into 'text_ret'. This can be used in any thread.
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	static bool decompressFrame( Compression	compression,
+				     const QByteArray & compressed,
+				     QByteArray &	text_ret );
+
+	/**
+	 * Return a frame for the end of the file that stores 'offset' in a
+	 * way that decompressors ignore. This is used to find the block
+	 * index of a cache file.
+	 **/
+	static QByteArray offsetTrailer( Compression compression, qint64 offset );
+
+	/**
+	 * Return the offset that was stored with offsetTrailer() at the end of
+	 * 'fileName' or -1 if there is none.
+	 **/
+	static qint64 readOffsetTrailer( const QString & fileName,
+					 Compression	 compression );
+
+	/**
+	 * Return the size of the trailer from offsetTrailer().
+	 **/
+	static int offsetTrailerSize( Compression compression );
+
+
+    protected:
+
+#if HAVE_ZSTD
+
+	/**
+	 * Compress the pending input with 'mode' and write the result to the
+	 * file.
+	 **/
+	void compressPending( ZSTD_EndDirective mode );
+
+	/**
+	 * Decompress the next chunk of data into _out. Return 'false' at the
+	 * end of the file or upon error.
+	 **/
+	bool fillOutput();
+
+#endif
+
+
+	//
+	// Data members
+	//
+
+	Compression	_compression;
+	QString		_fileName;
+	gzFile		_gzFile;
+	FILE *		_file;		// zstd only
+	bool		_writing;
+	bool		_error;
+	bool		_eof;
+	qint64		_compressedOffset;
+	qint64		_uncompressedOffset;
+
+	// zstd buffers: When writing, _in is the uncompressed data that is
+	// not compressed yet. When reading, _in is the compressed data read
+	// from the file and _out the decompressed data.
+
+	QByteArray	_in;
+	QByteArray	_out;
+	size_t		_inPos;
+	size_t		_inSize;
+	size_t		_outPos;
+	size_t		_outSize;
+
+#if HAVE_ZSTD
+	ZSTD_CCtx *	_cctx;
+	ZSTD_DCtx *	_dctx;
+#endif
+
+    };	// class CacheFile
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheFile_h
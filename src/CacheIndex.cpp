@@ -0,0 +1,429 @@
+/*
+ *   File name: CacheIndex.cpp
+ *   Summary:	Block and directory index of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <ctype.h>	// isspace()
+#include <string.h>	// memchr(), memset(), strncmp()
+#include <sys/stat.h>	// stat(), fstat()
+
+#include "CacheIndex.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Numbers before the cache line in a directory index line:
+//
+//   parent block offset files items subdirs total_files unignored
+//   total_size allocated blocks latest oldest
+
+#define DIR_INDEX_FIELDS	13
+
+
+using namespace QDirStat;
+
+
+CacheIndex::CacheIndex():
+    _compression( CacheFile::Gzip ),
+    _withUidGidPerm( true ),
+    _fileChanged( false ),
+    _loadedBlock( -1 )
+{
+    memset( &_fileStat, 0, sizeof( _fileStat ) );
+}
+
+
+/**
+ * Return 'true' if 'a' and 'b' are the same file with the same content as
+ * far as stat() can tell.
+ **/
+static bool sameFile( const struct stat & a, const struct stat & b )
+{
+    return a.st_dev   == b.st_dev   &&
+	   a.st_ino   == b.st_ino   &&
+	   a.st_size  == b.st_size  &&
+	   a.st_mtime == b.st_mtime;
+}
+
+
+CacheIndex::~CacheIndex()
+{
+    // NOP
+}
+
+
+bool CacheIndex::open( const QString & fileName )
+{
+    _file.close();
+    _fileChanged = false;
+    _loadedBlock = -1;
+    _blockText.clear();
+
+    // The index is read with a file of its own: Remember what file that
+    // was to make sure the one that is kept open is the same.
+
+    struct stat indexStat;
+
+    if ( stat( fileName.toUtf8(), &indexStat ) != 0 )
+	return false;
+
+    // Only the header tells if there are UID, GID and permissions
+
+    CacheFile cache;
+    char      header[ MAX_CACHE_LINE_LEN ];
+
+    if ( ! cache.openRead( fileName ) || ! cache.gets( header, sizeof( header ) ) )
+	return false;
+
+    CacheFile::Compression compression = cache.compression();
+    cache.close();
+
+    if ( strncmp( header, "[qdirstat ", 10 ) != 0 &&
+	 strncmp( header, "[kdirstat ", 10 ) != 0 )
+    {
+	return false;	// Not a text cache file
+    }
+
+    _withUidGidPerm = CacheReader::parseNumber( header + 10 ) >= 2;
+
+    if ( ! read( fileName, compression, true ) || _dirs.isEmpty() )
+	return false;
+
+    _file.setFileName( fileName );
+
+    if ( ! _file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    if ( fstat( _file.handle(), &_fileStat ) != 0 || ! sameFile( _fileStat, indexStat ) )
+    {
+	logWarning() << fileName << " changed while reading its index" << endl;
+	_file.close();
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheIndex::read( const QString &	      fileName,
+		       CacheFile::Compression compression,
+		       bool		      withDirs )
+{
+    _fileName	 = fileName;
+    _compression = compression;
+    _blocks.clear();
+    _dirs.clear();
+    _text.clear();
+
+    qint64 indexOffset = CacheFile::readOffsetTrailer( fileName, compression );
+
+    if ( indexOffset < 0 )
+	return false;
+
+    QFile file( fileName );
+    qint64 indexSize = -1;
+
+    if ( file.open( QIODevice::ReadOnly ) )
+	indexSize = file.size() - CacheFile::offsetTrailerSize( compression ) - indexOffset;
+
+    if ( indexOffset <= 0 || indexSize <= 0 ||
+	 ! file.seek( indexOffset ) ||
+	 ! CacheFile::decompressFrame( compression, file.read( indexSize ), _text ) )
+    {
+	logWarning() << fileName << ": Invalid block index" << endl;
+	_text.clear();
+
+	return false;
+    }
+
+    char * current = _text.data();
+    char * end	   = current + _text.size();
+
+    while ( current < end )
+    {
+	char * line    = current;
+	char * newline = (char *) memchr( current, '\n', end - current );
+	current = newline ? newline + 1 : end;
+
+	if ( newline )
+	    *newline = 0;	// QByteArray::data() is 0-terminated anyway
+
+	if ( strncmp( line, "#@D ", 4 ) == 0 )
+	{
+	    if ( withDirs && ! addDir( line - _text.data() ) )
+	    {
+		logWarning() << fileName << ": Invalid directory index entry "
+			     << line << endl;
+
+		withDirs = false;
+		_dirs.clear();
+	    }
+
+	    continue;
+	}
+
+	if ( strncmp( line, "#@", 2 ) != 0 )
+	    continue;
+
+	char * fields[ MAX_FIELDS_PER_LINE ];
+
+	if ( CacheReader::splitFields( CacheReader::skipWhiteSpace( line + 2 ), fields ) != 2 )
+	    continue;	// Comment
+
+	const char * offsetEnd = 0;
+	const char * sizeEnd   = 0;
+
+	CacheBlock block;
+	block.offset = CacheReader::parseNumber( fields[0], 10, &offsetEnd );
+	block.size   = CacheReader::parseNumber( fields[1], 10, &sizeEnd   );
+
+	if ( *offsetEnd || *sizeEnd ||
+	     block.offset <= 0 || block.size < 0 ||
+	     block.offset + block.size > indexOffset )
+	{
+	    logWarning() << fileName << ": Invalid block index entry "
+			 << fields[0] << " " << fields[1] << endl;
+
+	    _blocks.clear();
+	    _dirs.clear();
+	    _text.clear();
+
+	    return false;
+	}
+
+	_blocks << block;
+    }
+
+    _lastSubDir.clear();
+
+    if ( _dirs.isEmpty() )
+	_text.clear();	// Nothing refers to it
+    else
+	logDebug() << fileName << ": " << _dirs.size() << " directories in the index" << endl;
+
+    return true;
+}
+
+
+bool CacheIndex::addDir( int line )
+{
+    // Only the numbers that are needed for navigating: The rest of the
+    // line is parsed in readDir() when it is needed.
+
+    const char * pos = _text.constData() + line + 4;
+    qint64 values[ 4 ];	  // parent block offset files
+
+    for ( int i=0; i < 4; ++i )
+    {
+	const char * end = 0;
+
+	while ( isspace( (uchar) *pos ) )
+	    ++pos;
+
+	values[ i ] = CacheReader::parseNumber( pos, 10, &end );
+
+	if ( end == pos )
+	    return false;
+
+	pos = end;
+    }
+
+    int dirNo  = _dirs.size();
+    int parent = (int) values[0];
+
+    if ( dirNo == 0 ? parent != -1 : parent < 0 || parent >= dirNo )
+	return false;	// Each directory has to come after its parent
+
+    if ( values[1] < 0 || values[1] >= _blocks.size() || values[2] < 0 || values[3] < 0 )
+	return false;
+
+    DirRecord dir;
+    dir.line	    = line;
+    dir.block	    = (int) values[1];
+    dir.offset	    = (int) values[2];
+    dir.files	    = (int) values[3];
+    dir.firstSubDir = -1;
+    dir.nextSubDir  = -1;
+
+    _dirs << dir;
+    _lastSubDir << -1;
+
+    if ( parent >= 0 )
+    {
+	// Keep the order of the cache file
+
+	if ( _lastSubDir.at( parent ) < 0 )
+	    _dirs[ parent ].firstSubDir = dirNo;
+	else
+	    _dirs[ _lastSubDir.at( parent ) ].nextSubDir = dirNo;
+
+	_lastSubDir[ parent ] = dirNo;
+    }
+
+    return true;
+}
+
+
+bool CacheIndex::readDir( int dirNo, CacheDirEntry & entry_ret ) const
+{
+    if ( dirNo < 0 || dirNo >= _dirs.size() )
+	return false;
+
+    // Parsing modifies the line, so work on a copy
+
+    QByteArray line( _text.constData() + _dirs.at( dirNo ).line + 4 );
+    char * fields[ MAX_FIELDS_PER_LINE ];
+
+    int fieldsCount    = CacheReader::splitFields( CacheReader::skipWhiteSpace( line.data() ), fields );
+    int expectedFields = DIR_INDEX_FIELDS + ( _withUidGidPerm ? 7 : 4 );
+
+    if ( fieldsCount < expectedFields )
+	return false;
+
+    int n = 3;	// parent, block and offset are already known
+
+    entry_ret.files		  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalItems	  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalSubDirs	  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalFiles	  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalUnignoredItems = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalSize		  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalAllocatedSize  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.totalBlocks	  = CacheReader::parseNumber( fields[ n++ ] );
+    entry_ret.latestMtime	  = CacheReader::parseNumber( fields[ n++ ], 0 );
+    entry_ret.oldestFileMtime	  = CacheReader::parseNumber( fields[ n++ ], 0 );
+
+    CacheReader::parseItem( fields + n, fieldsCount - n, _withUidGidPerm, entry_ret.item );
+
+    return entry_ret.item.isDir;
+}
+
+
+bool CacheIndex::readFiles( int dirNo, QVector<CacheItem> & files_ret )
+{
+    files_ret.clear();
+
+    if ( dirNo < 0 || dirNo >= _dirs.size() )
+	return false;
+
+    const DirRecord & dir = _dirs.at( dirNo );
+
+    if ( dir.files == 0 )
+	return true;	// Nothing to read
+
+    if ( ! loadBlock( dir.block ) )
+	return false;
+
+    const char * pos = _blockText.constData() + dir.offset;
+    const char * end = _blockText.constData() + _blockText.size();
+
+    if ( pos >= end || *pos != 'D' )
+    {
+	logError() << _fileName << ": No directory at offset " << dir.offset
+		   << " in block " << dir.block << endl;
+	return false;
+    }
+
+    // The files of a directory directly follow its own line (see
+    // CacheWriter::sortedChildren()), and blocks only start with a directory,
+    // so they are all in this block.
+
+    pos = (const char *) memchr( pos, '\n', end - pos );
+    pos = pos ? pos + 1 : end;
+
+    int	   expectedFields = _withUidGidPerm ? 7 : 4;
+    char * fields[ MAX_FIELDS_PER_LINE ];
+
+    while ( pos < end && files_ret.size() < dir.files )
+    {
+	const char * newline = (const char *) memchr( pos, '\n', end - pos );
+
+	// Parsing modifies the line, and the block might still be needed
+	// for other directories
+
+	QByteArray buffer( pos, ( newline ? newline : end ) - pos );
+	pos = newline ? newline + 1 : end;
+
+	char * line = CacheReader::skipWhiteSpace( buffer.data() );
+	CacheReader::killTrailingWhiteSpace( line );
+
+	if ( *line == 0 || *line == '#' )	// empty or comment line
+	    continue;
+
+	int fieldsCount = CacheReader::splitFields( line, fields );
+
+	if ( fieldsCount < expectedFields )
+	{
+	    logError() << _fileName << ": Syntax error in block " << dir.block << endl;
+	    continue;
+	}
+
+	CacheItem item;
+	CacheReader::parseItem( fields, fieldsCount, _withUidGidPerm, item );
+
+	if ( item.isDir )	// The next directory already
+	    break;
+
+	files_ret << item;
+    }
+
+    if ( files_ret.size() < dir.files )
+    {
+	logWarning() << _fileName << ": Expected " << dir.files << " files for directory "
+		     << dirNo << ", found " << files_ret.size() << endl;
+    }
+
+    return true;
+}
+
+
+bool CacheIndex::loadBlock( int blockNo )
+{
+    if ( blockNo == _loadedBlock )
+	return true;
+
+    if ( blockNo < 0 || blockNo >= _blocks.size() || ! _file.isOpen() )
+	return false;
+
+    if ( ! checkFile() )
+	return false;
+
+    const CacheBlock & block = _blocks.at( blockNo );
+
+    _loadedBlock = -1;
+    _blockText.clear();
+
+    if ( ! _file.seek( block.offset ) ||
+	 ! CacheFile::decompressFrame( _compression, _file.read( block.size ), _blockText ) )
+    {
+	logError() << _fileName << ": Can't read block " << blockNo << endl;
+	return false;
+    }
+
+    _loadedBlock = blockNo;
+
+    return true;
+}
+
+
+bool CacheIndex::checkFile()
+{
+    struct stat fileStat;
+
+    if ( fstat( _file.handle(), &fileStat ) == 0 && sameFile( fileStat, _fileStat ) )
+	return true;
+
+    logError() << _fileName << " was changed; can't read anything more from it" << endl;
+
+    _fileChanged = true;
+    _file.close();
+
+    return false;
+}
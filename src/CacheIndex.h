@@ -0,0 +1,213 @@
+/*
+ *   File name: CacheIndex.h
+ *   Summary:	Block and directory index of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheIndex_h
+#define CacheIndex_h
+
+
+#include <sys/stat.h>
+
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+#include "DirTreeCache.h"	// CacheItem, CacheBlock
+#include "CacheFile.h"
+
+
+namespace QDirStat
+{
+    /**
+     * One directory from the directory index of a cache file: Its own
+     * cache line and the sums of its complete subtree, i.e. everything
+     * that is needed to add it to a tree without reading anything below
+     * it.
+     **/
+    struct CacheDirEntry
+    {
+	CacheItem	item;		// Only the name for all but the toplevel
+	int		files;		// Non-directory children
+	FileCount	totalItems;
+	FileCount	totalSubDirs;
+	FileCount	totalFiles;
+	FileCount	totalUnignoredItems;
+	FileSize	totalSize;
+	FileSize	totalAllocatedSize;
+	FileSize	totalBlocks;
+	time_t		latestMtime;
+	time_t		oldestFileMtime;
+    };
+
+
+    /**
+     * The index at the end of a cache file that was written in independently
+     * compressed blocks (see CacheWriter::startBlock()): Where each block
+     * starts and, optionally, where the line of each directory is and the
+     * sums of its subtree.
+     *
+     * With the directory index, a directory can be added to a tree with
+     * all its sums, but without any children; they are only read from the
+     * cache file when they are needed (see SubtreeStore). Opening even a
+     * huge cache file this way only reads the index and the first block.
+     *
+     * The directories are numbered in the order of the cache file, so the
+     * toplevel directory is number 0, and each directory comes before its
+     * subdirectories.
+     **/
+    class CacheIndex
+    {
+    public:
+
+	/**
+	 * Constructor. Use read() or open() to read the index of a file.
+	 **/
+	CacheIndex();
+
+	/**
+	 * Destructor.
+	 **/
+	~CacheIndex();
+
+	/**
+	 * Read the block index of cache file 'fileName' with 'compression',
+	 * and also the directory index if 'withDirs' is 'true'.
+	 *
+	 * Return 'true' if OK, 'false' if there is no index or if it is
+	 * invalid.
+	 **/
+	bool read( const QString &	  fileName,
+		   CacheFile::Compression compression,
+		   bool			  withDirs = false );
+
+	/**
+	 * Read the complete index of cache file 'fileName' with any
+	 * compression and keep the file open for readFiles().
+	 *
+	 * Return 'true' if that cache file has a directory index, 'false'
+	 * otherwise.
+	 **/
+	bool open( const QString & fileName );
+
+	/**
+	 * Return the name of the cache file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return the blocks of the cache file.
+	 **/
+	const QVector<CacheBlock> & blocks() const { return _blocks; }
+
+	/**
+	 * Return the number of directories in the directory index.
+	 **/
+	int dirCount() const { return _dirs.size(); }
+
+	/**
+	 * Return the first subdirectory of directory 'dirNo' or -1 if
+	 * there is none.
+	 **/
+	int firstSubDir( int dirNo ) const { return _dirs.at( dirNo ).firstSubDir; }
+
+	/**
+	 * Return the next subdirectory of the same parent after 'dirNo' or
+	 * -1 if there is none.
+	 **/
+	int nextSubDir( int dirNo ) const { return _dirs.at( dirNo ).nextSubDir; }
+
+	/**
+	 * Return 'true' if the cache file has UID, GID and permissions.
+	 **/
+	bool withUidGidPerm() const { return _withUidGidPerm; }
+
+	/**
+	 * Parse the index entry of directory 'dirNo' into 'entry_ret'.
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool readDir( int dirNo, CacheDirEntry & entry_ret ) const;
+
+	/**
+	 * Read the non-directory children of directory 'dirNo' from the
+	 * cache file into 'files_ret'. This needs open().
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool readFiles( int dirNo, QVector<CacheItem> & files_ret );
+
+	/**
+	 * Return 'true' if the cache file was changed in place (its size,
+	 * mtime or inode) since open(). Nothing can be read from it any
+	 * more then: The index doesn't fit the content any more.
+	 *
+	 * A cache file that was replaced by a new one (e.g. by renaming) is
+	 * not a change: The old one is still open and can still be read.
+	 **/
+	bool fileChanged() const { return _fileChanged; }
+
+
+    protected:
+
+	/**
+	 * Add the directory index line at 'line' in _text. Return 'false'
+	 * if it is invalid.
+	 **/
+	bool addDir( int line );
+
+	/**
+	 * Decompress block 'blockNo' into _blockText unless it is already
+	 * there. Return 'true' if OK, 'false' upon error.
+	 **/
+	bool loadBlock( int blockNo );
+
+	/**
+	 * Check if the open cache file still has the size, mtime and inode
+	 * that it had when it was opened. Set _fileChanged and return
+	 * 'false' if not.
+	 **/
+	bool checkFile();
+
+
+	/**
+	 * One directory of the directory index.
+	 **/
+	struct DirRecord
+	{
+	    int line;		// Offset of its index line in _text
+	    int block;
+	    int offset;		// Of its cache line in the uncompressed block
+	    int files;
+	    int firstSubDir;
+	    int nextSubDir;
+	};
+
+
+	//
+	// Data members
+	//
+
+	QString			_fileName;
+	CacheFile::Compression	_compression;
+	bool			_withUidGidPerm;
+	QVector<CacheBlock>	_blocks;
+	QByteArray		_text;		// The index with 0 bytes as line ends
+	QVector<DirRecord>	_dirs;
+	QVector<int>		_lastSubDir;	// Only while reading the index
+	QFile			_file;
+	struct stat		_fileStat;	// When it was opened
+	bool			_fileChanged;
+	int			_loadedBlock;
+	QByteArray		_blockText;
+
+    };	// class CacheIndex
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheIndex_h
@@ -0,0 +1,204 @@
+/*
+ *   File name: CacheJournal.cpp
+ *   Summary:	Append-only journal of changes to a QDirStat cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdio.h>	// rename()
+#include <string.h>	// strncmp()
+#include <sys/stat.h>	// stat()
+
+#include <QFile>
+#include <QFileInfo>
+
+#include "CacheJournal.h"
+#include "CacheFile.h"
+#include "DirTreeCache.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+CacheJournal::CacheJournal( const QString & cacheFileName, DirTree * tree ):
+    _cacheFileName( cacheFileName ),
+    _fileName( fileName( cacheFileName ) ),
+    _tree( tree ),
+    _baseIdentity( baseIdentity( cacheFileName ) )
+{
+}
+
+
+CacheJournal::~CacheJournal()
+{
+    // NOP
+}
+
+
+QString CacheJournal::fileName( const QString & cacheFileName )
+{
+    return cacheFileName + ".journal";
+}
+
+
+bool CacheJournal::exists() const
+{
+    return QFileInfo( _fileName ).exists();
+}
+
+
+QByteArray CacheJournal::baseIdentity( const QString & cacheFileName )
+{
+    struct stat fileStat;
+
+    if ( stat( cacheFileName.toUtf8(), &fileStat ) != 0 )
+	return QByteArray();
+
+    return QByteArray::number( (qlonglong) fileStat.st_size ) + " 0x" +
+	QByteArray::number( (qlonglong) fileStat.st_mtime, 16 );
+}
+
+
+bool CacheJournal::matchesBase() const
+{
+    QByteArray base = baseIdentity( _cacheFileName );
+    CacheFile  file;
+
+    if ( base.isEmpty() || ! file.openRead( _fileName ) )
+	return false;
+
+    // The base line is in the header before the first record. A journal
+    // from before there was such a line doesn't match anything.
+
+    char   buffer[ 1024 ];
+    char * line;
+
+    while ( ( line = file.gets( buffer, sizeof( buffer ) ) ) )
+    {
+	if ( strncmp( line, "#@J ", 4 ) == 0 )
+	    break;
+
+	if ( strncmp( line, "#@B ", 4 ) == 0 )
+	    return QByteArray( line + 4 ).trimmed() == base;
+    }
+
+    return false;
+}
+
+
+bool CacheJournal::appendSubtree( DirInfo * subtree )
+{
+    if ( ! subtree )
+	return false;
+
+    return append( subtree->url(), subtree );
+}
+
+
+bool CacheJournal::appendRemoval( const QString & url )
+{
+    return append( url, 0 );
+}
+
+
+bool CacheJournal::append( const QString & url, DirInfo * subtree )
+{
+    // Like CacheWriter: Only with UID, GID and permissions if the tree has
+    // them. This is the same for all records of the journal since it is
+    // always for the same tree.
+
+    FileInfo * toplevel	      = _tree ? _tree->firstToplevel() : 0;
+    bool       withUidGidPerm = toplevel ? toplevel->hasUid() : true;
+    bool       newFile	      = QFileInfo( _fileName ).size() <= 0;
+
+    // Each record is a gzip member of its own: Appending never touches
+    // what is already in the file.
+
+    CacheFile file;
+
+    if ( ! file.openWrite( _fileName, CacheFile::Gzip, -1, true ) )
+	return false;
+
+    if ( newFile )
+    {
+	file.printf( withUidGidPerm ?
+		     "[qdirstat 2.0 cache file]\n" :
+		     "[qdirstat 1.0 cache file]\n" );
+	file.printf( "# Journal of %s - do not edit!\n"
+		     "#@B %s\n"
+		     "#\n",
+		     QFileInfo( _cacheFileName ).fileName().toUtf8().constData(),
+		     _baseIdentity.constData() );
+    }
+
+    QByteArray line( "#@J remove " );
+    CacheWriter::appendUrlEncoded( line, url );
+    line.append( '\n' );
+    file.write( line.constData(), line.size() );
+
+    if ( subtree )
+	CacheWriter::writeSubtree( file, subtree, withUidGidPerm );
+
+    if ( ! file.close() )
+    {
+	logError() << "Can't append to " << _fileName << endl;
+	return false;
+    }
+
+    logDebug() << ( subtree ? "Replaced " : "Removed " ) << url
+	       << " in " << _fileName << endl;
+
+    return true;
+}
+
+
+bool CacheJournal::needsCompaction() const
+{
+    qint64 journalSize = QFileInfo( _fileName	   ).size();
+    qint64 baseSize    = QFileInfo( _cacheFileName ).size();
+
+    return journalSize * 100 > baseSize * CACHE_JOURNAL_MAX_PERCENT;
+}
+
+
+QString CacheJournal::compactionFileName() const
+{
+    QFileInfo base( _cacheFileName );
+
+    return base.absolutePath() + "/.compacting-" + base.fileName();
+}
+
+
+bool CacheJournal::finishCompaction()
+{
+    QString compacted = compactionFileName();
+
+    // rename() replaces the base atomically: A reader never sees a partly
+    // written cache file, and the base is never missing.
+
+    if ( ::rename( compacted.toUtf8(), _cacheFileName.toUtf8() ) != 0 )
+    {
+	logError() << "Can't rename " << compacted << " to " << _cacheFileName
+		   << ": " << formatErrno() << endl;
+
+	QFile::remove( compacted );
+	return false;
+    }
+
+    remove();
+    logInfo() << "Compacted " << _fileName << " into " << _cacheFileName << endl;
+
+    return true;
+}
+
+
+void CacheJournal::remove()
+{
+    if ( exists() && ! QFile::remove( _fileName ) )
+	logWarning() << "Can't remove " << _fileName << endl;
+}
@@ -0,0 +1,177 @@
+/*
+ *   File name: CacheJournal.h
+ *   Summary:	Append-only journal of changes to a QDirStat cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheJournal_h
+#define CacheJournal_h
+
+
+#include <QByteArray>
+#include <QString>
+
+
+// Compact the journal into a new cache file when it is larger than this
+// percentage of the cache file
+
+#define CACHE_JOURNAL_MAX_PERCENT	20
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * Journal of the changes of a tree since it was written to a cache file
+     * (the base): Instead of writing the complete tree again after each
+     * refresh or cleanup, only the subtrees that were replaced or deleted
+     * are appended to a file next to the base cache file.
+     *
+     * The journal is a text cache file that is compressed with gzip, one
+     * gzip member per record. Its header has a line
+     *
+     *	 #@B <size> <mtime>
+     *
+     * with the size and mtime of the base when the journal was started: If
+     * the base was written again in some other way (e.g. by the
+     * qdirstat-cache-writer script or an older version of QDirStat), the
+     * journal doesn't belong to it any more (see matchesBase()).
+     *
+     * Each record starts with a line
+     *
+     *	 #@J remove <path>
+     *
+     * that removes that subtree from the tree; for a replaced subtree, this
+     * is followed by the lines of its new content just like in a cache
+     * file. Since this line is a comment for everything else, the journal
+     * can be read with a plain CacheReader: It replays the records in the
+     * order they were appended when it is read after the base (see
+     * DirTree::readCache()).
+     *
+     * When the journal gets too large compared to the base (see
+     * needsCompaction()), the complete tree is written to a new base in the
+     * background, and the journal is removed.
+     **/
+    class CacheJournal
+    {
+    public:
+
+	/**
+	 * Constructor for the journal of cache file 'cacheFileName' with the
+	 * changes of 'tree'. This does not create or read anything yet.
+	 **/
+	CacheJournal( const QString & cacheFileName, DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	~CacheJournal();
+
+	/**
+	 * Return the name of the journal of cache file 'cacheFileName'.
+	 **/
+	static QString fileName( const QString & cacheFileName );
+
+	/**
+	 * Return the name of the journal file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return the name of the base cache file.
+	 **/
+	const QString & cacheFileName() const { return _cacheFileName; }
+
+	/**
+	 * Return 'true' if the journal file exists.
+	 **/
+	bool exists() const;
+
+	/**
+	 * Return 'true' if the journal was started for the base as it is
+	 * now, i.e. if the size and mtime of the base in its header are
+	 * still the same. Replaying it on any other base would revert
+	 * subtrees to their content from when the journal was written.
+	 **/
+	bool matchesBase() const;
+
+	/**
+	 * Append a record that replaces 'subtree' with its current content.
+	 * This also works for a subtree that is new.
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool appendSubtree( DirInfo * subtree );
+
+	/**
+	 * Append a record that removes the subtree with URL 'url'.
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool appendRemoval( const QString & url );
+
+	/**
+	 * Return 'true' if the journal is so large compared to the base that
+	 * it should be compacted.
+	 **/
+	bool needsCompaction() const;
+
+	/**
+	 * Return the name of the file to write the compacted cache to: A
+	 * hidden file in the same directory with the same suffix as the
+	 * base, so it is written in the same format.
+	 **/
+	QString compactionFileName() const;
+
+	/**
+	 * Replace the base with the compacted cache file and remove the
+	 * journal. Call this only when the compacted file was written
+	 * completely.
+	 *
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool finishCompaction();
+
+	/**
+	 * Remove the journal file, e.g. because the base was written again.
+	 **/
+	void remove();
+
+
+    protected:
+
+	/**
+	 * Write the record line for 'url' and, if 'subtree' is non-null,
+	 * the lines of that subtree to the end of the journal.
+	 **/
+	bool append( const QString & url, DirInfo * subtree );
+
+	/**
+	 * Return the size and mtime of cache file 'cacheFileName' as they
+	 * are in the header of the journal or an empty string if there is no
+	 * such file.
+	 **/
+	static QByteArray baseIdentity( const QString & cacheFileName );
+
+
+	//
+	// Data members
+	//
+
+	QString	   _cacheFileName;
+	QString	   _fileName;
+	DirTree *  _tree;
+	QByteArray _baseIdentity;	// When the journal was started
+
+    };	// class CacheJournal
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheJournal_h
@@ -67,6 +67,7 @@ bool Cleanup::worksFor( FileInfo *item ) const
     if ( ! _active || ! item )
 	return false;
 
+    if	( item->isAggregate() )	return false;	// No real file on disk
     if	( item->isPseudoDir() )	return worksForDotEntry();
     if	( item->isDir() )	return worksForDir();
 
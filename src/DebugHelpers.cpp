@@ -136,4 +136,36 @@ namespace Debug
     }
 
 
+    void dumpMemoryUsage( FileInfo * subtree )
+    {
+	if ( ! subtree )
+	    return;
+
+	FileCount items = subtree->totalItems() + 1;
+	FileCount dirs	= subtree->totalSubDirs() + ( subtree->isDirInfo() ? 1 : 0 );
+
+	// Aggregated files don't have an object of their own, so this uses
+	// the objects in memory of the whole tree (see DirTree::residentItems())
+	// rather than the items. Each directory with any non-directory
+	// children also has a dot entry; those are counted like the files.
+
+	FileCount objects = subtree->tree() ? subtree->tree()->residentItems() : items;
+	FileCount files	  = qMax( objects - dirs, (FileCount) 0 );
+
+	if ( objects < 1 )
+	    return;
+
+	FileSize bytes = files * sizeof( FileInfo ) +
+			 dirs  * sizeof( DirInfo );
+
+	logDebug() << "Memory for " << objects << " objects for " << items << " items ("
+		   << dirs << " dirs) in " << subtree << ": "
+		   << formatSize( bytes ) << "; "
+		   << bytes / objects << " bytes per object"
+		   << " (FileInfo: " << sizeof( FileInfo )
+		   << ", DirInfo: "  << sizeof( DirInfo ) << ")"
+		   << endl;
+    }
+
+
 } // namespace
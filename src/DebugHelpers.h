@@ -55,6 +55,15 @@ namespace Debug
      **/
     void dumpExcludeRules();
 
+    /**
+     * Log an estimate of the memory used by the objects in memory of the
+     * tree of 'subtree': In total and per object. Aggregated files don't
+     * have an object of their own. This only uses cached sums, so it is
+     * cheap even for huge trees; it does not include the names and any
+     * caches.
+     **/
+    void dumpMemoryUsage( FileInfo * subtree );
+
     /**
      * Return a string list of data(0) of the tree ancestors of 'index'.
      * The list will start with the tree's root.
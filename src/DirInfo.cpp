@@ -7,14 +7,17 @@
  */
 
 
-#include <algorithm>    // std::stable_sort()
+#include <algorithm>    // std::upper_bound(), std::merge(), std::sort()
+#include <iterator>     // std::back_inserter()
 
 #include "DirInfo.h"
 #include "DirTree.h"
 #include "DotEntry.h"
 #include "Attic.h"
+#include "AggregateInfo.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
+#include "SubtreeStore.h"
 #include "FormatUtil.h"
 #include "Exception.h"
 #include "DebugHelpers.h"
@@ -28,6 +31,16 @@
 #define VERBOSE_DOMINANCE_CHECK                 0
 #define DIRECT_CHILDREN_COUNT_SANITY_CHECK      0
 
+// Minimum number of rows to sort if only the first rows are needed
+#define PARTIAL_SORT_MIN_ROWS                   128
+
+// Minimum number of children for an index of their names
+#define NAME_INDEX_MIN_CHILDREN                 100
+
+// FNV-1a, 64 bit, for DirInfo::digest()
+#define DIGEST_OFFSET_BASIS                     0xcbf29ce484222325ULL
+#define DIGEST_PRIME                            0x100000001b3ULL
+
 using namespace QDirStat;
 
 
@@ -89,9 +102,11 @@ void DirInfo::init()
     _isMountPoint	 = false;
     _isExcluded		 = false;
     _summaryDirty	 = false;
+    _mtimeDirty		 = false;
     _deletingAll	 = false;
     _locked		 = false;
     _touched		 = false;
+    _isSpilled		 = false;
     _pendingReadJobs	 = 0;
     _dotEntry		 = 0;
     _firstChild		 = 0;
@@ -112,28 +127,178 @@ void DirInfo::init()
     _dominantChildren    = 0;
     _lastSortCol	 = UndefinedCol;
     _lastSortOrder	 = Qt::AscendingOrder;
+    _lastIncludeAttic	 = false;
+    _sortedRows		 = 0;
+    _sortableRows	 = 0;
+    _sortCacheStamp	 = 0;
+    _cachedUrl		 = 0;
+    _cachedUrlGeneration = 0;
+    _preOrder		 = 0;
+    _postOrder		 = 0;
+    _nextLabel		 = 0;
+    _generation		 = nextGeneration();
+    _digest		 = 0;
+    _digestGeneration	 = 0;
+    _nameIndex		 = 0;
+}
+
+
+quint64 DirInfo::nextGeneration()
+{
+    // One counter for all trees: A generation number is never used twice,
+    // not even by an item that happens to get the address of a deleted one.
+
+    static quint64 lastGeneration = 0;
+
+    return ++lastGeneration;
+}
+
+
+void DirInfo::markChanged()
+{
+    quint64 generation = nextGeneration();
+
+    for ( DirInfo * dir = this; dir; dir = dir->parent() )
+	dir->_generation = generation;
+}
+
+
+/**
+ * Add 'value' to FNV-1a hash 'hash' byte by byte from the lowest one, so
+ * the result is the same on every platform.
+ **/
+static quint64 digestAdd( quint64 hash, quint64 value, int bytes = 8 )
+{
+    for ( int i=0; i < bytes; ++i )
+    {
+	hash ^= value & 0xff;
+	hash *= DIGEST_PRIME;
+	value >>= 8;
+    }
+
+    return hash;
+}
+
+
+/**
+ * Return the hash of one child for the digest of its parent.
+ **/
+static quint64 childDigest( FileInfo * child )
+{
+    quint64 hash = DIGEST_OFFSET_BASIS;
+    QString name = AggregateInfo::storedName( child );
+
+    for ( int i=0; i < name.size(); ++i )
+	hash = digestAdd( hash, name.at( i ).unicode(), 2 );
+
+    hash = digestAdd( hash, name.size() );	// Where the name ends
+    hash = digestAdd( hash, child->mode() & S_IFMT );
+    hash = digestAdd( hash, child->rawByteSize() );
+    hash = digestAdd( hash, child->mtime() );
+
+    if ( child->isDirInfo() )
+	hash = digestAdd( hash, child->toDirInfo()->digest() );
+
+    return hash;
+}
+
+
+quint64 DirInfo::digest()
+{
+    if ( ! hasDigest() )
+    {
+	_digest		  = calcDigest();
+	_digestGeneration = _generation;
+    }
+
+    return _digest;
+}
+
+
+quint64 DirInfo::calcDigest()
+{
+    // Adding up the hashes of the children does not depend on their order
+    // like hashing one after the other would.
+
+    quint64 sum   = 0;
+    quint64 count = 0;
+
+    for ( FileInfo * child = firstChild(); child; child = child->next() )
+    {
+	sum += childDigest( child );
+	++count;
+    }
+
+    if ( dotEntry() )
+    {
+	for ( FileInfo * child = dotEntry()->firstChild(); child; child = child->next() )
+	{
+	    sum += childDigest( child );
+	    ++count;
+	}
+    }
+
+    return digestAdd( digestAdd( DIGEST_OFFSET_BASIS, sum ), count );
 }
 
 
 DirInfo::~DirInfo()
 {
-    clear();
+    // Not using clear() here: Whoever deletes this directory already took
+    // care of the sums of the ancestors (see deletingChild()).
+
+    deleteChildren();
+
+    if ( _isSpilled && _tree && _tree->subtreeStore() )
+	_tree->subtreeStore()->discard( this );
+
+    if ( _cachedUrl )
+	delete _cachedUrl;
 }
 
 
 void DirInfo::clear()
+{
+    if ( _isSpilled )
+	pageIn();
+
+    if ( _parent && ( _firstChild || _dotEntry || _attic ) )
+    {
+	// This directory stays, but everything below it is about to go away:
+	// Subtract what the children contributed to the sums of the ancestors.
+
+	Summary delta;
+	FileInfoIterator it( this );
+
+	while ( *it )
+	{
+	    addContribution( delta, *it );
+	    ++it;
+	}
+
+	if ( _attic )
+	{
+	    delta.ignoredItems += _attic->totalIgnoredItems();
+	    delta.errSubDirs   += _attic->errSubDirCount();
+	}
+
+	_parent->subtractFromSummary( delta, _isIgnored );
+    }
+
+    reclaimChildren();
+}
+
+
+void DirInfo::deleteChildren()
 {
     _deletingAll = true;
+    dropNameIndex();
 
     // Recursively delete all children.
 
     while ( _firstChild )
     {
 	FileInfo * nextChild = _firstChild->next();
-
-	if ( _parent )
-	    _parent->deletingChild( _firstChild );
-
 	delete _firstChild;
 	_firstChild = nextChild; // unlink the old first child
     }
@@ -159,6 +324,61 @@ void DirInfo::clear()
 }
 
 
+void DirInfo::reclaimChildren()
+{
+    if ( ! _tree )
+    {
+	deleteChildren();
+	return;
+    }
+
+    // Nothing in the tree may refer to any item below this directory any
+    // more when the reclaimer thread deletes them.
+
+    _tree->releaseCaches( this, false );
+    dropNameIndex();
+
+    FileInfo * child = _firstChild;
+    _firstChild = 0;
+
+    if ( child )
+    {
+	// Only the direct children need to be cut off; anything below them
+	// is only reachable through them.
+
+	for ( FileInfo * sibling = child; sibling; sibling = sibling->next() )
+	{
+	    sibling->setParent( 0 );
+
+	    if ( sibling->isDirInfo() )
+		sibling->toDirInfo()->dropLabels();
+	}
+
+	_tree->reclaim( child );
+    }
+
+    if ( _dotEntry )
+    {
+	_dotEntry->setParent( 0 );
+	_dotEntry->dropLabels();
+	_tree->reclaim( _dotEntry );
+	_dotEntry = 0;
+    }
+
+    if ( _attic )
+    {
+	_attic->setParent( 0 );
+	_attic->dropLabels();
+	_tree->reclaim( _attic );
+	_attic = 0;
+    }
+
+    _summaryDirty = true;
+    dropSortCache();
+    markChanged();
+}
+
+
 void DirInfo::reset()
 {
     if ( _firstChild || _dotEntry || _attic )
@@ -186,6 +406,7 @@ DotEntry * DirInfo::ensureDotEntry()
 
 	_dotEntry = new DotEntry( _tree, this );
 	CHECK_NEW( _dotEntry );
+	dropSortCache();
     }
 
     return _dotEntry;
@@ -200,6 +421,7 @@ void DirInfo::deleteEmptyDotEntry()
 
 	delete _dotEntry;
 	_dotEntry = 0;
+	dropSortCache();
 
 	countDirectChildren();
     }
@@ -214,6 +436,9 @@ Attic * DirInfo::ensureAttic()
 
 	_attic = new Attic( _tree, this );
 	CHECK_NEW( _attic );
+
+	if ( _lastIncludeAttic )
+	    dropSortCache();
     }
 
     return _attic;
@@ -228,6 +453,9 @@ void DirInfo::deleteEmptyAttic()
 
 	delete _attic;
 	_attic = 0;
+
+	if ( _lastIncludeAttic )
+	    dropSortCache();
     }
 }
 
@@ -238,57 +466,156 @@ bool DirInfo::hasAtticChildren() const
 }
 
 
+DirInfo::Summary::Summary():
+    size( 0 ),
+    allocatedSize( 0 ),
+    blocks( 0 ),
+    items( 0 ),
+    subDirs( 0 ),
+    files( 0 ),
+    ignoredItems( 0 ),
+    unignoredItems( 0 ),
+    errSubDirs( 0 ),
+    latestMtime( 0 ),
+    oldestFileMtime( 0 )
+{
+}
+
+
+void DirInfo::Summary::add( const Summary & other )
+{
+    size	   += other.size;
+    allocatedSize  += other.allocatedSize;
+    blocks	   += other.blocks;
+    items	   += other.items;
+    subDirs	   += other.subDirs;
+    files	   += other.files;
+    ignoredItems   += other.ignoredItems;
+    unignoredItems += other.unignoredItems;
+    errSubDirs	   += other.errSubDirs;
+    latestMtime	    = qMax( latestMtime, other.latestMtime );
+
+    if ( oldestFileMtime == 0 ||
+	 ( other.oldestFileMtime > 0 && other.oldestFileMtime < oldestFileMtime ) )
+    {
+	oldestFileMtime = other.oldestFileMtime;
+    }
+}
+
+
+void DirInfo::addContribution( Summary & sum, FileInfo * child )
+{
+    sum.size	       += child->totalSize();
+    sum.allocatedSize  += child->totalAllocatedSize();
+    sum.blocks	       += child->totalBlocks();
+    sum.items	       += child->totalItems() + 1;
+    sum.subDirs	       += child->totalSubDirs();
+    sum.errSubDirs     += child->errSubDirCount();
+    sum.files	       += child->totalFiles();
+    sum.ignoredItems   += child->totalIgnoredItems();
+    sum.unignoredItems += child->totalUnignoredItems();
+
+    if ( child->isDir() )
+    {
+	sum.subDirs++;
+
+	if ( child->readError() )
+	    sum.errSubDirs++;
+    }
+
+    if ( child->isFile() )
+	sum.files++;
+
+    if ( ! child->isDir() )
+    {
+	if ( child->isIgnored() )
+	    sum.ignoredItems++;
+	else
+	    sum.unignoredItems++;
+    }
+
+    time_t childLatestMtime = child->latestMtime();
+
+    if ( childLatestMtime > sum.latestMtime )
+	sum.latestMtime = childLatestMtime;
+
+    time_t childOldestFileMTime = child->oldestFileMtime();
+
+    if ( childOldestFileMTime > 0 )
+    {
+	if ( sum.oldestFileMtime == 0 ||
+	     childOldestFileMTime < sum.oldestFileMtime )
+	{
+	    sum.oldestFileMtime = childOldestFileMTime;
+	}
+    }
+}
+
+
 void DirInfo::recalc()
 {
     // logDebug() << this << endl;
 
-    _totalSize		 = _size;
-    _totalAllocatedSize	 = _allocatedSize;
-    _totalBlocks	 = _blocks;
-    _totalItems		 = 0;
-    _totalSubDirs	 = 0;
-    _totalFiles		 = 0;
-    _totalIgnoredItems	 = 0;
-    _totalUnignoredItems = 0;
+    if ( _isSpilled )
+    {
+	// The sums are all that is left of a spilled subtree, and they
+	// cannot change as long as it is spilled.
+
+	_summaryDirty = false;
+	_mtimeDirty   = false;
+	return;
+    }
+
+    Summary sum;
     _directChildrenCount = 0;
-    _errSubDirCount	 = 0;
-    _latestMtime	 = _mtime;
-    _oldestFileMtime	 = 0;
 
     FileInfoIterator it( this );
 
     while ( *it )
     {
 	_directChildrenCount++;
-	_totalSize	     += (*it)->totalSize();
-	_totalAllocatedSize  += (*it)->totalAllocatedSize();
-	_totalBlocks	     += (*it)->totalBlocks();
-	_totalItems	     += (*it)->totalItems() + 1;
-	_totalSubDirs	     += (*it)->totalSubDirs();
-	_errSubDirCount	     += (*it)->errSubDirCount();
-	_totalFiles	     += (*it)->totalFiles();
-	_totalIgnoredItems   += (*it)->totalIgnoredItems();
-	_totalUnignoredItems += (*it)->totalUnignoredItems();
-
-	if ( (*it)->isDir() )
-	{
-	    _totalSubDirs++;
+	addContribution( sum, *it );
+	++it;
+    }
 
-	    if ( (*it)->readError() )
-		_errSubDirCount++;
-	}
+    if ( _attic )
+    {
+	sum.ignoredItems += _attic->totalIgnoredItems();
+	sum.errSubDirs	 += _attic->errSubDirCount();
+    }
 
-	if ( (*it)->isFile() )
-	    _totalFiles++;
+    _totalSize		 = _size	  + sum.size;
+    _totalAllocatedSize	 = _allocatedSize + sum.allocatedSize;
+    _totalBlocks	 = _blocks	  + sum.blocks;
+    _totalItems		 = sum.items;
+    _totalSubDirs	 = sum.subDirs;
+    _totalFiles		 = sum.files;
+    _totalIgnoredItems	 = sum.ignoredItems;
+    _totalUnignoredItems = sum.unignoredItems;
+    _errSubDirCount	 = sum.errSubDirs;
+    _latestMtime	 = qMax( _mtime, sum.latestMtime );
+    _oldestFileMtime	 = sum.oldestFileMtime;
 
-	if ( ! (*it)->isDir() )
-	{
-	    if ( (*it)->isIgnored() )
-		_totalIgnoredItems++;
-	    else
-		_totalUnignoredItems++;
-	}
+    _summaryDirty = false;
+    _mtimeDirty	  = false;
+}
+
+
+void DirInfo::recalcMtimes()
+{
+    if ( _isSpilled )
+    {
+	_mtimeDirty = false;
+	return;
+    }
+
+    _latestMtime     = _mtime;
+    _oldestFileMtime = 0;
+
+    FileInfoIterator it( this );
 
+    while ( *it )
+    {
 	time_t childLatestMtime = (*it)->latestMtime();
 
 	if ( childLatestMtime > _latestMtime )
@@ -308,13 +635,64 @@ void DirInfo::recalc()
 	++it;
     }
 
-    if ( _attic )
+    _mtimeDirty = false;
+}
+
+
+void DirInfo::subtractFromSummary( const Summary & delta, bool ignored )
+{
+    for ( DirInfo * dir = this; dir; dir = dir->parent() )
     {
-	_totalIgnoredItems += _attic->totalIgnoredItems();
-	_errSubDirCount	   += _attic->errSubDirCount();
+	if ( ignored || dir->isAttic() )
+	{
+	    dir->markSummaryDirty();
+	    return;
+	}
+
+	dir->_generation = nextGeneration();
+
+	// A dirty summary will be recalculated anyway, but the ancestors of
+	// this one might still have valid sums.
+
+	if ( ! dir->_summaryDirty )
+	{
+	    dir->_totalSize	      -= delta.size;
+	    dir->_totalAllocatedSize  -= delta.allocatedSize;
+	    dir->_totalBlocks	      -= delta.blocks;
+	    dir->_totalItems	      -= delta.items;
+	    dir->_totalSubDirs	      -= delta.subDirs;
+	    dir->_totalFiles	      -= delta.files;
+	    dir->_totalIgnoredItems   -= delta.ignoredItems;
+	    dir->_totalUnignoredItems -= delta.unignoredItems;
+	    dir->_errSubDirCount      -= delta.errSubDirs;
+
+	    // The removed items might have had the latest or the oldest
+	    // mtime, and finding the second latest or second oldest one would
+	    // need a look at all the other children. Leave that until
+	    // somebody really wants to know.
+
+	    if ( delta.latestMtime >= dir->_latestMtime )
+		dir->_mtimeDirty = true;
+
+	    if ( delta.oldestFileMtime > 0 &&
+		 delta.oldestFileMtime <= dir->_oldestFileMtime )
+	    {
+		dir->_mtimeDirty = true;
+	    }
+	}
     }
+}
 
-    _summaryDirty = false;
+
+void DirInfo::markSummaryDirty()
+{
+    quint64 generation = nextGeneration();
+
+    for ( DirInfo * dir = this; dir; dir = dir->parent() )
+    {
+	dir->_summaryDirty = true;
+	dir->_generation   = generation;
+    }
 }
 
 
@@ -351,7 +729,7 @@ FileSize DirInfo::totalBlocks()
 }
 
 
-int DirInfo::totalItems()
+FileCount DirInfo::totalItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -360,7 +738,7 @@ int DirInfo::totalItems()
 }
 
 
-int DirInfo::totalSubDirs()
+FileCount DirInfo::totalSubDirs()
 {
     if ( _summaryDirty )
 	recalc();
@@ -369,7 +747,7 @@ int DirInfo::totalSubDirs()
 }
 
 
-int DirInfo::totalFiles()
+FileCount DirInfo::totalFiles()
 {
     if ( _summaryDirty )
 	recalc();
@@ -378,7 +756,7 @@ int DirInfo::totalFiles()
 }
 
 
-int DirInfo::totalNonDirItems()
+FileCount DirInfo::totalNonDirItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -387,7 +765,7 @@ int DirInfo::totalNonDirItems()
 }
 
 
-int DirInfo::totalIgnoredItems()
+FileCount DirInfo::totalIgnoredItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -396,7 +774,7 @@ int DirInfo::totalIgnoredItems()
 }
 
 
-int DirInfo::totalUnignoredItems()
+FileCount DirInfo::totalUnignoredItems()
 {
     if ( _summaryDirty )
 	recalc();
@@ -409,6 +787,8 @@ time_t DirInfo::latestMtime()
 {
     if ( _summaryDirty )
 	recalc();
+    else if ( _mtimeDirty )
+	recalcMtimes();
 
     return _latestMtime;
 }
@@ -418,6 +798,8 @@ time_t DirInfo::oldestFileMtime()
 {
     if ( _summaryDirty )
 	recalc();
+    else if ( _mtimeDirty )
+	recalcMtimes();
 
     return _oldestFileMtime;
 }
@@ -449,6 +831,9 @@ int DirInfo::countDirectChildren()
 {
     // logDebug() << this << endl;
 
+    if ( _isSpilled )
+	return _directChildrenCount;
+
     _directChildrenCount = 0;
 
     FileInfo * child = _firstChild;
@@ -466,7 +851,7 @@ int DirInfo::countDirectChildren()
 }
 
 
-int DirInfo::errSubDirCount()
+FileCount DirInfo::errSubDirCount()
 {
     if ( _summaryDirty )
 	recalc();
@@ -509,6 +894,9 @@ void DirInfo::insertChild( FileInfo * newChild )
 {
     CHECK_PTR( newChild );
 
+    if ( _isSpilled )
+	pageIn();
+
     if ( newChild->isDir() || ! _dotEntry )
     {
 	/**
@@ -526,10 +914,7 @@ void DirInfo::insertChild( FileInfo * newChild )
 	 * none of our business; the corresponding "view" object for this tree
 	 * will take care of such niceties.
 	 **/
-	newChild->setNext( _firstChild );
-	_firstChild = newChild;
-	newChild->setParent( this );	// make sure the parent pointer is correct
-
+	linkChild( newChild );
 	childAdded( newChild );		// update summaries
     }
     else
@@ -543,6 +928,20 @@ void DirInfo::insertChild( FileInfo * newChild )
 }
 
 
+void DirInfo::linkChild( FileInfo * newChild )
+{
+    newChild->setNext( _firstChild );
+    _firstChild = newChild;
+    newChild->setParent( this );	// make sure the parent pointer is correct
+
+    if ( _nameIndex )
+	_nameIndex->insert( newChild->name(), newChild );
+
+    if ( _tree && newChild->isDirInfo() )
+	_tree->labelNewDir( this, newChild->toDirInfo() );
+}
+
+
 void DirInfo::moveToAttic( FileInfo * child )
 {
     unlinkChild( child );
@@ -574,121 +973,273 @@ void DirInfo::addToAttic( FileInfo * newChild )
 }
 
 
-void DirInfo::childAdded( FileInfo * newChild )
+void DirInfo::insertChildren( const FileInfoList & newChildren )
 {
-    bool addToTotal = true;
+    if ( newChildren.isEmpty() )
+	return;
 
-    if ( newChild->isIgnored() )
-    {
-	if ( newChild->isDir() )
-	    _totalIgnoredItems += newChild->totalIgnoredItems();
-	else
-	    _totalIgnoredItems++;
+    if ( _isSpilled )
+	pageIn();
 
-	// Add ignored items only to all the totals if this directory is also
-	// ignored or if this is the attic.
+    // Ignored items and the attic follow special rules for the sums;
+    // leave that to insertChild().
 
-	if ( ! _isIgnored &&  ! isAttic() )
-	    addToTotal = false;
-    }
-    else
+    bool simple = true;
+
+    for ( DirInfo * dir = this; dir && simple; dir = dir->parent() )
     {
-	if ( ! newChild->isDir() )
-	    _totalUnignoredItems++;
+	if ( dir->_isIgnored || dir->isAttic() )
+	    simple = false;
     }
 
-    if ( addToTotal )
+    for ( int i=0; i < newChildren.size() && simple; ++i )
     {
-	if ( ! _summaryDirty )
-	{
-	    _totalSize		+= newChild->size();
-	    _totalAllocatedSize += newChild->allocatedSize();
-	    _totalBlocks	+= newChild->blocks();
-	    _totalItems++;
+	if ( newChildren.at( i )->isIgnored() )
+	    simple = false;
+    }
 
-	    if ( newChild->parent() == this )
-		_directChildrenCount++;
+    if ( ! simple )
+    {
+	foreach ( FileInfo * child, newChildren )
+	    insertChild( child );
 
-	    if ( newChild->isDir() )
-		_totalSubDirs++;
+	return;
+    }
 
-	    if ( newChild->isFile() )
-		_totalFiles++;
+    // Link the children just like insertChild() does: Directories (and
+    // everything if there is no dot entry) here, everything else in the
+    // dot entry.
 
-	    if ( newChild->mtime() > _latestMtime )
-		_latestMtime = newChild->mtime();
+    Summary ownSum;
+    Summary dotEntrySum;
+    int	    ownCount	  = 0;
+    int	    dotEntryCount = 0;
 
-	    time_t childOldestFileMTime = newChild->oldestFileMtime();
+    foreach ( FileInfo * child, newChildren )
+    {
+	DirInfo * parent = ( child->isDir() || ! _dotEntry ) ? this : _dotEntry;
+	parent->linkChild( child );
 
-	    if ( childOldestFileMTime > 0 && newChild->isFile() )
-	    {
-		if ( _oldestFileMtime == 0 ||
-		     childOldestFileMTime < _oldestFileMtime )
-		{
-		    _oldestFileMtime = childOldestFileMTime;
-		}
-	    }
+	if ( parent == this )
+	{
+	    addNewChild( ownSum, child );
+	    ++ownCount;
 	}
 	else
 	{
-	    // NOP
-
-	    /*
-	     * Don't bother updating the summary fields if the summary is dirty
-	     * (i.e. outdated) anyway: As soon as anybody wants to know some
-	     * exact value a complete recalculation of the entire subtree will
-	     * be triggered. On the other hand, if nobody wants to know (which
-	     * is very likely) we can save this effort.
-	     */
+	    addNewChild( dotEntrySum, child );
+	    ++dotEntryCount;
 	}
     }
 
-    if ( _lastSortCol != ReadJobsCol )
-	dropSortCache();
+    if ( dotEntryCount > 0 )
+    {
+	_dotEntry->addToSummary( dotEntrySum, dotEntryCount );
+	_dotEntry->sortCacheChildrenAdded( newChildren );
 
-    if ( _parent )
-	_parent->childAdded( newChild );
+	// For all ancestors, it doesn't matter where the children are
+
+	ownSum.add( dotEntrySum );
+    }
+
+    addToSummary( ownSum, ownCount );
+    sortCacheChildrenAdded( newChildren );
+
+    for ( DirInfo * dir = _parent; dir; dir = dir->parent() )
+    {
+	dir->addToSummary( ownSum, 0 );
+	dir->sortCacheChildrenAdded( newChildren );
+    }
 }
 
 
-void DirInfo::deletingChild( FileInfo * child )
+void DirInfo::addNewChild( Summary & sum, FileInfo * child )
 {
-    /**
-     * When children are deleted, things go downhill: Marking the summary
-     * fields as dirty (i.e. outdated) is the only thing that can be done here.
-     *
-     * The accumulated sizes could be updated (by subtracting this deleted
-     * child's values from them), but the latest mtime definitely has to be
-     * recalculated: The child now being deleted might just be the one with the
-     * latest mtime, and figuring out the second-latest cannot easily be
-     * done. So we merely mark the summary as dirty and wait until a recalc()
-     * will be triggered from outside - which might as well never happen if
-     * nobody wants to know some summary field anyway.
-     **/
+    // An aggregate stands for many files (see AggregateInfo)
+    FileCount items = child->isAggregate() ? 1 + child->totalItems() : 1;
 
-    _summaryDirty = true;
+    sum.size	      += child->size();
+    sum.allocatedSize += child->allocatedSize();
+    sum.blocks	      += child->blocks();
+    sum.items	      += items;
 
-    if ( _parent )
-	_parent->deletingChild( child );
+    if ( child->isDir() )
+	sum.subDirs++;
+    else
+	sum.unignoredItems += items;
 
-    if ( child->parent() == this )
-    {
-	if ( ! _deletingAll )
+    if ( child->isFile() )
+	sum.files += items;
+
+    if ( child->mtime() > sum.latestMtime )
+	sum.latestMtime = child->mtime();
+
+    time_t childOldestFileMTime = child->oldestFileMtime();
+
+    if ( childOldestFileMTime > 0 && child->isFile() )
+    {
+	if ( sum.oldestFileMtime == 0 ||
+	     childOldestFileMTime < sum.oldestFileMtime )
 	{
-	    /**
-	     * Unlink the child from the children's list - but only if this
-	     * doesn't happen recursively for all children of this object: No
-	     * use bothering about the validity of the children's list if this
-	     * will all be history anyway in a moment.
-	     **/
-
-	    unlinkChild( child );
+	    sum.oldestFileMtime = childOldestFileMTime;
 	}
-	else
+    }
+}
+
+
+void DirInfo::addToSummary( const Summary & delta, int directChildren )
+{
+    _generation		  = nextGeneration();
+    _totalUnignoredItems += delta.unignoredItems;
+
+    if ( _summaryDirty )
+    {
+	// Don't bother updating the summary fields if the summary is dirty
+	// (i.e. outdated) anyway: As soon as anybody wants to know some
+	// exact value a complete recalculation of the entire subtree will
+	// be triggered. On the other hand, if nobody wants to know (which
+	// is very likely) we can save this effort.
+
+	return;
+    }
+
+    _totalSize		 += delta.size;
+    _totalAllocatedSize	 += delta.allocatedSize;
+    _totalBlocks	 += delta.blocks;
+    _totalItems		 += delta.items;
+    _totalSubDirs	 += delta.subDirs;
+    _totalFiles		 += delta.files;
+    _directChildrenCount += directChildren;
+
+    if ( delta.latestMtime > _latestMtime )
+	_latestMtime = delta.latestMtime;
+
+    if ( delta.oldestFileMtime > 0 )
+    {
+	if ( _oldestFileMtime == 0 ||
+	     delta.oldestFileMtime < _oldestFileMtime )
+	{
+	    _oldestFileMtime = delta.oldestFileMtime;
+	}
+    }
+}
+
+
+void DirInfo::sortCacheChildrenAdded( const FileInfoList & newChildren )
+{
+    if ( ! _sortedChildren || _lastSortCol == ReadJobsCol )
+	return;
+
+    // Keep the sort cache if possible: New direct children can simply be
+    // inserted at the right place. Something added further down in the
+    // subtree changes sizes, item counts etc. of the children, but not
+    // their names or their owners, so the order by those stays the same.
+
+    bool	 subtreeIndependent = isSubtreeIndependentCol( _lastSortCol );
+    FileInfoList direct;
+
+    foreach ( FileInfo * child, newChildren )
+    {
+	if ( child->parent() == this )
+	    direct << child;
+	else if ( ! subtreeIndependent )
 	{
 	    dropSortCache();
+	    return;
 	}
     }
+
+    if ( ! direct.isEmpty() && ! insertIntoSortCache( direct ) )
+	dropSortCache();
+}
+
+
+void DirInfo::childAdded( FileInfo * newChild )
+{
+    bool addToTotal = true;
+
+    if ( newChild->isIgnored() )
+    {
+	if ( newChild->isDir() )
+	    _totalIgnoredItems += newChild->totalIgnoredItems();
+	else
+	    _totalIgnoredItems++;
+
+	// Add ignored items only to all the totals if this directory is also
+	// ignored or if this is the attic.
+
+	if ( ! _isIgnored &&  ! isAttic() )
+	    addToTotal = false;
+    }
+
+    // The same rules as for a number of children at once (see
+    // insertChildren()); only ignored children are special.
+
+    Summary delta;
+
+    if ( addToTotal )
+	addNewChild( delta, newChild );
+
+    if ( newChild->isIgnored() )
+	delta.unignoredItems = 0;
+
+    addToSummary( delta, addToTotal && newChild->parent() == this ? 1 : 0 );
+
+    if ( _sortedChildren )
+	sortCacheChildrenAdded( FileInfoList() << newChild );
+
+    if ( _parent )
+	_parent->childAdded( newChild );
+}
+
+
+void DirInfo::deletingChild( FileInfo * child )
+{
+    if ( child->parent() != this )
+    {
+	// Not a direct child: Nothing is known about how it contributes to
+	// the sums here, so all that can be done is to mark them as dirty.
+
+	markSummaryDirty();
+	return;
+    }
+
+    if ( _deletingAll )
+    {
+	/**
+	 * Don't bother about the validity of the children's list or the sums
+	 * if this will all be history anyway in a moment.
+	 **/
+
+	dropSortCache();
+	return;
+    }
+
+    /**
+     * Subtract this child's values from the sums of this directory and all
+     * its ancestors. This is much cheaper than marking them as dirty: That
+     * would mean a recalc() of each ancestor which iterates over all its
+     * direct children. Only the latest / oldest mtime might need to be
+     * recalculated if this child had one of them; subtractFromSummary()
+     * takes care of that.
+     **/
+
+    Summary delta;
+    addContribution( delta, child );
+
+    dropSortCache();
+
+    if ( removeFromChildrenList( child ) )
+    {
+	if ( ! _summaryDirty )
+	    _directChildrenCount--;
+
+	subtractFromSummary( delta, child->isIgnored() );
+    }
+    else
+    {
+	markSummaryDirty();
+    }
 }
 
 
@@ -703,15 +1254,24 @@ void DirInfo::unlinkChild( FileInfo * deletedChild )
 
     dropSortCache();
     _summaryDirty = true;
+    removeFromChildrenList( deletedChild );
+    markChanged();
+}
+
+
+bool DirInfo::removeFromChildrenList( FileInfo * deletedChild )
+{
+    // Another child with the same name might have been hidden in the index
+    dropNameIndex();
 
     if ( deletedChild == _firstChild )
     {
 	// logDebug() << "Unlinking first child " << deletedChild << endl;
 	_firstChild = deletedChild->next();
-	return;
+	return true;
     }
 
-    FileInfo * child = firstChild();
+    FileInfo * child = _firstChild;
 
     while ( child )
     {
@@ -720,7 +1280,7 @@ void DirInfo::unlinkChild( FileInfo * deletedChild )
 	    // logDebug() << "Unlinking " << deletedChild << endl;
 	    child->setNext( deletedChild->next() );
 
-	    return;
+	    return true;
 	}
 
 	child = child->next();
@@ -728,6 +1288,8 @@ void DirInfo::unlinkChild( FileInfo * deletedChild )
 
     logError() << "Couldn't unlink " << deletedChild << " from "
 	       << this << " children list" << endl;
+
+    return false;
 }
 
 
@@ -984,13 +1546,23 @@ void DirInfo::clearTouched( bool recursive )
 
 const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
 					      Qt::SortOrder sortOrder,
-					      bool	    includeAttic )
+					      bool	    includeAttic,
+					      int	    minRows )
 {
+    if ( _isSpilled )
+	pageIn();
+
     if ( _sortedChildren &&
 	 sortCol      == _lastSortCol	   &&
 	 sortOrder    == _lastSortOrder	   &&
 	 includeAttic == _lastIncludeAttic    )
     {
+	if ( minRows < 0 || minRows > _sortedRows )
+	    extendSortedRows( minRows );
+
+	if ( _tree )
+	    _sortCacheStamp = _tree->sortCacheUsed( this );
+
 	return *_sortedChildren;
     }
 
@@ -1015,33 +1587,31 @@ const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
     if ( _dotEntry )
 	_sortedChildren->append( _dotEntry );
 
+    _sortableRows = _sortedChildren->size();
+    _sortedRows	  = 0;
 
-    // Sort
-
-    // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
-
-    if ( sortCol != NameCol )
+    if ( includeAttic && _attic )
     {
-	// Do secondary sorting by NameCol (always in ascending order)
-
-	std::stable_sort( _sortedChildren->begin(),
-			  _sortedChildren->end(),
-			  FileInfoSorter( NameCol, Qt::AscendingOrder ) );
+	_sortedChildren->append( _attic );
+	_attic->setRowNumber( _sortableRows );
     }
 
+    _lastSortCol      = sortCol;
+    _lastSortOrder    = sortOrder;
+    _lastIncludeAttic = includeAttic;
+
 
-    // Primary sorting by sortCol ascending or descending (as specified in sortOrder)
+    // Sort (maybe only the first part of the list)
 
-    std::stable_sort( _sortedChildren->begin(),
-		      _sortedChildren->end(),
-		      FileInfoSorter( sortCol, sortOrder ) );
+    // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
 
-    if ( includeAttic && _attic )
-	_sortedChildren->append( _attic );
+    extendSortedRows( minRows );
 
-    _lastSortCol      = sortCol;
-    _lastSortOrder    = sortOrder;
-    _lastIncludeAttic = includeAttic;
+    if ( _tree )
+    {
+	_sortCacheStamp = _tree->sortCacheUsed( this );
+	_tree->sortCacheAdded( this );
+    }
 
 
 #if DIRECT_CHILDREN_COUNT_SANITY_CHECK
@@ -1061,6 +1631,174 @@ const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
 }
 
 
+void DirInfo::extendSortedRows( int minRows )
+{
+    if ( ! _sortedChildren || _sortedRows >= _sortableRows )
+	return;
+
+    if ( minRows >= 0 && minRows <= _sortedRows )
+	return;
+
+    int rows = _sortableRows;
+
+    if ( minRows >= 0 )
+    {
+	// Sort more than requested so scrolling down a little does not need
+	// another partial sort right away. Growing geometrically keeps the
+	// total effort in O(n * log n) even if the user scrolls all the way
+	// to the end of the list.
+
+	rows = qMax( minRows, qMax( 2 * _sortedRows, PARTIAL_SORT_MIN_ROWS ) );
+
+	// A partial sort is only worthwhile for a small part of the list
+
+	if ( rows > _sortableRows / 2 )
+	    rows = _sortableRows;
+    }
+
+    // The name is used as a secondary sort key (always in ascending order).
+    // This makes the result of a partial sort the same as that of a stable
+    // sort by name and then by 'sortCol'.
+
+    FileInfoKeySorter sorter( _lastSortCol, _lastSortOrder,
+			      true ); // nameTieBreak
+
+    sorter.partialSort( _sortedChildren->begin() + _sortedRows,
+			_sortedChildren->begin() + rows,
+			_sortedChildren->begin() + _sortableRows );
+
+    // Let each child know its row so the row of a child can be found
+    // without searching the list.
+
+    updateRowNumbers( _sortedRows, rows );
+    _sortedRows = rows;
+}
+
+
+bool DirInfo::insertIntoSortCache( const FileInfoList & newChildren )
+{
+    if ( ! _sortedChildren )
+	return false;
+
+    FileInfoSorter sorter( _lastSortCol, _lastSortOrder,
+			   true ); // nameTieBreak
+
+    // The sorted part of the list always has the first entries of the
+    // completely sorted list: A new child that sorts before its last entry
+    // belongs there, everything else is simply appended to the unsorted
+    // part.
+
+    FileInfoList sortedNew;
+    FileInfoList unsortedNew;
+
+    foreach ( FileInfo * newChild, newChildren )
+    {
+	if ( newChild->isAttic() )
+	    return false;
+
+	bool inSortedPart = _sortedRows == _sortableRows ||
+	    ( _sortedRows > 0 && sorter( newChild, _sortedChildren->at( _sortedRows - 1 ) ) );
+
+	if ( inSortedPart )
+	    sortedNew << newChild;
+	else
+	    unsortedNew << newChild;
+    }
+
+    FileInfoList::iterator sortedEnd = _sortedChildren->begin() + _sortedRows;
+    int firstRow = _sortableRows;
+
+    if ( ! sortedNew.isEmpty() )
+    {
+	// Merge all of them into the sorted part at once rather than
+	// inserting them one by one, moving everything behind each of them:
+	// While reading, the children of a directory that is shown in a view
+	// come in batches (see insertChildren()).
+
+	std::sort( sortedNew.begin(), sortedNew.end(), sorter );
+	firstRow = std::upper_bound( _sortedChildren->begin(), sortedEnd,
+				     sortedNew.first(), sorter ) - _sortedChildren->begin();
+
+	FileInfoList merged;
+	merged.reserve( _sortedChildren->size() + newChildren.size() );
+
+	std::merge( _sortedChildren->begin(), sortedEnd,
+		    sortedNew.begin(), sortedNew.end(),
+		    std::back_inserter( merged ), sorter );
+
+	merged.append( _sortedChildren->mid( _sortedRows, _sortableRows - _sortedRows ) );
+	merged.append( unsortedNew );
+	merged.append( _sortedChildren->mid( _sortableRows ) ); // The attic
+
+	*_sortedChildren = merged;
+	_sortedRows	+= sortedNew.size();
+    }
+    else
+    {
+	for ( int i=0; i < unsortedNew.size(); ++i )
+	    _sortedChildren->insert( _sortableRows + i, unsortedNew.at( i ) );
+    }
+
+    _sortableRows += newChildren.size();
+    updateRowNumbers( firstRow, _sortedChildren->size() );
+
+    if ( _dominantChildren )
+    {
+	delete _dominantChildren;
+	_dominantChildren = 0;
+    }
+
+    if ( _tree )
+	_tree->sortCacheResized( this );
+
+    return true;
+}
+
+
+void DirInfo::updateRowNumbers( int from, int to )
+{
+    for ( int row = from; row < to; ++row )
+	_sortedChildren->at( row )->setRowNumber( row );
+}
+
+
+int DirInfo::sortedRow( FileInfo * child ) const
+{
+    if ( ! _sortedChildren || ! child )
+	return -1;
+
+    // The row number of a child is only a hint; it might be left over from
+    // an older sort cache.
+
+    int row = child->rowNumber();
+
+    if ( row < 0 || row >= _sortedChildren->size() || _sortedChildren->at( row ) != child )
+	return -1;
+
+    if ( row >= _sortedRows && row < _sortableRows )
+	return -1; // Not sorted yet: This is not its final row
+
+    return row;
+}
+
+
+bool DirInfo::isSubtreeIndependentCol( DataColumn sortCol )
+{
+    switch ( sortCol )
+    {
+	case NameCol:
+	case UserCol:
+	case GroupCol:
+	case PermissionsCol:
+	case OctalPermissionsCol:
+	    return true;
+
+	default:
+	    return false;
+    }
+}
+
+
 void DirInfo::dropSortCache( bool recursive )
 {
     if ( _sortedChildren )
@@ -1077,8 +1815,13 @@ void DirInfo::dropSortCache( bool recursive )
 	// open to a certain tree level), then closed them again and now opens
 	// select branches manually.
 
+	if ( _tree )
+	    _tree->sortCacheDropped( this );
+
 	delete _sortedChildren;
 	_sortedChildren = 0;
+	_sortedRows	= 0;
+	_sortableRows	= 0;
 
 	// Optimization: If this dir didn't have any sort cache, there won't be
 	// any in the subtree, either. And dot entries don't have dir children
@@ -1115,6 +1858,64 @@ void DirInfo::dropSortCache( bool recursive )
 }
 
 
+void DirInfo::appendUrl( QString & buffer ) const
+{
+    if ( _tree && _tree->cacheDirUrls() )
+    {
+	if ( _cachedUrl && _cachedUrlGeneration == _tree->dirUrlGeneration() )
+	{
+	    buffer += *_cachedUrl;
+	    return;
+	}
+
+	int start = buffer.size();
+	FileInfo::appendUrl( buffer );
+
+	if ( ! _cachedUrl )
+	{
+	    _cachedUrl = new QString();
+	    CHECK_NEW( _cachedUrl );
+	}
+
+	*_cachedUrl = buffer.mid( start );
+	_cachedUrlGeneration = _tree->dirUrlGeneration();
+    }
+    else
+    {
+	FileInfo::appendUrl( buffer );
+    }
+}
+
+
+void DirInfo::dropUrlCache( bool recursive )
+{
+    if ( _cachedUrl )
+    {
+	delete _cachedUrl;
+	_cachedUrl = 0;
+    }
+
+    if ( recursive )
+    {
+	FileInfo * child = _firstChild;
+
+	while ( child )
+	{
+	    if ( child->isDirInfo() )
+		child->toDirInfo()->dropUrlCache( recursive );
+
+	    child = child->next();
+	}
+
+	if ( _dotEntry )
+	    _dotEntry->dropUrlCache( recursive );
+
+	if ( _attic )
+	    _attic->dropUrlCache( recursive );
+    }
+}
+
+
 const DirInfo * DirInfo::findNearestMountPoint() const
 {
     const DirInfo * dir = this;
@@ -1126,6 +1927,121 @@ const DirInfo * DirInfo::findNearestMountPoint() const
 }
 
 
+quint32 DirInfo::assignLabels( quint32 next, quint32 gap )
+{
+    // Using the raw children pointers: Don't page in spilled subtrees
+
+    _preOrder = next++;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    next = child->toDirInfo()->assignLabels( next, gap );
+    }
+
+    if ( _dotEntry )
+	next = _dotEntry->assignLabels( next, gap );
+
+    if ( _attic )
+	next = _attic->assignLabels( next, gap );
+
+    // Only real directories get new subdirectories later
+
+    _nextLabel = next;
+
+    if ( ! isPseudoDir() )
+	next += gap;
+
+    _postOrder = next++;
+
+    return next;
+}
+
+
+bool DirInfo::labelNewChild( DirInfo * newChild )
+{
+    CHECK_PTR( newChild );
+
+    if ( ! isLabelled() || _nextLabel >= _postOrder )
+	return false;
+
+    // Give the new directory a part of the remaining gap: Most of the
+    // time, more siblings will follow.
+
+    quint32 unused = _postOrder - _nextLabel;
+
+    if ( unused < MinLabelRange )
+	return false;
+
+    quint32 range = unused / 8;
+
+    if ( range < MinLabelRange )
+	range = MinLabelRange;
+
+    newChild->_preOrder	 = _nextLabel;
+    newChild->_postOrder = _nextLabel + range - 1;
+    newChild->_nextLabel = _nextLabel + 1;
+    _nextLabel += range;
+
+    if ( newChild->_dotEntry )
+    {
+	DirInfo * dotEntry = newChild->_dotEntry;
+
+	dotEntry->_preOrder  = newChild->_nextLabel;
+	dotEntry->_postOrder = newChild->_nextLabel;
+	dotEntry->_nextLabel = newChild->_nextLabel;
+	newChild->_nextLabel++;
+    }
+
+    return true;
+}
+
+
+bool DirInfo::ensureNameIndex()
+{
+    if ( _nameIndex )
+	return true;
+
+    if ( directChildrenCount() < NAME_INDEX_MIN_CHILDREN )
+	return false;
+
+    QHash<QString, FileInfo *> * nameIndex = new QHash<QString, FileInfo *>();
+    CHECK_NEW( nameIndex );
+    nameIndex->reserve( directChildrenCount() );
+
+    for ( FileInfo * child = firstChild(); child; child = child->next() )
+    {
+	if ( child->name().contains( '/' ) )
+	{
+	    // The toplevel items have their complete path as their name;
+	    // leave that to the linear search in FileInfo::locate().
+
+	    delete nameIndex;
+	    return false;
+	}
+
+	// Like the linear search: The first one in the list wins
+
+	if ( ! nameIndex->contains( child->name() ) )
+	    nameIndex->insert( child->name(), child );
+    }
+
+    _nameIndex = nameIndex;
+
+    return true;
+}
+
+
+void DirInfo::dropNameIndex()
+{
+    if ( _nameIndex )
+    {
+	delete _nameIndex;
+	_nameIndex = 0;
+    }
+}
+
+
 void DirInfo::takeAllChildren( DirInfo * oldParent )
 {
     FileInfo * child = oldParent->firstChild();
@@ -1138,8 +2054,11 @@ void DirInfo::takeAllChildren( DirInfo * oldParent )
 	_firstChild = child;
 	FileInfo * lastChild = child;
 
-	oldParent->setFirstChild( 0 );
+	oldParent->setFirstChild( 0 );	// This also drops its name index
+	dropNameIndex();
 	oldParent->recalc();
+	oldParent->dropSortCache();
+	dropSortCache();
 
 	_directChildrenCount = -1;
 	_summaryDirty	     = true;
@@ -1152,6 +2071,32 @@ void DirInfo::takeAllChildren( DirInfo * oldParent )
 	}
 
 	lastChild->setNext( oldFirstChild );
+
+	oldParent->markChanged();
+	markChanged();
+    }
+}
+
+
+bool DirInfo::hasChildren() const
+{
+    return _isSpilled || _firstChild || _dotEntry;
+}
+
+
+void DirInfo::pageIn() const
+{
+    SubtreeStore * store = _tree ? _tree->subtreeStore() : 0;
+
+    if ( store )
+    {
+	store->pageIn( const_cast<DirInfo *>( this ) );
+	_tree->checkResidentItems();
+    }
+    else
+    {
+	logError() << "No subtree store for spilled " << this << endl;
+	const_cast<DirInfo *>( this )->_isSpilled = false;
     }
 }
 
@@ -1188,13 +2133,15 @@ void DirInfo::findDominantChildren()
     if ( _lastSortOrder != Qt::DescendingOrder )
         return;
 
+    extendSortedRows( DOMINANCE_ITEM_COUNT );
+
     if ( _dominantChildren )
         delete _dominantChildren;
 
     _dominantChildren = new FileInfoList();
     CHECK_NEW( _dominantChildren );
 
-    qreal count = qMin( _sortedChildren->size(), 30 );
+    qreal count = qMin( _sortedChildren->size(), DOMINANCE_ITEM_COUNT );
 
     if ( count < 2 )
         return;
@@ -11,6 +11,8 @@
 #define DirInfo_h
 
 
+#include <QHash>
+
 #include "FileInfo.h"
 #include "DataColumns.h"
 
@@ -20,6 +22,7 @@ namespace QDirStat
     // Forward declarations
     class DirTree;
     class DotEntry;
+    class SubtreeStore;
 
     /**
      * A more specialized version of FileInfo: This class can actually manage
@@ -108,7 +111,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of subdirectories in this subtree,
@@ -116,7 +119,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalSubDirs() Q_DECL_OVERRIDE;
+	virtual FileCount totalSubDirs() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of plain file children in this subtree,
@@ -124,7 +127,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalFiles() Q_DECL_OVERRIDE;
+	virtual FileCount totalFiles() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of non-directory items in this subtree,
@@ -132,7 +135,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalNonDirItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalNonDirItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of ignored (non-directory!) items in this
@@ -140,7 +143,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalIgnoredItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalIgnoredItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of not ignored (non-directory!) items in
@@ -148,7 +151,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int totalUnignoredItems() Q_DECL_OVERRIDE;
+	virtual FileCount totalUnignoredItems() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the total number of direct children of this directory.
@@ -160,6 +163,9 @@ namespace QDirStat
 	 * considerably faster than the unconditional countDirectChildren()
 	 * method.
 	 *
+	 * Unlike the other counters, this is still an 'int': It is used as
+	 * the row count of the DirTreeModel which can't be larger anyway.
+	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
 	virtual int directChildrenCount() Q_DECL_OVERRIDE;
@@ -173,7 +179,7 @@ namespace QDirStat
 	 *
 	 * Reimplemented - inherited from FileInfo.
 	 **/
-	virtual int errSubDirCount() Q_DECL_OVERRIDE;
+	virtual FileCount errSubDirCount() Q_DECL_OVERRIDE;
 
 	/**
 	 * Returns the latest modification time of this subtree.
@@ -255,7 +261,24 @@ namespace QDirStat
 	 * Use the child's next() method to get the next child.
 	 **/
 	virtual FileInfo * firstChild() const Q_DECL_OVERRIDE
-	    { return _firstChild;	}
+	    { if ( _isSpilled ) pageIn(); return _firstChild; }
+
+	/**
+	 * Return 'true' if this item has any children (including a dot
+	 * entry). This does not page in a spilled subtree.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual bool hasChildren() const Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if the children of this directory were moved out of
+	 * memory to the tree's SubtreeStore. All the sums are still valid.
+	 *
+	 * Accessing the children with firstChild(), dotEntry() or attic()
+	 * transparently moves them back into memory.
+	 **/
+	bool isSpilled() const { return _isSpilled; }
 
 	/**
 	 * Set this entry's first child.
@@ -264,7 +287,7 @@ namespace QDirStat
 	 * Reimplemented - inherited from FileInfo.
 	 **/
 	virtual void setFirstChild( FileInfo * newfirstChild ) Q_DECL_OVERRIDE
-	    { _firstChild = newfirstChild; }
+	    { _firstChild = newfirstChild; dropNameIndex(); }
 
 	/**
 	 * Insert a child into the children list.
@@ -274,6 +297,16 @@ namespace QDirStat
 	 **/
 	virtual void insertChild( FileInfo * newChild ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Insert a number of new children at once. This has the same result
+	 * as calling insertChild() for each of them, but the sums of the
+	 * ancestors and their sort caches are only updated once.
+	 *
+	 * This is meant for newly created children, i.e. directories that
+	 * don't have any children yet.
+	 **/
+	void insertChildren( const FileInfoList & newChildren );
+
 	/**
 	 * Add a child to the attic. This is very much like insertChild(), but
 	 * it inserts the child into the appropriate attic instead (and sets
@@ -297,7 +330,7 @@ namespace QDirStat
 	 * itself and which are the accumulated values of the entire subtree.
 	 **/
 	virtual DotEntry * dotEntry() const Q_DECL_OVERRIDE
-	    { return _dotEntry; }
+	    { if ( _isSpilled ) pageIn(); return _dotEntry; }
 
 	/**
 	 * Return the dot entry for this node. If it doesn't have one yet,
@@ -321,7 +354,7 @@ namespace QDirStat
 	 * Reimplemented - inherited from FileInfo.
 	 **/
 	virtual Attic * attic() const Q_DECL_OVERRIDE
-	    { return _attic; }
+	    { if ( _isSpilled ) pageIn(); return _attic; }
 
 	/**
 	 * Return the attic for this node. If it doesn't have one yet, create
@@ -450,16 +483,205 @@ namespace QDirStat
 	 * This might return cached information if all parameters are the same
 	 * as for the last call to this function, and there were no children
 	 * added or removed in the meantime.
+	 *
+	 * If 'minRows' is not negative, only the first 'minRows' entries of
+	 * the list are guaranteed to be in their final sort order; the rest
+	 * is sorted lazily by subsequent calls with a larger 'minRows'. This
+	 * is much cheaper for huge directories where only the first few rows
+	 * are ever visible. The default (-1) sorts the complete list.
 	 **/
 	const FileInfoList & sortedChildren( DataColumn	   sortCol,
 					     Qt::SortOrder sortOrder,
-					     bool	   includeAttic = false );
+					     bool	   includeAttic = false,
+					     int	   minRows	= -1 );
+
+	/**
+	 * Return the row of 'child' in the list returned by the last
+	 * sortedChildren() call or -1 if 'child' is not in that list or if
+	 * its position is not final yet (i.e. it is not in the part of the
+	 * list that is already sorted).
+	 **/
+	int sortedRow( FileInfo * child ) const;
+
+	/**
+	 * Return 'true' if there is a cached sorted children list.
+	 **/
+	bool hasSortCache() const { return _sortedChildren != 0; }
+
+	/**
+	 * Return the number of entries in the sort cache (0 if there is none).
+	 **/
+	int sortCacheSize() const
+	    { return _sortedChildren ? _sortedChildren->size() : 0; }
+
+	/**
+	 * Return the stamp of the last use of the sort cache. The DirTree
+	 * uses this to drop the least recently used sort caches.
+	 **/
+	quint64 sortCacheStamp() const { return _sortCacheStamp; }
 
 	/**
 	 * Drop all cached information about children sorting.
 	 **/
 	void dropSortCache( bool recursive = false );
 
+	/**
+	 * Return 'true' if the sort order of the children for 'sortCol' does
+	 * not change when something is added further down in their subtrees,
+	 * i.e. if it only depends on the children's own attributes.
+	 **/
+	static bool isSubtreeIndependentCol( DataColumn sortCol );
+
+	/**
+	 * Append the full URL of this directory to 'buffer'.
+	 *
+	 * If the tree caches directory URLs (see DirTree::setCacheDirUrls()),
+	 * this uses the cached URL if it is still valid, and it caches it
+	 * otherwise.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual void appendUrl( QString & buffer ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Drop the cached URL of this directory.
+	 **/
+	void dropUrlCache( bool recursive = false );
+
+	/**
+	 * Return the pre-order label of this directory or 0 if it doesn't
+	 * have one (see DirTree::ensureLabels()).
+	 *
+	 * If the labels of the tree are valid, a labelled directory 'dir' is
+	 * in the subtree of a labelled directory 'subtree' if and only if
+	 *
+	 *   subtree->preOrder() <= dir->preOrder() &&
+	 *   dir->postOrder()	 <= subtree->postOrder()
+	 **/
+	quint32 preOrder() const { return _preOrder; }
+
+	/**
+	 * Return the post-order label of this directory or 0 if it doesn't
+	 * have one.
+	 **/
+	quint32 postOrder() const { return _postOrder; }
+
+	/**
+	 * Return 'true' if this directory has pre-order and post-order
+	 * labels.
+	 **/
+	bool isLabelled() const { return _preOrder > 0; }
+
+	/**
+	 * Drop the labels of this directory. This is needed when it is
+	 * detached from the tree to be deleted (see TreeReclaimer): Otherwise
+	 * it might still look like it is in the subtree of a labelled
+	 * directory after the next ensureLabels(). The labels of its
+	 * descendants are left alone; they are not reachable from the tree
+	 * anymore, and nothing may use them until they are deleted.
+	 **/
+	void dropLabels() { _preOrder = _postOrder = _nextLabel = 0; }
+
+	/**
+	 * Assign pre-order and post-order labels to this directory and all
+	 * directories, dot entries and attics below it, starting with 'next'.
+	 * Each real directory keeps a gap of 'gap' unused labels for
+	 * directories that are added later (see labelNewChild()).
+	 *
+	 * This does not page in any spilled subtrees; their items simply
+	 * don't get any labels.
+	 *
+	 * Return the next unused label.
+	 **/
+	quint32 assignLabels( quint32 next, quint32 gap );
+
+	/**
+	 * Minimum number of labels for a new directory: Pre-order and
+	 * post-order label, its dot entry and at least one more for its own
+	 * gap.
+	 **/
+	enum { MinLabelRange = 4 };
+
+	/**
+	 * Assign labels to a newly inserted directory 'newChild' (and its dot
+	 * entry) from the gap of this directory. Return 'false' if this
+	 * directory doesn't have any labels or if its gap is used up.
+	 **/
+	bool labelNewChild( DirInfo * newChild );
+
+	/**
+	 * Make sure this directory has an index of the names of its children
+	 * (only those in the children list, not in the dot entry or the
+	 * attic) if it has a lot of them. Return 'true' if there is one.
+	 *
+	 * The index is built when it is needed for the first time. It is
+	 * kept up to date when children are inserted, and it is dropped when
+	 * any child is removed.
+	 **/
+	bool ensureNameIndex();
+
+	/**
+	 * Return the child with name 'name' from the name index or 0 if
+	 * there is no such child or no name index. Use ensureNameIndex()
+	 * first.
+	 **/
+	FileInfo * indexedChild( const QString & name ) const
+	    { return _nameIndex ? _nameIndex->value( name, 0 ) : 0; }
+
+	/**
+	 * Drop the name index.
+	 **/
+	void dropNameIndex();
+
+	/**
+	 * Return the generation of this directory: A number that changes
+	 * whenever anything in this subtree changes, i.e. when any item is
+	 * added, removed or moved or when any sums change.
+	 *
+	 * Generation numbers are never used twice, so anything derived from
+	 * this subtree can be cached together with the subtree and its
+	 * generation (see MemoCache): It is still valid as long as the
+	 * subtree still has the same generation.
+	 *
+	 * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual quint64 generation() const Q_DECL_OVERRIDE
+	    { return _generation; }
+
+	/**
+	 * Give this directory and all its ancestors a new generation.
+	 **/
+	void markChanged();
+
+	/**
+	 * Return a new generation number.
+	 **/
+	static quint64 nextGeneration();
+
+	/**
+	 * Return a digest of this subtree: A 64 bit hash of the name, type,
+	 * size and mtime of each child (including the files in the dot
+	 * entry, but not the ignored ones in the attic) and of the digest of
+	 * each subdirectory.
+	 *
+	 * If two subtrees have the same digest, nothing below them is
+	 * different (with a very high probability), so a comparison can stop
+	 * right there. The digest does not depend on the order of the
+	 * children, and it is the same for a subtree that was read from disk
+	 * and one that was read from a cache file.
+	 *
+	 * It is calculated when it is needed and kept until anything in this
+	 * subtree changes (see generation()). This pages in a spilled
+	 * subtree unless hasDigest().
+	 **/
+	quint64 digest();
+
+	/**
+	 * Return 'true' if the digest of this subtree is already known,
+	 * i.e. if digest() will not have to look at any children.
+	 **/
+	bool hasDigest() const { return _digestGeneration == _generation; }
+
 	/**
 	 * Check if this directory is locked. This is purely a user lock
 	 * that can be used by the application. The DirInfo does not care
@@ -479,6 +701,12 @@ namespace QDirStat
 
 	/**
 	 * Recursively delete all children, including the dot entry.
+	 *
+	 * The sums of the ancestors of this directory are updated accordingly,
+	 * so they remain valid without a recalc().
+	 *
+	 * The children are only detached here; they are deleted in the
+	 * background (see DirTree::reclaim()).
 	 **/
 	void clear();
 
@@ -588,6 +816,148 @@ namespace QDirStat
          **/
         void findDominantChildren();
 
+	/**
+	 * Extend the part of the sort cache that is in its final order to at
+	 * least 'minRows' entries (all entries if 'minRows' is negative).
+	 **/
+	void extendSortedRows( int minRows );
+
+	/**
+	 * Insert the direct children 'newChildren' into the existing sort
+	 * cache at the positions where a complete re-sort would put them.
+	 * Return 'false' if that is not possible; the caller has to drop the
+	 * sort cache then.
+	 **/
+	bool insertIntoSortCache( const FileInfoList & newChildren );
+
+	/**
+	 * Update the row numbers of the entries 'from' to 'to' (exclusive) in
+	 * the sort cache.
+	 **/
+	void updateRowNumbers( int from, int to );
+
+	/**
+	 * Summary values that a subtree contributes to the sums of its
+	 * ancestors.
+	 **/
+	struct Summary
+	{
+	    Summary();
+
+	    /**
+	     * Add the values of 'other' to this one.
+	     **/
+	    void add( const Summary & other );
+
+	    FileSize	size;
+	    FileSize	allocatedSize;
+	    FileSize	blocks;
+	    FileCount	items;
+	    FileCount	subDirs;
+	    FileCount	files;
+	    FileCount	ignoredItems;
+	    FileCount	unignoredItems;
+	    FileCount	errSubDirs;
+	    time_t	latestMtime;
+	    time_t	oldestFileMtime;
+	};
+
+	/**
+	 * Add what 'child' contributes to the sums of its parent to 'sum'.
+	 * This uses the same rules as recalc().
+	 **/
+	static void addContribution( Summary & sum, FileInfo * child );
+
+	/**
+	 * Subtract 'delta' from the sums of this directory and all its
+	 * ancestors. This is what makes deleting a child or clearing a subtree
+	 * cheap: No recalc() of the ancestors is needed afterwards.
+	 *
+	 * Only the latest and oldest mtimes cannot be updated by simple
+	 * subtraction; they are marked as dirty if 'delta' might have
+	 * contained the latest or the oldest one, and they are lazily
+	 * recalculated on the next access (see recalcMtimes()).
+	 *
+	 * Since ignored items are not added to all sums in all cases (see
+	 * childAdded()), if 'ignored' is true or there is an attic in the
+	 * ancestors, this falls back to marking the summaries as dirty.
+	 **/
+	void subtractFromSummary( const Summary & delta, bool ignored );
+
+	/**
+	 * Link 'newChild' into the children of this directory itself (not
+	 * its dot entry) and into the name index and label it if it is a
+	 * directory. This does not update any sums; insertChild() and
+	 * insertChildren() do that.
+	 **/
+	void linkChild( FileInfo * newChild );
+
+	/**
+	 * Add what a new, unignored 'child' contributes to the sums of its
+	 * parent and all further ancestors to 'sum'. childAdded() uses this
+	 * as well as insertChildren().
+	 **/
+	static void addNewChild( Summary & sum, FileInfo * child );
+
+	/**
+	 * Add 'delta' to the sums of this directory (only this one, not the
+	 * ancestors). 'directChildren' is the number of new direct children.
+	 **/
+	void addToSummary( const Summary & delta, int directChildren );
+
+	/**
+	 * Update the sort cache after 'newChildren' were added somewhere in
+	 * this subtree: Insert the direct children, keep the cache if the
+	 * order can't change, or drop it.
+	 **/
+	void sortCacheChildrenAdded( const FileInfoList & newChildren );
+
+	/**
+	 * Mark the summary of this directory and all its ancestors as dirty.
+	 **/
+	void markSummaryDirty();
+
+	/**
+	 * Recalculate only the latest and oldest mtime from the direct
+	 * children. This is much cheaper than a complete recalc() since the
+	 * other sums are still valid.
+	 **/
+	void recalcMtimes();
+
+	/**
+	 * Delete all children, including the dot entry and the attic, without
+	 * updating the summaries of the ancestors.
+	 **/
+	void deleteChildren();
+
+	/**
+	 * Like deleteChildren(), but only detach all children and hand them
+	 * over to the tree for deletion in the background.
+	 **/
+	void reclaimChildren();
+
+	/**
+	 * Move the children of a spilled directory back into memory.
+	 *
+	 * This is 'const' since it is called from the const accessors for
+	 * the children; logically, this object does not change.
+	 **/
+	void pageIn() const;
+
+	// SubtreeStore saves and restores the sums and the children list
+	friend class SubtreeStore;
+
+	/**
+	 * Remove 'child' from the children list without touching any sums.
+	 * Return 'true' if successful, 'false' if it was not found.
+	 **/
+	bool removeFromChildrenList( FileInfo * child );
+
+	/**
+	 * Calculate the digest of this subtree from its children.
+	 **/
+	quint64 calcDigest();
+
 
 	//
 	// Data members
@@ -596,9 +966,11 @@ namespace QDirStat
 	bool		_isMountPoint:1;	// Flag: is this a mount point?
 	bool		_isExcluded:1;		// Flag: was this directory excluded?
 	bool		_summaryDirty:1;	// dirty flag for the cached values
+	bool		_mtimeDirty:1;		// dirty flag for the latest / oldest mtime
 	bool		_deletingAll:1;		// Deleting complete children tree?
 	bool		_locked:1;		// App lock
 	bool		_touched:1;		// App 'touch' flag
+	bool		_isSpilled:1;		// Children are in the SubtreeStore
 	int		_pendingReadJobs;	// number of open directories in this subtree
 
 	// Children management
@@ -612,13 +984,13 @@ namespace QDirStat
 	FileSize	_totalSize;
 	FileSize	_totalAllocatedSize;
 	FileSize	_totalBlocks;
-	int		_totalItems;
-	int		_totalSubDirs;
-	int		_totalFiles;
-	int		_totalIgnoredItems;
-	int		_totalUnignoredItems;
+	FileCount	_totalItems;
+	FileCount	_totalSubDirs;
+	FileCount	_totalFiles;
+	FileCount	_totalIgnoredItems;
+	FileCount	_totalUnignoredItems;
 	int		_directChildrenCount;
-	int		_errSubDirCount;
+	FileCount	_errSubDirCount;
 	time_t		_latestMtime;
 	time_t		_oldestFileMtime;
 
@@ -627,9 +999,24 @@ namespace QDirStat
 	DataColumn	_lastSortCol;
 	Qt::SortOrder	_lastSortOrder;
 	bool		_lastIncludeAttic;
+	int		_sortedRows;		// rows in final order in _sortedChildren
+	int		_sortableRows;		// rows in _sortedChildren without the attic
+	quint64		_sortCacheStamp;	// for LRU eviction by the DirTree
 
 	DirReadState	_readState;
 
+	mutable QString * _cachedUrl;
+	mutable quint32	_cachedUrlGeneration;
+
+	quint32		_preOrder;		// see DirTree::ensureLabels()
+	quint32		_postOrder;
+	quint32		_nextLabel;		// first unused label in the gap
+	quint64		_generation;		// changes with any change below
+	quint64		_digest;		// see digest()
+	quint64		_digestGeneration;
+
+	QHash<QString, FileInfo *> * _nameIndex; // see ensureNameIndex()
+
 
     private:
 
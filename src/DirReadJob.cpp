@@ -18,6 +18,7 @@
 #include "DirTree.h"
 #include "DirInfo.h"
 #include "DirTreeCache.h"
+#include "AggregateInfo.h"
 #include "ExcludeRules.h"
 #include "MountPoints.h"
 #include "Exception.h"
@@ -98,6 +99,12 @@ void DirReadJob::childAdded( FileInfo *newChild )
 }
 
 
+void DirReadJob::childrenAdded( DirInfo * parent, const FileInfoList & newChildren )
+{
+    _tree->childrenAddedNotify( parent, newChildren );
+}
+
+
 void DirReadJob::deletingChild( FileInfo *deletedChild )
 {
     _tree->deletingChildNotify( deletedChild );
@@ -197,6 +204,7 @@ LocalDirReadJob::LocalDirReadJob( DirTree * tree,
 				  DirInfo * dir ):
     DirReadJob( tree, dir ),
     _applyFileChildExcludeRules( false ),
+    _aggregate( true ),
     _checkedForNtfs( false ),
     _isNtfs( false )
 {
@@ -253,6 +261,10 @@ void LocalDirReadJob::startReading()
 #endif
 
 	QMultiMap<ino_t, QString> entryMap;
+	FileSize	aggregateLimit = aggregateMaxSize();
+	AggregateInfo * aggregate      = 0;
+	FileInfoList	newChildren;	// Not yet inserted into _dir
+	QList<DirInfo *> subDirs;	// Not yet processed
 
 	while ( ( entry = readdir( diskDir ) ) )
 	{
@@ -284,8 +296,8 @@ void LocalDirReadJob::startReading()
 		    DirInfo *subDir = new DirInfo( entryName, &statInfo, _tree, _dir );
 		    CHECK_NEW( subDir );
 
-		    processSubDir( entryName, subDir );
-
+		    newChildren << subDir;
+		    subDirs	<< subDir;
 		}
 		else  // non-directory child
 		{
@@ -293,6 +305,11 @@ void LocalDirReadJob::startReading()
 		    {
 			logDebug() << "Found cache file " << defaultCacheName << endl;
 
+			// Make the partially read directory content complete so
+			// it can be cleaned up properly if the cache file is used.
+
+			insertNewChildren( newChildren );
+
 			// Try to read the cache file. If that was successful and the toplevel
 			// path in that cache file matches the path of the directory we are
 			// reading right now, the directory is finished reading, the read job
@@ -300,7 +317,12 @@ void LocalDirReadJob::startReading()
 			// member variables; just return.
 
 			if ( readCacheFile( entryName ) )
+			{
+			    if ( aggregate )
+				delete aggregate;
+
 			    return;
+			}
 		    }
 
 #if DONT_TRUST_NTFS_HARD_LINKS
@@ -325,18 +347,35 @@ void LocalDirReadJob::startReading()
                         statInfo.st_nlink = 1;
                     }
 #endif
+		    bool ignore = checkIgnoreFilters( entryName );
+
+		    if ( ! ignore && aggregateLimit != 0 && S_ISREG( statInfo.st_mode ) &&
+			 ( aggregateLimit < 0 || statInfo.st_size < aggregateLimit ) )
+		    {
+			// Only count this file, don't keep a node for it
+
+			if ( ! aggregate )
+			{
+			    aggregate = new AggregateInfo( _tree, _dir );
+			    CHECK_NEW( aggregate );
+			}
+
+			FileInfo file( entryName, &statInfo, _tree, _dir );
+			aggregate->add( &file );
+			continue;
+		    }
+
 		    FileInfo * child = new FileInfo( entryName, &statInfo, _tree, _dir );
 		    CHECK_NEW( child );
 
-		    if ( checkIgnoreFilters( entryName ) )
+		    if ( ignore )
 		    {
 			// logDebug() << "Ignoring " << child << endl;
 			_dir->addToAttic( child );
+			childAdded( child );
 		    }
 		    else
-			_dir->insertChild( child );
-
-		    childAdded( child );
+			newChildren << child;
 		}
 	    }
 	    else  // lstat() error
@@ -348,6 +387,22 @@ void LocalDirReadJob::startReading()
 	closedir( diskDir );
 	DirReadState readState = DirFinished;
 
+	// Insert all new children at once: This updates the sums of all
+	// ancestors only once, not once for each child.
+
+	insertNewChildren( newChildren );
+
+	foreach ( DirInfo * subDir, subDirs )
+	    processSubDir( subDir->name(), subDir );
+
+	if ( aggregate )
+	{
+	    // Add it only now that all sums are complete
+
+	    _dir->insertChild( aggregate );
+	    childAdded( aggregate );
+	}
+
 	//
 	// Check all entries against exclude rules that match against any
 	// direct non-directory entry.
@@ -392,11 +447,19 @@ void LocalDirReadJob::finishReading( DirInfo * dir, DirReadState readState )
 }
 
 
-void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir )
+void LocalDirReadJob::insertNewChildren( FileInfoList & newChildren )
 {
-    _dir->insertChild( subDir );
-    childAdded( subDir );
+    if ( newChildren.isEmpty() )
+	return;
+
+    _dir->insertChildren( newChildren );
+    childrenAdded( _dir, newChildren );
+    newChildren.clear();
+}
+
 
+void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir )
+{
     // On macOS, /System/Volumes/Data is the APFS data volume that backs the
     // firmlinks at /Users, /Applications, /Library, etc. Walking into it
     // re-counts everything already read via the firmlinks. The existing
@@ -419,6 +482,7 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
 	    LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
 	    CHECK_NEW( job );
 	    job->setApplyFileChildExcludeRules( true );
+	    job->setAggregate( _aggregate );
 	    _tree->addJob( job );
 	}
 	else	    // The subdirectory we just found is a mount point.
@@ -430,6 +494,7 @@ void LocalDirReadJob::processSubDir( const QString & entryName, DirInfo * subDir
 		LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
 		CHECK_NEW( job );
 		job->setApplyFileChildExcludeRules( true );
+		job->setAggregate( _aggregate );
 		_tree->addJob( job );
 	    }
 	    else
@@ -455,6 +520,31 @@ bool LocalDirReadJob::matchesExcludeRule( const QString & entryName ) const
 }
 
 
+FileSize LocalDirReadJob::aggregateMaxSize() const
+{
+    if ( ! _aggregate || ! _tree->aggregationEnabled() )
+	return 0;
+
+    // Exclude rules that check the direct file children of a directory
+    // need the names of those files, so don't aggregate anything then.
+
+    if ( _applyFileChildExcludeRules &&
+	 ExcludeRules::instance()->hasFileChildRules() )
+    {
+	return 0;
+    }
+
+    int minDepth = _tree->aggregateMinDepth();
+
+    // treeLevel() of the starting directory is 1 (below the invisible root)
+
+    if ( minDepth >= 0 && _dir->treeLevel() - 1 >= minDepth )
+	return -1;
+
+    return _tree->aggregateMaxSize();
+}
+
+
 bool LocalDirReadJob::checkIgnoreFilters( const QString & entryName ) const
 {
     if ( ! _tree->hasFilters() )
@@ -507,7 +597,7 @@ bool LocalDirReadJob::readCacheFile( const QString & cacheFileName )
 	    // All data members of this object are invalid from here on!
 
 	    logDebug() << "Deleting subtree " << dir << endl;
-	    tree->deleteSubtree( dir );
+	    tree->deleteSubtree( dir, true );	// Replaced by the cache file
 	}
 
 	return true;
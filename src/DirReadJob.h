@@ -118,6 +118,12 @@ namespace QDirStat
 	 **/
 	void childAdded( FileInfo *newChild );
 
+	/**
+	 * Notification that a number of new children has been added to
+	 * 'parent' at once with DirInfo::insertChildren().
+	 **/
+	void childrenAdded( DirInfo * parent, const FileInfoList & newChildren );
+
 	/**
 	 * Notification that a child is about to be deleted.
 	 *
@@ -245,6 +251,21 @@ namespace QDirStat
 	void setApplyFileChildExcludeRules( bool val )
 	    { _applyFileChildExcludeRules = val; }
 
+	/**
+	 * Return 'true' if small files may be aggregated according to the
+	 * aggregation settings of the DirTree (see
+	 * DirTree::setAggregation()). This is inherited by the read jobs for
+	 * subdirectories.
+	 *
+	 * The default is 'true'.
+	 **/
+	bool aggregate() const { return _aggregate; }
+
+	/**
+	 * Set the aggregate flag.
+	 **/
+	void setAggregate( bool val ) { _aggregate = val; }
+
     protected:
 
 	/**
@@ -261,7 +282,14 @@ namespace QDirStat
 	void finishReading( DirInfo * dir, DirReadState readState );
 
 	/**
-	 * Process one subdirectory entry.
+	 * Insert 'newChildren' into the directory of this job at once, send
+	 * the corresponding notification and clear the list.
+	 **/
+	void insertNewChildren( FileInfoList & newChildren );
+
+	/**
+	 * Process one subdirectory entry. 'subDir' has to be inserted into
+	 * the directory of this job already.
 	 **/
 	void processSubDir( const QString & entryName,
 			    DirInfo	  * subDir    );
@@ -277,6 +305,12 @@ namespace QDirStat
 	 **/
 	bool checkIgnoreFilters( const QString & entryName ) const;
 
+	/**
+	 * Return the size limit for files that are aggregated in this
+	 * directory: 0 for none, -1 for all regular files.
+	 **/
+	FileSize aggregateMaxSize() const;
+
 	/**
 	 * Read a cache file that was picked up along the way:
 	 *
@@ -326,6 +360,7 @@ namespace QDirStat
 
 	QString _dirName;
 	bool	_applyFileChildExcludeRules;
+	bool	_aggregate;
 	bool	_checkedForNtfs;
 	bool	_isNtfs;
 
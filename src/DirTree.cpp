@@ -7,16 +7,24 @@
  */
 
 
+#include <unistd.h>	// sysconf()
+
 #include <QDir>
 #include <QFileInfo>
+#include <QTimer>
 
 #include "DirTree.h"
 #include "DirTreeCache.h"
+#include "CacheIndex.h"
+#include "CacheJournal.h"
 #include "DirTreeFilter.h"
 #include "DotEntry.h"
 #include "Attic.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSet.h"
+#include "TreeColumns.h"
+#include "SubtreeStore.h"
+#include "TreeReclaimer.h"
 #include "ExcludeRules.h"
 #include "PkgReader.h"
 #include "MountPoints.h"
@@ -26,6 +34,17 @@
 
 #define VERBOSE_EXCLUDE_RULES	1
 
+// Minimum number of items in a subtree to be moved out of memory
+#define MIN_SPILL_ITEMS		1000
+
+// Number of unused labels that each directory keeps for new subdirectories
+#define MAX_LABEL_GAP		64
+
+// Maximum number of changed directories to update the snapshot for instead
+// of building it again
+#define MAX_SNAPSHOT_CHANGES	1000
+
+
 using namespace QDirStat;
 
 
@@ -34,10 +53,36 @@ DirTree::DirTree():
     _excludeRules( 0 ),
     _beingDestroyed( false ),
     _haveClusterSize( false ),
-    _blocksPerCluster( 1 )
+    _blocksPerCluster( 1 ),
+    _epoch( 1 ),
+    _cacheDirUrls( false ),
+    _dirUrlGeneration( 1 ),
+    _labelsValid( false ),
+    _labelsComplete( false ),
+    _sortCacheItems( 0 ),
+    _sortCacheBudget( 0 ),
+    _sortCacheStamp( 0 ),
+    _subtreeStore( 0 ),
+    _maxResidentItems( 0 ),
+    _memoryBudget( 0 ),
+    _residentNodes( 0 ),
+    _spillEnabled( false ),
+    _spillPending( false ),
+    _reclaimer( 0 ),
+    _cacheUseZstd( false ),
+    _cacheCompressionLevel( -1 ),
+    _lazyCacheLoading( false ),
+    _rereadCachePending( false ),
+    _cacheWriter( 0 ),
+    _temporaryCache( false ),
+    _incrementalCache( false ),
+    _journal( 0 ),
+    _refreshFoundNoChanges( false )
 {
     _isBusy	      = false;
     _crossFilesystems = false;
+    _aggregateMaxSize  = 0;
+    _aggregateMinDepth = -1;
     _root = new DirInfo( this );
     CHECK_NEW( _root );
 
@@ -46,16 +91,44 @@ DirTree::DirTree():
 
     connect( this,	  SIGNAL( deletingChild	     ( FileInfo * ) ),
 	     & _jobQueue, SLOT	( deletingChildNotify( FileInfo * ) ) );
+
+    // The background cache writer can't cope with any change of the tree
+
+    connect( this, SIGNAL( clearing()			 ),
+	     this, SLOT	 ( abortWritingCache()		 ) );
+
+    connect( this, SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this, SLOT	 ( abortWritingCache()		 ) );
+
+    connect( this, SIGNAL( clearingSubtree( DirInfo * )  ),
+	     this, SLOT	 ( abortWritingCache()		 ) );
+
+    connect( this, SIGNAL( startingReading()		 ),
+	     this, SLOT	 ( abortWritingCache()		 ) );
+
+    connect( this, SIGNAL( startingReading( DirInfo * )  ),
+	     this, SLOT	 ( abortWritingCache()		 ) );
 }
 
 
 DirTree::~DirTree()
 {
     _beingDestroyed = true;
+    dropColumns();
+
+    if ( _cacheWriter )
+	delete _cacheWriter;	// This stops writing and removes the file
+
+    dropJournal();
+
+    if ( _reclaimer )
+	delete _reclaimer;	// This waits until all pending subtrees are deleted
 
     if ( _root )
 	delete _root;
 
+    dropSubtreeStore();
+
     if ( _excludeRules )
 	delete _excludeRules;
 
@@ -65,6 +138,8 @@ DirTree::~DirTree()
 
 void DirTree::setRoot( DirInfo *newRoot )
 {
+    dropColumns();
+
     if ( _root )
     {
 	emit deletingChild( _root );
@@ -72,6 +147,9 @@ void DirTree::setRoot( DirInfo *newRoot )
 	emit childDeleted();
     }
 
+    dropSubtreeStore();
+    invalidateLabels();
+
     _root = newRoot;
 
     FileInfo * realRoot = firstToplevel();
@@ -111,6 +189,7 @@ QString DirTree::url() const
 void DirTree::clear()
 {
     _jobQueue.clear();
+    dropColumns();
 
     if ( _root )
     {
@@ -118,7 +197,14 @@ void DirTree::clear()
 	_root->clear();
     }
 
+    dropSubtreeStore();
+    dropJournal();
+    invalidateLabels();
+    _refreshDigests.clear();
+    _refreshFoundNoChanges = false;
+
     _isBusy	      = false;
+    _spillEnabled     = false;
     _haveClusterSize  = false;
     _blocksPerCluster = 1;
     _device.clear();
@@ -147,6 +233,12 @@ void DirTree::startReading( const QString & rawUrl )
 	clear();
 
     _isBusy = true;
+    _refreshFoundNoChanges = false;
+
+    // With filters, the tree is traversed completely when reading is
+    // finished, so spilling would not help until then.
+
+    _spillEnabled = ! hasFilters();
     emit startingReading();
 
     FileInfo * item = LocalDirReadJob::stat( _url, this, _root );
@@ -180,21 +272,27 @@ void DirTree::startReading( const QString & rawUrl )
 
 void DirTree::refresh( const FileInfoSet & refreshSet )
 {
-    FileInfoSet items = refreshSet.invalidRemoved().normalized();
+    // Refreshing a directory hands its old subtree over to the reclaimer
+    // thread right away, so none of the directories may be in the subtree
+    // of another one that is refreshed before it: Those items can't even be
+    // checked anymore. This is why the directories are normalized here, not
+    // just the items.
+
+    FileInfoSet dirs;
 
-    foreach ( FileInfo * item, items )
+    foreach ( FileInfo * item, refreshSet.invalidRemoved() )
     {
-	// Need to check the magic number here again because a previous
-	// iteration step might have made the item invalid already
+	FileInfo * dir = item->isDirInfo() ? item : item->parent();
 
-	if ( item && item->checkMagicNumber() )
-	{
-	    if ( item->isDirInfo() )
-		refresh( item->toDirInfo() );
-	    else if ( item->parent() )
-		refresh( item->parent() );
-	}
+	if ( dir && dir->isDotEntry() )
+	    dir = dir->parent();
+
+	if ( dir )
+	    dirs << dir;
     }
+
+    foreach ( FileInfo * dir, dirs.normalized() )
+	refresh( dir->toDirInfo() );
 }
 
 
@@ -205,10 +303,10 @@ void DirTree::refresh( DirInfo * subtree )
 
     if ( ! subtree->checkMagicNumber() )
     {
-	// Not using CHECK_MAGIC() here which would throw an exception since
-	// this might easily happen after cleanup actions with multi selection
-	// if one selected item is in the subtree of another, and that parent
-	// was already refreshed.
+	// Not using CHECK_MAGIC() here which would throw an exception. This
+	// is only a last line of defence: The callers make sure not to pass
+	// any items of subtrees that were deleted, i.e. handed over to the
+	// reclaimer (see refresh( FileInfoSet ) and Refresher).
 
 	logWarning() << "Item is no longer valid - not refreshing subtree" << endl;
 	return;
@@ -232,6 +330,12 @@ void DirTree::refresh( DirInfo * subtree )
     {
 	// logDebug() << "Refreshing subtree " << subtree << endl;
 
+	// Remember what the subtree was like to find out later if anything
+	// changed at all, but don't page it in just for that: 0 is unknown.
+
+	bool knownDigest = subtree->hasDigest() || ! subtree->isSpilled();
+	_refreshDigests.insert( subtree->url(), knownDigest ? subtree->digest() : 0 );
+
 	clearSubtree( subtree );
 
 	subtree->reset();
@@ -240,7 +344,14 @@ void DirTree::refresh( DirInfo * subtree )
 	_isBusy = true;
 	subtree->setReadState( DirReading );
 	emit startingReading();
-	addJob( new LocalDirReadJob( this, subtree ) );
+
+	// Refreshing a subtree is how the user gets the individual files
+	// back that were aggregated when the tree was read.
+
+	LocalDirReadJob * job = new LocalDirReadJob( this, subtree );
+	CHECK_NEW( job );
+	job->setAggregate( false );
+	addJob( job );
     }
 }
 
@@ -251,6 +362,10 @@ void DirTree::abortReading()
 	return;
 
     _jobQueue.abort();
+    _refreshDigests.clear();
+
+    if ( appendPendingRemovals() )
+	QTimer::singleShot( 0, this, SLOT( compactJournal() ) );
 
     _isBusy = false;
     emit aborted();
@@ -261,6 +376,7 @@ void DirTree::finalizeTree()
 {
     if ( _root && hasFilters() )
     {
+	dropColumns();
 	recalc( _root );
 	ignoreEmptyDirs( _root );
 	recalc( _root );
@@ -276,16 +392,63 @@ void DirTree::finalizeTree()
 void DirTree::slotFinished()
 {
     finalizeTree();
+
+    // Keep spilling: Anything that traverses the tree later pages in
+    // spilled subtrees again.
+
+    _spillEnabled = true;
+    checkRefreshedSubtrees();
     _isBusy = false;
+    enforceSortCacheBudget( 0 );
+    ensureLabels();
     emit finished();
 }
 
 
+void DirTree::checkRefreshedSubtrees()
+{
+    _refreshFoundNoChanges = ! _refreshDigests.isEmpty();
+    bool journalChanged	   = appendPendingRemovals();
+
+    for ( QHash<QString, quint64>::const_iterator it = _refreshDigests.constBegin();
+	  it != _refreshDigests.constEnd();
+	  ++it )
+    {
+	FileInfo * item = locate( it.key() );
+	DirInfo	 * dir	= item ? item->toDirInfo() : 0;
+
+	if ( dir && it.value() != 0 && dir->digest() == it.value() )
+	    logInfo() << "No changes in " << it.key() << endl;
+	else
+	{
+	    _refreshFoundNoChanges = false;
+
+	    if ( _journal )
+	    {
+		if ( dir )
+		    _journal->appendSubtree( dir );
+		else	// The subtree itself is gone
+		    _journal->appendRemoval( it.key() );
+
+		journalChanged = true;
+	    }
+	}
+    }
+
+    _refreshDigests.clear();
+
+    if ( journalChanged )
+	QTimer::singleShot( 0, this, SLOT( compactJournal() ) );
+}
+
+
 void DirTree::childAddedNotify( FileInfo * newChild )
 {
     if ( ! _haveClusterSize )
         detectClusterSize( newChild );
 
+    snapshotChanged( newChild->parent() );
+
     emit childAdded( newChild );
 
     if ( newChild->dotEntry() )
@@ -293,9 +456,30 @@ void DirTree::childAddedNotify( FileInfo * newChild )
 }
 
 
+void DirTree::childrenAddedNotify( DirInfo * parent, const FileInfoList & newChildren )
+{
+    if ( newChildren.isEmpty() )
+	return;
+
+    for ( int i=0; i < newChildren.size() && ! _haveClusterSize; ++i )
+	detectClusterSize( newChildren.at( i ) );
+
+    snapshotChanged( parent );
+
+    foreach ( FileInfo * newChild, newChildren )
+    {
+	emit childAdded( newChild );
+
+	if ( newChild->dotEntry() )
+	    emit childAdded( newChild->dotEntry() );
+    }
+}
+
+
 void DirTree::deletingChildNotify( FileInfo * deletedChild )
 {
     logDebug() << "Deleting child " << deletedChild << endl;
+    snapshotChanged( deletedChild->parent(), deletedChild );
     emit deletingChild( deletedChild );
 
     if ( deletedChild == _root )
@@ -309,11 +493,28 @@ void DirTree::childDeletedNotify()
 }
 
 
-void DirTree::deleteSubtree( FileInfo *subtree )
+void DirTree::deleteSubtree( FileInfo *subtree, bool replaced )
 {
     // logDebug() << "Deleting subtree " << subtree << endl;
     DirInfo * parent = subtree->parent();
 
+    // A toplevel item can't be replaced in the journal at all.
+
+    if ( _journal && ! replaced && parent && parent != _root )
+    {
+	// While reading, the journal gets the removal when reading is done:
+	// Its records have to be in the order of the changes, and the
+	// subtrees that are being read are appended only then.
+
+	if ( _isBusy )
+	    _pendingRemovals << subtree->url();
+	else
+	{
+	    _journal->appendRemoval( subtree->url() );
+	    QTimer::singleShot( 0, this, SLOT( compactJournal() ) );
+	}
+    }
+
     // Send notification to anybody interested (e.g., to attached views)
     deletingChildNotify( subtree );
 
@@ -359,12 +560,26 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 	parent->deletingChild( subtree );
     }
 
-    delete subtree;
-
     if ( subtree == _root )
     {
+	delete subtree;
 	_root = 0;
     }
+    else if ( subtree->isDirInfo() )
+    {
+	// Deleting a large subtree takes a while; leave that to the
+	// reclaimer thread.
+
+	releaseCaches( subtree );
+	subtree->setParent( 0 );
+	subtree->setNext( 0 );
+	subtree->toDirInfo()->dropLabels();
+	reclaim( subtree );
+    }
+    else
+    {
+	delete subtree;
+    }
 
     emit childDeleted();
 }
@@ -374,6 +589,7 @@ void DirTree::clearSubtree( DirInfo * subtree )
 {
     if ( subtree->hasChildren() )
     {
+	snapshotChanged( subtree, subtree );
 	emit clearingSubtree( subtree );
 	subtree->clear();
 	emit subtreeCleared( subtree );
@@ -381,6 +597,46 @@ void DirTree::clearSubtree( DirInfo * subtree )
 }
 
 
+void DirTree::reclaim( FileInfo * first )
+{
+    if ( ! first )
+	return;
+
+    if ( ! _reclaimer )
+    {
+	_reclaimer = new TreeReclaimer();
+	CHECK_NEW( _reclaimer );
+    }
+
+    _reclaimer->reclaim( first );
+}
+
+
+void DirTree::releaseCaches( FileInfo * subtree, bool includeSubtree )
+{
+    // The sort caches register with the tree, so dropping them on the
+    // reclaimer thread would mean accessing the tree from there.
+
+    QList<DirInfo *> dirs;
+
+    for ( QHash<DirInfo *, int>::const_iterator it = _sortCacheDirs.constBegin();
+	  it != _sortCacheDirs.constEnd();
+	  ++it )
+    {
+	DirInfo * dir = it.key();
+
+	if ( ( includeSubtree || dir != subtree ) && dir->isInSubtree( subtree ) )
+	    dirs << dir;
+    }
+
+    foreach ( DirInfo * dir, dirs )
+	dir->dropSortCache(); // this calls sortCacheDropped()
+
+    if ( _subtreeStore )
+	_subtreeStore->discardSubtree( subtree, includeSubtree );
+}
+
+
 void DirTree::addJob( DirReadJob * job )
 {
     _jobQueue.enqueue( job );
@@ -430,6 +686,26 @@ void DirTree::sendReadJobFinished( DirInfo * dir )
 {
     // logDebug() << dir << endl;
     emit readJobFinished( dir );
+    checkResidentItems();
+}
+
+
+void DirTree::checkResidentItems()
+{
+    if ( _spillPending )
+	return;
+
+    FileCount resident = residentItems();
+
+    if ( ( _spillEnabled && _maxResidentItems > 0 && resident > _maxResidentItems ) ||
+	 ( _memoryBudget > 0 && resident * bytesPerItem() > _memoryBudget ) )
+    {
+	// Not right now: The read job that sent this might still need the
+	// subtree.
+
+	_spillPending = true;
+	QTimer::singleShot( 0, this, SLOT( limitResidentItems() ) );
+    }
 }
 
 
@@ -453,13 +729,172 @@ FileInfo * DirTree::locate( QString url, bool findPseudoDirs )
 
 bool DirTree::writeCache( const QString & cacheFileName )
 {
+    readRestOfCache( cacheFileName );
+
     CacheWriter writer( cacheFileName.toUtf8(), this );
+
+    // Any journal of an older cache file with that name is obsolete now
+
+    if ( writer.ok() )
+	CacheJournal( cacheFileName, this ).remove();
+
     return writer.ok();
 }
 
 
+void DirTree::startWritingCache( const QString & cacheFileName,
+				 bool		 temporary )
+{
+    abortWritingCache();
+    readRestOfCache( cacheFileName );
+
+    _cacheWriter    = new CacheWriter( cacheFileName, this, true );
+    CHECK_NEW( _cacheWriter );
+    _temporaryCache = temporary;
+
+    connect( _cacheWriter, SIGNAL( progress	     ( FileCount, FileCount ) ),
+	     this,	   SIGNAL( cacheWriteProgress( FileCount, FileCount ) ) );
+
+    connect( _cacheWriter, SIGNAL( finished	      ( bool, bool ) ),
+	     this,	   SLOT	 ( cacheWriterFinished( bool, bool ) ) );
+}
+
+
+void DirTree::abortWritingCache()
+{
+    if ( _cacheWriter )
+	_cacheWriter->abort();	// This sends finished()
+}
+
+
+void DirTree::cacheWriterFinished( bool ok, bool aborted )
+{
+    CacheWriter * writer = _cacheWriter;
+
+    if ( ! writer )
+	return;
+
+    _cacheWriter = 0;
+    writer->deleteLater();
+
+    if ( _journal && writer->fileName() == _journal->compactionFileName() )
+    {
+	// Only compacting the journal, nothing the user asked for. Any
+	// change of the tree would have aborted writing, so the new cache
+	// file has everything that is in the journal.
+
+	if ( ok )
+	    _journal->finishCompaction();
+
+	return;
+    }
+
+    if ( ok && ! _temporaryCache )
+    {
+	CacheJournal( writer->fileName(), this ).remove();
+	startJournal( writer->fileName() );
+    }
+
+    emit cacheWriteFinished( writer->fileName(), ok, aborted );
+}
+
+
+void DirTree::compactJournal()
+{
+    if ( ! _journal || _cacheWriter || _isBusy || ! _journal->needsCompaction() )
+	return;
+
+    logInfo() << "Compacting " << _journal->fileName() << endl;
+
+    // Not with startWritingCache(): No progress reports for this
+
+    _cacheWriter = new CacheWriter( _journal->compactionFileName(), this, true );
+    CHECK_NEW( _cacheWriter );
+
+    connect( _cacheWriter, SIGNAL( finished	      ( bool, bool ) ),
+	     this,	   SLOT	 ( cacheWriterFinished( bool, bool ) ) );
+}
+
+
+void DirTree::startJournal( const QString & cacheFileName )
+{
+    dropJournal();
+
+    if ( ! _incrementalCache || cacheFileName.isEmpty() )
+	return;
+
+    _journal = new CacheJournal( cacheFileName, this );
+    CHECK_NEW( _journal );
+
+    logInfo() << "Appending changes to " << _journal->fileName() << endl;
+}
+
+
+void DirTree::dropJournal()
+{
+    if ( _journal )
+    {
+	delete _journal;
+	_journal = 0;
+    }
+
+    _pendingRemovals.clear();
+}
+
+
+bool DirTree::appendPendingRemovals()
+{
+    if ( ! _journal || _pendingRemovals.isEmpty() )
+	return false;
+
+    foreach ( const QString & url, _pendingRemovals )
+	_journal->appendRemoval( url );
+
+    _pendingRemovals.clear();
+
+    return true;
+}
+
+
+void DirTree::setCacheCompression( bool useZstd, int level )
+{
+    if ( useZstd && ! CacheFile::haveZstd() )
+    {
+	logWarning() << "Built without zstd support - using gzip for cache files" << endl;
+	useZstd = false;
+    }
+
+    _cacheUseZstd	   = useZstd;
+    _cacheCompressionLevel = level;
+}
+
+
 bool DirTree::readCache( const QString & cacheFileName )
 {
+    // The journal can only be replayed on a complete tree
+
+    CacheJournal journal( cacheFileName, this );
+    QString	 journalFileName = journal.fileName();
+    bool	 haveJournal	 = journal.exists();
+
+    if ( haveJournal && ! journal.matchesBase() )
+    {
+	// The cache file was written again without this journal, e.g. by
+	// qdirstat-cache-writer: The journal is older than the cache file.
+
+	logWarning() << "Ignoring " << journalFileName
+		     << ": It is not for the current " << cacheFileName << endl;
+
+	journal.remove();
+	haveJournal = false;
+    }
+
+    if ( _lazyCacheLoading && ! haveJournal && readCacheLazy( cacheFileName ) )
+    {
+	startJournal( cacheFileName );
+	return true;
+    }
+
     CacheReader * reader = new CacheReader( cacheFileName, this, 0 );
     CHECK_NEW( reader );
 
@@ -470,10 +905,127 @@ bool DirTree::readCache( const QString & cacheFileName )
     emit startingReading();
     addJob( new CacheReadJob( this, 0, cacheFileName ) );
 
+    if ( haveJournal )
+    {
+	logInfo() << "Replaying " << journalFileName << endl;
+	addJob( new CacheReadJob( this, 0, journalFileName ) );
+    }
+
+    startJournal( cacheFileName );
+
+    return true;
+}
+
+
+bool DirTree::readCacheLazy( const QString & cacheFileName )
+{
+    if ( hasFilters() || ! ExcludeRules::instance()->isEmpty() )
+	return false;
+
+    CacheIndex * index = new CacheIndex();
+    CHECK_NEW( index );
+
+    if ( ! index->open( cacheFileName ) )
+    {
+	delete index;
+	return false;
+    }
+
+    _isBusy = true;
+    emit startingReading();
+
+    if ( ! _subtreeStore )
+    {
+	_subtreeStore = new SubtreeStore( this );
+	CHECK_NEW( _subtreeStore );
+    }
+
+    _subtreeStore->setCacheIndex( index );
+    DirInfo * toplevel = _subtreeStore->addCacheToplevel( _root );
+
+    if ( ! toplevel )
+    {
+	logWarning() << "Can't use the directory index of " << cacheFileName << endl;
+
+	_subtreeStore->setCacheIndex( 0 );
+	_isBusy = false;
+
+	return false;
+    }
+
+    logInfo() << "Reading " << cacheFileName << " on demand: "
+	      << index->dirCount() << " directories" << endl;
+
+    // This also reads the first level from the cache file
+
+    childAddedNotify( toplevel );
+    sendReadJobFinished( toplevel );
+
+    // Not right away, just like with the job queue: The caller might not
+    // be ready for it yet.
+
+    QTimer::singleShot( 0, this, SLOT( slotFinished() ) );
+
     return true;
 }
 
 
+void DirTree::cacheFileChanged()
+{
+    if ( _rereadCachePending )
+	return;
+
+    // Not right now: This is called while paging in a subtree, i.e. from
+    // somewhere deep down in some traversal of the tree.
+
+    _rereadCachePending = true;
+    QTimer::singleShot( 0, this, SLOT( rereadChangedCache() ) );
+}
+
+
+void DirTree::rereadChangedCache()
+{
+    _rereadCachePending = false;
+
+    QString cacheFileName = _subtreeStore ? _subtreeStore->cacheFileName() : QString();
+
+    if ( cacheFileName.isEmpty() )
+	return;
+
+    logWarning() << cacheFileName << " was changed; reading it completely" << endl;
+
+    bool lazy = _lazyCacheLoading;
+    _lazyCacheLoading = false;
+    clearAndReadCache( cacheFileName );
+    _lazyCacheLoading = lazy;
+}
+
+
+void DirTree::readRestOfCache( const QString & cacheFileName )
+{
+    if ( ! _subtreeStore || ! _root )
+	return;
+
+    QString lazyFile = QFileInfo( _subtreeStore->cacheFileName() ).canonicalFilePath();
+
+    if ( lazyFile.isEmpty() || lazyFile != QFileInfo( cacheFileName ).canonicalFilePath() )
+	return;
+
+    logInfo() << "Reading the rest of " << cacheFileName << " before overwriting it" << endl;
+    pageInAll( _root );
+}
+
+
+void DirTree::pageInAll( DirInfo * dir )
+{
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    pageInAll( child->toDirInfo() );
+    }
+}
+
+
 void DirTree::clearAndReadCache( const QString & cacheFileName )
 {
     clear();
@@ -672,6 +1224,430 @@ void DirTree::recalc( DirInfo * dir )
 }
 
 
+const TreeColumns * DirTree::columns( FileInfo * subtree )
+{
+    return snapshot( subtree ).data();
+}
+
+
+TreeSnapshot DirTree::snapshot( FileInfo * subtree )
+{
+    CHECK_PTR( subtree );
+
+    if ( _snapshot && _snapshot->subtree() == subtree && _snapshotChanges.isEmpty() )
+	return _snapshot;
+
+    // Never rebuild the old snapshot in place: Other threads may still be
+    // reading it.
+
+    TreeColumns * columns = new TreeColumns();
+    CHECK_NEW( columns );
+
+    if ( ! _snapshot || _snapshot->subtree() != subtree ||
+	 ! columns->update( *_snapshot, _snapshotChanges ) )
+    {
+	columns->build( subtree );
+    }
+
+    columns->setEpoch( _epoch );
+
+    _snapshot = TreeSnapshot( columns );
+    _snapshotChanges.clear();
+
+    if ( columns->isTooLarge() )
+	emit snapshotTooLarge( subtree );
+
+    return _snapshot;
+}
+
+
+void DirTree::dropColumns()
+{
+    _snapshot.clear();
+    _snapshotChanges.clear();
+    ++_epoch;
+}
+
+
+void DirTree::snapshotChanged( FileInfo * parent, FileInfo * removed )
+{
+    ++_epoch;
+
+    if ( ! _snapshot )
+	return;
+
+    FileInfo * subtree = _snapshot->subtree();
+
+    if ( removed && subtree->isInSubtree( removed ) )
+    {
+	// The snapshot's subtree itself goes away or loses all its children
+
+	dropColumns();
+	return;
+    }
+
+    if ( removed && ! _snapshotChanges.isEmpty() )
+    {
+	// Don't keep pointers to directories that are deleted now
+
+	QSet<DirInfo *>::iterator it = _snapshotChanges.begin();
+
+	while ( it != _snapshotChanges.end() )
+	{
+	    if ( *it != parent && (*it)->isInSubtree( removed ) )
+		it = _snapshotChanges.erase( it );
+	    else
+		++it;
+	}
+    }
+
+    // Changes in a dot entry or an attic are changes of its parent since
+    // pseudo directories don't have rows in the snapshot.
+
+    while ( parent && parent->isPseudoDir() )
+	parent = parent->parent();
+
+    if ( ! parent || ! parent->isDirInfo() || ! parent->isInSubtree( subtree ) )
+	return;
+
+    if ( subtree->isPseudoDir() || parent == subtree )
+    {
+	// Nothing to gain from updating
+
+	dropColumns();
+	return;
+    }
+
+    _snapshotChanges.insert( parent->toDirInfo() );
+
+    // Building the snapshot again is cheaper than matching that many
+    // directories
+
+    if ( _snapshotChanges.size() > MAX_SNAPSHOT_CHANGES )
+	dropColumns();
+}
+
+
+bool DirTree::ensureLabels()
+{
+    if ( ( _labelsValid && _labelsComplete ) || _isBusy || ! _root )
+	return _labelsValid;
+
+    // Each directory (plus its dot entry and attic) needs two labels. Use
+    // whatever is left of the label range for the gaps, but don't waste
+    // more than needed.
+
+    quint64 dirs = 3 * ( (quint64) _root->totalSubDirs() + 2 );
+
+    if ( 2 * dirs >= 0xFFFFFFF0ULL )
+    {
+	logWarning() << "Too many directories for labels" << endl;
+	return false;
+    }
+
+    quint64 gap = ( 0xFFFFFFF0ULL - 2 * dirs ) / dirs;
+
+    if ( gap > MAX_LABEL_GAP )
+	gap = MAX_LABEL_GAP;
+
+    _root->assignLabels( 1, (quint32) gap );
+    _labelsValid    = true;
+    _labelsComplete = true;
+
+    return true;
+}
+
+
+void DirTree::labelNewDir( DirInfo * parent, DirInfo * newDir )
+{
+    if ( ! _labelsValid )
+	return;
+
+    if ( newDir->isLabelled() )
+    {
+	// Not a new directory after all: It might bring labelled
+	// descendants from another place in the tree along.
+
+	_labelsValid = false;
+	return;
+    }
+
+    if ( ! parent->labelNewChild( newDir ) )
+	_labelsComplete = false;
+}
+
+
+void DirTree::setCacheDirUrls( bool enable )
+{
+    if ( enable == _cacheDirUrls )
+	return;
+
+    _cacheDirUrls = enable;
+    invalidateDirUrls();
+
+    if ( ! enable && _root )
+	_root->dropUrlCache( true ); // recursive
+}
+
+
+void DirTree::setSortCacheBudget( int maxItems )
+{
+    _sortCacheBudget = maxItems > 0 ? maxItems : 0;
+    enforceSortCacheBudget( 0 );
+}
+
+
+void DirTree::sortCacheAdded( DirInfo * dir )
+{
+    int size = dir->sortCacheSize();
+    _sortCacheItems += size - _sortCacheDirs.value( dir, 0 );
+    _sortCacheDirs.insert( dir, size );
+
+    enforceSortCacheBudget( dir );
+}
+
+
+void DirTree::sortCacheResized( DirInfo * dir )
+{
+    int size = dir->sortCacheSize();
+    _sortCacheItems += size - _sortCacheDirs.value( dir, 0 );
+    _sortCacheDirs.insert( dir, size );
+
+    // While reading, sort caches grow with each new child; this is checked
+    // again when reading is finished.
+
+    if ( ! _isBusy )
+	enforceSortCacheBudget( dir );
+}
+
+
+void DirTree::sortCacheDropped( DirInfo * dir )
+{
+    _sortCacheItems -= _sortCacheDirs.take( dir );
+
+    QMap<quint64, DirInfo *>::iterator it = _sortCacheLru.find( dir->sortCacheStamp() );
+
+    if ( it != _sortCacheLru.end() && it.value() == dir )
+	_sortCacheLru.erase( it );
+}
+
+
+quint64 DirTree::sortCacheUsed( DirInfo * dir )
+{
+    QMap<quint64, DirInfo *>::iterator it = _sortCacheLru.find( dir->sortCacheStamp() );
+
+    if ( it != _sortCacheLru.end() && it.value() == dir )
+	_sortCacheLru.erase( it );
+
+    _sortCacheLru.insert( ++_sortCacheStamp, dir );
+
+    return _sortCacheStamp;
+}
+
+
+void DirTree::enforceSortCacheBudget( DirInfo * keep )
+{
+    if ( _sortCacheBudget <= 0 || _sortCacheItems <= _sortCacheBudget )
+	return;
+
+    // Don't do this for every single new sort cache once the budget is
+    // reached: Drop enough to get well below it. The sort caches of
+    // directories that are shown in a view are needed all the time, so
+    // they are kept.
+
+    qint64 target = _sortCacheBudget / 4 * 3;
+    updateExposedDirs();
+
+    QMap<quint64, DirInfo *>::iterator it = _sortCacheLru.begin();
+
+    while ( it != _sortCacheLru.end() && _sortCacheItems > target )
+    {
+	DirInfo * dir = it.value();
+	++it; // dropSortCache() removes 'dir' from _sortCacheLru
+
+	if ( dir != keep && ! _exposedDirs.contains( dir ) )
+	    dir->dropSortCache(); // this calls sortCacheDropped()
+    }
+
+    _exposedDirs.clear();
+
+    // logDebug() << "Sort cache: " << _sortCacheItems << " items in "
+    //		  << _sortCacheDirs.size() << " dirs" << endl;
+}
+
+
+void DirTree::updateExposedDirs()
+{
+    _exposedDirs.clear();
+    emit exposedDirsNeeded();
+}
+
+
+void DirTree::exposeDir( FileInfo * item )
+{
+    DirInfo * dir = item && item->isDirInfo() ? item->toDirInfo() : 0;
+
+    if ( ! dir && item )
+	dir = item->parent();
+
+    // Stop at the first ancestor that is already there: Its ancestors are,
+    // too.
+
+    while ( dir && ! _exposedDirs.contains( dir ) )
+    {
+	_exposedDirs.insert( dir );
+	dir = dir->parent();
+    }
+}
+
+
+void DirTree::setMaxResidentItems( FileCount maxItems )
+{
+    if ( maxItems < 0 )
+    {
+	// Use half of the physical memory for the tree
+
+	qint64 physMem = (qint64) sysconf( _SC_PHYS_PAGES ) * sysconf( _SC_PAGESIZE );
+	maxItems = physMem > 0 ? physMem / 2 / bytesPerItem() : 0;
+
+	logInfo() << "Max. resident items: " << maxItems << endl;
+    }
+
+    _maxResidentItems = maxItems;
+}
+
+
+void DirTree::setMemoryBudget( qint64 bytes )
+{
+    if ( bytes < 0 )
+    {
+	qint64 physMem = (qint64) sysconf( _SC_PHYS_PAGES ) * sysconf( _SC_PAGESIZE );
+	bytes = physMem > 0 ? physMem / 4 * 3 : 0;
+    }
+
+    _memoryBudget = bytes;
+    logInfo() << "Memory budget: " << formatSize( _memoryBudget ) << endl;
+}
+
+
+qint64 DirTree::bytesPerItem()
+{
+    return sizeof( FileInfo ) + 64;
+}
+
+
+void DirTree::limitResidentItems()
+{
+    _spillPending = false;
+    spillColdSubtrees();
+
+    if ( ! _isBusy || _memoryBudget <= 0 )
+	return;
+
+    qint64 needed = residentItems() * bytesPerItem();
+
+    if ( needed > _memoryBudget )
+    {
+	// Better stop here than having the whole system thrash or the
+	// process killed: The items that are read so far are still usable.
+
+	logError() << "Memory budget of " << formatSize( _memoryBudget )
+		   << " exceeded: " << formatSize( needed )
+		   << " needed for " << residentItems() << " items" << endl;
+
+	abortReading();
+	emit memoryBudgetExceeded( _memoryBudget );
+    }
+}
+
+
+void DirTree::spillColdSubtrees()
+{
+    if ( ! _spillEnabled || ! _root || _maxResidentItems <= 0 )
+	return;
+
+    if ( _cacheWriter )	// It keeps pointers to items while it is writing
+	return;
+
+    if ( residentItems() <= _maxResidentItems )
+	return;
+
+    if ( ! _subtreeStore )
+    {
+	_subtreeStore = new SubtreeStore( this );
+	CHECK_NEW( _subtreeStore );
+    }
+
+    // The columnar snapshot might refer to items that are spilled now
+    dropColumns();
+
+    FileCount target = _maxResidentItems / 4 * 3;
+    updateExposedDirs();
+    spillColdSubtrees( _root, target );
+    _exposedDirs.clear();
+
+    logInfo() << "Resident items: " << residentItems()
+	      << "; spilled: " << _subtreeStore->spilledItems()
+	      << " items in " << _subtreeStore->spilledDirs() << " dirs"
+	      << " (" << formatSize( _subtreeStore->fileSize() ) << ")"
+	      << endl;
+}
+
+
+void DirTree::spillColdSubtrees( DirInfo * dir, FileCount target )
+{
+    // Don't use firstChild() etc. here: That would page in spilled subtrees.
+
+    FileInfo * child = dir->isSpilled() ? 0 : dir->firstChild();
+
+    while ( child && residentItems() > target )
+    {
+	if ( child->isDirInfo() && ! child->isPkgInfo() )
+	{
+	    DirInfo * subDir = child->toDirInfo();
+
+	    // Only subtrees that no view shows: The views might refer to
+	    // the children of exposed directories.
+
+	    bool cold = ! subDir->isSpilled()			 &&
+			! _exposedDirs.contains( subDir )	 &&
+			! subDir->isLocked()			 &&
+			! subDir->isBusy()			 &&
+			subDir->readState() == DirFinished	 &&
+			subDir->totalItems() >= MIN_SPILL_ITEMS;
+
+	    if ( cold )
+	    {
+		// Its sort cache would refer to the children that are spilled
+
+		subDir->dropSortCache();
+		_subtreeStore->spill( subDir );
+	    }
+	    else if ( ! subDir->isSpilled() )
+		spillColdSubtrees( subDir, target );
+	}
+
+	child = child->next();
+    }
+}
+
+
+void DirTree::dropSubtreeStore()
+{
+    if ( _subtreeStore )
+    {
+	if ( _subtreeStore->spilledDirs() > 0 )
+	{
+	    logError() << "Still " << _subtreeStore->spilledDirs()
+		       << " spilled dirs" << endl;
+	}
+
+	delete _subtreeStore;
+	_subtreeStore = 0;
+    }
+}
+
+
 void DirTree::detectClusterSize( FileInfo * item )
 {
     if ( item &&
@@ -11,9 +11,15 @@
 #define DirTree_h
 
 
+#include <QAtomicInteger>
 #include <QList>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QStringList>
 
 #include "DirReadJob.h"
+#include "TreeColumns.h"
 #include "PkgFilter.h"
 
 
@@ -24,6 +30,10 @@ namespace QDirStat
     class FileInfoSet;
     class ExcludeRules;
     class DirTreeFilter;
+    class SubtreeStore;
+    class TreeReclaimer;
+    class CacheWriter;
+    class CacheJournal;
 
 
     /**
@@ -92,14 +102,34 @@ namespace QDirStat
 	void refresh( DirInfo * subtree = 0 );
 
 	/**
-	 * Refresh a number of subtrees.
+	 * Refresh a number of subtrees: The directories in 'refreshSet' and
+	 * the parents of all other items. All items must still be part of
+	 * this tree; keep a set up to date with deletingChild() and
+	 * clearingSubtree() if the tree may change in the meantime (see
+	 * Refresher).
 	 **/
 	void refresh( const FileInfoSet & refreshSet );
 
+	/**
+	 * Return 'true' if the subtrees of the last refresh are all still
+	 * the same as before it, i.e. if each of them has the same digest
+	 * (see DirInfo::digest()) after reading it again.
+	 *
+	 * This only reports that nothing changed; it does not save any
+	 * reading: Each refreshed subtree is still read completely.
+	 **/
+	bool refreshFoundNoChanges() const { return _refreshFoundNoChanges; }
+
 	/**
 	 * Delete a subtree.
+	 *
+	 * If 'replaced' is true, it is about to be replaced by reading (e.g.
+	 * from a cache file or a journal), so it is not recorded in the
+	 * journal: The journal gets the new content of any refreshed subtree
+	 * when reading is done. Other deletions while reading are recorded
+	 * when reading is done (see appendPendingRemovals()).
 	 **/
-	void deleteSubtree( FileInfo * subtree );
+	void deleteSubtree( FileInfo * subtree, bool replaced = false );
 
 	/**
 	 * Delete all children of a subtree, but leave the subtree inself
@@ -107,6 +137,28 @@ namespace QDirStat
 	 **/
 	void clearSubtree( DirInfo * subtree );
 
+	/**
+	 * Hand over 'first' and all its siblings with all their children to
+	 * the background reclaimer thread for deletion (see TreeReclaimer).
+	 *
+	 * The items must already be unlinked from the tree, their parent
+	 * must be 0, and releaseCaches() must have been called for them.
+	 **/
+	void reclaim( FileInfo * first );
+
+	/**
+	 * Release everything the tree keeps for items in 'subtree' (sort
+	 * caches, spilled subtrees) in preparation of deleting the subtree.
+	 * If 'includeSubtree' is 'false', 'subtree' itself is left alone.
+	 **/
+	void releaseCaches( FileInfo * subtree, bool includeSubtree = true );
+
+	/**
+	 * Abort writing a cache file in the background and remove the
+	 * incomplete file. This sends cacheWriteFinished().
+	 **/
+	void abortWritingCache();
+
 	/**
 	 * Finalize the complete tree after all read jobs are done.
 	 **/
@@ -204,6 +256,36 @@ namespace QDirStat
 	void setCrossFilesystems( bool doCross )
 	    { _crossFilesystems = doCross; }
 
+	/**
+	 * Set up "aggregated leaf mode": When reading directories, regular
+	 * files smaller than 'maxSize' bytes and all regular files in
+	 * directories at least 'minDepth' levels below the starting
+	 * directory are not stored as individual FileInfo nodes, but only
+	 * added to one AggregateInfo per directory.
+	 *
+	 * 'maxSize' 0 and 'minDepth' -1 disable each of those criteria.
+	 * Refreshing a subtree always reads all files individually.
+	 **/
+	void setAggregation( FileSize maxSize, int minDepth )
+	    { _aggregateMaxSize = maxSize; _aggregateMinDepth = minDepth; }
+
+	/**
+	 * Return the size limit for aggregated files or 0 if there is none.
+	 **/
+	FileSize aggregateMaxSize() const { return _aggregateMaxSize; }
+
+	/**
+	 * Return the depth from which on all files are aggregated or -1 if
+	 * there is none.
+	 **/
+	int aggregateMinDepth() const { return _aggregateMinDepth; }
+
+	/**
+	 * Return 'true' if any files are aggregated.
+	 **/
+	bool aggregationEnabled() const
+	    { return _aggregateMaxSize > 0 || _aggregateMinDepth >= 0; }
+
 	/**
 	 * Notification that a child has been added.
 	 *
@@ -212,6 +294,16 @@ namespace QDirStat
 	 **/
 	virtual void childAddedNotify( FileInfo *newChild );
 
+	/**
+	 * Notification that a number of children has been added to 'parent'
+	 * at once with DirInfo::insertChildren().
+	 *
+	 * This does the same as childAddedNotify() for each of them, but the
+	 * bookkeeping only once. It still emits childAdded() for each of
+	 * them.
+	 **/
+	void childrenAddedNotify( DirInfo * parent, const FileInfoList & newChildren );
+
 	/**
 	 * Notification that a child is about to be deleted.
 	 *
@@ -261,14 +353,92 @@ namespace QDirStat
 	bool isBusy() { return _isBusy; }
 
 	/**
-	 * Write the complete tree to a cache file.
+	 * Write the complete tree to a cache file. If the file name ends with
+	 * BINARY_CACHE_SUFFIX, this uses the binary cache file format.
 	 *
 	 * Returns true if OK, false upon error.
 	 **/
 	bool writeCache( const QString & cacheFileName );
 
 	/**
-	 * Read a cache file.
+	 * Write the complete tree to a cache file like writeCache(), but in
+	 * the background so the program remains responsive: This sends
+	 * cacheWriteProgress() signals from time to time and
+	 * cacheWriteFinished() at the end.
+	 *
+	 * Any change of the tree (clearing it, deleting items, reading)
+	 * aborts writing.
+	 *
+	 * If 'temporary' is true, the file is only needed for a moment, e.g.
+	 * to compare the tree with another cache file: It does not become the
+	 * base of a journal (see CacheJournal).
+	 **/
+	void startWritingCache( const QString & cacheFileName,
+				bool		temporary = false );
+
+	/**
+	 * Return 'true' if a cache file is being written in the background.
+	 **/
+	bool isWritingCache() const { return _cacheWriter != 0; }
+
+	/**
+	 * Return 'true' if writeCache() should compress with zstd rather
+	 * than with gzip if the file name doesn't say otherwise.
+	 **/
+	bool cacheUseZstd() const { return _cacheUseZstd; }
+
+	/**
+	 * Return the compression level for writeCache() or -1 for the
+	 * default level of the compression.
+	 **/
+	int cacheCompressionLevel() const { return _cacheCompressionLevel; }
+
+	/**
+	 * Set the compression for writeCache(): zstd if 'useZstd' is true,
+	 * gzip otherwise, with compression level 'level' (-1 for the
+	 * default). zstd is only used if QDirStat was built with it.
+	 **/
+	void setCacheCompression( bool useZstd, int level = -1 );
+
+	/**
+	 * Return 'true' if readCache() only reads the toplevel directories
+	 * of a cache file with a directory index and everything else when it
+	 * is needed.
+	 **/
+	bool lazyCacheLoading() const { return _lazyCacheLoading; }
+
+	/**
+	 * Enable or disable lazy loading for readCache().
+	 **/
+	void setLazyCacheLoading( bool enable ) { _lazyCacheLoading = enable; }
+
+	/**
+	 * Return 'true' if the changes of a tree that was read from or
+	 * written to a cache file are appended to a journal next to that
+	 * cache file (see CacheJournal): Refreshed subtrees and deleted
+	 * items are written there instead of the complete tree again.
+	 **/
+	bool incrementalCache() const { return _incrementalCache; }
+
+	/**
+	 * Enable or disable the cache journal for the next cache file that
+	 * is read or written.
+	 **/
+	void setIncrementalCache( bool enable ) { _incrementalCache = enable; }
+
+	/**
+	 * Read a cache file in the text or the binary format.
+	 *
+	 * With lazyCacheLoading(), a cache file with a directory index (see
+	 * CacheIndex) is not read completely: Only the toplevel directory
+	 * and its direct children are created right away, with the sums of
+	 * their complete subtrees from the index. Their children are read
+	 * from the cache file when anybody needs them, e.g. when a branch is
+	 * opened in the tree view or when the treemap is built.
+	 *
+	 * If there is a journal for that cache file, it is read afterwards:
+	 * This replays the changes that were made after the cache file was
+	 * written. Lazy loading is not possible then.
 	 *
 	 * Returns true if OK, false upon error.
 	 **/
@@ -358,11 +528,251 @@ namespace QDirStat
          **/
         FileSize clusterSize() const { return _blocksPerCluster * STD_BLOCK_SIZE; }
 
+	/**
+	 * Return a columnar snapshot (see TreeColumns) of 'subtree' for
+	 * analysis passes. The last snapshot is kept until the tree changes,
+	 * so several passes over the same subtree only need to build it once.
+	 *
+	 * The returned object is owned by this tree. Don't keep it around;
+	 * it becomes invalid with the next change in the tree or the next
+	 * call to this method for a different subtree. Use snapshot() to
+	 * keep it.
+	 **/
+	const TreeColumns * columns( FileInfo * subtree );
+
+	/**
+	 * Return a consistent read-only view of 'subtree' that stays valid
+	 * as long as the caller keeps it, no matter what happens to the tree
+	 * in the meantime. It can be handed to another thread for analysis
+	 * (see e.g. FileSizeStats::collect( const TreeColumns & )) while
+	 * reading or cleanups continue on this one.
+	 *
+	 * This has to be called on the GUI thread. Building the snapshot
+	 * traverses the subtree once; as long as the tree doesn't change, the
+	 * same snapshot is returned for the same subtree. After changes, the
+	 * next snapshot of the same subtree is built from the last one: Only
+	 * the directories that changed are traversed again (see
+	 * TreeColumns::update()). Old snapshots are deleted when their last
+	 * reader drops them.
+	 **/
+	TreeSnapshot snapshot( FileInfo * subtree );
+
+	/**
+	 * Drop the tree's reference to the current snapshot, if there is
+	 * any, and start a new epoch.
+	 **/
+	void dropColumns();
+
+	/**
+	 * Notification that the children of 'parent' changed: Start a new
+	 * epoch and remember 'parent' for updating the current snapshot. If
+	 * 'removed' is non-null, it and everything below it is about to be
+	 * deleted (for a cleared subtree, 'removed' is 'parent' itself).
+	 **/
+	void snapshotChanged( FileInfo * parent, FileInfo * removed = 0 );
+
+	/**
+	 * Return the current epoch of the tree. This is incremented with each
+	 * change in the tree.
+	 **/
+	quint32 epoch() const { return _epoch; }
+
+	/**
+	 * Return 'true' if 'snapshot' still reflects the current content of
+	 * the tree, i.e. there was no change since it was built.
+	 **/
+	bool isCurrent( const TreeSnapshot & snapshot ) const
+	    { return snapshot && snapshot->epoch() == _epoch; }
+
+	/**
+	 * Return 'true' if directories in this tree cache their URL for
+	 * FileInfo::url() and FileInfo::appendUrl() of their descendants.
+	 **/
+	bool cacheDirUrls() const { return _cacheDirUrls; }
+
+	/**
+	 * Enable or disable caching directory URLs.
+	 *
+	 * This is useful for passes that need the URLs of a lot of items in
+	 * the same directories. Each directory that is used keeps a copy of
+	 * its URL, so this costs memory; it should be disabled again when such
+	 * a pass is done. Disabling it drops all cached URLs.
+	 **/
+	void setCacheDirUrls( bool enable );
+
+	/**
+	 * Invalidate all cached directory URLs. This is cheap; the cached URLs
+	 * are only updated when they are used the next time.
+	 **/
+	void invalidateDirUrls() { ++_dirUrlGeneration; }
+
+	/**
+	 * Return the current generation of cached directory URLs. Only
+	 * cached URLs with this generation are valid.
+	 **/
+	quint32 dirUrlGeneration() const { return _dirUrlGeneration; }
+
+	/**
+	 * Make sure the directories of this tree have valid pre-order and
+	 * post-order labels (see DirInfo::preOrder()) so ancestor and
+	 * descendant checks like FileInfo::isInSubtree() take constant time.
+	 *
+	 * The labels are assigned when reading is finished and then
+	 * maintained for new directories as long as there is room in the gaps
+	 * that each directory keeps. If there is no more room, a new directory
+	 * simply does not get any labels; this is still correct, only slower.
+	 * Moving a directory to another parent invalidates all labels.
+	 *
+	 * This assigns new labels if needed and possible, i.e. if the tree is
+	 * not busy reading. It returns 'true' if the labels are valid.
+	 **/
+	bool ensureLabels();
+
+	/**
+	 * Return 'true' if the directory labels of this tree are valid. Even
+	 * then, not every directory might have labels.
+	 **/
+	bool labelsValid() const { return _labelsValid; }
+
+	/**
+	 * Invalidate the directory labels. This is cheap; they are only
+	 * assigned again with the next ensureLabels().
+	 **/
+	void invalidateLabels() { _labelsValid = false; }
+
+	/**
+	 * Notification that a new directory was inserted into 'parent' so it
+	 * can get labels.
+	 **/
+	void labelNewDir( DirInfo * parent, DirInfo * newDir );
+
+	/**
+	 * Return the maximum number of entries in the sorted children lists
+	 * of all directories of this tree (see DirInfo::sortedChildren()).
+	 * 0 means unlimited.
+	 **/
+	int sortCacheBudget() const { return _sortCacheBudget; }
+
+	/**
+	 * Set the maximum number of entries in all sorted children lists.
+	 * When that is exceeded, the least recently used lists are dropped
+	 * until only 3/4 of that budget is used. They are simply sorted again
+	 * when they are needed the next time. The lists of directories that
+	 * are shown in a view are never dropped (see exposedDirsNeeded()).
+	 **/
+	void setSortCacheBudget( int maxItems );
+
+	/**
+	 * Return the total number of entries in all sorted children lists.
+	 **/
+	qint64 sortCacheItems() const { return _sortCacheItems; }
+
+	/**
+	 * Notifications from DirInfo about its sort cache: It was created,
+	 * it changed its size, or it was dropped.
+	 *
+	 * These are only for DirInfo; don't call them from anywhere else.
+	 **/
+	void sortCacheAdded( DirInfo * dir );
+	void sortCacheResized( DirInfo * dir );
+	void sortCacheDropped( DirInfo * dir );
+
+	/**
+	 * Notification from DirInfo that the sort cache of 'dir' was just
+	 * used. Return its new stamp. The directories with the oldest stamps
+	 * are dropped first.
+	 **/
+	quint64 sortCacheUsed( DirInfo * dir );
+
+	/**
+	 * Mark 'item' (if it is a directory, otherwise its parent) and all
+	 * its ancestors as exposed in a view: Their sort caches are not
+	 * dropped, and their children are not spilled to the SubtreeStore.
+	 * Call this only from a slot connected to the exposedDirsNeeded()
+	 * signal.
+	 **/
+	void exposeDir( FileInfo * item );
+
+	/**
+	 * Check if there are more items in memory than maxResidentItems()
+	 * allows or than the memory budget allows, and if so, spill cold
+	 * subtrees when control returns to the event loop. This is called
+	 * when reading a directory is finished and when a spilled subtree is
+	 * paged in again.
+	 **/
+	void checkResidentItems();
+
+	/**
+	 * Notification that the cache file that this tree is read from on
+	 * demand (see readCacheLazy()) was changed: Nothing more can be read
+	 * from it. This clears the tree and reads the cache file completely
+	 * when control returns to the event loop.
+	 **/
+	void cacheFileChanged();
+
+	/**
+	 * Return the maximum number of items to keep in memory. When that is
+	 * exceeded, subtrees that are completely read and that no view shows
+	 * are moved to a temporary file ("spilled", see SubtreeStore) until
+	 * only 3/4 of that number is left. 0 means unlimited.
+	 **/
+	FileCount maxResidentItems() const { return _maxResidentItems; }
+
+	/**
+	 * Set the maximum number of items to keep in memory. A negative value
+	 * means to calculate it from the size of the physical memory.
+	 **/
+	void setMaxResidentItems( FileCount maxItems );
+
+	/**
+	 * Return the memory budget for the items of this tree in bytes: When
+	 * the items in memory need more than that even after spilling as
+	 * much as possible, reading is aborted (see memoryBudgetExceeded()).
+	 * 0 means unlimited.
+	 **/
+	qint64 memoryBudget() const { return _memoryBudget; }
+
+	/**
+	 * Set the memory budget in bytes. A negative value means 3/4 of the
+	 * physical memory.
+	 **/
+	void setMemoryBudget( qint64 bytes );
+
+	/**
+	 * Return the estimated memory for one item in the tree in bytes. This
+	 * is for a file with a name of average length, including malloc()
+	 * overhead.
+	 **/
+	static qint64 bytesPerItem();
+
+	/**
+	 * Return the number of items in memory, i.e. all items that are not
+	 * in spilled subtrees. This counts the objects, not what they stand
+	 * for: An aggregate (see AggregateInfo) is only one item.
+	 **/
+	FileCount residentItems() const { return _residentNodes.loadRelaxed(); }
+
+	/**
+	 * Notifications from FileInfo that an item of this tree was created
+	 * or deleted. Items are also deleted on the reclaimer thread (see
+	 * TreeReclaimer), so this is all that they may do with the tree.
+	 **/
+	void nodeCreated() { _residentNodes.ref();   }
+	void nodeDeleted() { _residentNodes.deref(); }
+
+	/**
+	 * Return the store for spilled subtrees or 0 if nothing was spilled
+	 * yet.
+	 **/
+	SubtreeStore * subtreeStore() const { return _subtreeStore; }
+
 
     signals:
 
 	/**
-	 * Emitted when a child has been added.
+	 * Emitted when a child has been added. This is also emitted for each
+	 * child that was added together with others with
+	 * DirInfo::insertChildren() (see childrenAddedNotify()).
 	 **/
 	void childAdded( FileInfo * newChild );
 
@@ -430,6 +840,38 @@ namespace QDirStat
 	 **/
 	void progressInfo( const QString & infoLine );
 
+	/**
+	 * Emitted from time to time while writing a cache file in the
+	 * background.
+	 **/
+	void cacheWriteProgress( FileCount itemsWritten, FileCount totalItems );
+
+	/**
+	 * Emitted when writing a cache file in the background is finished or
+	 * aborted ('ok' is 'false' and 'aborted' is 'true' then).
+	 **/
+	void cacheWriteFinished( const QString & cacheFileName, bool ok, bool aborted );
+
+	/**
+	 * Emitted before the tree drops data that views might still use,
+	 * i.e. sort caches or subtrees that are spilled to the SubtreeStore.
+	 * Models connected to this (with a direct connection) report all
+	 * directories that they expose to their views with exposeDir().
+	 **/
+	void exposedDirsNeeded();
+
+	/**
+	 * Emitted when reading was aborted because the items in memory
+	 * needed more than the memory budget (see memoryBudget()).
+	 **/
+	void memoryBudgetExceeded( qint64 budget );
+
+	/**
+	 * Emitted when a snapshot for 'subtree' is requested that has too
+	 * many items (see TreeColumns::isTooLarge()).
+	 **/
+	void snapshotTooLarge( FileInfo * subtree );
+
 
     protected slots:
 
@@ -439,6 +881,38 @@ namespace QDirStat
 	 **/
 	void slotFinished();
 
+	/**
+	 * Spill subtrees that were completely read and that no view shows
+	 * (see exposedDirsNeeded()) to the SubtreeStore until the number of
+	 * resident items is well below maxResidentItems().
+	 **/
+	void spillColdSubtrees();
+
+	/**
+	 * Spill cold subtrees (see above). If the resident items still need
+	 * more than the memory budget, abort reading and emit
+	 * memoryBudgetExceeded().
+	 **/
+	void limitResidentItems();
+
+	/**
+	 * Notification that the background cache writer is done.
+	 **/
+	void cacheWriterFinished( bool ok, bool aborted );
+
+	/**
+	 * Clear the tree and read the cache file that was read on demand
+	 * completely again (see cacheFileChanged()).
+	 **/
+	void rereadChangedCache();
+
+	/**
+	 * Write the complete tree to a new cache file in the background if
+	 * the journal has grown too large (see CacheJournal). This replaces
+	 * the old cache file and the journal when it is done.
+	 **/
+	void compactJournal();
+
 
     protected:
 
@@ -465,11 +939,79 @@ namespace QDirStat
 	 **/
 	void recalc( DirInfo * dir );
 
+	/**
+	 * Compare the digests of the subtrees that were refreshed with the
+	 * ones from before the refresh and log those that didn't change.
+	 * The others are appended to the journal if there is one.
+	 **/
+	void checkRefreshedSubtrees();
+
         /**
          * Try to derive the cluster size from 'item'.
          **/
         void detectClusterSize( FileInfo * item );
 
+	/**
+	 * Drop the least recently used sort caches if the sort cache budget
+	 * is exceeded. 'keep' is never dropped.
+	 **/
+	void enforceSortCacheBudget( DirInfo * keep );
+
+	/**
+	 * Ask all connected models which directories they expose
+	 * (see exposedDirsNeeded()) and store them in _exposedDirs.
+	 **/
+	void updateExposedDirs();
+
+	/**
+	 * Recursively spill subtrees from 'dir' on until only 'target' items
+	 * are resident.
+	 **/
+	void spillColdSubtrees( DirInfo * dir, FileCount target );
+
+	/**
+	 * Delete the SubtreeStore. This must only be done when there are no
+	 * more spilled directories.
+	 **/
+	void dropSubtreeStore();
+
+	/**
+	 * Start reading a cache file lazily (see readCache()). Return
+	 * 'false' if that is not possible, e.g. if the cache file has no
+	 * directory index or if there are exclude rules or filters: They
+	 * need to see every item.
+	 **/
+	bool readCacheLazy( const QString & cacheFileName );
+
+	/**
+	 * If the tree was read lazily from 'cacheFileName', read everything
+	 * that is still missing: That file is about to be overwritten.
+	 **/
+	void readRestOfCache( const QString & cacheFileName );
+
+	/**
+	 * Recursively read all subtrees below 'dir' that are not in memory.
+	 **/
+	void pageInAll( DirInfo * dir );
+
+	/**
+	 * Start appending changes to the journal of 'cacheFileName' if
+	 * incrementalCache() is enabled.
+	 **/
+	void startJournal( const QString & cacheFileName );
+
+	/**
+	 * Stop appending changes to the journal. This does not remove the
+	 * journal file.
+	 **/
+	void dropJournal();
+
+	/**
+	 * Append the removals of subtrees that were deleted while reading to
+	 * the journal. Return 'true' if anything was appended.
+	 **/
+	bool appendPendingRemovals();
+
 
 
 	// Data members
@@ -477,6 +1019,8 @@ namespace QDirStat
 	DirInfo *		_root;
 	DirReadJobQueue		_jobQueue;
 	bool			_crossFilesystems;
+	FileSize		_aggregateMaxSize;
+	int			_aggregateMinDepth;
 	bool			_isBusy;
 	QString			_device;
 	QString			_url;
@@ -485,6 +1029,37 @@ namespace QDirStat
 	bool			_beingDestroyed;
         bool                    _haveClusterSize;
         int                     _blocksPerCluster;
+	TreeSnapshot		_snapshot;
+	QSet<DirInfo *>		_snapshotChanges;
+	quint32			_epoch;
+	bool			_cacheDirUrls;
+	quint32			_dirUrlGeneration;
+	bool			_labelsValid;
+	bool			_labelsComplete;
+	QHash<DirInfo *, int>	_sortCacheDirs;
+	QMap<quint64, DirInfo *> _sortCacheLru;	// by stamp, oldest first
+	qint64			_sortCacheItems;
+	int			_sortCacheBudget;
+	quint64			_sortCacheStamp;
+	QSet<DirInfo *>		_exposedDirs;
+	SubtreeStore *		_subtreeStore;
+	FileCount		_maxResidentItems;
+	qint64			_memoryBudget;
+	QAtomicInteger<qint64>	_residentNodes;
+	bool			_spillEnabled;
+	bool			_spillPending;
+	TreeReclaimer *		_reclaimer;
+	bool			_cacheUseZstd;
+	int			_cacheCompressionLevel;
+	bool			_lazyCacheLoading;
+	bool			_rereadCachePending;
+	CacheWriter *		_cacheWriter;
+	bool			_temporaryCache;
+	bool			_incrementalCache;
+	CacheJournal *		_journal;
+	QStringList		_pendingRemovals;	// see deleteSubtree()
+	QHash<QString, quint64> _refreshDigests;	// by URL, see refresh()
+	bool			_refreshFoundNoChanges;
 
     };	// class DirTree
 
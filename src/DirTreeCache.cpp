@@ -8,9 +8,22 @@
 
 
 #include <ctype.h>      // isspace()
-#include <QUrl>
+#include <string.h>     // strchr()
+#include <algorithm>    // std::sort()
+#include <QFile>
+#include <QQueue>
+#include <QTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
 
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "CacheIndex.h"
+#include "AggregateInfo.h"
 #include "DirInfo.h"
 #include "DirTree.h"
 #include "DotEntry.h"
@@ -27,6 +40,11 @@
 
 #define MAX_ERROR_COUNT			1000
 
+#define CACHE_WRITE_QUEUE_LEN		8	// Buffers waiting for the compressor
+#define CACHE_WRITE_SLICE_MILLISEC	20
+#define CACHE_WRITE_SLICE_ITEMS		1000
+#define CACHE_WRITE_WAIT_MILLISEC	10
+
 #define VERBOSE_READ			0
 #define VERBOSE_CACHE_DIRS		0
 #define VERBOSE_CACHE_FILE_INFOS	0
@@ -35,543 +53,1946 @@
 using namespace QDirStat;
 
 
-CacheWriter::CacheWriter( const QString & fileName, DirTree *tree )
-    : _withUidGuidPerm( true )
+namespace QDirStat
 {
-    _ok = writeCache( fileName, tree );
-}
+    /**
+     * The result of parsing one block of a cache file in a worker thread.
+     * This is shared between the CacheReader and the CacheBlockParser, so
+     * it doesn't matter which one is done with it first.
+     **/
+    struct CacheBlockResult
+    {
+	CacheBlockResult():
+	    finished( false ),
+	    ok( false ),
+	    syntaxErrors( 0 )
+	    {}
+
+	QMutex			mutex;
+	QWaitCondition		finishedCondition;
+	bool			finished;
+	bool			ok;
+	QVector<CacheItem>	items;
+	int			syntaxErrors;
+    };
+
+
+    /**
+     * Worker for the thread pool that decompresses and parses one block
+     * of a cache file. This only creates CacheItems; adding them to the
+     * tree is left to the main thread.
+     **/
+    class CacheBlockParser: public QRunnable
+    {
+    public:
 
+	CacheBlockParser( const QString &	      fileName,
+			  CacheFile::Compression      compression,
+			  const CacheBlock &	      block,
+			  bool			      withUidGidPerm,
+			  const CacheBlockResultPtr & result ):
+	    QRunnable(),
+	    _fileName( fileName ),
+	    _compression( compression ),
+	    _block( block ),
+	    _withUidGidPerm( withUidGidPerm ),
+	    _result( result )
+	    {}
 
-CacheWriter::~CacheWriter()
-{
-    // NOP
-}
+	virtual void run() Q_DECL_OVERRIDE;
 
+    protected:
 
-bool CacheWriter::writeCache( const QString & fileName, DirTree *tree )
-{
-    if ( ! tree )
-	return false;
+	void parse( QByteArray & text, QVector<CacheItem> & items, int & syntaxErrors );
 
-    FileInfo * firstToplevel = tree->firstToplevel();
+	QString			_fileName;
+	CacheFile::Compression	_compression;
+	CacheBlock		_block;
+	bool			_withUidGidPerm;
+	CacheBlockResultPtr	_result;
+    };
 
-    if ( ! firstToplevel )
-        return false;
+}	// namespace QDirStat
+
+
+void CacheBlockParser::run()
+{
+    QVector<CacheItem> items;
+    int	 syntaxErrors = 0;
+    bool ok	      = false;
 
-    gzFile cache = gzopen( (const char *) fileName.toUtf8(), "w" );
+    QFile file( _fileName );
 
-    if ( cache == 0 )
+    if ( file.open( QIODevice::ReadOnly ) && file.seek( _block.offset ) )
     {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
-	return false;
+	QByteArray text;
+	ok = CacheFile::decompressFrame( _compression, file.read( _block.size ), text );
+
+	if ( ok )
+	    parse( text, items, syntaxErrors );
     }
 
-    _withUidGuidPerm = firstToplevel->hasUid();
-    const char * version = _withUidGuidPerm ? "2.0" : "1.0";
+    QMutexLocker locker( &_result->mutex );
+
+    _result->items.swap( items );
+    _result->syntaxErrors = syntaxErrors;
+    _result->ok		  = ok;
+    _result->finished	  = true;
+    _result->finishedCondition.wakeAll();
+}
 
-    gzprintf( cache, "[qdirstat %s cache file]\n", version );
-    gzprintf( cache,
-              "# Do not edit!\n"
-              "#\n" );
 
-    if ( _withUidGuidPerm )
+void CacheBlockParser::parse( QByteArray &	   text,
+			      QVector<CacheItem> & items,
+			      int &		   syntaxErrors )
+{
+    int	   expectedFields = _withUidGidPerm ? 7 : 4;
+    char * fields[ MAX_FIELDS_PER_LINE ];
+    char * current = text.data();
+    char * end	   = current + text.size();
+
+    while ( current < end )
     {
-        gzprintf( cache,
-                  "# Type  path                            size     uid   gid  perm.       mtime      <optional fields>\n"
-                  "#\n" );
+	char * newline = (char *) memchr( current, '\n', end - current );
+	char * next    = newline ? newline + 1 : end;
+
+	if ( newline )
+	    *newline = 0;	// QByteArray::data() is 0-terminated anyway
+
+	char * line = CacheReader::skipWhiteSpace( current );
+	CacheReader::killTrailingWhiteSpace( line );
+	current = next;
+
+	if ( *line == 0 || *line == '#' )	// empty or comment line
+	    continue;
+
+	int fieldsCount = CacheReader::splitFields( line, fields );
+
+	if ( fieldsCount < expectedFields )
+	{
+	    ++syntaxErrors;
+	    continue;
+	}
+
+	items.append( CacheItem() );
+	CacheReader::parseItem( fields, fieldsCount, _withUidGidPerm, items.last() );
     }
-    else
+}
+
+
+namespace QDirStat
+{
+    /**
+     * Thread that compresses the buffers from a CacheWriter and writes them
+     * to the cache file, so filling the next buffer and compressing the
+     * last one can run in parallel. This also keeps track of the blocks
+     * and writes the block index at the end.
+     **/
+    class CacheCompressor: public QThread
     {
-        gzprintf( cache,
-                  "# Type  path                            size    mtime      <optional fields>\n"
-                  "#\n" );
-    }
+    public:
+
+	CacheCompressor( const QString & fileName, CacheFile::Compression compression ):
+	    QThread(),
+	    _fileName( fileName ),
+	    _compression( compression ),
+	    _finishing( false ),
+	    _aborted( false ),
+	    _ok( false ),
+	    _indexOffset( 0 )
+	    {}
+
+	/**
+	 * Open the cache file. Return 'true' if OK, 'false' upon error.
+	 **/
+	bool open( int level )
+	    { return _cache.openWrite( _fileName, _compression, level ); }
+
+	/**
+	 * Add 'buffer' to the queue. If 'endOfBlock' is 'true', finish the
+	 * current block after writing it. This waits if the queue is full.
+	 **/
+	void enqueue( const QByteArray & buffer, bool endOfBlock );
+
+	/**
+	 * Return 'true' if enqueue() would have to wait.
+	 **/
+	bool isFull();
+
+	/**
+	 * Write the block index and the directory index 'dirIndex' and close
+	 * the file after the last buffer.
+	 **/
+	void finish( const QByteArray & dirIndex );
+
+	/**
+	 * Stop after the current buffer and close the file.
+	 **/
+	void abort();
+
+	/**
+	 * Return 'true' if the file was written completely without error.
+	 **/
+	bool ok() const { return _ok; }
+
+    protected:
+
+	virtual void run() Q_DECL_OVERRIDE;
+
+	void startBlock();
+	void writeBlockIndex();
+	bool appendIndexTrailer();
+
+	struct Chunk
+	{
+	    QByteArray data;
+	    bool       endOfBlock;
+	};
 
-    writeTree( cache, tree->root()->firstChild() );
-    gzclose( cache );
+	QString			_fileName;
+	CacheFile::Compression	_compression;
+	CacheFile		_cache;
 
-    return true;
+	QMutex			_mutex;
+	QWaitCondition		_queueChanged;
+	QQueue<Chunk>		_queue;
+	bool			_finishing;
+	bool			_aborted;
+	bool			_ok;
+
+	QList<qint64>		_blockOffsets;
+	qint64			_indexOffset;
+	QByteArray		_dirIndex;
+    };
+
+}	// namespace QDirStat
+
+
+void CacheCompressor::enqueue( const QByteArray & buffer, bool endOfBlock )
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( _queue.size() >= CACHE_WRITE_QUEUE_LEN && ! _aborted )
+	_queueChanged.wait( &_mutex );
+
+    Chunk chunk;
+    chunk.data	     = buffer;
+    chunk.endOfBlock = endOfBlock;
+
+    _queue.enqueue( chunk );
+    _queueChanged.wakeAll();
 }
 
 
-void CacheWriter::writeTree( gzFile cache, FileInfo * item )
+bool CacheCompressor::isFull()
 {
-    if ( ! item )
-	return;
+    QMutexLocker locker( &_mutex );
 
-    //
-    // Write entry for this item
-    //
+    return _queue.size() >= CACHE_WRITE_QUEUE_LEN;
+}
 
-    if ( ! item->isDotEntry() )
-	writeItem( cache, item );
 
-    //
-    // Write file children
-    //
+void CacheCompressor::finish( const QByteArray & dirIndex )
+{
+    QMutexLocker locker( &_mutex );
 
-    if ( item->dotEntry() )
-	writeTree( cache, item->dotEntry() );
+    _dirIndex  = dirIndex;
+    _finishing = true;
+    _queueChanged.wakeAll();
+}
 
-    //
-    // Recurse through subdirectories
-    //
 
-    FileInfo * child = item->firstChild();
+void CacheCompressor::abort()
+{
+    QMutexLocker locker( &_mutex );
 
-    while ( child )
-    {
-	writeTree( cache, child );
-	child = child->next();
-    }
+    _aborted = true;
+    _queueChanged.wakeAll();
 }
 
 
-void CacheWriter::writeItem( gzFile cache, FileInfo * item )
+void CacheCompressor::run()
 {
-    if ( ! item )
-	return;
+    while ( true )
+    {
+	Chunk chunk;
 
-    // Write file type
+	{
+	    QMutexLocker locker( &_mutex );
 
-    const char * file_type = "";
-    if	    ( item->isFile()		)	file_type = "F";
-    else if ( item->isDir()		)	file_type = "D";
-    else if ( item->isSymLink()		)	file_type = "L";
-    else if ( item->isBlockDevice()	)	file_type = "BlockDev";
-    else if ( item->isCharDevice()	)	file_type = "CharDev";
-    else if ( item->isFifo()		)	file_type = "FIFO";
-    else if ( item->isSocket()		)	file_type = "Socket";
+	    while ( _queue.isEmpty() && ! _finishing && ! _aborted )
+		_queueChanged.wait( &_mutex );
 
-    gzprintf( cache, "%s", file_type );
+	    if ( _aborted || _queue.isEmpty() )
+		break;
 
-    // Write name
+	    chunk = _queue.dequeue();
+	    _queueChanged.wakeAll();	// There is room in the queue again
+	}
 
-    if ( item->isDirInfo() && ! item->isDotEntry() )
-    {
-	// Use absolute path
+	_cache.write( chunk.data.constData(), chunk.data.size() );
 
-	gzprintf( cache, " %-30s", urlEncoded( item->url() ).data() );
+	if ( chunk.endOfBlock )
+	    startBlock();
     }
-    else
-    {
-	// Use relative path
 
-	gzprintf( cache, "\t%-24s", urlEncoded( item->name() ).data() );
+    if ( _aborted )
+    {
+	_cache.close();
+	return;
     }
 
+    writeBlockIndex();
+    _ok = _cache.close() && appendIndexTrailer();
+}
 
-    // Write size
 
-    gzprintf( cache, "\t%s", formatSize( item->rawByteSize() ).toUtf8().data() );
+void CacheCompressor::startBlock()
+{
+    _cache.finishFrame();	// The next write starts a new frame
+    _blockOffsets << _cache.compressedOffset();
+}
 
 
-    // Format 2.0 only: UID, GID, permissions
+void CacheCompressor::writeBlockIndex()
+{
+    _cache.finishFrame();
+    _indexOffset = _cache.compressedOffset();
 
-    if ( _withUidGuidPerm )
+    _cache.printf( "#@ Block index: offset size\n" );
+
+    for ( int i=0; i < _blockOffsets.size(); ++i )
     {
-        gzprintf( cache, "\t%d  %d  0%3o",
-                  item->uid(),
-                  item->gid(),
-                  item->mode() & ALLPERMS );
+	qint64 end = i+1 < _blockOffsets.size() ? _blockOffsets.at( i+1 ) : _indexOffset;
+
+	_cache.printf( "#@ %lld %lld\n",
+		       (long long) _blockOffsets.at( i ),
+		       (long long) ( end - _blockOffsets.at( i ) ) );
     }
 
+    if ( ! _dirIndex.isEmpty() )
+    {
+	// See CacheIndex. Readers that don't know it ignore those lines: They
+	// have more than the two fields of a block index line.
 
-    // Write mtime
+	_cache.printf( "#@ Directory index: parent block offset files"
+		       " items subdirs total_files unignored"
+		       " total_size allocated blocks latest oldest  entry\n" );
+	_cache.write( _dirIndex.constData(), _dirIndex.size() );
+    }
+}
 
-    gzprintf( cache, "\t0x%lx", (unsigned long) item->mtime() );
 
-    // Optional fields
+bool CacheCompressor::appendIndexTrailer()
+{
+    QFile file( _fileName );
 
-    if ( item->isSparseFile() )
-	gzprintf( cache, "\tblocks: %lld", item->blocks() );
+    if ( ! file.open( QIODevice::Append ) )
+    {
+	logError() << "Can't open " << _fileName << ": " << file.errorString() << endl;
+	return false;
+    }
 
-    if ( item->isFile() && item->links() > 1 )
-	gzprintf( cache, "\tlinks: %u", (unsigned) item->links() );
+    QByteArray trailer = CacheFile::offsetTrailer( _compression, _indexOffset );
 
-    gzputc( cache, '\n' );
+    return file.write( trailer ) == trailer.size();
 }
 
 
-QByteArray CacheWriter::urlEncoded( const QString & path )
+
+
+CacheWriter::CacheWriter( const QString & fileName,
+			  DirTree *	  tree,
+			  bool		  background ):
+    QObject(),
+    _fileName( fileName ),
+    _tree( tree ),
+    _withUidGuidPerm( true ),
+    _ok( false ),
+    _finished( false ),
+    _aborted( false ),
+    _compressor( 0 ),
+    _bufferedBytes( 0 ),
+    _blockStart( 0 ),
+    _blockSize( CACHE_BLOCK_SIZE ),
+    _blockNo( -1 ),
+    _dirCount( 0 ),
+    _itemsWritten( 0 ),
+    _totalItems( 0 )
 {
-    // Using a protocol ("scheme") part to avoid directory names with a colon
-    // ":" being cut off because it looks like a URL protocol.
-    QUrl url;
-    url.setScheme( "foo" );
-    url.setPath( path );
+    _ok = startWriting( tree );
+
+    if ( background )
+    {
+	if ( _ok && _compressor )
+	{
+	    connect( _compressor, SIGNAL( finished()		 ),
+		     this,	  SLOT	( compressorFinished() ) );
+	}
 
-    QByteArray encoded = url.toEncoded( QUrl::RemoveScheme );
+	// Not right now: The caller needs to connect the signals first.
 
-    if ( encoded.isEmpty() )
+	QTimer::singleShot( 0, this, SLOT( writeSlice() ) );
+    }
+    else
     {
-        logError() << "Invalid file/dir name: " << path << endl;
+	if ( _ok )
+	{
+	    writeItems( 0 );
+	    _ok = finishWriting();
+	}
+
+	_finished = true;
     }
+}
 
-    return encoded;
 
+CacheWriter::CacheWriter( bool withUidGidPerm ):
+    QObject(),
+    _tree( 0 ),
+    _withUidGuidPerm( withUidGidPerm ),
+    _ok( true ),
+    _finished( false ),
+    _aborted( false ),
+    _compressor( 0 ),
+    _bufferedBytes( 0 ),
+    _blockStart( 0 ),
+    _blockSize( CACHE_BLOCK_SIZE ),
+    _blockNo( -1 ),
+    _dirCount( 0 ),
+    _itemsWritten( 0 ),
+    _totalItems( 0 )
+{
 }
 
 
-QString CacheWriter::formatSize( FileSize size )
+CacheWriter::~CacheWriter()
 {
-    if ( size >= TB && size % TB == 0 )
-        return QString( "%1T" ).arg( size / TB );
+    if ( _compressor )
+    {
+	if ( ! _finished && ! _compressor->isFinished() )
+	{
+	    // Destroyed while writing in the background
 
-    if ( size >= GB && size % GB == 0 )
-        return QString( "%1G" ).arg( size / GB );
+	    _compressor->abort();
+	    _compressor->wait();
+	    QFile::remove( _fileName );
+	}
 
-    if ( size >= MB && size % MB == 0 )
-        return QString( "%1M" ).arg( size / MB );
+	delete _compressor;
+    }
+}
 
-    if ( size >= KB && size % KB == 0 )
-        return QString( "%1K" ).arg( size / KB );
 
-    return QString( "%1" ).arg( size );
-}
+bool CacheWriter::startWriting( DirTree * tree )
+{
+    if ( ! tree )
+	return false;
+
+    FileInfo * firstToplevel = tree->firstToplevel();
 
+    if ( ! firstToplevel )
+        return false;
 
+    if ( _fileName.endsWith( BINARY_CACHE_SUFFIX ) )
+    {
+	// This is written right away: There is nothing to format or to
+	// compress.
 
+	BinaryCacheWriter writer( _fileName, tree );
+	return writer.ok();
+    }
 
+    // The file name can override the compression from the settings
 
+    CacheFile::Compression compression =
+	tree->cacheUseZstd() ? CacheFile::Zstd : CacheFile::Gzip;
 
+    if ( _fileName.endsWith( ZSTD_CACHE_SUFFIX ) )
+	compression = CacheFile::Zstd;
+    else if ( _fileName.endsWith( GZIP_CACHE_SUFFIX ) )
+	compression = CacheFile::Gzip;
 
-CacheReader::CacheReader( const QString & fileName,
-			  DirTree *	  tree,
-			  DirInfo *	  parent ):
-    QObject(),
-    _multiSlash( "//+" ) // cache regexp for multiple use
-{
-    _fileName		= fileName;
-    _buffer[0]		= 0;
-    _line		= _buffer;
-    _lineNo		= 0;
-    _ok			= true;
-    _aborted            = false;
-    _errorCount         = 0;
-    _tree		= tree;
-    _toplevel		= parent;
-    _lastDir		= 0;
-    _lastExcludedDir	= 0;
+    _compressor = new CacheCompressor( _fileName, compression );
+    CHECK_NEW( _compressor );
+
+    if ( ! _compressor->open( tree->cacheCompressionLevel() ) )
+	return false;
+
+    // zstd compresses better with more context, and it decompresses fast
+    // enough that larger blocks still keep all cores busy.
 
-    _cache = gzopen( fileName.toUtf8(), "r" );
+    _blockSize = compression == CacheFile::Zstd ? CACHE_ZSTD_BLOCK_SIZE : CACHE_BLOCK_SIZE;
+    _buffer.reserve( CACHE_WRITE_BUFFER_SIZE + MAX_CACHE_LINE_LEN );
 
-    if ( _cache == 0 )
+    _withUidGuidPerm = firstToplevel->hasUid();
+
+    _buffer.append( _withUidGuidPerm ?
+		    "[qdirstat 2.0 cache file]\n" :
+		    "[qdirstat 1.0 cache file]\n" );
+    _buffer.append( "# Do not edit!\n"
+		    "#\n" );
+
+    if ( _withUidGuidPerm )
     {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
-	_ok = false;
-	emit error();
-	return;
+        _buffer.append( "# Type  path                            size     uid   gid  perm.       mtime      <optional fields>\n"
+                        "#\n" );
+    }
+    else
+    {
+        _buffer.append( "# Type  path                            size    mtime      <optional fields>\n"
+                        "#\n" );
     }
 
-    // logDebug() << "Opening " << fileName << " OK" << endl;
-    checkHeader();
+    _compressor->start();
+    startBlock();	// The header is a frame of its own
+
+    FileInfo * toplevel = tree->root()->firstChild();
+    _url.clear();
+    _totalItems = tree->root()->totalItems();
+
+    if ( toplevel )
+    {
+	if ( toplevel->parent() )
+	    toplevel->parent()->appendUrl( _url );
+
+	enterItem( toplevel );
+    }
+
+    return true;
 }
 
 
-CacheReader::~CacheReader()
+bool CacheWriter::writeItems( int maxItems )
 {
-    if ( _cache )
-	gzclose( _cache );
-
-    logDebug() << "Cache reading finished" << endl;
+    int count = 0;
 
-    if ( _toplevel && ! _aborted )
+    while ( ! _steps.isEmpty() && ( maxItems == 0 || count < maxItems ) )
     {
-	// logDebug() << "Finalizing recursive for " << _toplevel << endl;
-	finalizeRecursive( _toplevel );
-	_toplevel->finalizeAll();
+	TraversalStep & step = _steps.last();
+
+	if ( step.nextChild < step.children.size() )
+	{
+	    FileInfo * child = step.children.at( step.nextChild++ );
+	    enterItem( child );	// This might invalidate 'step'
+	    ++count;
+	}
+	else
+	{
+	    _url.truncate( step.parentUrlLen );
+	    _steps.removeLast();
+	}
     }
 
-    emit finished();
+    return ! _steps.isEmpty();
 }
 
 
-void CacheReader::rewind()
+void CacheWriter::enterItem( FileInfo * item )
 {
-    if ( _cache )
+    if ( ! item->isDirInfo() )
     {
-	gzrewind( _cache );
-	checkHeader();		// skip cache header
+	// No children, and only the name is written, not the URL
+
+	writeItem( _buffer, item, _url );
+	++_itemsWritten;
+    }
+    else
+    {
+	// The files of the dot entry are written as children of the
+	// directory itself, so this is always a real directory.
+
+	TraversalStep step;
+	step.item	  = item;
+	step.children	  = sortedChildren( item->toDirInfo() );
+	step.nextChild	  = 0;
+	step.parentUrlLen = _url.size();
+	step.dirNo	  = _steps.isEmpty() ? -1 : _steps.last().dirNo;
+
+	item->appendToParentUrl( _url );
+
+	// Start new blocks only with a directory: Its absolute path is all a
+	// reader needs to parse that block on its own.
+
+	if ( _bufferedBytes + _buffer.size() - _blockStart >= _blockSize )
+	    startBlock();
+
+	addToDirIndex( item->toDirInfo(), step.dirNo );
+	step.dirNo = _dirCount++;
+
+	writeItem( _buffer, item, _url );
+	++_itemsWritten;
+
+	_steps.append( step );
     }
+
+    if ( _buffer.size() >= CACHE_WRITE_BUFFER_SIZE )
+	flushBuffer();
 }
 
 
-bool CacheReader::read( int maxLines )
+void CacheWriter::writeSubtree( CacheFile & file,
+				DirInfo *   subtree,
+				bool	    withUidGidPerm )
 {
-    while ( ! gzeof( _cache )
-	    && _ok
-	    && ( maxLines == 0 || --maxLines > 0 ) )
+    if ( ! subtree )
+	return;
+
+    CacheWriter writer( withUidGidPerm );
+
+    if ( subtree->parent() )
+	subtree->parent()->appendUrl( writer._url );
+
+    writer.enterItem( subtree );
+    bool more = true;
+
+    while ( more )
     {
-	if ( readLine() )
-	{
-	    splitLine();
-	    addItem();
-	}
+	more = writer.writeItems( CACHE_WRITE_SLICE_ITEMS );
+	file.write( writer._buffer.constData(), writer._buffer.size() );
+	writer._buffer.clear();
     }
+}
 
-    return _ok && ! gzeof( _cache );
+
+static bool nameLessThan( const FileInfo * a, const FileInfo * b )
+{
+    return AggregateInfo::storedName( a ) < AggregateInfo::storedName( b );
 }
 
 
-void CacheReader::addItem()
+QVector<FileInfo *> CacheWriter::sortedChildren( DirInfo * dir )
 {
-    int expectedFields = _withUidGidPerm ? 7 : 4;
+    QVector<FileInfo *> files;
+    QVector<FileInfo *> subDirs;
 
-    if ( fieldsCount() < expectedFields )
+    if ( ! dir )
+	return files;
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
     {
-	logError() << "Syntax error in " << _fileName << ":" << _lineNo
-		   << ": Expected at least " << expectedFields
-                   << " fields, saw only " << fieldsCount()
-		   << endl;
+	if ( child->isDirInfo() )
+	    subDirs << child;
+	else
+	    files << child;
+    }
+
+    if ( dir->dotEntry() )
+    {
+	for ( FileInfo * child = dir->dotEntry()->firstChild(); child; child = child->next() )
+	    files << child;
+    }
 
-	setReadError( _lastDir );
+    std::sort( files.begin(),	files.end(),   nameLessThan );
+    std::sort( subDirs.begin(), subDirs.end(), nameLessThan );
+
+    files += subDirs;
+
+    return files;
+}
 
-	if ( ++_errorCount > MAX_ERROR_COUNT )
-	{
-	    logError() << "Too many syntax errors. Giving up." << endl;
-	    _ok = false;
-	    emit error();
-	}
 
+void CacheWriter::flushBuffer( bool endOfBlock )
+{
+    if ( ! _compressor || ( _buffer.isEmpty() && ! endOfBlock ) )
 	return;
-    }
 
-    int n = 0;
-    char * type		= field( n++ );
-    char * raw_path	= field( n++ );
-    char * size_str	= field( n++ );
+    _bufferedBytes += _buffer.size();
+    _compressor->enqueue( _buffer, endOfBlock );
 
-    char * uid_str      = _withUidGidPerm ? field( n++ ) : 0;
-    char * gid_str      = _withUidGidPerm ? field( n++ ) : 0;
-    char * perm_str     = _withUidGidPerm ? field( n++ ) : 0;
+    // The compressor has its own copy now: Start a new buffer
 
-    char * mtime_str	= field( n++ );
-    char * blocks_str	= 0;
-    char * links_str	= 0;
+    _buffer = QByteArray();
+    _buffer.reserve( CACHE_WRITE_BUFFER_SIZE + MAX_CACHE_LINE_LEN );
+}
+
+
+void CacheWriter::startBlock()
+{
+    flushBuffer( true );
+    _blockStart = _bufferedBytes;
+    ++_blockNo;
+}
+
+
+bool CacheWriter::finishWriting()
+{
+    if ( ! _compressor )
+	return _ok;
+
+    flushBuffer();
+    _compressor->finish( _dirIndex );
+    _compressor->wait();
+
+    return _ok && _compressor->ok();
+}
+
+
+void CacheWriter::writeSlice()
+{
+    if ( _finished )
+	return;
+
+    if ( ! _ok || ! _compressor )
+    {
+	// Error or binary format: Nothing (more) to do in the background
+
+	_finished = true;
+	emit finished( _ok, false );
+	return;
+    }
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    bool more = true;
+
+    while ( more && stopWatch.elapsed() < CACHE_WRITE_SLICE_MILLISEC )
+    {
+	if ( _compressor->isFull() )
+	    break;	// Don't block the event loop; let the compressor catch up
+
+	more = writeItems( CACHE_WRITE_SLICE_ITEMS );
+    }
+
+    emit progress( _itemsWritten, _totalItems );
+
+    if ( more )
+    {
+	QTimer::singleShot( _compressor->isFull() ? CACHE_WRITE_WAIT_MILLISEC : 0,
+			    this, SLOT( writeSlice() ) );
+    }
+    else
+    {
+	// compressorFinished() follows when the file is complete
+
+	flushBuffer();
+	_compressor->finish( _dirIndex );
+	_dirIndex.clear();
+    }
+}
+
+
+void CacheWriter::compressorFinished()
+{
+    if ( _finished )
+	return;
+
+    _ok	      = _ok && _compressor->ok();
+    _finished = true;
+
+    emit finished( _ok, false );
+}
+
+
+void CacheWriter::abort()
+{
+    if ( _finished )
+	return;
+
+    logInfo() << "Aborted writing " << _fileName << endl;
+
+    _aborted  = true;
+    _finished = true;
+    _ok	      = false;
+    _steps.clear();
+    _dirIndex.clear();
+
+    if ( _compressor )
+    {
+	_compressor->abort();
+	_compressor->wait();
+	QFile::remove( _fileName );
+    }
+
+    emit finished( false, true );
+}
+
+
+void CacheWriter::writeItem( QByteArray & buffer, FileInfo * item, const QString & url )
+{
+    if ( ! item )
+	return;
+
+    // Write file type
+
+    const char * file_type = "";
+    if	    ( item->isFile()		)	file_type = "F";
+    else if ( item->isDir()		)	file_type = "D";
+    else if ( item->isSymLink()		)	file_type = "L";
+    else if ( item->isBlockDevice()	)	file_type = "BlockDev";
+    else if ( item->isCharDevice()	)	file_type = "CharDev";
+    else if ( item->isFifo()		)	file_type = "FIFO";
+    else if ( item->isSocket()		)	file_type = "Socket";
+
+    buffer.append( file_type );
+
+    // Write name
+
+    int nameStart;
+    int nameWidth;
+
+    if ( item->isDirInfo() && ! item->isDotEntry() )
+    {
+	// Use absolute path
+
+	buffer.append( ' ' );
+	nameStart = buffer.size();
+	nameWidth = 30;
+	appendUrlEncoded( buffer, url );
+    }
+    else
+    {
+	// Use relative path
+
+	buffer.append( '\t' );
+	nameStart = buffer.size();
+	nameWidth = 24;
+	appendUrlEncoded( buffer, AggregateInfo::storedName( item ) );
+    }
+
+    if ( buffer.size() == nameStart )
+        logError() << "Invalid file/dir name: " << url << endl;
+
+    while ( buffer.size() < nameStart + nameWidth )
+	buffer.append( ' ' );
+
+
+    // Write size
+
+    buffer.append( '\t' );
+    appendSize( buffer, item->rawByteSize() );
+
+
+    // Format 2.0 only: UID, GID, permissions
+
+    if ( _withUidGuidPerm )
+    {
+	mode_t perm = item->mode() & ALLPERMS;
+
+	buffer.append( '\t' );
+	appendNumber( buffer, item->uid() );
+	buffer.append( "  " );
+	appendNumber( buffer, item->gid() );
+	buffer.append( "  0" );
+
+	if ( perm < 0100 )	// Always at least 3 octal digits
+	    buffer.append( perm < 010 ? "00" : "0" );
+
+	appendNumber( buffer, perm, 8 );
+    }
+
+
+    // Write mtime
+
+    buffer.append( "\t0x" );
+    appendNumber( buffer, item->mtime(), 16 );
+
+    // Optional fields
+
+    if ( item->isSparseFile() )
+    {
+	buffer.append( "\tblocks: " );
+	appendNumber( buffer, item->blocks() );
+    }
+
+    if ( item->isFile() && item->links() > 1 )
+    {
+	buffer.append( "\tlinks: " );
+	appendNumber( buffer, item->links() );
+    }
+
+    if ( item->isAggregate() )
+	writeAggregate( buffer, static_cast<AggregateInfo *>( item ) );
+
+    if ( item->isDirInfo() && ! item->isDotEntry() )
+    {
+	// Unsigned, but hex numbers are written like that anyway
+
+	buffer.append( "\tdigest: 0x" );
+	appendNumber( buffer, (qint64) item->toDirInfo()->digest(), 16 );
+    }
+
+    buffer.append( '\n' );
+}
+
+
+void CacheWriter::writeAggregate( QByteArray & buffer, AggregateInfo * aggregate )
+{
+    buffer.append( "\taggregate: " );
+    appendNumber( buffer, aggregate->count() );
+
+    buffer.append( "\tallocated: " );
+    appendNumber( buffer, aggregate->rawAllocatedSize() );
+
+    buffer.append( "\tblocks: " );
+    appendNumber( buffer, aggregate->blocks() );
+
+    buffer.append( "\toldest: 0x" );
+    appendNumber( buffer, aggregate->oldestMtime(), 16 );
+
+    buffer.append( "\thistogram: " );
+
+    for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+    {
+	if ( i > 0 )
+	    buffer.append( ',' );
+
+	appendNumber( buffer, aggregate->histogram( i ) );
+    }
+}
+
+
+void CacheWriter::addToDirIndex( DirInfo * dir, int parentDirNo )
+{
+    // Only a file of its own has blocks and a directory index, not the
+    // lines of writeSubtree()
+
+    if ( ! dir || ! _compressor )
+	return;
+
+    // The files of a directory are in its dot entry if it has one
+
+    int files = 0;
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() )
+	    ++files;
+    }
+
+    if ( dir->dotEntry() )
+    {
+	for ( FileInfo * child = dir->dotEntry()->firstChild(); child; child = child->next() )
+	    ++files;
+    }
+
+    _dirIndex.append( "#@D " );
+    appendNumber( _dirIndex, parentDirNo );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, _blockNo );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, _bufferedBytes + _buffer.size() - _blockStart );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, files );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalItems() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalSubDirs() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalFiles() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalUnignoredItems() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalSize() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalAllocatedSize() );
+    _dirIndex.append( ' ' );
+    appendNumber( _dirIndex, dir->totalBlocks() );
+    _dirIndex.append( " 0x" );
+    appendNumber( _dirIndex, dir->latestMtime(), 16 );
+    _dirIndex.append( " 0x" );
+    appendNumber( _dirIndex, dir->oldestFileMtime(), 16 );
+    _dirIndex.append( '\t' );
+
+    // Only the toplevel directory with its complete path; the others can
+    // only be reached through their parents anyway.
+
+    writeItem( _dirIndex, dir, parentDirNo < 0 ? _url : dir->name() );
+}
+
+
+void CacheWriter::appendNumber( QByteArray & buffer, qint64 value, int base )
+{
+    // Like printf(): Only decimal numbers are signed
+
+    bool    negative = base == 10 && value < 0;
+    quint64 rest     = negative ? - (quint64) value : (quint64) value;
+
+    char digits[ 24 ];	// 64 bit octal: 22 digits
+    int	 pos = sizeof( digits );
+
+    do
+    {
+	digits[ --pos ] = "0123456789abcdef"[ rest % base ];
+	rest /= base;
+    }
+    while ( rest > 0 );
+
+    if ( negative )
+	digits[ --pos ] = '-';
+
+    buffer.append( digits + pos, sizeof( digits ) - pos );
+}
+
+
+void CacheWriter::appendSize( QByteArray & buffer, FileSize size )
+{
+    const char * unit = 0;
+
+    if	    ( size >= TB && size % TB == 0 ) { size /= TB; unit = "T"; }
+    else if ( size >= GB && size % GB == 0 ) { size /= GB; unit = "G"; }
+    else if ( size >= MB && size % MB == 0 ) { size /= MB; unit = "M"; }
+    else if ( size >= KB && size % KB == 0 ) { size /= KB; unit = "K"; }
+
+    appendNumber( buffer, size );
+
+    if ( unit )
+	buffer.append( unit );
+}
+
+
+/**
+ * Append 'byte' in percent notation to 'buffer'.
+ **/
+static inline void appendEscaped( QByteArray & buffer, uint byte )
+{
+    const char * hex = "0123456789ABCDEF";
+
+    buffer.append( '%' );
+    buffer.append( hex[ ( byte >> 4 ) & 0xF ] );
+    buffer.append( hex[ byte & 0xF ] );
+}
+
+
+void CacheWriter::appendUrlEncoded( QByteArray & buffer, const QString & path )
+{
+    const QChar * data = path.constData();
+    int		  len  = path.size();
+
+    for ( int i=0; i < len; ++i )
+    {
+	uint c = data[ i ].unicode();
+
+	if ( c < 0x80 )
+	{
+	    // Unreserved characters and those that QUrl doesn't escape in
+	    // paths either
+
+	    bool plain = ( c >= 'a' && c <= 'z' ) ||
+		( c >= 'A' && c <= 'Z' ) ||
+		( c >= '0' && c <= '9' ) ||
+		( c != 0 && strchr( "-._~!$&'()*+,;=:@/", c ) );
+
+	    if ( plain )
+		buffer.append( (char) c );
+	    else
+		appendEscaped( buffer, c );
+
+	    continue;
+	}
+
+	// Everything else is escaped byte by byte in UTF-8
+
+	if ( data[ i ].isHighSurrogate() && i+1 < len && data[ i+1 ].isLowSurrogate() )
+	{
+	    c = QChar::surrogateToUcs4( data[ i ], data[ i+1 ] );
+	    ++i;
+	}
+
+	if ( c < 0x800 )
+	{
+	    appendEscaped( buffer, 0xC0 | ( c >> 6 ) );
+	}
+	else if ( c < 0x10000 )
+	{
+	    appendEscaped( buffer, 0xE0 | ( c >> 12 ) );
+	    appendEscaped( buffer, 0x80 | ( ( c >> 6 ) & 0x3F ) );
+	}
+	else
+	{
+	    appendEscaped( buffer, 0xF0 | ( c >> 18 ) );
+	    appendEscaped( buffer, 0x80 | ( ( c >> 12 ) & 0x3F ) );
+	    appendEscaped( buffer, 0x80 | ( ( c >> 6 ) & 0x3F ) );
+	}
+
+	appendEscaped( buffer, 0x80 | ( c & 0x3F ) );
+    }
+}
+
+
+
+
+
+
+
+CacheReader::CacheReader( const QString & fileName,
+			  DirTree *	  tree,
+			  DirInfo *	  parent ):
+    QObject()
+{
+    _fileName		= fileName;
+    _buffer[0]		= 0;
+    _line		= _buffer;
+    _lineNo		= 0;
+    _ok			= true;
+    _aborted            = false;
+    _errorCount         = 0;
+    _tree		= tree;
+    _toplevel		= parent;
+    _lastDir		= 0;
+    _lastExcludedDir	= 0;
+    _pendingParent	= 0;
+    _binary		= 0;
+    _binaryPos		= 0;
+    _nextBlock		= 0;
+    _blockItemPos	= 0;
+    _stopWatch.start();
+
+    // Subtrees might be deleted while this is reading, e.g. by a journal
+    // command or by another read job; forget the directories in them.
+
+    if ( _tree )
+    {
+	connect( _tree, SIGNAL( deletingChild	   ( FileInfo * ) ),
+		 this,	SLOT  ( deletingChildNotify( FileInfo * ) ) );
+
+	connect( _tree, SIGNAL( clearingSubtree	     ( DirInfo * ) ),
+		 this,	SLOT  ( clearingSubtreeNotify( DirInfo * ) ) );
+    }
+
+    if ( BinaryCacheReader::isBinaryCache( fileName ) )
+    {
+	_binary = new BinaryCacheReader( fileName );
+	CHECK_NEW( _binary );
+
+	_withUidGidPerm = _binary->withUidGidPerm();
+
+	if ( ! _binary->ok() )
+	{
+	    _ok = false;
+	    emit error();
+	}
+
+	return;
+    }
+
+    if ( ! _cache.openRead( fileName ) )
+    {
+	_ok = false;
+	emit error();
+	return;
+    }
+
+    // logDebug() << "Opening " << fileName << " OK" << endl;
+
+    if ( checkHeader() )
+	readBlockIndex();
+}
+
+
+CacheReader::~CacheReader()
+{
+    _cache.close();
+
+    logDebug() << "Cache reading finished after "
+	       << formatMillisec( _stopWatch.elapsed() ) << endl;
+
+    if ( _aborted )
+    {
+	// Not inserted into the tree yet
+	qDeleteAll( _pendingChildren );
+	_pendingChildren.clear();
+    }
+    else
+	flushPendingChildren();
+
+    if ( _toplevel && ! _aborted )
+    {
+	// logDebug() << "Finalizing recursive for " << _toplevel << endl;
+	finalizeRecursive( _toplevel );
+	_toplevel->finalizeAll();
+    }
+
+    delete _binary;
+
+    emit finished();
+}
+
+
+void CacheReader::rewind()
+{
+    if ( _binary )
+    {
+	_binaryPos = 0;
+	_binaryDirEntries.clear();
+	_binaryDirs.clear();
+    }
+
+    _dirsByPath.clear();
+
+    if ( _cache.isOpen() )
+    {
+	_cache.rewind();
+	checkHeader();		// skip cache header
+    }
+
+    if ( ! _blocks.isEmpty() )
+    {
+	// Blocks that are still being parsed are simply discarded when
+	// they are done
+
+	_nextBlock = 0;
+	_blockResults.clear();
+	_blockItems.clear();
+	_blockItemPos = 0;
+    }
+}
+
+
+bool CacheReader::read( int maxLines )
+{
+    if ( _binary )
+	return readBinary( maxLines );
+
+    if ( ! _blocks.isEmpty() )
+	return readBlocks( maxLines );
+
+    while ( ! _cache.eof()
+	    && _ok
+	    && ( maxLines == 0 || --maxLines > 0 ) )
+    {
+	if ( readLine() )
+	{
+	    splitLine();
+
+	    if ( fieldsCount() > 0 )	// Not just a comment at the end
+		addItem();
+	}
+    }
+
+    flushPendingChildren();
+
+    return _ok && ! _cache.eof();
+}
+
+
+void CacheReader::addItem()
+{
+    int expectedFields = _withUidGidPerm ? 7 : 4;
+
+    if ( fieldsCount() < expectedFields )
+    {
+	logError() << "Syntax error in " << _fileName << ":" << _lineNo
+		   << ": Expected at least " << expectedFields
+                   << " fields, saw only " << fieldsCount()
+		   << endl;
+
+	syntaxError();
+	return;
+    }
+
+    CacheItem item;
+    parseItem( _fields, _fieldsCount, _withUidGidPerm, item );
+    insertItem( item );
+}
+
+
+void CacheReader::syntaxError()
+{
+    setReadError( _lastDir );
+
+    if ( ++_errorCount > MAX_ERROR_COUNT )
+    {
+	logError() << "Too many syntax errors. Giving up." << endl;
+	_ok = false;
+	emit error();
+    }
+}
+
+
+void CacheReader::parseItem( char **	 fields,
+			     int	 fieldsCount,
+			     bool	 withUidGidPerm,
+			     CacheItem & item )
+{
+    int n = 0;
+    char * type		= fields[ n++ ];
+    char * raw_path	= fields[ n++ ];
+    char * size_str	= fields[ n++ ];
+
+    char * uid_str      = withUidGidPerm ? fields[ n++ ] : 0;
+    char * gid_str      = withUidGidPerm ? fields[ n++ ] : 0;
+    char * perm_str     = withUidGidPerm ? fields[ n++ ] : 0;
+
+    char * mtime_str	= fields[ n++ ];
+    char * blocks_str	= 0;
+    char * links_str	= 0;
+    char * aggregate_str	= 0;
+    char * allocated_str	= 0;
+    char * oldest_str	= 0;
+    char * digest_str	= 0;
+    const char * histogram_str = 0;
+
+    while ( fieldsCount > n+1 )
+    {
+	char * keyword	= fields[ n++ ];
+	char * val_str	= fields[ n++ ];
+
+	if	( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
+	else if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str  = val_str;
+	else if ( strcasecmp( keyword, "aggregate:" ) == 0 ) aggregate_str = val_str;
+	else if ( strcasecmp( keyword, "allocated:" ) == 0 ) allocated_str = val_str;
+	else if ( strcasecmp( keyword, "oldest:"    ) == 0 ) oldest_str    = val_str;
+	else if ( strcasecmp( keyword, "histogram:" ) == 0 ) histogram_str = val_str;
+	else if ( strcasecmp( keyword, "digest:"    ) == 0 ) digest_str    = val_str;
+    }
+
+
+    // Type
+
+    mode_t mode = S_IFREG;
+
+    if	    ( strcasecmp( type, "F"	   ) == 0 )	mode = S_IFREG;
+    else if ( strcasecmp( type, "D"	   ) == 0 )	mode = S_IFDIR;
+    else if ( strcasecmp( type, "L"	   ) == 0 )	mode = S_IFLNK;
+    else if ( strcasecmp( type, "BlockDev" ) == 0 )	mode = S_IFBLK;
+    else if ( strcasecmp( type, "CharDev"  ) == 0 )	mode = S_IFCHR;
+    else if ( strcasecmp( type, "FIFO"	   ) == 0 )	mode = S_IFIFO;
+    else if ( strcasecmp( type, "Socket"   ) == 0 )	mode = S_IFSOCK;
+
+    item.isDir = mode == S_IFDIR;
+
+
+    // Path
+
+    item.absolutePath = *raw_path == '/';
+
+
+    // Size
+
+    const char * end = 0;
+    FileSize size = parseNumber( size_str, 10, &end );
+
+    switch ( *end )
+    {
+	case 'K':	size *= KB; break;
+	case 'M':	size *= MB; break;
+	case 'G':	size *= GB; break;
+	case 'T':	size *= TB; break;
+	default: break;
+    }
+
+    item.size = size;
+
+
+    // UID, GID, permissions
+
+    item.uid	= uid_str  ? parseNumber( uid_str  ) : 0;
+    item.gid	= gid_str  ? parseNumber( gid_str  ) : 0;
+    mode_t perm = perm_str ? parseNumber( perm_str, 8 ) : 0;
+
+    item.mode = mode | perm;
+
+
+    // MTime
+
+    item.mtime = parseNumber( mtime_str, 0 );
+
+
+    // Blocks
+
+    item.blocks = blocks_str ? parseNumber( blocks_str ) : -1;
+
+
+    // Links
+
+    item.links = links_str ? parseNumber( links_str ) : 1;
+
+
+    // Subtree digest
+
+    item.digest = digest_str ? (quint64) parseNumber( digest_str, 16 ) : 0;
+
+
+    // Aggregate sums
+
+    item.isAggregate = aggregate_str != 0;
+
+    if ( aggregate_str )
+    {
+	item.count	   = parseNumber( aggregate_str );
+	item.allocatedSize = allocated_str ? parseNumber( allocated_str ) : size;
+	item.oldestMtime   = oldest_str ? parseNumber( oldest_str, 0 ) : item.mtime;
+
+	for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+	{
+	    item.histogram[ i ] = 0;
+
+	    if ( histogram_str )
+	    {
+		const char * end = 0;
+		item.histogram[ i ] = parseNumber( histogram_str, 10, &end );
+		histogram_str = *end == ',' ? end + 1 : 0;
+	    }
+	}
+    }
+
+
+    // Path and name
+
+    splitRawPath( raw_path, item.path, item.name );
+}
+
+
+void CacheReader::insertItem( const CacheItem & cached )
+{
+    const QString & path = cached.path;
+    const QString & name = cached.name;
+
+    if ( cached.absolutePath )
+	_lastDir = 0;
+
+    if ( _lastExcludedDir )
+    {
+	if ( path.startsWith( _lastExcludedDirUrl ) )
+	{
+	    // logDebug() << "Excluding " << path << "/" << name << endl;
+	    return;
+	}
+    }
+
+    // A new directory might need the files read so far for its parent,
+    // e.g. when locating it.
+
+    if ( cached.isDir )
+	flushPendingChildren();
+
+    // Find parent in tree
+
+    DirInfo * parent = _lastDir;
+
+    if ( ! parent && _tree->root() )
+    {
+	parent = locateParent( path, name );
+
+	if ( ! parent )
+	    return;	// Ignore this cache line completely
+    }
+
+    if ( parent && parent != _toplevel && parent->isExcluded() )
+    {
+	// Inside an excluded directory, but not right after it in the cache
+	// file. Make sure that anything further below ends up here as well.
+
+	if ( cached.isDir )
+	    _dirsByPath.insert( buildPath( path, name ), parent );
+
+	return;
+    }
+
+    if ( cached.isDir )
+    {
+	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
+#if VERBOSE_CACHE_DIRS
+	logDebug() << "Creating DirInfo for " << url << " with parent " << parent << endl;
+#endif
+	DirInfo * dir = new DirInfo( _tree, parent, url,
+				     cached.mode, cached.size,
+                                     _withUidGidPerm, cached.uid, cached.gid,
+                                     cached.mtime );
+	dir->setReadState( DirReading );
+	_lastDir = dir;
+	_dirsByPath.insert( cached.absolutePath ? buildPath( path, name ) : dir->url(), dir );
+
+	if ( parent )
+	    parent->insertChild( dir );
+
+	if ( ! _tree->root() )
+	{
+	    _tree->setRoot( dir );
+	    _toplevel = dir;
+	}
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	_tree->childAddedNotify( dir );
+
+	if ( dir != _toplevel )
+	{
+	    if ( ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	    {
+		logDebug() << "Excluding " << name << endl;
+		dir->setExcluded();
+		dir->setReadState( DirOnRequestOnly );
+		dir->finalizeLocal();
+		_tree->sendReadJobFinished( dir );
+
+		_lastExcludedDir    = dir;
+		_lastExcludedDirUrl = _lastExcludedDir->url();
+		_lastDir	    = 0;
+	    }
+	}
+    }
+    else
+    {
+	if ( parent )
+	{
+#if VERBOSE_CACHE_FILE_INFOS
+	    logDebug() << "Creating FileInfo for "
+		       << buildPath( parent->debugUrl(), name ) << endl;
+#endif
+
+	    addPendingChild( parent, createItem( _tree, parent, cached, _withUidGidPerm ) );
+	}
+	else
+	{
+	    logError() << _fileName << ":" << _lineNo << ": "
+		       << "No parent for item " << name << endl;
+	}
+    }
+}
+
+
+FileInfo * CacheReader::createItem( DirTree *		tree,
+				    DirInfo *		parent,
+				    const CacheItem &	cached,
+				    bool		withUidGidPerm )
+{
+    FileInfo * item = 0;
+
+    if ( cached.isAggregate )
+    {
+	AggregateInfo * aggregate = new AggregateInfo( tree, parent );
+	CHECK_NEW( aggregate );
+
+	aggregate->setSums( cached.count,
+			    cached.size,
+			    cached.allocatedSize,
+			    cached.blocks < 0 ? 0 : cached.blocks,
+			    cached.oldestMtime,
+			    cached.mtime );
+
+	for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+	    aggregate->setHistogram( i, cached.histogram[ i ] );
+
+	item = aggregate;
+    }
+    else
+    {
+	item = new FileInfo( tree, parent, cached.name,
+			     cached.mode, cached.size,
+			     withUidGidPerm, cached.uid, cached.gid,
+			     cached.mtime,
+			     cached.blocks, cached.links );
+    }
+
+    CHECK_NEW( item );
+
+    return item;
+}
+
+
+DirInfo * CacheReader::locateParent( const QString & path, const QString & name )
+{
+    DirInfo * parent = 0;
+
+    if ( ! _tree->root()->hasChildren() )
+	parent = _tree->root();
+
+    // The directories read from this cache file so far: This works no
+    // matter in which order the cache file lists them
+
+    if ( ! parent )
+	parent = _dirsByPath.value( path, 0 );
+
+    // Try the easy way next - the starting point of this cache
+
+    if ( ! parent && _toplevel )
+	parent = dynamic_cast<DirInfo *> ( _toplevel->locate( path ) );
+
+#if DEBUG_LOCATE_PARENT
+    if ( parent )
+	logDebug() << "Using cache starting point as parent for " << buildPath( path, name ) << endl;
+#endif
+
+
+    // Fallback: Search the entire tree
+
+    if ( ! parent )
+    {
+	parent = dynamic_cast<DirInfo *> ( _tree->locate( path ) );
+
+#if DEBUG_LOCATE_PARENT
+	if ( parent )
+	    logDebug() << "Located parent " << path << " in tree" << endl;
+#endif
+    }
+
+    if ( parent && parent != _tree->root() )
+	_dirsByPath.insert( path, parent );
+
+    if ( ! parent ) // Still nothing?
+    {
+	logError() << _fileName << ":" << _lineNo << ": "
+		   << "Could not locate parent \"" << path << "\" for "
+		   << name << endl;
+
+	if ( ++_errorCount > MAX_ERROR_COUNT )
+	{
+	    logError() << "Too many consistency errors. Giving up." << endl;
+	    _ok = false;
+	    emit error();
+	}
+
+#if DEBUG_LOCATE_PARENT
+	THROW( Exception( "Could not locate cache item parent" ) );
+#endif
+    }
+
+    return parent;
+}
+
+
+bool CacheReader::readBinary( int maxEntries )
+{
+    quint32 entryCount = _binary->entryCount();
+
+    while ( _binaryPos < entryCount
+	    && _ok
+	    && ( maxEntries == 0 || --maxEntries > 0 ) )
+    {
+	addBinaryItem();
+    }
+
+    flushPendingChildren();
+
+    return _ok && _binaryPos < entryCount;
+}
+
+
+void CacheReader::addBinaryItem()
+{
+    quint32 index = _binaryPos++;
+    const BinaryCacheEntry & entry = _binary->entry( index );
+    QString name = _binary->name( entry );
+    DirInfo * parent = 0;
+
+    if ( S_ISDIR( entry.mode ) )
+	flushPendingChildren();
+
+    if ( entry.parent == BinaryCacheNoParent )
+    {
+	// The toplevel entry has its complete path as its name
+
+	QString path;
+	QString baseName;
+	splitPath( name, path, baseName );
+
+	_binaryDirEntries.clear();
+	_binaryDirs.clear();
+
+	if ( _tree->root() )
+	    parent = locateParent( path, baseName );
+
+	if ( ! parent )
+	{
+	    _binaryPos = _binary->subtreeEnd( index );
+	    return;
+	}
+
+	if ( parent != _tree->root() )
+	    name = baseName;
+    }
+    else
+    {
+	// The entries are in depth-first order, so the parent is one of the
+	// directories on the stack; everything above it is complete.
+
+	while ( ! _binaryDirEntries.isEmpty() && _binaryDirEntries.last() != entry.parent )
+	{
+	    _binaryDirEntries.removeLast();
+	    _binaryDirs.removeLast();
+	}
+
+	if ( _binaryDirEntries.isEmpty() )
+	{
+	    logError() << _fileName << ": No parent for entry #" << index
+		       << " " << name << endl;
+
+	    if ( ++_errorCount > MAX_ERROR_COUNT )
+	    {
+		logError() << "Too many consistency errors. Giving up." << endl;
+		_ok = false;
+		emit error();
+	    }
+
+	    return;
+	}
+
+	parent = _binaryDirs.last();
+    }
+
+    if ( name.isEmpty() )
+    {
+	logError() << _fileName << ": Invalid name for entry #" << index << endl;
+	_binaryPos = _binary->subtreeEnd( index );
+	return;
+    }
+
+    if ( S_ISDIR( entry.mode ) )
+    {
+#if VERBOSE_CACHE_DIRS
+	logDebug() << "Creating DirInfo for " << name << " with parent " << parent << endl;
+#endif
+	DirInfo * dir = new DirInfo( _tree, parent, name,
+				     entry.mode, entry.size,
+				     _withUidGidPerm, entry.uid, entry.gid,
+				     entry.mtime );
+	CHECK_NEW( dir );
+
+	dir->setReadState( DirReading );
+	parent->insertChild( dir );
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	_tree->childAddedNotify( dir );
+
+	if ( dir != _toplevel &&
+	     ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	{
+	    logDebug() << "Excluding " << name << endl;
+	    dir->setExcluded();
+	    dir->setReadState( DirOnRequestOnly );
+	    dir->finalizeLocal();
+	    _tree->sendReadJobFinished( dir );
+
+	    // Skip the complete subtree without even looking at it
+
+	    _binaryPos = _binary->subtreeEnd( index );
+	    return;
+	}
 
-    while ( fieldsCount() > n+1 )
+	_binaryDirEntries << index;
+	_binaryDirs	  << dir;
+    }
+    else
     {
-	char * keyword	= field( n++ );
-	char * val_str	= field( n++ );
+#if VERBOSE_CACHE_FILE_INFOS
+	logDebug() << "Creating FileInfo for "
+		   << buildPath( parent->debugUrl(), name ) << endl;
+#endif
+	FileInfo * item = 0;
+	const BinaryCacheAggregate * sums = 0;
 
-	if ( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
-	if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str	= val_str;
-    }
+	if ( entry.flags & BinaryCacheAggregate )
+	    sums = _binary->aggregate( index );
 
+	if ( sums )
+	{
+	    AggregateInfo * aggregate = new AggregateInfo( _tree, parent );
+	    CHECK_NEW( aggregate );
 
-    // Type
+	    aggregate->setSums( sums->count,
+				entry.size,
+				sums->allocatedSize,
+				entry.blocks < 0 ? 0 : entry.blocks,
+				sums->oldestMtime,
+				entry.mtime );
 
-    mode_t mode = S_IFREG;
+	    for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+		aggregate->setHistogram( i, sums->histogram[ i ] );
 
-    if	    ( strcasecmp( type, "F"	   ) == 0 )	mode = S_IFREG;
-    else if ( strcasecmp( type, "D"	   ) == 0 )	mode = S_IFDIR;
-    else if ( strcasecmp( type, "L"	   ) == 0 )	mode = S_IFLNK;
-    else if ( strcasecmp( type, "BlockDev" ) == 0 )	mode = S_IFBLK;
-    else if ( strcasecmp( type, "CharDev"  ) == 0 )	mode = S_IFCHR;
-    else if ( strcasecmp( type, "FIFO"	   ) == 0 )	mode = S_IFIFO;
-    else if ( strcasecmp( type, "Socket"   ) == 0 )	mode = S_IFSOCK;
+	    item = aggregate;
+	}
+	else
+	{
+	    item = new FileInfo( _tree, parent, name,
+				 entry.mode, entry.size,
+				 _withUidGidPerm, entry.uid, entry.gid,
+				 entry.mtime,
+				 ( entry.flags & BinaryCacheSparse ) ? entry.blocks : -1,
+				 entry.links );
+	}
 
+	CHECK_NEW( item );
+	addPendingChild( parent, item );
+    }
+}
 
-    // Path
 
-    if ( *raw_path == '/' )
-	_lastDir = 0;
+void CacheReader::readBlockIndex()
+{
+    // No block index (e.g. written by an older version or by a script):
+    // Read the cache file sequentially
 
+    CacheIndex index;
 
-    // Size
+    if ( ! index.read( _fileName, _cache.compression() ) )
+	return;
 
-    char * end = 0;
-    FileSize size = strtoll( size_str, &end, 10 );
+    // With only one block, there is nothing to gain
 
-    if ( end )
+    if ( index.blocks().size() > 1 )
     {
-	switch ( *end )
-	{
-	    case 'K':	size *= KB; break;
-	    case 'M':	size *= MB; break;
-	    case 'G':	size *= GB; break;
-	    case 'T':	size *= TB; break;
-	    default: break;
-	}
-    }
+	logDebug() << _fileName << ": Reading " << index.blocks().size()
+		   << " blocks in parallel" << endl;
 
+	_blocks = index.blocks();
+    }
+}
 
-    // UID, GID, permissions
 
-    uid_t  uid  = uid_str  ? strtol( uid_str,  0, 10 ) : 0;
-    gid_t  gid  = gid_str  ? strtol( gid_str,  0, 10 ) : 0;
-    mode_t perm = perm_str ? strtol( perm_str, 0,  8 ) : 0;
+bool CacheReader::readBlocks( int maxLines )
+{
+    while ( _ok && ( maxLines == 0 || --maxLines > 0 ) )
+    {
+	if ( _blockItemPos >= _blockItems.size() )
+	{
+	    // In a time slice, never block the GUI thread: If the next block
+	    // is not parsed yet, try again in the next slice.
 
-    mode |= perm;
+	    if ( ! nextBlock( maxLines == 0 ) )
+		break;
 
+	    continue;
+	}
 
-    // MTime
+	insertItem( _blockItems.at( _blockItemPos++ ) );
+    }
 
-    time_t mtime = strtol( mtime_str, 0, 0 );
+    flushPendingChildren();
 
+    return _ok && ! eof();
+}
 
-    // Blocks
 
-    FileSize blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
+bool CacheReader::nextBlock( bool wait )
+{
+    _blockItems.clear();
+    _blockItemPos = 0;
 
+    scheduleBlocks();
 
-    // Links
+    if ( _blockResults.isEmpty() )
+	return false;
 
-    int links = links_str ? atoi( links_str ) : 1;
+    CacheBlockResultPtr result = _blockResults.first();
+    bool ok	    = false;
+    int syntaxErrors = 0;
 
+    {
+	QMutexLocker locker( &result->mutex );
 
-    //
-    // Create a new item
-    //
+	if ( ! result->finished && ! wait )
+	    return false;
 
-    QString fullPath = unescapedPath( raw_path );
-    QString path;
-    QString name;
-    splitPath( fullPath, path, name );
+	while ( ! result->finished )
+	    result->finishedCondition.wait( &result->mutex );
 
-    if ( _lastExcludedDir )
-    {
-	if ( path.startsWith( _lastExcludedDirUrl ) )
-	{
-	    // logDebug() << "Excluding " << path << "/" << name << endl;
-	    return;
-	}
+	_blockResults.removeFirst();
+	_blockItems.swap( result->items );
+	ok	     = result->ok;
+	syntaxErrors = result->syntaxErrors;
     }
 
-    // Find parent in tree
+    // Keep the worker threads busy while this block is added to the tree
 
-    DirInfo * parent = _lastDir;
+    scheduleBlocks();
 
-    if ( ! parent && _tree->root() )
+    if ( ! ok )
     {
-	if ( ! _tree->root()->hasChildren() )
-	    parent = _tree->root();
+	logError() << _fileName << ": Can't decompress a block" << endl;
+	_ok = false;
+	emit error();
 
-	// Try the easy way first - the starting point of this cache
+	return false;
+    }
 
-	if ( ! parent && _toplevel )
-	    parent = dynamic_cast<DirInfo *> ( _toplevel->locate( path ) );
+    if ( syntaxErrors > 0 )
+    {
+	logError() << "Syntax errors in " << _fileName << ": "
+		   << syntaxErrors << " lines with too few fields" << endl;
 
-#if DEBUG_LOCATE_PARENT
-	if ( parent )
-	    logDebug() << "Using cache starting point as parent for " << fullPath << endl;
-#endif
+	_errorCount += syntaxErrors - 1;
+	syntaxError();
+    }
 
+    return _ok;
+}
 
-	// Fallback: Search the entire tree
 
-	if ( ! parent )
-	{
-	    parent = dynamic_cast<DirInfo *> ( _tree->locate( path ) );
+void CacheReader::scheduleBlocks()
+{
+    // Parsing a block takes longer than adding its items to the tree, so
+    // keep more blocks in progress than there are cores, but not all of
+    // them to limit the memory used by the parsed items.
 
-#if DEBUG_LOCATE_PARENT
-	    if ( parent )
-		logDebug() << "Located parent " << path << " in tree" << endl;
-#endif
-	}
+    int maxPending = 2 * qMax( 1, QThread::idealThreadCount() );
 
-	if ( ! parent ) // Still nothing?
-	{
-	    logError() << _fileName << ":" << _lineNo << ": "
-		       << "Could not locate parent \"" << path << "\" for "
-		       << name << endl;
+    while ( _nextBlock < _blocks.size() && _blockResults.size() < maxPending )
+    {
+	CacheBlockResultPtr result( new CacheBlockResult() );
+	CHECK_NEW( result );
 
-            if ( ++_errorCount > MAX_ERROR_COUNT )
-            {
-                logError() << "Too many consistency errors. Giving up." << endl;
-                _ok = false;
-                emit error();
-            }
+	CacheBlockParser * parser =
+	    new CacheBlockParser( _fileName, _cache.compression(),
+				  _blocks.at( _nextBlock++ ),
+				  _withUidGidPerm, result );
+	CHECK_NEW( parser );
 
-#if DEBUG_LOCATE_PARENT
-	    THROW( Exception( "Could not locate cache item parent" ) );
-#endif
-	    return;	// Ignore this cache line completely
-	}
+	_blockResults << result;
+	QThreadPool::globalInstance()->start( parser );	// takes ownership
     }
+}
 
-    if ( strcasecmp( type, "D" ) == 0 )
-    {
-	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
-#if VERBOSE_CACHE_DIRS
-	logDebug() << "Creating DirInfo for " << url << " with parent " << parent << endl;
-#endif
-	DirInfo * dir = new DirInfo( _tree, parent, url,
-				     mode, size,
-                                     _withUidGidPerm, uid, gid,
-                                     mtime );
-	dir->setReadState( DirReading );
-	_lastDir = dir;
-
-	if ( parent )
-	    parent->insertChild( dir );
 
-	if ( ! _tree->root() )
-	{
-	    _tree->setRoot( dir );
-	    _toplevel = dir;
-	}
+void CacheReader::addPendingChild( DirInfo * parent, FileInfo * item )
+{
+    if ( parent != _pendingParent )
+    {
+	flushPendingChildren();
+	_pendingParent = parent;
+    }
 
-	if ( ! _toplevel )
-	    _toplevel = dir;
+    _pendingChildren << item;
+}
 
-	_tree->childAddedNotify( dir );
 
-	if ( dir != _toplevel )
-	{
-	    if ( ExcludeRules::instance()->match( dir->url(), dir->name() ) )
-	    {
-		logDebug() << "Excluding " << name << endl;
-		dir->setExcluded();
-		dir->setReadState( DirOnRequestOnly );
-		dir->finalizeLocal();
-		_tree->sendReadJobFinished( dir );
+void CacheReader::flushPendingChildren()
+{
+    if ( _pendingChildren.isEmpty() )
+	return;
 
-		_lastExcludedDir    = dir;
-		_lastExcludedDirUrl = _lastExcludedDir->url();
-		_lastDir	    = 0;
-	    }
-	}
-    }
-    else
-    {
-	if ( parent )
-	{
-#if VERBOSE_CACHE_FILE_INFOS
-	    logDebug() << "Creating FileInfo for "
-		       << buildPath( parent->debugUrl(), name ) << endl;
-#endif
+    _pendingParent->insertChildren( _pendingChildren );
+    _tree->childrenAddedNotify( _pendingParent, _pendingChildren );
 
-	    FileInfo * item = new FileInfo( _tree, parent, name,
-					    mode, size,
-                                            _withUidGidPerm, uid, gid,
-                                            mtime,
-                                            blocks, links );
-	    parent->insertChild( item );
-	    _tree->childAddedNotify( item );
-	}
-	else
-	{
-	    logError() << _fileName << ":" << _lineNo << ": "
-		       << "No parent for item " << name << endl;
-	}
-    }
+    _pendingChildren.clear();
+    _pendingParent = 0;
 }
 
 
 bool CacheReader::eof()
 {
-    if ( ! _ok || ! _cache )
+    if ( _binary )
+	return ! _ok || _binaryPos >= _binary->entryCount();
+
+    if ( ! _ok || ! _cache.isOpen() )
 	return true;
 
-    return gzeof( _cache );
+    if ( ! _blocks.isEmpty() )
+    {
+	return _nextBlock >= _blocks.size() &&
+	    _blockResults.isEmpty() &&
+	    _blockItemPos >= _blockItems.size();
+    }
+
+    return _cache.eof();
 }
 
 
 QString CacheReader::firstDir()
 {
-    while ( ! gzeof( _cache ) && _ok )
+    if ( _binary )
+    {
+	if ( ! _ok || _binary->entryCount() == 0 )
+	    return "";
+
+	return _binary->name( _binary->entry( 0 ) );
+    }
+
+    while ( ! _cache.eof() && _ok )
     {
 	if ( ! readLine() )
 	    return "";
@@ -642,7 +2063,7 @@ bool CacheReader::checkHeader()
 
 bool CacheReader::readLine()
 {
-    if ( ! _ok || ! _cache )
+    if ( ! _ok || ! _cache.isOpen() )
 	return false;
 
     _fieldsCount = 0;
@@ -651,12 +2072,12 @@ bool CacheReader::readLine()
     {
 	_lineNo++;
 
-	if ( ! gzgets( _cache, _buffer, MAX_CACHE_LINE_LEN-1 ) )
+	if ( ! _cache.gets( _buffer, MAX_CACHE_LINE_LEN-1 ) )
 	{
 	    _buffer[0]	= 0;
 	    _line	= _buffer;
 
-	    if ( ! gzeof( _cache ) )
+	    if ( ! _cache.eof() )
 	    {
 		_ok = false;
 		logError() << _fileName << ":" << _lineNo << ": Read error" << endl;
@@ -671,7 +2092,10 @@ bool CacheReader::readLine()
 
 	// logDebug() << "line[ " << _lineNo << "]: \"" << _line<< "\"" << endl;
 
-    } while ( ! gzeof( _cache ) &&
+	if ( strncmp( _line, "#@J ", 4 ) == 0 )
+	    journalCommand( _line + 4 );
+
+    } while ( ! _cache.eof() &&
 	      ( *_line == 0   ||	// empty line
 		*_line == '#'	  ) );	// comment line
 
@@ -679,6 +2103,121 @@ bool CacheReader::readLine()
 }
 
 
+void CacheReader::journalCommand( char * command )
+{
+    char * fields[ MAX_FIELDS_PER_LINE ];
+
+    if ( splitFields( skipWhiteSpace( command ), fields ) != 2 ||
+	 strcmp( fields[0], "remove" ) != 0 )
+    {
+	logWarning() << _fileName << ":" << _lineNo << ": Unknown journal command" << endl;
+	return;
+    }
+
+    // Everything read so far has to be in the tree before anything is
+    // removed from it
+
+    flushPendingChildren();
+
+    QString path;
+    QString name;
+    splitRawPath( fields[1], path, name );
+    QString url = buildPath( path, name );
+
+    // The records of a journal can be anywhere in the tree: Finalize the
+    // complete tree when done.
+
+    if ( ! _toplevel && _tree->firstToplevel() )
+	_toplevel = _tree->firstToplevel()->toDirInfo();
+
+    FileInfo * item = _tree->locate( url );
+
+    if ( ! item )
+	return;		// A new subtree: Nothing to remove
+
+    if ( ! item->parent() || item->parent() == _tree->root() )
+    {
+	logError() << _fileName << ":" << _lineNo
+		   << ": Can't replace the toplevel directory " << url << endl;
+	return;
+    }
+
+    // Anything from before might be in that subtree
+
+    _dirsByPath.clear();
+    _lastDir		= 0;
+    _lastExcludedDir	= 0;
+
+    _tree->deleteSubtree( item, true );
+}
+
+
+void CacheReader::deletingChildNotify( FileInfo * deletedChild )
+{
+    if ( deletedChild->isDirInfo() )
+	dropSubtree( deletedChild, true );
+}
+
+
+void CacheReader::clearingSubtreeNotify( DirInfo * subtree )
+{
+    dropSubtree( subtree, false );
+}
+
+
+void CacheReader::dropSubtree( FileInfo * subtree, bool includeSubtree )
+{
+    // This is called before the subtree is detached, so all directories
+    // that are still known here are part of the tree and can safely be
+    // checked. _lastExcludedDir is only used for its URL.
+
+    if ( _lastDir && ( includeSubtree || _lastDir != subtree ) && _lastDir->isInSubtree( subtree ) )
+	_lastDir = 0;
+
+    if ( _toplevel && ( includeSubtree || _toplevel != subtree ) && _toplevel->isInSubtree( subtree ) )
+	_toplevel = 0;
+
+    if ( _pendingParent && ( includeSubtree || _pendingParent != subtree ) &&
+	 _pendingParent->isInSubtree( subtree ) )
+    {
+	// Not inserted into the tree yet
+
+	qDeleteAll( _pendingChildren );
+	_pendingChildren.clear();
+	_pendingParent = 0;
+    }
+
+    QHash<QString, DirInfo *>::iterator it = _dirsByPath.begin();
+
+    while ( it != _dirsByPath.end() )
+    {
+	DirInfo * dir = it.value();
+
+	if ( ( includeSubtree || dir != subtree ) && dir->isInSubtree( subtree ) )
+	    it = _dirsByPath.erase( it );
+	else
+	    ++it;
+    }
+
+    // The binary format lists the entries depth-first, so the current
+    // position is below all directories on the stack: Skip the rest of
+    // the subtree of the outermost one that is deleted.
+
+    for ( int i=0; i < _binaryDirs.size(); ++i )
+    {
+	DirInfo * dir = _binaryDirs.at( i );
+
+	if ( ( includeSubtree || dir != subtree ) && dir->isInSubtree( subtree ) )
+	{
+	    _binaryPos = qMax( _binaryPos, _binary->subtreeEnd( _binaryDirEntries.at( i ) ) );
+	    _binaryDirs.resize( i );
+	    _binaryDirEntries.resize( i );
+	    break;
+	}
+    }
+}
+
+
 void CacheReader::splitLine()
 {
     _fieldsCount = 0;
@@ -686,26 +2225,38 @@ void CacheReader::splitLine()
     if ( ! _ok || ! _line )
 	return;
 
-    if ( *_line == '#' )	// skip comment lines
-	*_line = 0;
+    _fieldsCount = splitFields( _line, _fields );
+}
+
 
-    char * current = _line;
-    char * end	   = _line + strlen( _line );
+int CacheReader::splitFields( char * line, char ** fields )
+{
+    int fieldsCount = 0;
+
+    if ( *line == '#' )		// skip comment lines
+	return 0;
+
+    // Split in place in one pass: Terminate each field with a 0 byte
 
-    while ( current
-	    && current < end
-	    && *current
-	    && _fieldsCount < MAX_FIELDS_PER_LINE-1 )
+    char * current = line;
+
+    while ( *current && fieldsCount < MAX_FIELDS_PER_LINE-1 )
     {
-	_fields[ _fieldsCount++ ] = current;
-	current = findNextWhiteSpace( current );
+	fields[ fieldsCount++ ] = current;
+
+	while ( *current && ! isspace( (uchar) *current ) )
+	    ++current;
 
-	if ( current && current < end )
+	if ( *current )
 	{
 	    *current++ = 0;
-	    current = skipWhiteSpace( current );
+
+	    while ( *current && isspace( (uchar) *current ) )
+		++current;
 	}
     }
+
+    return fieldsCount;
 }
 
 
@@ -758,7 +2309,7 @@ void CacheReader::killTrailingWhiteSpace( char * cptr )
 
 void CacheReader::splitPath( const QString & fileNameWithPath,
 			     QString	   & path_ret,
-			     QString	   & name_ret ) const
+			     QString	   & name_ret )
 {
     bool absolutePath = fileNameWithPath.startsWith( "/" );
     QStringList components = fileNameWithPath.split( "/", Qt::SkipEmptyParts );
@@ -779,7 +2330,7 @@ void CacheReader::splitPath( const QString & fileNameWithPath,
 }
 
 
-QString CacheReader::buildPath( const QString & path, const QString & name ) const
+QString CacheReader::buildPath( const QString & path, const QString & name )
 {
     if ( path.isEmpty() )
 	return name;
@@ -791,22 +2342,115 @@ QString CacheReader::buildPath( const QString & path, const QString & name ) con
 }
 
 
-QString CacheReader::unescapedPath( const QString & rawPath ) const
+/**
+ * Return the value of digit 'c' in any base up to 16 or 99 if it is not a
+ * digit.
+ **/
+static inline int digitValue( char c )
 {
-    // Using a protocol part to avoid directory names with a colon ":"
-    // being cut off because it looks like a URL protocol.
-    QString protocol = "foo:";
-    QString url = protocol + cleanPath( rawPath );
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+
+    return 99;
+}
+
+
+void CacheReader::splitRawPath( char *	   rawPath,
+				QString & path_ret,
+				QString & name_ret )
+{
+    bool absolutePath = *rawPath == '/';
+
+    // Decode percent escapes and collapse duplicate slashes in place: The
+    // result is never longer than the raw path.
+
+    const char * src  = rawPath;
+    char *	 dest = rawPath;
+
+    while ( *src )
+    {
+	char c = *src++;
+
+	if ( c == '%' && isxdigit( (uchar) src[0] ) && isxdigit( (uchar) src[1] ) )
+	{
+	    c = (char) ( digitValue( src[0] ) * 16 + digitValue( src[1] ) );
+	    src += 2;
+	}
+
+	if ( c == '/' && dest > rawPath && dest[-1] == '/' )
+	    continue;
+
+	*dest++ = c;
+    }
+
+    if ( dest > rawPath && dest[-1] == '/' )
+	--dest;
+
+    *dest = 0;
+
+    if ( dest == rawPath )	// Only "/" or nothing at all
+    {
+	path_ret.clear();
+	name_ret = absolutePath ? "/" : "";
+
+	return;
+    }
+
+    // Split at the last slash
 
-    return QUrl::fromEncoded( url.toUtf8() ).path();
+    const char * lastSlash = dest - 1;
+
+    while ( lastSlash >= rawPath && *lastSlash != '/' )
+	--lastSlash;
+
+    const char * name = lastSlash + 1;
+    name_ret = QString::fromUtf8( name, dest - name );
+
+    if ( lastSlash < rawPath )
+	path_ret.clear();
+    else if ( lastSlash == rawPath )
+	path_ret = "/";
+    else
+	path_ret = QString::fromUtf8( rawPath, lastSlash - rawPath );
 }
 
 
-QString CacheReader::cleanPath( const QString & rawPath ) const
+qint64 CacheReader::parseNumber( const char *  str,
+				 int	       base,
+				 const char ** end_ret )
 {
-    QString clean = _multiSlash.replaceIn( rawPath, "/" );
+    const char * pos	  = str;
+    bool	 negative = false;
+
+    if ( *pos == '-' || *pos == '+' )
+	negative = *pos++ == '-';
+
+    if ( ( base == 0 || base == 16 ) &&
+	 pos[0] == '0' && ( pos[1] == 'x' || pos[1] == 'X' ) )
+    {
+	base = 16;
+	pos += 2;
+    }
+    else if ( base == 0 )
+    {
+	base = *pos == '0' ? 8 : 10;
+    }
+
+    quint64 value = 0;
+
+    int digit;
+
+    while ( ( digit = digitValue( *pos ) ) < base )
+    {
+	value = value * base + digit;
+	++pos;
+    }
+
+    if ( end_ret )
+	*end_ret = pos;
 
-    return clean;
+    return negative ? - (qint64) value : (qint64) value;
 }
 
 
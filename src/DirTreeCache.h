@@ -11,27 +11,104 @@
 #define DirTreeCache_h
 
 
-#include <zlib.h>    // gzFile
+#include <QVector>
+#include <QHash>
+#include <QSharedPointer>
+#include <QElapsedTimer>
 #include "DirTree.h"
+#include "AggregateInfo.h"
+#include "CacheFile.h"
 
 
 #define DEFAULT_CACHE_NAME	".qdirstat.cache.gz"
 #define MAX_CACHE_LINE_LEN	1024
 #define MAX_FIELDS_PER_LINE	32
 
+// Uncompressed size after which CacheWriter starts a new block
+#define CACHE_BLOCK_SIZE	( 1024 * 1024 )
+#define CACHE_ZSTD_BLOCK_SIZE	( 8 * 1024 * 1024 )
+
+// Uncompressed size of the buffers that CacheWriter passes to its
+// compressor thread
+#define CACHE_WRITE_BUFFER_SIZE	( 256 * 1024 )
+
 
 namespace QDirStat
 {
-    class CacheWriter
+    class BinaryCacheReader;
+    class CacheCompressor;
+    struct CacheBlockResult;
+
+    typedef QSharedPointer<CacheBlockResult> CacheBlockResultPtr;
+
+
+    /**
+     * The data of one item line of a cache file after parsing, before it
+     * is added to the tree.
+     **/
+    struct CacheItem
+    {
+	bool		isDir;
+	bool		absolutePath;
+	QString		path;
+	QString		name;
+	mode_t		mode;
+	FileSize	size;
+	uid_t		uid;
+	gid_t		gid;
+	time_t		mtime;
+	FileSize	blocks;
+	nlink_t		links;
+	quint64		digest;		// Only for directories, 0 if unknown
+
+	// Only for aggregates
+
+	bool		isAggregate;
+	FileCount	count;
+	FileSize	allocatedSize;
+	time_t		oldestMtime;
+	FileCount	histogram[ AggregateInfo::HistogramBuckets ];
+    };
+
+
+    /**
+     * Position of one independently compressed block of a cache file.
+     **/
+    struct CacheBlock
+    {
+	qint64 offset;	// Compressed, from the start of the file
+	qint64 size;	// Compressed
+    };
+
+
+    class CacheWriter: public QObject
     {
+	Q_OBJECT
+
     public:
 
 	/**
-	 * Write 'tree' to file 'fileName' in gzip format (using zlib).
+	 * Write 'tree' to file 'fileName' in gzip format (using zlib) or in
+	 * zstd format (see CacheFile): A file name ending with ".zst" or
+	 * ".gz" selects that compression, otherwise the setting of 'tree'
+	 * (see DirTree::cacheUseZstd()) is used.
 	 *
-	 * Check CacheWriter::ok() to see if writing the cache file went OK.
+	 * The tree is written into large memory buffers that are compressed
+	 * and written to the file in a separate thread while the next buffer
+	 * is being filled.
+	 *
+	 * If 'background' is 'false', this writes the complete cache file
+	 * before the constructor returns. Check CacheWriter::ok() to see if
+	 * writing the cache file went OK.
+	 *
+	 * If 'background' is 'true', this only starts writing: The tree is
+	 * written in small time slices from the event loop, sending
+	 * progress() signals, and finished() when the file is complete. The
+	 * tree must not change in the meantime; use abort() before that.
 	 **/
-	CacheWriter( const QString & fileName, DirTree *tree );
+	CacheWriter( const QString & fileName,
+		     DirTree *	     tree,
+		     bool	     background = false );
 
 	/**
 	 * Destructor
@@ -39,50 +116,202 @@ namespace QDirStat
 	virtual ~CacheWriter();
 
 	/**
-	 * Returns true if writing the cache file went OK.
+	 * Returns true if writing the cache file went OK (so far).
 	 **/
 	bool ok() const { return _ok; }
 
 	/**
-	 * Format a file size as string - with trailing "G", "M", "K" for
-	 * "Gigabytes", "Megabytes, "Kilobytes", respectively (provided there
-	 * is no fractional part - 27M is OK, 27.2M is not).
+	 * Return 'true' if writing is complete or was aborted.
+	 **/
+	bool isFinished() const { return _finished; }
+
+	/**
+	 * Return the name of the cache file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Append a file size to 'buffer' - with trailing "T", "G", "M", "K"
+	 * for "Terabytes", "Gigabytes", "Megabytes, "Kilobytes",
+	 * respectively (provided there is no fractional part - 27M is OK,
+	 * 27.2M is not).
+	 **/
+	static void appendSize( QByteArray & buffer, FileSize size );
+
+	/**
+	 * Append 'path' URL-encoded in UTF-8 to 'buffer', i.e. with some
+	 * special characters escaped in percent notation (" " -> "%20").
+	 * This is the same encoding that QUrl uses for paths.
+	 **/
+	static void appendUrlEncoded( QByteArray & buffer, const QString & path );
+
+	/**
+	 * Append 'value' in 'base' (8, 10 or 16) to 'buffer'.
+	 **/
+	static void appendNumber( QByteArray & buffer, qint64 value, int base = 10 );
+
+	/**
+	 * Write the lines of 'subtree' and everything below it to 'file' in
+	 * the same order as in a cache file, but without a header, blocks or
+	 * a directory index. This is what the cache journal needs (see
+	 * CacheJournal).
+	 **/
+	static void writeSubtree( CacheFile & file,
+				  DirInfo *   subtree,
+				  bool	      withUidGidPerm );
+
+
+    signals:
+
+	/**
+	 * Emitted from time to time while writing in the background.
+	 **/
+	void progress( FileCount itemsWritten, FileCount totalItems );
+
+	/**
+	 * Emitted when writing in the background is complete, or when it was
+	 * aborted ('ok' is 'false' and 'aborted' is 'true' then).
+	 **/
+	void finished( bool ok, bool aborted );
+
+
+    public slots:
+
+	/**
+	 * Abort writing in the background and remove the incomplete file.
+	 * Use this before the tree changes.
+	 **/
+	void abort();
+
+
+    protected slots:
+
+	/**
+	 * Write the next time slice in the background.
 	 **/
-	QString formatSize( FileSize size );
+	void writeSlice();
+
+	/**
+	 * Notification that the compressor thread is done.
+	 **/
+	void compressorFinished();
 
 
     protected:
 
 	/**
-	 * Write cache file in gzip format.
-	 * Returns 'true' if OK, 'false' upon error.
+	 * Constructor for writeSubtree(): Only the tree traversal, without
+	 * a file of its own.
 	 **/
-	bool writeCache( const QString & fileName, DirTree *tree );
+	CacheWriter( bool withUidGidPerm );
 
 	/**
-	 * Write 'item' recursively to cache file 'cache'.
-	 * Uses zlib to write gzip-compressed files.
+	 * Open the cache file, write the header and prepare writing the
+	 * tree. Return 'true' if OK, 'false' upon error.
 	 **/
-	void writeTree( gzFile cache, FileInfo * item );
+	bool startWriting( DirTree * tree );
 
 	/**
-	 * Write 'item' to cache file 'cache' without recursion.
-	 * Uses zlib to write gzip-compressed files.
+	 * Write up to 'maxItems' items (0 for all) from where the last call
+	 * left off. Return 'true' if there is more to write.
 	 **/
-	void writeItem( gzFile cache, FileInfo * item );
+	bool writeItems( int maxItems );
+
+	/**
+	 * Write all remaining data and wait until the file is complete.
+	 * Return 'true' if OK, 'false' upon error.
+	 **/
+	bool finishWriting();
+
+	/**
+	 * Enter 'item' during the tree traversal: Write it and remember its
+	 * children for the next steps.
+	 **/
+	void enterItem( FileInfo * item );
+
+	/**
+	 * Return the children of 'dir' in the order they are written: First
+	 * all files (including those in its dot entry), then all
+	 * subdirectories, each sorted by name. This makes the order of the
+	 * lines the same for the same tree, so two cache files can be
+	 * compared line by line (see CacheDiff).
+	 **/
+	static QVector<FileInfo *> sortedChildren( DirInfo * dir );
+
+	/**
+	 * Pass the buffer to the compressor thread. If 'endOfBlock' is
+	 * 'true', the compressor also finishes the current block.
+	 **/
+	void flushBuffer( bool endOfBlock = false );
+
+	/**
+	 * Finish the current block and start a new one.
+	 *
+	 * Each block is a complete gzip member or zstd frame, so it can be
+	 * decompressed independently of all others, and it starts with a
+	 * directory with an absolute path, so it can also be parsed
+	 * independently. A file with several gzip members (zstd frames) is
+	 * still a valid file for any gzip (zstd) decompressor.
+	 **/
+	void startBlock();
+
+	/**
+	 * Write 'item' with URL 'url' to 'buffer' without recursion.
+	 **/
+	void writeItem( QByteArray & buffer, FileInfo * item, const QString & url );
+
+	/**
+	 * Write the optional fields with the sums of an aggregate entry.
+	 **/
+	void writeAggregate( QByteArray & buffer, AggregateInfo * aggregate );
+
+	/**
+	 * Add 'dir' to the directory index (see CacheIndex): Where its line
+	 * is in the file, its parent, and the sums of its subtree. This has
+	 * to be called right before the line of 'dir' is written.
+	 **/
+	void addToDirIndex( DirInfo * dir, int parentDirNo );
+
+
+	/**
+	 * One directory (or other item) in the tree traversal with the
+	 * children that are not written yet.
+	 **/
+	struct TraversalStep
+	{
+	    FileInfo *		item;
+	    QVector<FileInfo *> children;	// See sortedChildren()
+	    int			nextChild;
+	    int			parentUrlLen;
+	    int			dirNo;		// In the directory index
+	};
 
-        /**
-         * Return the 'path' in an URL-encoded form, i.e. with some special
-         * characters escaped in percent notation (" " -> "%20").
-         **/
-        QByteArray urlEncoded( const QString & path );
 
 	//
 	// Data members
 	//
 
-        bool _withUidGuidPerm;
-	bool _ok;
+	QString			_fileName;
+	DirTree *		_tree;
+        bool			_withUidGuidPerm;
+	bool			_ok;
+	bool			_finished;
+	bool			_aborted;
+
+	CacheCompressor *	_compressor;
+	QByteArray		_buffer;
+	qint64			_bufferedBytes;	// Total uncompressed
+	qint64			_blockStart;	// Uncompressed
+	qint64			_blockSize;	// Uncompressed
+	int			_blockNo;
+
+	QByteArray		_dirIndex;
+	int			_dirCount;
+
+	QVector<TraversalStep>	_steps;
+	QString			_url;
+	FileCount		_itemsWritten;
+	FileCount		_totalItems;
     };
 
 
@@ -96,6 +325,10 @@ namespace QDirStat
 	/**
 	 * Begin reading cache file 'fileName'. The cache file remains open
 	 * until this object is destroyed.
+	 *
+	 * This can be a cache file in the text format compressed with gzip or
+	 * zstd or in the binary format (see BinaryCacheReader); that is
+	 * detected automatically.
 	 **/
 	CacheReader( const QString & fileName,
 		     DirTree	   * tree,
@@ -184,6 +417,48 @@ namespace QDirStat
 	 **/
 	static void killTrailingWhiteSpace( char * cptr );
 
+	/**
+	 * Split 'line' into fields separated by whitespace and store them in
+	 * 'fields' which needs room for MAX_FIELDS_PER_LINE fields. This
+	 * modifies 'line'. Return the number of fields.
+	 **/
+	static int splitFields( char * line, char ** fields );
+
+	/**
+	 * Parse the fields of one item line of a cache file into 'item'.
+	 * 'fieldsCount' has to be checked before. This does not access
+	 * the tree, so it can also be used in worker threads.
+	 **/
+	static void parseItem( char **	    fields,
+			       int	    fieldsCount,
+			       bool	    withUidGidPerm,
+			       CacheItem &  item );
+
+	/**
+	 * Create a FileInfo (or an AggregateInfo) for the non-directory item
+	 * 'cached' with 'parent' as its parent, but don't insert it into the
+	 * children of 'parent' yet.
+	 **/
+	static FileInfo * createItem( DirTree *		tree,
+				      DirInfo *		parent,
+				      const CacheItem & cached,
+				      bool		withUidGidPerm );
+
+	/**
+	 * Parse a number like strtoll(), but without locale support, error
+	 * handling or overflow checks. 'base' is 8, 10, 16 or 0 to use the
+	 * base from a C style "0x" or "0" prefix. If 'end_ret' is non-null,
+	 * it returns the first character after the number.
+	 **/
+	static qint64 parseNumber( const char *	 str,
+				   int		 base	 = 10,
+				   const char ** end_ret = 0 );
+
+	/**
+	 * Build a full path from path + file name (without path).
+	 **/
+	static QString buildPath( const QString & path, const QString & name );
+
 
     signals:
 
@@ -203,8 +478,31 @@ namespace QDirStat
 	void error();
 
 
+    protected slots:
+
+	/**
+	 * Notification that 'deletedChild' is about to be deleted: Forget
+	 * all directories in its subtree.
+	 **/
+	void deletingChildNotify( FileInfo * deletedChild );
+
+	/**
+	 * Notification that all children of 'subtree' are about to be
+	 * deleted: Forget all directories below it.
+	 **/
+	void clearingSubtreeNotify( DirInfo * subtree );
+
+
     protected:
 
+	/**
+	 * Forget all directories in the subtree of 'subtree' and, if
+	 * 'includeSubtree' is 'true', 'subtree' itself: _dirsByPath,
+	 * _lastDir, the pending children and the stack of directories of
+	 * the binary format.
+	 **/
+	void dropSubtree( FileInfo * subtree, bool includeSubtree );
+
 	/**
 	 * Check this cache's header (see if it is a QDirStat cache at all)
 	 **/
@@ -223,6 +521,13 @@ namespace QDirStat
 	 **/
 	bool readLine();
 
+	/**
+	 * Execute the command of a cache journal line "#@J <command>" (see
+	 * CacheJournal): Remove the subtree that the following lines, if
+	 * any, replace.
+	 **/
+	void journalCommand( char * command );
+
 	/**
 	 * split the current input line into fields separated by whitespace.
 	 **/
@@ -235,32 +540,40 @@ namespace QDirStat
 	char * field( int no );
 
 	/**
-	 * Split up a file name with path into its path and its name component
-	 * and return them in path_ret and name_ret, respectively.
-	 *
-	 * Example:
-	 *     "/some/dir/somewhere/myfile.obj"
-	 * ->  "/some/dir/somewhere", "myfile.obj"
+	 * Add an item that was parsed with parseItem() to _tree.
 	 **/
-	void splitPath( const QString & fileNameWithPath,
-			QString	      & path_ret,
-			QString	      & name_ret ) const;
+	void insertItem( const CacheItem & cached );
 
 	/**
-	 * Build a full path from path + file name (without path).
+	 * Handle a syntax error in the current line: Set the read error
+	 * flag and give up if there are too many errors.
 	 **/
-	QString buildPath( const QString & path, const QString & name ) const;
+	void syntaxError();
 
 	/**
-	 * Return an unescaped version of 'rawPath'.
+	 * Split up a file name with path into its path and its name component
+	 * and return them in path_ret and name_ret, respectively.
+	 *
+	 * Example:
+	 *     "/some/dir/somewhere/myfile.obj"
+	 * ->  "/some/dir/somewhere", "myfile.obj"
 	 **/
-	QString unescapedPath( const QString & rawPath ) const;
+	static void splitPath( const QString & fileNameWithPath,
+			       QString	     & path_ret,
+			       QString	     & name_ret );
 
 	/**
-	 * Clean a path: Replace duplicate (or triplicate or more) slashes with
-	 * just one. QUrl doesn't seem to handle those well.
+	 * Split up a raw path from a cache line like splitPath(), but
+	 * working in place on 'rawPath': Decode any percent escapes,
+	 * collapse duplicate slashes and remove a trailing slash. This
+	 * modifies 'rawPath'.
+	 *
+	 * This only creates a QString for the path if there is one, i.e.
+	 * not for the usual file lines with just a name.
 	 **/
-	QString cleanPath( const QString & rawPath ) const;
+	static void splitRawPath( char *    rawPath,
+				  QString & path_ret,
+				  QString & name_ret );
 
 	/**
 	 * Returns the number of fields in the current input line after
@@ -281,16 +594,86 @@ namespace QDirStat
          **/
         void setReadError( DirInfo * dir );
 
+	/**
+	 * Find the parent directory with path 'path' for a new item 'name'
+	 * in the tree. Log an error and return 0 if there is none.
+	 *
+	 * This uses the directories read from this cache file so far first,
+	 * so the lines of a cache file can be in any order as long as each
+	 * directory comes before anything inside it; the much slower search
+	 * in the tree is only needed for directories outside this cache
+	 * file.
+	 **/
+	DirInfo * locateParent( const QString & path, const QString & name );
+
+	/**
+	 * Read at most 'maxEntries' entries from a binary cache file or all
+	 * of them if 'maxEntries' is 0. This is what read() does for the
+	 * binary format.
+	 **/
+	bool readBinary( int maxEntries );
+
+	/**
+	 * Add the next entry of a binary cache file to _tree.
+	 **/
+	void addBinaryItem();
+
+	/**
+	 * Read the block index of a cache file that was written in
+	 * independently compressed blocks (see CacheWriter::startBlock()).
+	 * If there is one, read() decompresses and parses the blocks in
+	 * worker threads and only adds the parsed items to the tree in the
+	 * main thread.
+	 **/
+	void readBlockIndex();
+
+	/**
+	 * Add at most 'maxLines' items from the parsed blocks to the tree or
+	 * all of them if 'maxLines' is 0. This is what read() does if there
+	 * is a block index.
+	 **/
+	bool readBlocks( int maxLines );
+
+	/**
+	 * Make the items of the next block the current ones. If 'wait' is
+	 * 'true', this waits until that block is parsed if necessary;
+	 * otherwise it returns 'false' if it is not parsed yet. Return
+	 * 'false' if there are no more blocks or if there was an error.
+	 **/
+	bool nextBlock( bool wait );
+
+	/**
+	 * Hand over blocks to the worker threads until enough of them are
+	 * being parsed.
+	 **/
+	void scheduleBlocks();
+
+	/**
+	 * Add 'item' to the pending children of 'parent'. This flushes the
+	 * pending children first if they belong to another parent.
+	 **/
+	void addPendingChild( DirInfo * parent, FileInfo * item );
+
+	/**
+	 * Insert the pending file children that were read for the current
+	 * directory into it all at once and send the notification.
+	 *
+	 * Lines for the files of a directory are usually consecutive, so
+	 * this updates the sums of all ancestors once per directory instead
+	 * of once per file.
+	 **/
+	void flushPendingChildren();
+
 
 	//
 	// Data members
 	//
 
 	DirTree *	_tree;
-	gzFile		_cache;
+	CacheFile	_cache;
 	char		_buffer[ MAX_CACHE_LINE_LEN ];
 	char *		_line;
-	int		_lineNo;
+	FileCount	_lineNo;
 	QString		_fileName;
 	char *		_fields[ MAX_FIELDS_PER_LINE ];
 	int		_fieldsCount;
@@ -301,7 +684,19 @@ namespace QDirStat
 	DirInfo *	_lastDir;
 	DirInfo *	_lastExcludedDir;
 	QString		_lastExcludedDirUrl;
-        QRegExp         _multiSlash;
+	QHash<QString, DirInfo *> _dirsByPath;
+	QElapsedTimer	_stopWatch;
+	BinaryCacheReader * _binary;
+	quint32		_binaryPos;
+	QVector<quint32>   _binaryDirEntries;
+	QVector<DirInfo *> _binaryDirs;
+	QVector<CacheBlock>	   _blocks;
+	int			   _nextBlock;
+	QList<CacheBlockResultPtr> _blockResults;
+	QVector<CacheItem>	   _blockItems;
+	int			   _blockItemPos;
+	DirInfo *	_pendingParent;
+	FileInfoList	_pendingChildren;
         bool            _withUidGidPerm;
     };
 
@@ -13,6 +13,7 @@
 #include "DirTreeModel.h"
 #include "DirTree.h"
 #include "DirInfo.h"
+#include "CacheDiff.h"
 #include "FileInfoIterator.h"
 #include "DataColumns.h"
 #include "SelectionModel.h"
@@ -45,7 +46,8 @@ DirTreeModel::DirTreeModel( QObject * parent ):
     _slowUpdate( false ),
     _sortCol( NameCol ),
     _sortOrder( Qt::AscendingOrder ),
-    _removingRows( false )
+    _removingRows( false ),
+    _cacheDiff( 0 )
 {
     createTree();
     readSettings();
@@ -61,6 +63,9 @@ DirTreeModel::~DirTreeModel()
 {
     writeSettings();
 
+    if ( _cacheDiff )
+	delete _cacheDiff;
+
     if ( _tree )
 	delete _tree;
 }
@@ -77,6 +82,23 @@ void DirTreeModel::readSettings()
     _treeIconDir	 = settings.value( "TreeIconDir" , ":/icons/tree-medium/" ).toString();
     _updateTimerMillisec = settings.value( "UpdateTimerMillisec", 333 ).toInt();
     _slowUpdateMillisec	 = settings.value( "SlowUpdateMillisec", 3000 ).toInt();
+    _tree->setSortCacheBudget( settings.value( "SortCacheMaxItems", 1000000 ).toInt() );
+    _tree->setMaxResidentItems( settings.value( "MaxResidentItems",  -1 ).toLongLong() );
+    _tree->setMemoryBudget( settings.value( "MemoryBudgetMB", 0 ).toLongLong() * 1024 * 1024 );
+    _tree->setCacheCompression( settings.value( "CacheCompression", "gzip" ).toString() == "zstd",
+				settings.value( "CacheCompressionLevel", -1 ).toInt() );
+    _tree->setLazyCacheLoading( settings.value( "LazyCacheLoading", false ).toBool() );
+    _tree->setIncrementalCache( settings.value( "IncrementalCache", false ).toBool() );
+
+    if ( settings.value( "AggregateSmallFiles", false ).toBool() )
+    {
+	_tree->setAggregation( settings.value( "AggregateMaxFileSize", 8192 ).toInt(),
+			       settings.value( "AggregateMinDepth",	 -1 ).toInt() );
+    }
+    else
+    {
+	_tree->setAggregation( 0, -1 );
+    }
 
     settings.endGroup();
 
@@ -113,6 +135,16 @@ void DirTreeModel::writeSettings()
     settings.setDefaultValue( "IgnoreHardLinks",     FileInfo::ignoreHardLinks() );
     settings.setDefaultValue( "TreeIconDir",	     _treeIconDir		 );
     settings.setDefaultValue( "UpdateTimerMillisec", _updateTimerMillisec	 );
+    settings.setDefaultValue( "SortCacheMaxItems",   _tree ? _tree->sortCacheBudget() : 1000000 );
+    settings.setDefaultValue( "MaxResidentItems",    -1 ); // -1: from physical memory
+    settings.setDefaultValue( "MemoryBudgetMB",	     0 ); // 0: unlimited; -1: 3/4 of physical memory
+    settings.setDefaultValue( "CacheCompression",    QString( _tree && _tree->cacheUseZstd() ? "zstd" : "gzip" ) );
+    settings.setDefaultValue( "CacheCompressionLevel", -1 ); // -1: default of the compression
+    settings.setDefaultValue( "LazyCacheLoading",    _tree ? _tree->lazyCacheLoading() : false );
+    settings.setDefaultValue( "IncrementalCache",    _tree ? _tree->incrementalCache() : false );
+    settings.setDefaultValue( "AggregateSmallFiles", _tree ? _tree->aggregationEnabled() : false );
+    settings.setDefaultValue( "AggregateMaxFileSize", 8192 );
+    settings.setDefaultValue( "AggregateMinDepth",   -1 );
 
     settings.endGroup();
 
@@ -172,11 +204,16 @@ void DirTreeModel::createTree()
 
     connect( _tree, SIGNAL( childDeleted() ),
 	     this,  SLOT  ( childDeleted() ) );
+
+    connect( _tree, SIGNAL( exposedDirsNeeded() ),
+	     this,  SLOT  ( exposeDirs()	) );
 }
 
 
 void DirTreeModel::clear()
 {
+    setCacheDiff( 0 );
+
     if ( _tree )
     {
 	beginResetModel();
@@ -193,6 +230,21 @@ void DirTreeModel::clear()
 }
 
 
+void DirTreeModel::setCacheDiff( CacheDiff * diff )
+{
+    if ( diff == _cacheDiff )
+	return;
+
+    // The views must not use the old one anymore before it is deleted
+
+    const CacheDiff * oldDiff = _cacheDiff;
+    _cacheDiff = diff;
+    emit cacheDiffChanged( _cacheDiff );
+
+    delete oldDiff;
+}
+
+
 void DirTreeModel::openUrl( const QString & url )
 {
     CHECK_PTR( _tree );
@@ -257,9 +309,12 @@ FileInfo * DirTreeModel::findChild( DirInfo * parent, int childNo ) const
 {
     CHECK_PTR( parent );
 
+    // Only the rows up to this one need to be sorted
+
     const FileInfoList & childrenList =
 	parent->sortedChildren( _sortCol, _sortOrder,
-				true );	    // includeAttic
+				true,	    // includeAttic
+				childNo + 1 );
 
     if ( childNo < 0 || childNo >= childrenList.size() )
     {
@@ -282,11 +337,35 @@ int DirTreeModel::rowNumber( FileInfo * child ) const
     if ( ! child->parent() )
 	return 0;
 
+    DirInfo * parent = child->parent();
+
+    // Make sure the sort cache is for the current sort column and order.
+    // Normally the child is in the part of the list that is already sorted
+    // since the view got its model index from findChild().
+
+    parent->sortedChildren( _sortCol, _sortOrder,
+			    true,  // includeAttic
+			    0 );   // minRows
+
+    int row = parent->sortedRow( child );
+
+    if ( row >= 0 )
+	return row;
+
+    // Not sorted yet: Sort the complete list.
+
     const FileInfoList & childrenList =
-	child->parent()->sortedChildren( _sortCol, _sortOrder,
-					 true ); // includeAttic
+	parent->sortedChildren( _sortCol, _sortOrder,
+				true ); // includeAttic
+
+    row = parent->sortedRow( child );
 
-    int row = childrenList.indexOf( child );
+    if ( row >= 0 )
+	return row;
+
+    // The row numbers are only a hint; search the list as a fallback.
+
+    row = childrenList.indexOf( child );
 
     if ( row < 0 )
     {
@@ -449,6 +528,19 @@ QVariant DirTreeModel::data( const QModelIndex & index, int role ) const
 		return QVariant();
 	    }
 
+	case Qt::BackgroundRole:
+	    {
+		if ( _cacheDiff )
+		{
+		    QColor color = _cacheDiff->color( item );
+
+		    if ( color.isValid() )
+			return color;
+		}
+
+		return QVariant();
+	    }
+
 	case Qt::DecorationRole: // Icon
 	    return columnIcon( item, col );
 
@@ -1237,6 +1329,22 @@ void DirTreeModel::updatePersistentIndexes()
 }
 
 
+void DirTreeModel::exposeDirs()
+{
+    // The views keep persistent indexes for all expanded items and for the
+    // current item; they only have indexes for the children of expanded
+    // items apart from that.
+
+    QModelIndexList persistentList = persistentIndexList();
+
+    foreach ( const QModelIndex & index, persistentList )
+    {
+	if ( index.isValid() )
+	    _tree->exposeDir( static_cast<FileInfo *>( index.internalPointer() ) );
+    }
+}
+
+
 void DirTreeModel::beginRemoveRows( const QModelIndex & parent, int first, int last )
 {
     if ( _removingRows )
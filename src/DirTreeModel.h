@@ -29,6 +29,7 @@ namespace QDirStat
     class DirTree;
     class DirInfo;
     class SelectionModel;
+    class CacheDiff;
 
     enum CustomRoles
     {
@@ -66,6 +67,21 @@ namespace QDirStat
 	 **/
 	DirTree *tree()	{ return _tree; }
 
+	/**
+	 * Set the result of comparing the tree with a cache file to color the
+	 * rows by how they changed. This takes over ownership of 'diff'.
+	 * Use 0 to stop that. clear() also does that.
+	 *
+	 * This sends cacheDiffChanged().
+	 **/
+	void setCacheDiff( CacheDiff * diff );
+
+	/**
+	 * Return the result of comparing the tree with a cache file or 0 if
+	 * there is none.
+	 **/
+	const CacheDiff * cacheDiff() const { return _cacheDiff; }
+
 	/**
 	 * Set the column order and what columns to display.
 	 *
@@ -236,6 +252,16 @@ namespace QDirStat
 	bool slowUpdate() const { return _slowUpdate; }
 
 
+    signals:
+
+	/**
+	 * Emitted when the result of comparing the tree with a cache file
+	 * changed (see setCacheDiff()). 'diff' may be 0; it is only valid
+	 * until the next time this is emitted.
+	 **/
+	void cacheDiffChanged( const CacheDiff * diff );
+
+
     public:
 
 	// Mapping of tree items to model rows and vice versa.
@@ -428,6 +454,12 @@ namespace QDirStat
 	void invalidatePersistent( FileInfo * subtree,
 				   bool	      includeParent );
 
+	/**
+	 * Report all directories that the views show to the tree
+	 * (see DirTree::exposedDirsNeeded()).
+	 **/
+	void exposeDirs();
+
     protected:
 	/**
 	 * Create a new tree (and delete the old one if there is one)
@@ -533,6 +565,7 @@ namespace QDirStat
 	Qt::SortOrder	 _sortOrder;
 	bool		 _removingRows;
 	bool		 _useBoldForDominantItems;
+	CacheDiff *	 _cacheDiff;
 
 	// Colors and fonts
 
@@ -237,6 +237,18 @@ bool ExcludeRules::matchDirectChildren( DirInfo * dir )
 }
 
 
+bool ExcludeRules::hasFileChildRules() const
+{
+    foreach ( ExcludeRule * rule, _rules )
+    {
+	if ( rule->checkAnyFileChild() )
+	    return true;
+    }
+
+    return false;
+}
+
+
 const ExcludeRule * ExcludeRules::matchingRule( const QString & fullPath,
 						const QString & fileName )
 {
@@ -217,6 +217,13 @@ namespace QDirStat
          **/
         bool matchDirectChildren( DirInfo * dir );
 
+        /**
+         * Return 'true' if there is any rule that checks the direct
+         * non-directory children of a directory (see
+         * ExcludeRule::checkAnyFileChild()).
+         **/
+        bool hasFileChildRules() const;
+
 	/**
 	 * Find the exclude rule that matches 'text'.
 	 * Return 0 if there is no match.
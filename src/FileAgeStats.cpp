@@ -10,7 +10,9 @@
 #include <QDate>
 
 #include "FileAgeStats.h"
-#include "FileInfoIterator.h"
+#include "DirTree.h"
+#include "MemoCache.h"
+#include "TreeColumns.h"
 #include "Logger.h"
 #include "Exception.h"
 
@@ -22,6 +24,18 @@ short FileAgeStats::_thisMonth = 0;
 short FileAgeStats::_lastYear  = 0;
 
 
+/**
+ * Results of the last few calculations, shared by all instances so they
+ * survive closing and opening the window again.
+ **/
+static MemoCache<FileAgeStats> & memoCache()
+{
+    static MemoCache<FileAgeStats> cache;
+
+    return cache;
+}
+
+
 FileAgeStats::FileAgeStats( FileInfo * subtree )
 {
     clear();
@@ -64,50 +78,67 @@ void FileAgeStats::clearMonthStats( short year )
 
 void FileAgeStats::collect( FileInfo * subtree )
 {
+    // The month statistics depend on the current year
+
+    QString params = QString::number( thisYear() );
+    MemoCache<FileAgeStats>::ResultPtr result = memoCache().find( subtree, params );
+
+    if ( result )
+    {
+	*this = *result;
+	return;
+    }
+
     clear();
-    collectRecursive( subtree );
+    collectFiles( subtree );
     calcPercentages();
     collectYears();
+
+    // While reading, the subtree changes all the time anyway
+
+    if ( subtree && ! subtree->tree()->isBusy() )
+    {
+	memoCache().insert( subtree, params,
+			    MemoCache<FileAgeStats>::ResultPtr( new FileAgeStats( *this ) ) );
+    }
 }
 
 
-void FileAgeStats::collectRecursive( FileInfo * dir )
+void FileAgeStats::collectFiles( FileInfo * subtree )
 {
-    if ( ! dir )
+    if ( ! subtree )
 	return;
 
-    FileInfoIterator it( dir );
+    const TreeColumns * columns = subtree->tree()->columns( subtree );
+    int rows = columns->rows();
 
-    while ( *it )
-    {
-	FileInfo * item = *it;
+    // Row 0 is the subtree itself unless that is a pseudo directory; only
+    // its descendants are counted.
+
+    int firstRow = ( rows > 0 && columns->hasSubtreeRow() ) ? 1 : 0;
 
-        if ( item && item->isFile() )
+    for ( int row = firstRow; row < rows; ++row )
+    {
+        if ( columns->isFile( row ) )
         {
-            short year  = item->mtimeYear();
-            short month = item->mtimeMonth();
+            short    year  = columns->mtimeYear ( row );
+            short    month = columns->mtimeMonth( row );
+            FileSize size  = columns->size( row );
 
             YearStats &yearStats = _yearStats[ year ];
 
             yearStats.year = year;
             yearStats.filesCount++;
-            yearStats.size += item->size();
+            yearStats.size += size;
 
             YearStats * monthStats = this->monthStats( year, month );
 
             if ( monthStats )
             {
                 monthStats->filesCount++;
-                monthStats->size += item->size();
+                monthStats->size += size;
             }
         }
-
-	if ( item->hasChildren() )
-	{
-	    collectRecursive( item );
-	}
-
-        ++it;
     }
 }
 
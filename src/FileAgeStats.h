@@ -71,6 +71,10 @@ namespace QDirStat
         /**
          * Recurse through all file elements in the subtree and calculate the
          * data for that subtree.
+         *
+         * If the data for this subtree were calculated before and nothing
+         * changed in the subtree since then, this simply uses the old data
+         * (see MemoCache).
          **/
     	void collect( FileInfo * subtree );
 
@@ -131,10 +135,10 @@ namespace QDirStat
         void clearMonthStats( short year );
 
         /**
-         * Recurse through all file elements in the subtree and calculate the
+         * Go through all file elements in the subtree and calculate the
          * data for that subtree.
          **/
-    	void collectRecursive( FileInfo * subtree );
+    	void collectFiles( FileInfo * subtree );
 
         /**
          * Sum up the totals over all years and calculate the percentages for
@@ -594,9 +594,9 @@ void FileDetailsView::showSelectionSummary( const FileInfoSet & selectedItems )
     setCurrentPage( _ui->selectionSummaryPage );
     FileInfoSet sel = selectedItems.normalized();
 
-    int fileCount	 = 0;
-    int dirCount	 = 0;
-    int subtreeFileCount = 0;
+    int	      fileCount	       = 0;
+    int	      dirCount	       = 0;
+    FileCount subtreeFileCount = 0;
 
     foreach ( FileInfo * item, sel )
     {
@@ -630,7 +630,7 @@ void FileDetailsView::showSelectionSummary( const FileInfoSet & selectedItems )
 
 
 void FileDetailsView::setLabel( QLabel *	label,
-				int		number,
+				FileCount	number,
 				const QString & prefix )
 {
     CHECK_PTR( label );
@@ -138,7 +138,7 @@ namespace QDirStat
 	/**
 	 * Set a label with a number and an optional prefix.
 	 **/
-	void setLabel( QLabel * label, int number, const QString & prefix = "" );
+	void setLabel( QLabel * label, FileCount number, const QString & prefix = "" );
 
 	/**
 	 * Set a file size label with a file size and an optional prefix.
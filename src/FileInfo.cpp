@@ -64,8 +64,12 @@ FileInfo::FileInfo( DirTree    * tree,
     _mtime	   = 0;
     _mtimeYear     = -1;
     _mtimeMonth    = -1;
+    _rowNumber     = -1;
     _allocatedSize = 0;
     _magic	   = FileInfoMagic;
+
+    if ( _tree )
+	_tree->nodeCreated();
 }
 
 
@@ -97,9 +101,13 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
     _mtime	   = statInfo->st_mtime;
     _mtimeYear     = -1;
     _mtimeMonth    = -1;
+    _rowNumber     = -1;
     _magic	   = FileInfoMagic;
     _allocatedSize = 0;
 
+    if ( _tree )
+	_tree->nodeCreated();
+
     if ( isSpecial() )
     {
 	_size		= 0;
@@ -185,12 +193,16 @@ FileInfo::FileInfo( DirTree *	    tree,
     _mtime	   = mtime;
     _mtimeYear     = -1;
     _mtimeMonth    = -1;
+    _rowNumber     = -1;
     _allocatedSize = 0;
     _links	   = links;
     _uid	   = uid;
     _gid	   = gid;
     _magic	   = FileInfoMagic;
 
+    if ( _tree )
+	_tree->nodeCreated();
+
     if ( blocks < 0 )
     {
 	_isSparseFile	= false;
@@ -226,6 +238,12 @@ FileInfo::~FileInfo()
 {
     _magic = 0;
 
+    // This might be on the reclaimer thread: Nothing else of the tree may
+    // be touched here.
+
+    if ( _tree )
+	_tree->nodeDeleted();
+
     /**
      * The destructor should also take care about unlinking this object from
      * its parent's children list, but regrettably that just doesn't work: At
@@ -281,21 +299,35 @@ int FileInfo::usedPercent() const
 
 
 QString FileInfo::url() const
+{
+    QString result;
+    appendUrl( result );
+
+    return result;
+}
+
+
+void FileInfo::appendUrl( QString & buffer ) const
 {
     if ( _parent )
-    {
-	QString parentUrl = _parent->url();
+	_parent->appendUrl( buffer );
 
-	if ( isPseudoDir() ) // don't append "/." for dot entries and attics
-	    return parentUrl;
+    appendToParentUrl( buffer );
+}
 
-	if ( ! parentUrl.endsWith( "/" ) && ! _name.startsWith( "/" ) )
-	    parentUrl += "/";
 
-	return parentUrl + _name;
+void FileInfo::appendToParentUrl( QString & parentUrl ) const
+{
+    if ( _parent )
+    {
+	if ( isPseudoDir() ) // don't append "/." for dot entries and attics
+	    return;
+
+	if ( ! parentUrl.endsWith( '/' ) && ! _name.startsWith( '/' ) )
+	    parentUrl += '/';
     }
-    else
-	return _name;
+
+    parentUrl += _name;
 }
 
 
@@ -364,6 +396,22 @@ int FileInfo::treeLevel() const
 }
 
 
+void FileInfo::setParent( DirInfo * newParent )
+{
+    if ( _parent && newParent != _parent && _tree && isDirInfo() )
+    {
+	// A directory that moves to another parent takes its complete
+	// subtree along, so any cached URL prefix below it might be wrong now,
+	// and so are the directory labels.
+
+	_tree->invalidateDirUrls();
+	_tree->invalidateLabels();
+    }
+
+    _parent = newParent;
+}
+
+
 bool FileInfo::hasChildren() const
 {
     return firstChild() || dotEntry();
@@ -372,6 +420,25 @@ bool FileInfo::hasChildren() const
 
 bool FileInfo::isInSubtree( const FileInfo *subtree ) const
 {
+    if ( subtree == this )
+	return true;
+
+    // Use the directory labels if possible (see DirTree::ensureLabels()):
+    // A non-directory item is in a subtree if its parent is.
+
+    if ( subtree && subtree->isDirInfo() && _tree &&
+	 _tree == subtree->tree() && _tree->labelsValid() )
+    {
+	const DirInfo * subtreeDir = static_cast<const DirInfo *>( subtree );
+	const DirInfo * dir	   = isDirInfo() ? static_cast<const DirInfo *>( this ) : _parent;
+
+	if ( dir && dir->isLabelled() && subtreeDir->isLabelled() )
+	{
+	    return subtreeDir->preOrder() <= dir->preOrder() &&
+		dir->postOrder() <= subtreeDir->postOrder();
+	}
+    }
+
     const FileInfo * ancestor = this;
 
     while ( ancestor )
@@ -386,6 +453,12 @@ bool FileInfo::isInSubtree( const FileInfo *subtree ) const
 }
 
 
+quint64 FileInfo::generation() const
+{
+    return _parent ? _parent->generation() : 0;
+}
+
+
 FileInfo * FileInfo::locate( QString url, bool findPseudoDirs )
 {
     if ( ! _tree )
@@ -417,18 +490,38 @@ FileInfo * FileInfo::locate( QString url, bool findPseudoDirs )
 	}
 
 
-	// Search all children
+	// Search all children. Large directories have an index of the names
+	// of their children, so only the child with the first component of
+	// the URL as its name needs to be searched.
 
-	FileInfo * child = firstChild();
+	DirInfo *  dir	 = ( isDirInfo() && this != _tree->root() ) ? toDirInfo() : 0;
+	FileInfo * child = 0;
 
-	while ( child )
+	if ( dir && dir->ensureNameIndex() )
 	{
-	    FileInfo * foundChild = child->locate( url, findPseudoDirs );
+	    child = dir->indexedChild( url.section( '/', 0, 0 ) );
 
-	    if ( foundChild )
-		return foundChild;
-	    else
-		child = child->next();
+	    if ( child )
+	    {
+		FileInfo * foundChild = child->locate( url, findPseudoDirs );
+
+		if ( foundChild )
+		    return foundChild;
+	    }
+	}
+	else
+	{
+	    child = firstChild();
+
+	    while ( child )
+	    {
+		FileInfo * foundChild = child->locate( url, findPseudoDirs );
+
+		if ( foundChild )
+		    return foundChild;
+		else
+		    child = child->next();
+	    }
 	}
 
 
@@ -461,18 +554,28 @@ FileInfo * FileInfo::locate( QString url, bool findPseudoDirs )
 	{
             // logDebug() << "Searching DotEntry for " << url << " in " << this << endl;
 
-            child = dotEntry()->firstChild();
+	    if ( dotEntry()->ensureNameIndex() )
+	    {
+		child = dotEntry()->indexedChild( url );
 
-            while ( child )
-            {
-                if ( child->name() == url )
-                {
-                    // logDebug() << "Found " << url << " in " << dotEntry() << endl;
-                    return child;
-                }
+		if ( child )
+		    return child;
+	    }
+	    else
+	    {
+		child = dotEntry()->firstChild();
 
-                child = child->next();
-            }
+		while ( child )
+		{
+		    if ( child->name() == url )
+		    {
+			// logDebug() << "Found " << url << " in " << dotEntry() << endl;
+			return child;
+		    }
+
+		    child = child->next();
+		}
+	    }
 
             // logDebug() << "Cannot find " << url << " in DotEntry" << endl;
 	}
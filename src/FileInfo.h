@@ -40,6 +40,7 @@ namespace QDirStat
     class Attic;
     class PkgInfo;
     class DirTree;
+    class SubtreeStore;
 
 
     /**
@@ -166,6 +167,27 @@ namespace QDirStat
 	 **/
 	virtual QString url() const;
 
+	/**
+	 * Append the full URL of this object to 'buffer'. This is what url()
+	 * uses internally. Code that needs the URLs of many items can reuse
+	 * one buffer with this to avoid creating a lot of temporary strings.
+	 *
+	 * Parent directories may add a cached URL prefix (see
+	 * DirTree::setCacheDirUrls()).
+	 **/
+	virtual void appendUrl( QString & buffer ) const;
+
+	/**
+	 * Append the part that this object adds to the URL of its parent to
+	 * 'parentUrl': Nothing for pseudo directories (dot entries and
+	 * attics), otherwise a "/" if needed and the name.
+	 *
+	 * This is intended for tree traversals that keep the URL of the
+	 * current directory in a buffer and truncate it back to its previous
+	 * length when they are done with an item.
+	 **/
+	void appendToParentUrl( QString & parentUrl ) const;
+
 	/**
 	 * Returns the full path of this object. Unlike url(), this never has a
 	 * protocol prefix or a part that identifies the package this belongs
@@ -379,35 +401,35 @@ namespace QDirStat
 	 * item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalItems() { return 0; }
+	virtual FileCount totalItems() { return 0; }
 
 	/**
 	 * Returns the total number of subdirectories in this subtree,
 	 * excluding this item. Dot entries and "." or ".." are not counted.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalSubDirs() { return 0; }
+	virtual FileCount totalSubDirs() { return 0; }
 
 	/**
 	 * Returns the total number of plain file children in this subtree,
 	 * excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalFiles() { return 0; }
+	virtual FileCount totalFiles() { return 0; }
 
 	/**
 	 * Returns the total number of non-directory items in this subtree,
 	 * excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalNonDirItems() { return 0; }
+	virtual FileCount totalNonDirItems() { return 0; }
 
 	/**
 	 * Returns the total number of ignored (non-directory!) items in this
 	 * subtree, excluding this item.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalIgnoredItems() { return 0; }
+	virtual FileCount totalIgnoredItems() { return 0; }
 
 	/**
 	 * Returns the total number of not ignored (non-directory!) items in
@@ -415,7 +437,7 @@ namespace QDirStat
 	 *
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int totalUnignoredItems() { return 0; }
+	virtual FileCount totalUnignoredItems() { return 0; }
 
 	/**
 	 * Returns the total number of direct children of this item.
@@ -433,7 +455,7 @@ namespace QDirStat
 	 *
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual int errSubDirCount() { return 0; }
+	virtual FileCount errSubDirCount() { return 0; }
 
 	/**
 	 * Returns the latest modification time of this subtree.
@@ -560,7 +582,23 @@ namespace QDirStat
 	/**
 	 * Set the "parent" pointer.
 	 **/
-	void setParent( DirInfo * newParent ) { _parent = newParent; }
+	void setParent( DirInfo * newParent );
+
+	/**
+	 * Return the row number of this item in the sorted children list of
+	 * its parent as cached by the last DirInfo::sortedChildren() call of
+	 * the parent, or -1 if there is none.
+	 *
+	 * This is only a hint: Callers need to check if the parent's current
+	 * sorted children list really has this item at that position.
+	 **/
+	int rowNumber() const { return _rowNumber; }
+
+	/**
+	 * Set the cached row number. This is intended for
+	 * DirInfo::sortedChildren().
+	 **/
+	void setRowNumber( int row ) { _rowNumber = row; }
 
 	/**
 	 * Returns a pointer to the next entry on the same level
@@ -602,6 +640,14 @@ namespace QDirStat
 	 **/
 	bool isInSubtree( const FileInfo *subtree ) const;
 
+	/**
+	 * Return the generation of this item: A number that changes whenever
+	 * anything in its subtree changes (see DirInfo::generation()). For
+	 * anything that is not a directory, this is the generation of the
+	 * parent.
+	 **/
+	virtual quint64 generation() const;
+
 	/**
 	 * Locate a child somewhere in this subtree whose URL (i.e. complete
 	 * path) matches the URL passed. Returns 0 if there is no such child.
@@ -773,6 +819,15 @@ namespace QDirStat
 	 **/
 	virtual bool isPkgInfo() const { return false; }
 
+	/**
+	 * Returns true if this is an AggregateInfo object, i.e. a pseudo
+	 * entry that stands for a number of files that were not read
+	 * individually.
+	 *
+	 * This default implementation always returns 'false'.
+	 **/
+	virtual bool isAggregate() const { return false; }
+
 	/**
 	 * Try to convert this to a DirInfo pointer. This returns null if this
 	 * is not a DirInfo.
@@ -944,6 +999,10 @@ namespace QDirStat
 
     protected:
 
+	// SubtreeStore saves and restores the raw fields of items that are
+	// moved out of memory.
+	friend class SubtreeStore;
+
         /**
          * Calculate values that are dependent on _mtime, yet quite expensive
          * to calculate, and cache them: _mtimeYear, _mtimeMonth
@@ -973,6 +1032,7 @@ namespace QDirStat
 	time_t		_mtime;			// modification time
         short           _mtimeYear;             // year  of the modification time or -1
         short           _mtimeMonth;            // month of the modification time or -1
+	int		_rowNumber;		// row in the parent's sorted children or -1
 
 	DirInfo	 *	_parent;		// pointer to the parent entry
 	FileInfo *	_next;			// pointer to the next entry
@@ -7,8 +7,6 @@
  */
 
 
-#include <algorithm>    // std::stable_sort()
-
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
 #include "DotEntry.h"
@@ -116,10 +114,8 @@ FileInfoSortedBySizeIterator::FileInfoSortedBySizeIterator( FileInfo	  * parent,
 	++it;
     }
 
-    std::stable_sort( _sortedChildren.begin(),
-		      _sortedChildren.end(),
-		      FileInfoSorter( SizeCol, sortOrder ) );
-
+    FileInfoKeySorter sorter( SizeCol, sortOrder );
+    sorter.sort( _sortedChildren.begin(), _sortedChildren.end() );
 }
 
 
@@ -7,6 +7,9 @@
  */
 
 
+#include <algorithm>    // std::sort()
+#include <QVector>
+
 #include "FileInfoSet.h"
 #include "DirTree.h"
 #include "DirInfo.h"
@@ -30,10 +33,99 @@ bool FileInfoSet::containsAncestorOf( FileInfo * item ) const
 }
 
 
+namespace
+{
+    /**
+     * Label range of an item of a FileInfoSet: For a directory, that is
+     * its pre-order and post-order label; for anything else, it is the
+     * pre-order label of its parent.
+     **/
+    struct LabelRange
+    {
+	quint32	   from;
+	quint32	   to;
+	bool	   isDir;
+	FileInfo * item;
+    };
+
+
+    /**
+     * Sort label ranges so that each directory is followed by everything in
+     * its subtree.
+     **/
+    bool labelRangeLessThan( const LabelRange & a, const LabelRange & b )
+    {
+	if ( a.from != b.from )
+	    return a.from < b.from;
+
+	return a.to > b.to;
+    }
+}
+
+
+bool FileInfoSet::normalizeByLabels( FileInfoSet & result ) const
+{
+    FileInfo * firstItem = first();
+
+    if ( ! firstItem || ! firstItem->tree() || ! firstItem->tree()->ensureLabels() )
+	return false;
+
+    DirTree * tree = firstItem->tree();
+    QVector<LabelRange> ranges;
+    ranges.reserve( size() );
+
+    foreach ( FileInfo * item, *this )
+    {
+	if ( ! item || item->tree() != tree )
+	    return false;
+
+	LabelRange range;
+	range.item  = item;
+	range.isDir = item->isDirInfo();
+
+	DirInfo * dir = range.isDir ? item->toDirInfo() : item->parent();
+
+	if ( ! dir || ! dir->isLabelled() )
+	    return false;
+
+	range.from = dir->preOrder();
+	range.to   = range.isDir ? dir->postOrder() : range.from;
+	ranges << range;
+    }
+
+    std::sort( ranges.begin(), ranges.end(), labelRangeLessThan );
+
+    // Sweep: Everything that starts within the range of the last directory
+    // that was kept is in its subtree. Labels start with 1.
+
+    quint32 coveredTo = 0;
+
+    foreach ( const LabelRange & range, ranges )
+    {
+	if ( range.from <= coveredTo )
+	    continue;
+
+	result << range.item;
+
+	if ( range.isDir )
+	    coveredTo = range.to;
+    }
+
+    return true;
+}
+
+
 FileInfoSet FileInfoSet::normalized() const
 {
     FileInfoSet normalized;
 
+    // For large sets, checking the ancestors of every item is expensive
+
+    if ( size() > 1 && normalizeByLabels( normalized ) )
+	return normalized;
+
+    normalized.clear();
+
     foreach ( FileInfo * item, *this )
     {
 	if ( ! containsAncestorOf( item ) )
@@ -110,6 +110,12 @@ namespace QDirStat
 	 * Return a set with all the invalid items removed, i.e. without items
 	 * where checkMagicNumber() returns 'false'.
 	 *
+	 * This does not help for deleted subtrees: The tree hands them over
+	 * to the reclaimer thread (see TreeReclaimer), so their items may be
+	 * deleted at any time. Sets that are kept while the tree may change
+	 * have to drop those items when the tree sends deletingChild() or
+	 * clearingSubtree() (see Refresher).
+	 *
 	 * If there is reason to believe that any items of the set might have
 	 * become invalid, call this first before any other operations.
 	 *
@@ -121,9 +127,23 @@ namespace QDirStat
 	/**
 	 * Return a 'normalized' set, i.e. with all items removed that have
 	 * ancestors in the set.
+	 *
+	 * If possible, this uses the directory labels of the tree (see
+	 * DirTree::ensureLabels()), so it takes O(n log n) for n items no
+	 * matter how deep they are in the tree.
 	 **/
 	FileInfoSet normalized() const;
 
+
+    protected:
+
+	/**
+	 * Normalize this set with the directory labels of the tree and store
+	 * the result in 'result'. Return 'false' if that is not possible
+	 * because any item doesn't have labels.
+	 **/
+	bool normalizeByLabels( FileInfoSet & result ) const;
+
     };	// class FileInfoSet
 
 }	// namespace QDirStat
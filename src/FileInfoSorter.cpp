@@ -7,9 +7,13 @@
  */
 
 
-#include <algorithm>    // std::swap()
+#include <algorithm>    // std::swap(), std::sort(), std::partial_sort()
 #include "FileInfoSorter.h"
 
+// Minimum number of items for a radix sort; below that, std::sort() is faster
+#define RADIX_SORT_MIN_ITEMS	256
+
+
 using namespace QDirStat;
 
 
@@ -17,6 +21,22 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 {
     if ( !a || !b ) return false;
 
+    if ( _nameTieBreak )
+    {
+	if ( less( a, b ) ) return true;
+	if ( less( b, a ) ) return false;
+
+	// Equal in the sort column: Sort by name (always ascending)
+
+	return FileInfoSorter( NameCol, Qt::AscendingOrder ).less( a, b );
+    }
+
+    return less( a, b );
+}
+
+
+bool FileInfoSorter::less( FileInfo * a, FileInfo * b ) const
+{
     if ( _sortOrder == Qt::DescendingOrder )
 	std::swap( a, b ); // Now we only need to handle the a < b case
 
@@ -73,3 +93,262 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 
     return false;
 }
+
+
+
+/**
+ * Map a signed value to an unsigned one with the same sort order.
+ **/
+static inline quint64 signedKey( qint64 value )
+{
+    return ( (quint64) value ) ^ ( 1ULL << 63 );
+}
+
+
+FileInfoKeySorter::FileInfoKeySorter( DataColumn    sortCol,
+				      Qt::SortOrder sortOrder,
+				      bool	    nameTieBreak ):
+    _sortCol( sortCol ),
+    _sortOrder( sortOrder ),
+    _nameTieBreak( nameTieBreak && sortCol != NameCol )
+{
+}
+
+
+FileInfoKeySorter::KeyLess FileInfoKeySorter::keyLess() const
+{
+    return KeyLess( _nameTieBreak || _sortCol == NameCol,		     // compareName
+		    _sortCol == NameCol && _sortOrder == Qt::DescendingOrder ); // reverseName
+}
+
+
+void FileInfoKeySorter::sort( FileInfoList::iterator begin,
+			      FileInfoList::iterator end )
+{
+    if ( end - begin < 2 )
+	return;
+
+    extractKeys( begin, end );
+
+    if ( _sortCol != NameCol && _keys.size() >= RADIX_SORT_MIN_ITEMS )
+    {
+	radixSort();
+
+	if ( _nameTieBreak )
+	    sortTies();
+    }
+    else if ( _nameTieBreak || _sortCol == NameCol )
+    {
+	// The keys are unique anyway, so there is no need for a stable sort
+
+	std::sort( _keys.begin(), _keys.end(), keyLess() );
+    }
+    else
+    {
+	std::stable_sort( _keys.begin(), _keys.end(), keyLess() );
+    }
+
+    storeSorted( begin );
+}
+
+
+void FileInfoKeySorter::partialSort( FileInfoList::iterator begin,
+				     FileInfoList::iterator middle,
+				     FileInfoList::iterator end )
+{
+    if ( middle == end )
+    {
+	sort( begin, end );
+	return;
+    }
+
+    if ( middle == begin )
+	return;
+
+    extractKeys( begin, end );
+    std::partial_sort( _keys.begin(),
+		       _keys.begin() + ( middle - begin ),
+		       _keys.end(),
+		       keyLess() );
+    storeSorted( begin );
+}
+
+
+void FileInfoKeySorter::extractKeys( FileInfoList::iterator begin,
+				     FileInfoList::iterator end )
+{
+    bool descending = _sortOrder == Qt::DescendingOrder;
+    bool namePrefixNeeded = _nameTieBreak || _sortCol == NameCol;
+
+    _keys.clear();
+    _keys.reserve( end - begin );
+
+    for ( FileInfoList::iterator it = begin; it != end; ++it )
+    {
+	FileInfo * item = *it;
+	SortKey	   key;
+
+	key.primary    = 0;
+	key.secondary  = 0;
+	key.namePrefix = namePrefixNeeded ? namePrefix( item->name() ) : 0;
+	key.item       = item;
+
+	switch ( _sortCol )
+	{
+	    case NameCol:
+		// Ignored items last, then the dot entry, see FileInfoSorter
+		key.primary = ( item->isIgnored()  ? 2 : 0 ) |
+			      ( item->isDotEntry() ? 1 : 0 );
+		break;
+
+	    case PercentBarCol:
+	    case PercentNumCol:
+	    case SizeCol:
+		key.primary   = signedKey( item->totalAllocatedSize() );
+		key.secondary = signedKey( item->totalSize() );
+		break;
+
+	    case TotalItemsCol:	  key.primary = signedKey( item->totalItems()	   ); break;
+	    case TotalFilesCol:	  key.primary = signedKey( item->totalFiles()	   ); break;
+	    case TotalSubDirsCol: key.primary = signedKey( item->totalSubDirs()	   ); break;
+	    case LatestMTimeCol:  key.primary = signedKey( item->latestMtime()	   ); break;
+	    case ReadJobsCol:	  key.primary = signedKey( item->pendingReadJobs() ); break;
+
+	    case OldestFileMTimeCol:
+		{
+		    // No oldest file mtime (0) sorts last
+
+		    time_t mtime = item->oldestFileMtime();
+		    key.primary = mtime == 0 ? ~0ULL : signedKey( mtime );
+		}
+		break;
+
+	    case UserCol:		key.primary = item->uid();  break;
+	    case GroupCol:		key.primary = item->gid();  break;
+	    case PermissionsCol:
+	    case OctalPermissionsCol:	key.primary = item->mode(); break;
+
+	    case UndefinedCol:
+		break;
+		// Intentionally omitting the 'default' branch
+		// so the compiler can warn about unhandled enum values
+	}
+
+	if ( descending )
+	{
+	    key.primary	  = ~key.primary;
+	    key.secondary = ~key.secondary;
+
+	    // For all other columns, the name is always in ascending order
+
+	    if ( _sortCol == NameCol )
+		key.namePrefix = ~key.namePrefix;
+	}
+
+	_keys << key;
+    }
+}
+
+
+void FileInfoKeySorter::storeSorted( FileInfoList::iterator begin )
+{
+    const SortKey * key = _keys.constData();
+    const SortKey * end = key + _keys.size();
+
+    while ( key != end )
+	*begin++ = ( key++ )->item;
+
+    _keys.clear();
+}
+
+
+void FileInfoKeySorter::radixSort()
+{
+    QVector<SortKey> buffer( _keys.size() );
+
+    // LSD: Sort by the less significant key first; since each pass is
+    // stable, the order by that key is kept for equal primary keys.
+
+    radixSortBy( &SortKey::secondary, buffer );
+    radixSortBy( &SortKey::primary,   buffer );
+}
+
+
+void FileInfoKeySorter::radixSortBy( quint64 SortKey::* field,
+				     QVector<SortKey> & buffer )
+{
+    int count = _keys.size();
+
+    // Find out which bits are not the same in all keys
+
+    quint64 first = _keys.constData()[ 0 ].*field;
+    quint64 diff  = 0;
+
+    for ( int i = 0; i < count; ++i )
+	diff |= ( _keys.constData()[ i ].*field ) ^ first;
+
+    for ( int shift = 0; shift < 64; shift += 8 )
+    {
+	if ( ( ( diff >> shift ) & 0xFF ) == 0 )
+	    continue; // This digit is the same in all keys
+
+	int offset[ 256 ] = { 0 };
+	const SortKey * src = _keys.constData();
+	SortKey	      * dest = buffer.data();
+
+	for ( int i = 0; i < count; ++i )
+	    ++offset[ ( src[ i ].*field >> shift ) & 0xFF ];
+
+	int pos = 0;
+
+	for ( int digit = 0; digit < 256; ++digit )
+	{
+	    int digitCount = offset[ digit ];
+	    offset[ digit ] = pos;
+	    pos += digitCount;
+	}
+
+	for ( int i = 0; i < count; ++i )
+	    dest[ offset[ ( src[ i ].*field >> shift ) & 0xFF ]++ ] = src[ i ];
+
+	_keys.swap( buffer );
+    }
+}
+
+
+void FileInfoKeySorter::sortTies()
+{
+    KeyLess less = keyLess();
+    int	    count = _keys.size();
+    int	    start = 0;
+
+    for ( int i = 1; i <= count; ++i )
+    {
+	if ( i == count ||
+	     _keys.at( i ).primary   != _keys.at( start ).primary ||
+	     _keys.at( i ).secondary != _keys.at( start ).secondary )
+	{
+	    if ( i - start > 1 )
+		std::sort( _keys.begin() + start, _keys.begin() + i, less );
+
+	    start = i;
+	}
+    }
+}
+
+
+quint64 FileInfoKeySorter::namePrefix( const QString & name )
+{
+    quint64 prefix = 0;
+    int	    len	   = qMin( (int) name.size(), 4 );
+
+    for ( int i = 0; i < 4; ++i )
+    {
+	prefix <<= 16;
+
+	if ( i < len )
+	    prefix |= name.at( i ).unicode();
+    }
+
+    return prefix;
+}
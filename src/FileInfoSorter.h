@@ -10,6 +10,8 @@
 #define FileInfoSorter_h
 
 
+#include <QVector>
+
 #include "FileInfo.h"
 #include "DataColumns.h"
 
@@ -41,10 +43,19 @@ namespace QDirStat
 	/**
 	 * Constructor. This sets the sort column and sort order that will be
 	 * used in subsequent calls.
+	 *
+	 * If 'nameTieBreak' is 'true', items that are equal in 'sortCol' are
+	 * sorted by name in ascending order. This gives the same result as a
+	 * std::stable_sort() by name followed by one by 'sortCol', but it
+	 * also works with algorithms that are not stable like
+	 * std::partial_sort().
 	 **/
-	FileInfoSorter( DataColumn sortCol, Qt::SortOrder sortOrder ):
+	FileInfoSorter( DataColumn    sortCol,
+			Qt::SortOrder sortOrder,
+			bool	      nameTieBreak = false ):
 	    _sortCol( sortCol ),
-	    _sortOrder( sortOrder )
+	    _sortOrder( sortOrder ),
+	    _nameTieBreak( nameTieBreak && sortCol != NameCol )
 	    {}
 
 	/**
@@ -53,12 +64,158 @@ namespace QDirStat
 	 **/
 	bool operator() ( FileInfo * a, FileInfo * b );
 
+    protected:
+
+	/**
+	 * Compare 'a' and 'b' only by the sort column.
+	 **/
+	bool less( FileInfo * a, FileInfo * b ) const;
+
     private:
 	DataColumn    _sortCol;
 	Qt::SortOrder _sortOrder;
+	bool	      _nameTieBreak;
 
     };	   // class FileInfoSorter
 
+
+
+    /**
+     * Sorter for large lists of FileInfo objects that sorts the same way as
+     * FileInfoSorter, but much faster:
+     *
+     * The sort key of each item is extracted only once per sort into a
+     * compact array of plain integers (including the first characters of
+     * the name), so the comparisons don't need to switch over the sort
+     * column, call virtual methods or recalculate anything. Columns with
+     * integer sort keys (i.e. all but the name) are sorted with a radix
+     * sort that only needs a few linear passes over that array.
+     *
+     * Example:
+     *
+     *	   FileInfoList childrenList;
+     *	   FileInfoKeySorter sorter( SizeCol, Qt::DescendingOrder );
+     *	   sorter.sort( childrenList.begin(), childrenList.end() );
+     **/
+    class FileInfoKeySorter
+    {
+    public:
+	/**
+	 * Constructor. See FileInfoSorter for the parameters.
+	 **/
+	FileInfoKeySorter( DataColumn	 sortCol,
+			   Qt::SortOrder sortOrder,
+			   bool		 nameTieBreak = false );
+
+	/**
+	 * Sort the range from 'begin' to 'end'. Unless the name is used as a
+	 * secondary sort key (see 'nameTieBreak'), this is a stable sort.
+	 **/
+	void sort( FileInfoList::iterator begin, FileInfoList::iterator end );
+
+	/**
+	 * Sort the range from 'begin' to 'end' only so far that the range
+	 * from 'begin' to 'middle' contains the same items in the same order
+	 * as after a complete sort. The order of the rest is undefined.
+	 **/
+	void partialSort( FileInfoList::iterator begin,
+			  FileInfoList::iterator middle,
+			  FileInfoList::iterator end );
+
+    protected:
+
+	/**
+	 * The precomputed sort key of one item.
+	 *
+	 * All keys are mapped to unsigned integers that sort the right way
+	 * with a plain operator<(), including the sort order: For descending
+	 * order they are simply inverted.
+	 **/
+	struct SortKey
+	{
+	    quint64	primary;
+	    quint64	secondary;
+	    quint64	namePrefix;	// first 4 UTF-16 characters of the name
+	    FileInfo *	item;
+	};
+
+	/**
+	 * Comparison functor for SortKeys. Only if the keys and the name
+	 * prefixes are the same, this needs to look at the items.
+	 **/
+	class KeyLess
+	{
+	public:
+	    KeyLess( bool compareName, bool reverseName ):
+		_compareName( compareName ),
+		_reverseName( reverseName )
+		{}
+
+	    bool operator() ( const SortKey & a, const SortKey & b ) const
+	    {
+		if ( a.primary	 != b.primary	) return a.primary   < b.primary;
+		if ( a.secondary != b.secondary ) return a.secondary < b.secondary;
+		if ( ! _compareName )		  return false;
+		if ( a.namePrefix != b.namePrefix ) return a.namePrefix < b.namePrefix;
+
+		return _reverseName ?
+		    b.item->name() < a.item->name() :
+		    a.item->name() < b.item->name();
+	    }
+
+	private:
+	    bool _compareName;
+	    bool _reverseName;
+	};
+
+	/**
+	 * Return the comparison functor for the keys.
+	 **/
+	KeyLess keyLess() const;
+
+	/**
+	 * Fill _keys with the sort keys of the items from 'begin' to 'end'.
+	 **/
+	void extractKeys( FileInfoList::iterator begin,
+			  FileInfoList::iterator end );
+
+	/**
+	 * Write the items back in the order of _keys, starting at 'begin'.
+	 **/
+	void storeSorted( FileInfoList::iterator begin );
+
+	/**
+	 * Stable LSD radix sort of _keys by 'primary' and 'secondary'.
+	 **/
+	void radixSort();
+
+	/**
+	 * One radix sort over the 'field' of the keys. This skips the digits
+	 * that are the same in all keys, so in the common case of small
+	 * numbers only a few passes are needed.
+	 **/
+	void radixSortBy( quint64 SortKey::* field, QVector<SortKey> & buffer );
+
+	/**
+	 * Sort runs of items with the same keys by name after a radix sort.
+	 **/
+	void sortTies();
+
+	/**
+	 * Return the first 4 UTF-16 characters of 'name' packed into an
+	 * integer that sorts the same way as the name.
+	 **/
+	static quint64 namePrefix( const QString & name );
+
+
+    private:
+	DataColumn	  _sortCol;
+	Qt::SortOrder	  _sortOrder;
+	bool		  _nameTieBreak;
+	QVector<SortKey>  _keys;
+
+    };	   // class FileInfoKeySorter
+
 }      // namespace QDirStat
 
 #endif // FileInfoSorter_h
@@ -8,7 +8,7 @@
 
 
 #include "FileMTimeStats.h"
-#include "FileInfoIterator.h"
+#include "TreeColumns.h"
 #include "DirTree.h"
 #include "Exception.h"
 
@@ -32,28 +32,20 @@ void FileMTimeStats::collect( FileInfo * subtree )
 {
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
-
-    if ( subtree->isFile() )
-        _data << subtree->mtime();
+    const TreeColumns * columns = subtree->tree()->columns( subtree );
+    const QVector<quint8> & flags  = columns->flagsColumn();
+    const QVector<time_t> & mtimes = columns->mtimeColumn();
+    int rows = columns->rows();
 
-    FileInfoIterator it( subtree );
+    if ( _data.isEmpty() )
+        _data.reserve( columns->fileCount() );
 
-    while ( *it )
+    for ( int row = 0; row < rows; ++row )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->mtime();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        // Disregard directories, symlinks, block devices and other special
+        // files
+
+        if ( flags[ row ] & TreeColumns::FileRow )
+            _data << mtimes[ row ];
     }
 }
@@ -20,6 +20,10 @@
 namespace QDirStat
 {
     typedef long long FileSize;
+
+    // Number of items in a subtree. This needs to be 64 bit: Large
+    // filesystems can have more than 2^31 items.
+    typedef long long FileCount;
 }
 
 
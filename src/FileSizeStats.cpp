@@ -8,7 +8,8 @@
 
 
 #include "FileSizeStats.h"
-#include "FileInfoIterator.h"
+#include "DirTree.h"
+#include "TreeColumns.h"
 #include "FormatUtil.h"
 #include "Exception.h"
 
@@ -32,61 +33,75 @@ void FileSizeStats::collect( FileInfo * subtree )
 {
     Q_CHECK_PTR( subtree );
 
-    if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+    collect( *subtree->tree()->columns( subtree ) );
+}
+
+
+void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
+{
+    Q_CHECK_PTR( subtree );
+
+    collect( *subtree->tree()->columns( subtree ), suffix );
+}
 
-    if ( subtree->isFile() )
-        _data << subtree->size();
 
-    FileInfoIterator it( subtree );
+void FileSizeStats::collect( const TreeColumns & columns )
+{
+    const QVector<quint8>   & flags = columns.flagsColumn();
+    const QVector<FileSize> & sizes = columns.sizeColumn();
+    int rows = columns.rows();
+
+    if ( _data.isEmpty() )
+        _data.reserve( columns.fileCount() );
 
-    while ( *it )
+    for ( int row = 0; row < rows; ++row )
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
-	{
-            _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        // Disregard directories, symlinks, block devices and other special
+        // files
+
+        if ( flags[ row ] & TreeColumns::FileRow )
+            _data << sizes[ row ];
     }
 }
 
 
-void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
+void FileSizeStats::collect( const TreeColumns & columns, const QString & suffix )
 {
-    Q_CHECK_PTR( subtree );
+    const QVector<quint8>   & flags = columns.flagsColumn();
+    const QVector<FileSize> & sizes = columns.sizeColumn();
+    int rows = columns.rows();
 
     if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+        _data.reserve( columns.fileCount() );
+
+    if ( suffix.startsWith( '.' ) && suffix.count( '.' ) == 1 )
+    {
+        // Simple suffix like ".jpg": Compare suffix IDs, not strings
 
-    if ( subtree->isFile() && subtree->name().toLower().endsWith( suffix ) )
-        _data << subtree->size();
+        int suffixId = columns.suffixId( suffix.mid( 1 ) );
 
-    FileInfoIterator it( subtree );
+        if ( suffixId < 0 )     // No item with that suffix at all
+            return;
 
-    while ( *it )
+        for ( int row = 0; row < rows; ++row )
+        {
+            if ( ( flags[ row ] & TreeColumns::FileRow ) &&
+                 columns.suffixId( row ) == suffixId )
+            {
+                _data << sizes[ row ];
+            }
+        }
+    }
+    else // Multi-part suffix like ".tar.bz2"
     {
-	FileInfo * item = *it;
-
-	if ( item->hasChildren() )
-	{
-	    collect( item, suffix );
-	}
-	else if ( item->isFile() )
-	{
-            if ( item->name().toLower().endsWith( suffix ) )
-                _data << item->size();
-	}
-	// Disregard symlinks, block devices and other special files
-
-	++it;
+        for ( int row = 0; row < rows; ++row )
+        {
+            if ( ( flags[ row ] & TreeColumns::FileRow ) &&
+                 columns.name( row ).toLower().endsWith( suffix ) )
+            {
+                _data << sizes[ row ];
+            }
+        }
     }
 }
 
@@ -10,12 +10,16 @@
 #ifndef FileSizeStats_h
 #define FileSizeStats_h
 
+#include <QSharedPointer>
+
 #include "PercentileStats.h"
 #include "FileInfo.h"
 
 
 namespace QDirStat
 {
+    class TreeColumns;
+
     /**
      * Helper class for extended file size statistics.
      *
@@ -54,6 +58,16 @@ namespace QDirStat
 	 **/
 	void collect( FileInfo * subtree, const QString & suffix );
 
+	/**
+	 * Append the size of each file in a columnar snapshot of a subtree
+	 * (all files or only those with the specified suffix).
+	 *
+	 * This does not access the tree, so it can be used on another thread
+	 * with a snapshot from DirTree::snapshot().
+	 **/
+	void collect( const TreeColumns & columns );
+	void collect( const TreeColumns & columns, const QString & suffix );
+
         /**
          * Fill buckets for a histogram from 'startPercentile' to
          * 'endPercentile'.
@@ -63,6 +77,9 @@ namespace QDirStat
                                int endPercentile );
     };
 
+
+    typedef QSharedPointer<FileSizeStats> FileSizeStatsPtr;
+
 }	// namespace QDirStat
 
 
@@ -11,6 +11,7 @@
 #include <QTableWidgetItem>
 #include <QCommandLinkButton>
 #include <QProcess>
+#include <QtConcurrent>
 
 #include "FileSizeStatsWindow.h"
 #include "HistogramView.h"
@@ -34,8 +35,7 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     QDialog( parent ),
     _ui( new Ui::FileSizeStatsWindow ),
     _subtree( 0 ),
-    _suffix( "" ),
-    _stats( 0 )
+    _suffix( "" )
 {
     // logDebug() << "init" << endl;
 
@@ -44,9 +44,12 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     initWidgets();
     readWindowSettings( this, "FileSizeStatsWindow" );
 
-    _stats = new FileSizeStats();
+    _stats = FileSizeStatsPtr( new FileSizeStats() );
     CHECK_NEW( _stats );
 
+    connect( &_watcher, SIGNAL( finished()     ),
+	     this,	SLOT  ( calcFinished() ) );
+
     _bucketsTableModel = new BucketsTableModel( this, _ui->histogramView );
     CHECK_NEW( _bucketsTableModel );
 
@@ -66,7 +69,6 @@ FileSizeStatsWindow::~FileSizeStatsWindow()
 {
     // logDebug() << "destroying" << endl;
     writeWindowSettings( this, "FileSizeStatsWindow" );
-    delete _stats;
     delete _ui;
 }
 
@@ -121,14 +123,37 @@ void FileSizeStatsWindow::initWidgets()
 
 void FileSizeStatsWindow::calc()
 {
-    _stats->clear();
+    // The snapshot stays valid even if the subtree is gone when the worker
+    // thread gets to it
 
-    if ( _suffix.isEmpty() )
-	_stats->collect( _subtree );
+    TreeSnapshot snapshot = _subtree->tree()->snapshot( _subtree );
+
+    _watcher.setFuture( QtConcurrent::run( &FileSizeStatsWindow::collect,
+					   snapshot, _suffix ) );
+}
+
+
+FileSizeStatsPtr FileSizeStatsWindow::collect( TreeSnapshot snapshot, QString suffix )
+{
+    FileSizeStatsPtr stats( new FileSizeStats() );
+
+    if ( suffix.isEmpty() )
+	stats->collect( *snapshot );
     else
-	_stats->collect( _subtree, _suffix );
+	stats->collect( *snapshot, suffix );
 
-    _stats->sort();
+    stats->sort();
+
+    return stats;
+}
+
+
+void FileSizeStatsWindow::calcFinished()
+{
+    _stats = _watcher.result();
+
+    fillHistogram();
+    fillPercentileTable();
 }
 
 
@@ -167,10 +192,9 @@ void FileSizeStatsWindow::populate( FileInfo * subtree, const QString & suffix )
     else
 	_ui->heading->setText( tr( "File Size Statistics for %1 in %2" )
 			       .arg( suffix ).arg( url ) );
-    calc();
 
-    fillHistogram();
-    fillPercentileTable();
+    // This continues in calcFinished() when the statistics are calculated
+    calc();
 }
 
 
@@ -12,10 +12,12 @@
 
 #include <QDialog>
 #include <QPointer>
+#include <QFutureWatcher>
 
 #include "ui_file-size-stats-window.h"
 #include "FileInfo.h"
 #include "FileSizeStats.h"
+#include "TreeColumns.h"
 
 class QTableWidget;
 
@@ -129,6 +131,12 @@ namespace QDirStat
 	 **/
 	void showHelp();
 
+	/**
+	 * Take over the statistics from the worker thread and fill the
+	 * widgets with them.
+	 **/
+	void calcFinished();
+
 
     protected:
 
@@ -138,10 +146,18 @@ namespace QDirStat
 	void clear();
 
 	/**
-	 * Calculate the statistics from the tree.
+	 * Calculate the statistics from the tree in the background.
+	 * calcFinished() is called when that is done.
 	 **/
 	void calc();
 
+	/**
+	 * Collect and sort the file sizes (of files with 'suffix' if that is
+	 * non-empty) from 'snapshot'. This is what runs on the worker thread,
+	 * so it must not access anything but the snapshot.
+	 **/
+	static FileSizeStatsPtr collect( TreeSnapshot snapshot, QString suffix );
+
 	/**
 	 * One-time initialization of the widgets in this window.
 	 **/
@@ -225,7 +241,8 @@ namespace QDirStat
 	Ui::FileSizeStatsWindow *   _ui;
 	FileInfo *		    _subtree;
 	QString			    _suffix;
-	FileSizeStats *		    _stats;
+	FileSizeStatsPtr	    _stats;
+	QFutureWatcher<FileSizeStatsPtr> _watcher;
 	BucketsTableModel *	    _bucketsTableModel;
 
 	static QPointer<FileSizeStatsWindow> _sharedInstance;
@@ -7,9 +7,12 @@
  */
 
 
+#include <QtConcurrent>
+
 #include "FileTypeStats.h"
 #include "DirTree.h"
-#include "FileInfoIterator.h"
+#include "MemoCache.h"
+#include "TreeColumns.h"
 #include "MimeCategorizer.h"
 #include "FormatUtil.h"
 #include "Logger.h"
@@ -18,8 +21,21 @@
 using namespace QDirStat;
 
 
+/**
+ * Results of the last few calculations, shared by all instances so they
+ * survive closing and opening the window again.
+ **/
+static MemoCache<FileTypeStatsResult> & memoCache()
+{
+    static MemoCache<FileTypeStatsResult> cache;
+
+    return cache;
+}
+
+
 FileTypeStats::FileTypeStats( QObject  * parent ):
     QObject( parent ),
+    _subtree( 0 ),
     _totalSize( 0LL )
 {
     _mimeCategorizer = MimeCategorizer::instance();
@@ -27,6 +43,9 @@ FileTypeStats::FileTypeStats( QObject  * parent ):
 
     _otherCategory = new MimeCategory( tr( "Other" ) );
     CHECK_NEW( _otherCategory );
+
+    connect( &_watcher, SIGNAL( finished()	  ),
+	     this,	SLOT  ( collectFinished() ) );
 }
 
 
@@ -103,38 +122,158 @@ double FileTypeStats::percentage( FileSize size ) const
 
 void FileTypeStats::calc( FileInfo * subtree )
 {
-    clear();
-
     if ( subtree && subtree->checkMagicNumber() )
     {
-        collect( subtree );
-        _totalSize = subtree->totalSize();
-        removeCruft();
-        removeEmpty();
-        sanityCheck();
+	// The results also depend on the MIME categories
+
+	QString params = QString::number( _mimeCategorizer->generation() );
+	FileTypeStatsResultPtr result = memoCache().find( subtree, params );
+
+	// Any calculation that is still running is obsolete now
+
+	_snapshot.clear();
+
+	if ( result )
+	{
+	    // logDebug() << "Using cached results for " << subtree << endl;
+	    restoreResult( *result );
+	    emit calcFinished();
+	    return;
+	}
+
+	clear();
+	_tree	  = subtree->tree();
+	_subtree  = subtree;
+	_params	  = params;
+	_snapshot = _tree->snapshot( subtree );
+
+	_watcher.setFuture( QtConcurrent::run( &FileTypeStats::collectResult, _snapshot ) );
     }
+    else
+    {
+	_snapshot.clear();
+        clear();
+        emit calcFinished();
+    }
+}
+
+
+void FileTypeStats::calc( const TreeColumns & columns )
+{
+    clear();
+    collect( columns );
+    _totalSize = columns.subtreeTotalSize();
+    finishResults();
 
     emit calcFinished();
 }
 
 
-void FileTypeStats::collect( FileInfo * dir )
+FileTypeStatsResultPtr FileTypeStats::collectResult( TreeSnapshot snapshot )
 {
-    if ( ! dir )
-	return;
+    FileTypeStats stats;
+    stats.collect( *snapshot );
+
+    return FileTypeStatsResultPtr( stats.saveResult() );
+}
+
 
-    FileInfoIterator it( dir );
+void FileTypeStats::collectFinished()
+{
+    if ( ! _snapshot )	// Obsolete
+	return;
 
-    while ( *it )
+    if ( _params != QString::number( _mimeCategorizer->generation() ) )
     {
-	FileInfo * item = *it;
+	// The MIME categories changed in the meantime, so the results might
+	// refer to categories that don't exist any more: Start again.
 
-	if ( item->hasChildren() )
-	{
-	    collect( item );
-	}
-	else if ( item->isFile() )
+	_params = QString::number( _mimeCategorizer->generation() );
+	_watcher.setFuture( QtConcurrent::run( &FileTypeStats::collectResult, _snapshot ) );
+	return;
+    }
+
+    restoreResult( *_watcher.result() );
+    _totalSize = _snapshot->subtreeTotalSize();
+    finishResults();
+
+    // While reading, the subtree changes all the time anyway. If anything
+    // changed since the snapshot was taken, the subtree might even be gone.
+
+    if ( _tree && _tree->isCurrent( _snapshot ) && ! _tree->isBusy() )
+	memoCache().insert( _subtree, _params, FileTypeStatsResultPtr( saveResult() ) );
+
+    _snapshot.clear();
+    emit calcFinished();
+}
+
+
+void FileTypeStats::finishResults()
+{
+    removeCruft();
+    removeEmpty();
+    sanityCheck();
+}
+
+
+FileTypeStatsResult * FileTypeStats::saveResult() const
+{
+    FileTypeStatsResult * result = new FileTypeStatsResult;
+    CHECK_NEW( result );
+
+    result->suffixSum			= _suffixSum;
+    result->suffixCount			= _suffixCount;
+    result->categorySum			= _categorySum;
+    result->categoryCount		= _categoryCount;
+    result->categoryNonSuffixRuleSum	= _categoryNonSuffixRuleSum;
+    result->categoryNonSuffixRuleCount	= _categoryNonSuffixRuleCount;
+    result->totalSize			= _totalSize;
+
+    // The "Other" category belongs to this object
+
+    if ( result->categorySum.contains( _otherCategory ) )
+	result->categorySum.insert( 0, result->categorySum.take( _otherCategory ) );
+
+    if ( result->categoryCount.contains( _otherCategory ) )
+	result->categoryCount.insert( 0, result->categoryCount.take( _otherCategory ) );
+
+    return result;
+}
+
+
+void FileTypeStats::restoreResult( const FileTypeStatsResult & result )
+{
+    _suffixSum			= result.suffixSum;
+    _suffixCount		= result.suffixCount;
+    _categorySum		= result.categorySum;
+    _categoryCount		= result.categoryCount;
+    _categoryNonSuffixRuleSum	= result.categoryNonSuffixRuleSum;
+    _categoryNonSuffixRuleCount = result.categoryNonSuffixRuleCount;
+    _totalSize			= result.totalSize;
+
+    if ( _categorySum.contains( 0 ) )
+	_categorySum.insert( _otherCategory, _categorySum.take( 0 ) );
+
+    if ( _categoryCount.contains( 0 ) )
+	_categoryCount.insert( _otherCategory, _categoryCount.take( 0 ) );
+}
+
+
+void FileTypeStats::collect( const TreeColumns & columns )
+{
+    int rows = columns.rows();
+
+    // Row 0 is the subtree itself unless that is a pseudo directory; only
+    // its descendants are counted.
+
+    int firstRow = ( rows > 0 && columns.hasSubtreeRow() ) ? 1 : 0;
+
+    for ( int row = firstRow; row < rows; ++row )
+    {
+	if ( columns.isFile( row ) )
 	{
+	    const QString & name = columns.name( row );
+	    FileSize	    size = columns.size( row );
 	    QString suffix;
 
 	    // First attempt: Try the MIME categorizer.
@@ -151,24 +290,24 @@ void FileTypeStats::collect( FileInfo * dir )
 	    // hand-crafted, so if it knows anything about a suffix, it's the
 	    // best choice.
 
-	    MimeCategory * category = _mimeCategorizer->category( item->name(), &suffix );
+	    MimeCategory * category = _mimeCategorizer->category( name, &suffix );
 
             if ( category )
             {
-                addCategorySum( category, item );
+                addCategorySum( category, size );
 
                 if ( suffix.isEmpty() )
-                    addNonSuffixRuleSum( category, item );
+                    addNonSuffixRuleSum( category, size );
                 else
-                    addSuffixSum( suffix, item );
+                    addSuffixSum( suffix, size );
             }
             else // ! category
             {
-                addCategorySum( _otherCategory, item );
+                addCategorySum( _otherCategory, size );
 
                 if ( suffix.isEmpty() )
                 {
-                    if ( item->name().contains( '.' ) && ! item->name().startsWith( '.' ) )
+                    if ( name.contains( '.' ) && ! name.startsWith( '.' ) )
                     {
                         // Fall back to the last (i.e. the shortest) suffix if the
                         // MIME categorizer didn't know it: Use section -1 (the
@@ -179,7 +318,7 @@ void FileTypeStats::collect( FileInfo * dir )
                         // much better than getting a ".eab7d88df-git.deb" rather
                         // than a ".deb".
 
-                        suffix = item->name().section( '.', -1 );
+                        suffix = name.section( '.', -1 );
                     }
                 }
 
@@ -188,33 +327,31 @@ void FileTypeStats::collect( FileInfo * dir )
                 if ( suffix.isEmpty() )
                     suffix = NO_SUFFIX;
 
-                addSuffixSum( suffix, item );
+                addSuffixSum( suffix, size );
             }
-            // Disregard symlinks, block devices and other special files
         }
-
-	++it;
+        // Disregard symlinks, block devices and other special files
     }
 }
 
 
-void FileTypeStats::addCategorySum( MimeCategory * category, FileInfo * item )
+void FileTypeStats::addCategorySum( MimeCategory * category, FileSize size )
 {
-    _categorySum[ category ] += item->size();
+    _categorySum[ category ] += size;
     ++_categoryCount[ category ];
 }
 
 
-void FileTypeStats::addSuffixSum( const QString & suffix, FileInfo * item )
+void FileTypeStats::addSuffixSum( const QString & suffix, FileSize size )
 {
-    _suffixSum[ suffix ] += item->size();
+    _suffixSum[ suffix ] += size;
     ++_suffixCount[ suffix ];
 }
 
 
-void FileTypeStats::addNonSuffixRuleSum( MimeCategory * category, FileInfo * item )
+void FileTypeStats::addNonSuffixRuleSum( MimeCategory * category, FileSize size )
 {
-    _categoryNonSuffixRuleSum[ category ] += item->size();
+    _categoryNonSuffixRuleSum[ category ] += size;
     ++_categoryNonSuffixRuleCount[ category ];
 }
 
@@ -12,9 +12,13 @@
 
 #include <QObject>
 #include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QFutureWatcher>
 
 #include "ui_file-type-stats-window.h"
 #include "DirInfo.h"
+#include "TreeColumns.h"
 
 // Using a suffix that can never occur: A slash is illegal in Linux/Unix
 // filenames.
@@ -37,10 +41,34 @@ namespace QDirStat
     typedef CategoryFileSizeMap::const_iterator CategoryFileSizeMapIterator;
 
 
+    /**
+     * The results of a FileTypeStats calculation, as kept in its memo
+     * cache. The "Other" category is stored with key 0 since each
+     * FileTypeStats object has its own.
+     **/
+    struct FileTypeStatsResult
+    {
+	StringFileSizeMap	suffixSum;
+	StringIntMap		suffixCount;
+	CategoryFileSizeMap	categorySum;
+	CategoryIntMap		categoryCount;
+	CategoryFileSizeMap	categoryNonSuffixRuleSum;
+	CategoryIntMap		categoryNonSuffixRuleCount;
+	FileSize		totalSize;
+    };
+
+    typedef QSharedPointer<const FileTypeStatsResult> FileTypeStatsResultPtr;
+
+
     /**
      * Class to calculate file type statistics for a subtree, such as how much
      * disk space is used for each kind of filename extension (*.jpg, *.mp4
      * etc.).
+     *
+     * The files are collected on a worker thread from a snapshot of the
+     * subtree (see DirTree::snapshot()), so the GUI stays responsive even
+     * for huge trees. Only the final cleanup of the results is done on the
+     * GUI thread.
      **/
     class FileTypeStats: public QObject
     {
@@ -61,7 +89,12 @@ namespace QDirStat
     public slots:
 
         /**
-         * Calculate the statistics from a new subtree.
+         * Calculate the statistics from a new subtree in the background.
+         * calcFinished() is emitted when the results are available.
+         *
+         * If the statistics for this subtree were calculated before and
+         * nothing changed in the subtree since then, this simply uses the
+         * old results (see MemoCache) and emits calcFinished() right away.
          **/
 	void calc( FileInfo * subtree );
 
@@ -73,15 +106,26 @@ namespace QDirStat
     signals:
 
 	/**
-	 * Emitted when the calculation is finished. This is useful when the
-	 * calc() slot is connected to some outside signal to recalculate the
-	 * contents. calc() itself is synchronous, i.e. it only returns when
-	 * the calculation is finished.
+	 * Emitted when the calculation is finished and the results are
+	 * available.
 	 **/
 	void calcFinished() const;
 
+    protected slots:
+
+	/**
+	 * Take over the results from the worker thread.
+	 **/
+	void collectFinished();
+
     public:
 
+	/**
+	 * Calculate the statistics from a columnar snapshot of a subtree
+	 * synchronously.
+	 **/
+	void calc( const TreeColumns & columns );
+
 	/**
 	 * Return the number of files in the tree with the specified suffix.
 	 **/
@@ -160,15 +204,28 @@ namespace QDirStat
 	 * Recursively go through the tree and collect sizes for each file type
 	 * (filename extension).
 	 **/
-	void collect( FileInfo * dir );
+	void collect( const TreeColumns & columns );
+
+	/**
+	 * Collect the sizes for each file type from 'snapshot' with a
+	 * temporary object and return its raw results. This is what runs on
+	 * the worker thread, so it must not log anything or access anything
+	 * but the snapshot and the MIME categorizer.
+	 **/
+	static FileTypeStatsResultPtr collectResult( TreeSnapshot snapshot );
+
+	/**
+	 * Clean up the collected results: Remove cruft and empty suffixes.
+	 **/
+	void finishResults();
 
         //
         // Add the various sums
         //
 
-        void addCategorySum     ( MimeCategory * category, FileInfo * item );
-        void addNonSuffixRuleSum( MimeCategory * category, FileInfo * item );
-        void addSuffixSum       ( const QString & suffix,  FileInfo * item );
+        void addCategorySum     ( MimeCategory * category, FileSize size );
+        void addNonSuffixRuleSum( MimeCategory * category, FileSize size );
+        void addSuffixSum       ( const QString & suffix,  FileSize size );
 
 	/**
 	 * Remove useless content from the maps. On a Linux system, there tend
@@ -199,6 +256,16 @@ namespace QDirStat
 	 **/
 	void sanityCheck();
 
+	/**
+	 * Return the current results for the memo cache.
+	 **/
+	FileTypeStatsResult * saveResult() const;
+
+	/**
+	 * Use 'result' from the memo cache.
+	 **/
+	void restoreResult( const FileTypeStatsResult & result );
+
 
 	//
 	// Data members
@@ -207,6 +274,12 @@ namespace QDirStat
 	MimeCategory *		_otherCategory;
 	MimeCategorizer *	_mimeCategorizer;
 
+	QFutureWatcher<FileTypeStatsResultPtr> _watcher;
+	TreeSnapshot		_snapshot;
+	QPointer<DirTree>	_tree;
+	FileInfo *		_subtree;	// Only for the memo cache
+	QString			_params;
+
 	StringFileSizeMap	_suffixSum;
 	StringIntMap		_suffixCount;
 	CategoryFileSizeMap	_categorySum;
@@ -63,6 +63,9 @@ FileTypeStatsWindow::FileTypeStatsWindow( QWidget * parent ):
 
     _stats = new FileTypeStats( this );
     CHECK_NEW( _stats );
+
+    connect( _stats,		   SIGNAL( calcFinished() ),
+	     this,		   SLOT	 ( fillTree()	  ) );
 }
 
 
@@ -140,11 +143,20 @@ void FileTypeStatsWindow::populate( FileInfo * newSubtree )
 {
     clear();
     _subtree = newSubtree;
-    _stats->calc( newSubtree ? newSubtree : _subtree() );
 
     _ui->heading->setText( tr( "File Type Statistics for %1" )
                            .arg( _subtree.url() ) );
 
+    // This continues in fillTree() when the statistics are calculated
+
+    _stats->calc( newSubtree ? newSubtree : _subtree() );
+}
+
+
+void FileTypeStatsWindow::fillTree()
+{
+    _ui->treeWidget->clear();
+
     // Don't sort until all items are added
     _ui->treeWidget->setSortingEnabled( false );
 
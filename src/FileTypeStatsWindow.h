@@ -122,6 +122,12 @@ namespace QDirStat
 	 **/
 	void enableActions( QTreeWidgetItem * currentItem );
 
+	/**
+	 * Fill the tree widget with the results of the statistics when they
+	 * are calculated.
+	 **/
+	void fillTree();
+
 
     protected:
 
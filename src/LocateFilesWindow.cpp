@@ -12,6 +12,7 @@
 #include "LocateFilesWindow.h"
 #include "QDirStatApp.h"        // SelectionModel, CleanupCollection
 #include "TreeWalker.h"
+#include "DirTree.h"
 #include "FileInfoIterator.h"
 #include "SelectionModel.h"
 #include "ActionManager.h"
@@ -123,7 +124,20 @@ void LocateFilesWindow::populate( FileInfo * newSubtree )
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
+    // The URLs of the results are built with the help of the URLs of their
+    // parent directories, and many results typically share the same
+    // directories: Let those directories cache their URLs while populating.
+
+    DirTree * tree = _subtree.tree();
+
+    if ( tree )
+	tree->setCacheDirUrls( true );
+
     populateRecursive( newSubtree ? newSubtree : _subtree() );
+
+    if ( tree )
+	tree->setCacheDirUrls( false );
+
     showResultsCount();
 
     _ui->treeWidget->setSortingEnabled( true );
@@ -12,6 +12,7 @@
 #include <QDateTime>
 #include <QString>
 #include <QStringList>
+#include <QThread>
 
 #include <iostream>     // cerr
 #include <string.h>     // strlen()
@@ -89,6 +90,7 @@ Logger::~Logger()
 void Logger::init()
 {
     _logLevel = LogSeverityVerbose;
+    _thread   = QThread::currentThread();
 }
 
 
@@ -165,8 +167,12 @@ LogStream & Logger::log( const QString & srcFile,
                          const QString & srcFunction,
                          LogSeverity     severity )
 {
+    bool otherThread = QThread::currentThread() != _thread;
+
     if ( severity < _logLevel )
-        return _nullStream;
+        return otherThread ? threadStream( true ) : _nullStream;
+
+    LogStream & stream = otherThread ? threadStream( false ) : _logStream;
 
     std::string sev;
 
@@ -181,9 +187,9 @@ LogStream & Logger::log( const QString & srcFile,
             // complain about unhandled enum values
     }
 
-    _logStream << Logger::timeStamp() << " "
-               << "[" << (int) getpid() << "] "
-               << sev << " ";
+    stream << Logger::timeStamp() << " "
+           << "[" << (int) getpid() << "] "
+           << sev << " ";
 
     if ( ! srcFile.isEmpty() )
     {
@@ -196,25 +202,49 @@ LogStream & Logger::log( const QString & srcFile,
             // section delimited with '/'.
 
             QString basename = srcFile.section( '/', -1 );
-            _logStream << basename;
+            stream << basename;
 
             // I hate CMake. Seriously, WTF?!
         }
         else
         {
-            _logStream << srcFile;
+            stream << srcFile;
         }
 
         if ( srcLine > 0 )
-            _logStream << ":" << srcLine;
+            stream << ":" << srcLine;
 
-        _logStream << " ";
+        stream << " ";
 
         if ( ! srcFunction.isEmpty() )
-            _logStream << srcFunction << "():  ";
+            stream << srcFunction << "():  ";
+    }
+
+    return stream;
+}
+
+
+LogStream & Logger::threadStream( bool null )
+{
+    // Neither QTextStream nor QFile are thread-safe, so each thread (e.g.
+    // from QtConcurrent) writes to a stream of its own that is opened on the
+    // same file. It is in append mode, and each line is written at once at
+    // 'endl', so lines from different threads don't get mixed up.
+
+    static thread_local LogStream logStream;
+    static thread_local LogStream nullStream;
+
+    LogStream & stream = null ? nullStream : logStream;
+
+    if ( ! stream.isOpen() )
+    {
+        if ( null )
+            stream.open( "/dev/null" );
+        else if ( ! _logFilename.isEmpty() )
+            stream.open( _logFilename );
     }
 
-    return _logStream;
+    return stream;
 }
 
 
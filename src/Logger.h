@@ -18,6 +18,9 @@
 #include "LogStream.h"
 
 
+class QThread;
+
+
 // Define NO_USING_LOGSTREAM_ENDL before including this header (or on the
 // compiler command line) if you are anal about this in your own code, but do
 // not remove it here.
@@ -308,6 +311,13 @@ protected:
      **/
     static QString oldNamePattern( const QString & filename );
 
+    /**
+     * Return the stream for log output from a thread other than the one
+     * that created this logger: The log file or, if 'null' is true, the
+     * null device.
+     **/
+    LogStream & threadStream( bool null );
+
 
 private:
 
@@ -318,6 +328,7 @@ private:
     QString         _logFilename;
     LogStream       _nullStream;
     LogSeverity     _logLevel;
+    QThread *       _thread;
 };
 
 
@@ -13,11 +13,15 @@
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QTemporaryFile>
+#include <QDir>
+#include <QtConcurrent>
 
 #include "MainWindow.h"
 #include "ActionManager.h"
 #include "BookmarksManager.h"
 #include "BusyPopup.h"
+#include "CacheDiff.h"
 #include "CleanupCollection.h"
 #include "CleanupConfigPage.h"
 #include "ConfigDialog.h"
@@ -70,7 +74,8 @@ MainWindow::MainWindow():
     _useTreemapHover( false ),
     _statusBarTimeout( 3000 ), // millisec
     _treeLevelMapper(0),
-    _currentLayout( 0 )
+    _currentLayout( 0 ),
+    _compareTmpFile( 0 )
 {
     CHECK_PTR( _ui );
 
@@ -95,6 +100,7 @@ MainWindow::MainWindow():
 
     _ui->treemapView->setDirTree( app()->dirTree() );
     _ui->treemapView->setSelectionModel( app()->selectionModel() );
+    _ui->treemapView->setCacheDiff( app()->dirTreeModel()->cacheDiff() );
 
     _futureSelection.setTree( app()->dirTree() );
     _futureSelection.setUseParentFallback( true );
@@ -179,8 +185,17 @@ MainWindow::~MainWindow()
 
     qDeleteAll( _layouts );
 
+    if ( _compareWatcher.isRunning() )
+    {
+	_compareWatcher.waitForFinished();
+	delete _compareWatcher.result();
+    }
+
     QDirStatApp::deleteInstance();
 
+    if ( _compareTmpFile )
+	delete _compareTmpFile;
+
     // logDebug() << "Main window destroyed" << endl;
 }
 
@@ -224,6 +239,21 @@ void MainWindow::connectSignals()
     connect( app()->dirTree(),		 SIGNAL( aborted()	   ),
 	     this,			 SLOT  ( readingAborted()  ) );
 
+    connect( app()->dirTree(),		 SIGNAL( cacheWriteProgress( FileCount, FileCount ) ),
+	     this,			 SLOT  ( cacheWriteProgress( FileCount, FileCount ) ) );
+
+    connect( app()->dirTree(),		 SIGNAL( cacheWriteFinished( QString, bool, bool ) ),
+	     this,			 SLOT  ( cacheWriteFinished( QString, bool, bool ) ) );
+
+    connect( &_compareWatcher,		 SIGNAL( finished()	   ),
+	     this,			 SLOT  ( compareFinished() ) );
+
+    connect( app()->dirTree(),		 SIGNAL( memoryBudgetExceeded( qint64 ) ),
+	     this,			 SLOT  ( showMemoryBudgetWarning( qint64 ) ) );
+
+    connect( app()->dirTree(),		 SIGNAL( snapshotTooLarge( FileInfo * ) ),
+	     this,			 SLOT  ( showTooLargeWarning( FileInfo * ) ) );
+
     connect( app()->selectionModel(),	 SIGNAL( selectionChanged() ),
 	     this,			 SLOT  ( updateActions()    ) );
 
@@ -254,6 +284,9 @@ void MainWindow::connectSignals()
     connect( _ui->treemapView,		 SIGNAL( treemapChanged() ),
 	     this,			 SLOT  ( updateActions()  ) );
 
+    connect( app()->dirTreeModel(),	 SIGNAL( cacheDiffChanged( const CacheDiff * ) ),
+	     _ui->treemapView,		 SLOT  ( setCacheDiff	 ( const CacheDiff * ) ) );
+
     connect( app()->cleanupCollection(), SIGNAL( startingCleanup( QString ) ),
 	     this,			 SLOT  ( startingCleanup( QString ) ) );
 
@@ -293,7 +326,11 @@ void MainWindow::updateActions()
     _ui->actionStopReading->setEnabled( reading );
     _ui->actionRefreshAll->setEnabled	( ! reading && firstToplevel );
     _ui->actionAskReadCache->setEnabled ( ! reading );
-    _ui->actionAskWriteCache->setEnabled( ! reading && ! pkgView && firstToplevel );
+    _ui->actionAskWriteCache->setEnabled( ! reading && ! pkgView && firstToplevel &&
+					  ! app()->dirTree()->isWritingCache() );
+    _ui->actionAskCompareWithCache->setEnabled( ! reading && ! pkgView && firstToplevel &&
+						! app()->dirTree()->isWritingCache() &&
+						! _compareTmpFile );
 
     _ui->actionCopyPathToClipboard->setEnabled( currentItem );
     _ui->actionGoUp->setEnabled( currentItem && currentItem->treeLevel() > 1 );
@@ -522,7 +559,12 @@ void MainWindow::readingFinished()
     idleDisplay();
 
     QString elapsedTime = formatMillisec( _stopWatch.elapsed() );
-    _ui->statusBar->showMessage( tr( "Finished. Elapsed time: %1").arg( elapsedTime ), LONG_MESSAGE );
+
+    if ( app()->dirTree()->refreshFoundNoChanges() )
+	_ui->statusBar->showMessage( tr( "Finished. No changes. Elapsed time: %1").arg( elapsedTime ), LONG_MESSAGE );
+    else
+	_ui->statusBar->showMessage( tr( "Finished. Elapsed time: %1").arg( elapsedTime ), LONG_MESSAGE );
+
     logInfo() << "Reading finished after " << elapsedTime << endl;
 
     if ( app()->dirTree()->firstToplevel() &&
@@ -531,6 +573,8 @@ void MainWindow::readingFinished()
 	showDirPermissionsWarning();
     }
 
+    Debug::dumpMemoryUsage( app()->dirTree()->firstToplevel() );
+
     // Debug::dumpModelTree( app()->dirTreeModel(), QModelIndex(), "" );
 }
 
@@ -830,18 +874,174 @@ void MainWindow::askWriteCache()
 						     DEFAULT_CACHE_NAME );
     if ( ! fileName.isEmpty() )
     {
-	bool ok = app()->dirTree()->writeCache( fileName );
+	// This continues in cacheWriteProgress() and cacheWriteFinished()
 
-	if ( ok )
-	{
-	    showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
-	}
-	else
-	{
-	    QMessageBox::warning( this,
-				   tr( "Error" ), // Title
-				   tr( "ERROR writing cache file \"%1\"").arg( fileName ) );
-	}
+	app()->dirTree()->startWritingCache( fileName );
+	updateActions();
+    }
+}
+
+
+void MainWindow::askCompareWithCache()
+{
+    QString fileName = QFileDialog::getOpenFileName( this, // parent
+						     tr( "Select QDirStat cache file to compare with" ),
+						     DEFAULT_CACHE_NAME );
+    if ( ! fileName.isEmpty() )
+	compareWithCache( fileName );
+
+    updateActions();
+}
+
+
+void MainWindow::compareWithCache( const QString & cacheFileName )
+{
+    if ( _compareTmpFile )	// Still comparing with another one
+	return;
+
+    // CacheDiff compares two cache files, so the current tree is written
+    // to a temporary one first. This continues in cacheWriteFinished().
+
+    _compareTmpFile = new QTemporaryFile( QDir::tempPath() + "/qdirstat-compare-XXXXXX.cache.gz" );
+    CHECK_NEW( _compareTmpFile );
+    _compareCacheFileName = cacheFileName;
+
+    if ( ! _compareTmpFile->open() )
+    {
+	startCompare( false, false );
+	return;
+    }
+
+    _compareTmpFile->close();	// Only the name is needed; it's kept until deleted
+
+    showProgress( tr( "Comparing with %1..." ).arg( cacheFileName ) );
+    app()->dirTree()->startWritingCache( _compareTmpFile->fileName(), true );
+    updateActions();
+}
+
+
+void MainWindow::startCompare( bool ok, bool aborted )
+{
+    if ( ok )
+    {
+	// This continues in compareFinished()
+
+	_compareWatcher.setFuture( QtConcurrent::run( &MainWindow::diffCache,
+						      _compareCacheFileName,
+						      _compareTmpFile->fileName() ) );
+	return;
+    }
+
+    delete _compareTmpFile;
+    _compareTmpFile = 0;
+    updateActions();
+
+    if ( aborted )
+    {
+	// Not an error: The tree was changed while it was written
+
+	showProgress( tr( "Comparing with %1 aborted" ).arg( _compareCacheFileName ) );
+    }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "Can't compare with cache file \"%1\"." )
+			      .arg( _compareCacheFileName ) );
+    }
+}
+
+
+CacheDiff * MainWindow::diffCache( QString oldFileName, QString newFileName )
+{
+    CacheDiff * diff = new CacheDiff();
+    CHECK_NEW( diff );
+
+    if ( ! diff->diff( oldFileName, newFileName ) )
+    {
+	delete diff;
+	return 0;
+    }
+
+    return diff;
+}
+
+
+void MainWindow::compareFinished()
+{
+    CacheDiff * diff = _compareWatcher.result();
+
+    delete _compareTmpFile;
+    _compareTmpFile = 0;
+    updateActions();
+
+    if ( ! diff )
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "Can't compare with cache file \"%1\".\n"
+				  "Cache files from older versions have to be written again first." )
+			      .arg( _compareCacheFileName ) );
+	return;
+    }
+
+    app()->dirTreeModel()->setCacheDiff( diff );
+    _ui->dirTreeView->viewport()->update();
+
+    if ( _ui->treemapView->isVisible() )
+	_ui->treemapView->rebuildTreemap();
+
+    FileSize delta = diff->total().sizeDelta();
+
+    showProgress( tr( "Compared with %1: %2%3 since then" )
+		  .arg( _compareCacheFileName )
+		  .arg( delta < 0 ? "-" : "+" )
+		  .arg( formatSize( qAbs( delta ) ) ) );
+}
+
+
+void MainWindow::cacheWriteProgress( FileCount itemsWritten, FileCount totalItems )
+{
+    int percent = totalItems > 0 ? (int) ( 100 * itemsWritten / totalItems ) : 0;
+
+    if ( _compareTmpFile )
+    {
+	showProgress( tr( "Comparing with %1... %2%" )
+		      .arg( _compareCacheFileName )
+		      .arg( qMin( percent, 100 ) ) );
+    }
+    else
+    {
+	showProgress( tr( "Writing cache file... %1%" ).arg( qMin( percent, 100 ) ) );
+    }
+}
+
+
+void MainWindow::cacheWriteFinished( const QString & fileName, bool ok, bool aborted )
+{
+    if ( _compareTmpFile && fileName == _compareTmpFile->fileName() )
+    {
+	startCompare( ok, aborted );
+	return;
+    }
+
+    updateActions();
+
+    if ( ok )
+    {
+	showProgress( tr( "Directory tree written to file %1" ).arg( fileName ) );
+    }
+    else if ( aborted )
+    {
+	// Not an error: The user changed the tree or cancelled it
+
+	showProgress( tr( "Writing cache file %1 aborted" ).arg( fileName ) );
+    }
+    else
+    {
+	QMessageBox::warning( this,
+			      tr( "Error" ), // Title
+			      tr( "ERROR writing cache file \"%1\"").arg( fileName ) );
     }
 }
 
@@ -1252,6 +1452,41 @@ void MainWindow::showDirPermissionsWarning()
 }
 
 
+void MainWindow::showMemoryBudgetWarning( qint64 budget )
+{
+    PanelMessage * msg = new PanelMessage( _ui->messagePanel );
+    CHECK_NEW( msg );
+
+    msg->setHeading( tr( "Reading aborted: Not enough memory." ) );
+    msg->setText( tr( "The directory tree needs more than %1. "
+		      "Change MemoryBudgetMB in the [DirectoryTree] section "
+		      "of the configuration file to use more." )
+		  .arg( formatSize( budget ) ) );
+    msg->setIcon( QPixmap( ":/icons/dialog-warning.png" ) );
+
+    _ui->messagePanel->add( msg );
+}
+
+
+void MainWindow::showTooLargeWarning( FileInfo * subtree )
+{
+    if ( _tooLargeWarning )
+	return;
+
+    PanelMessage * msg = new PanelMessage( _ui->messagePanel );
+    CHECK_NEW( msg );
+
+    msg->setHeading( tr( "Too many items for statistics." ) );
+    msg->setText( tr( "%1 has more than %2 items; statistics are not available for it." )
+		  .arg( subtree->url() )
+		  .arg( TREE_COLUMNS_MAX_ROWS ) );
+    msg->setIcon( QPixmap( ":/icons/dialog-warning.png" ) );
+
+    _ui->messagePanel->add( msg );
+    _tooLargeWarning = msg;
+}
+
+
 void MainWindow::showUnreadableDirs()
 {
     UnreadableDirsWindow::populateSharedInstance( app()->dirTree()->root() );
@@ -13,6 +13,7 @@
 #include <QMainWindow>
 #include <QActionGroup>
 #include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QPointer>
 #include <QString>
 #include <QTimer>
@@ -33,10 +34,12 @@ class QSignalMapper;
 class TreeLayout;
 class SysCallFailedException;
 class QMenu;
+class QTemporaryFile;
 
 
 namespace QDirStat
 {
+    class CacheDiff;
     class ConfigDialog;
     class FileInfo;
     class DiscoverActions;
@@ -45,6 +48,7 @@ namespace QDirStat
 }
 
 using QDirStat::FileAgeStatsWindow;
+using QDirStat::FileCount;
 using QDirStat::FileInfo;
 using QDirStat::FilesystemsWindow;
 using QDirStat::PanelMessage;
@@ -148,6 +152,34 @@ public slots:
      **/
     void askWriteCache();
 
+    /**
+     * Open a file selection dialog to ask for a cache file and compare the
+     * current tree with it.
+     **/
+    void askCompareWithCache();
+
+    /**
+     * Compare the current tree with an older cache file and show how it
+     * changed in the tree view and in the treemap.
+     *
+     * This is done in the background: The tree is written to a temporary
+     * cache file with DirTree::startWritingCache(), and then both files are
+     * compared in a worker thread. This continues in cacheWriteFinished()
+     * and compareFinished().
+     **/
+    void compareWithCache( const QString & cacheFileName );
+
+    /**
+     * Show the progress of writing a cache file in the background.
+     **/
+    void cacheWriteProgress( FileCount itemsWritten, FileCount totalItems );
+
+    /**
+     * Notification that writing a cache file in the background is done or
+     * was aborted.
+     **/
+    void cacheWriteFinished( const QString & fileName, bool ok, bool aborted );
+
     /**
      * Update the window title: Show "[root]" if running as root and add the
      * URL if that is configured.
@@ -248,6 +280,12 @@ protected slots:
      **/
     void startingReading();
 
+    /**
+     * Notification that comparing with a cache file in the worker thread
+     * is done: Show the result.
+     **/
+    void compareFinished();
+
     /**
      * Finalize display after reading is finished.
      **/
@@ -356,6 +394,18 @@ protected slots:
      **/
     void showDirPermissionsWarning();
 
+    /**
+     * Show a warning (as a panel message) that reading was aborted because
+     * the tree needs more memory than 'budget'.
+     **/
+    void showMemoryBudgetWarning( qint64 budget );
+
+    /**
+     * Show a warning (as a panel message) that 'subtree' has too many items
+     * for the statistics.
+     **/
+    void showTooLargeWarning( FileInfo * subtree );
+
     /**
      * Show the directories that could not be read in a separate non-modal
      * window.
@@ -405,6 +455,20 @@ protected:
      **/
     void connectSignals();
 
+    /**
+     * Compare the temporary cache file of the current tree with the cache
+     * file the user selected. This is called when writing the temporary
+     * cache file is done; 'ok' and 'aborted' are like in
+     * cacheWriteFinished().
+     **/
+    void startCompare( bool ok, bool aborted );
+
+    /**
+     * Compare cache file 'oldFileName' with 'newFileName'. This runs in a
+     * worker thread. Return the result or 0 upon error.
+     **/
+    static QDirStat::CacheDiff * diffCache( QString oldFileName, QString newFileName );
+
     /**
      * Connect menu QActions from the .ui file to actions of this class
      **/
@@ -518,6 +582,7 @@ private:
     QPointer<FileAgeStatsWindow>   _fileAgeStatsWindow;
     QPointer<FilesystemsWindow>    _filesystemsWindow;
     QPointer<PanelMessage>	   _dirPermissionsWarning;
+    QPointer<PanelMessage>	   _tooLargeWarning;
     QString			   _dUrl;
     QElapsedTimer		   _stopWatch;
     bool			   _enableDirPermissionsWarning;
@@ -532,6 +597,9 @@ private:
     QTimer			   _updateTimer;
     QTimer                         _treeExpandTimer;
     QDirStat::Subtree              _futureSelection;
+    QTemporaryFile *		   _compareTmpFile;
+    QString			   _compareCacheFileName;
+    QFutureWatcher<QDirStat::CacheDiff *> _compareWatcher;
 
 }; // class MainWindow
 
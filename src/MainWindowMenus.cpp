@@ -50,6 +50,7 @@ void MainWindow::connectFileMenu()
     CONNECT_ACTION( _ui->actionStopReading,		    this, stopReading()	      );
     CONNECT_ACTION( _ui->actionAskWriteCache,		    this, askWriteCache()     );
     CONNECT_ACTION( _ui->actionAskReadCache,		    this, askReadCache()      );
+    CONNECT_ACTION( _ui->actionAskCompareWithCache,	    this, askCompareWithCache() );
     CONNECT_ACTION( _ui->actionQuit,			    qApp, quit()	      );
 }
 
@@ -0,0 +1,146 @@
+/*
+ *   File name: MemoCache.h
+ *   Summary:	Support classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoCache_h
+#define MemoCache_h
+
+
+#include <QList>
+#include <QString>
+#include <QSharedPointer>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Small cache for results that are derived from a subtree, such as
+     * statistics, so they don't need to be calculated again as long as
+     * nothing in that subtree changed.
+     *
+     * A result is stored for a subtree, the generation of that subtree (see
+     * DirInfo::generation()) and a string with any additional parameters
+     * that the result depends on. It is only found again if all of them
+     * are still the same.
+     *
+     * The subtree pointer is only compared, never used, so it doesn't
+     * matter if the subtree is deleted in the meantime: Generation numbers
+     * are never used twice, so a new item that happens to get the same
+     * address will never match.
+     *
+     * Only the 'maxEntries' most recently used results are kept.
+     **/
+    template<class T> class MemoCache
+    {
+    public:
+
+	typedef QSharedPointer<const T> ResultPtr;
+
+	/**
+	 * Constructor.
+	 **/
+	MemoCache( int maxEntries = 4 ):
+	    _maxEntries( maxEntries )
+	    {}
+
+	/**
+	 * Return the result for 'subtree' with 'params' or a null pointer if
+	 * there is none or if the subtree changed in the meantime.
+	 **/
+	ResultPtr find( FileInfo * subtree, const QString & params = QString() )
+	{
+	    if ( ! subtree )
+		return ResultPtr();
+
+	    quint64 generation = subtree->generation();
+
+	    for ( int i=0; i < _entries.size(); ++i )
+	    {
+		const Entry & entry = _entries.at( i );
+
+		if ( entry.subtree    == subtree    &&
+		     entry.generation == generation &&
+		     entry.params     == params )
+		{
+		    ResultPtr result = entry.result;
+
+		    if ( i > 0 )
+			_entries.move( i, 0 );	// Most recently used first
+
+		    return result;
+		}
+	    }
+
+	    return ResultPtr();
+	}
+
+	/**
+	 * Store 'result' for the current generation of 'subtree' with
+	 * 'params'. This replaces any older result for the same subtree and
+	 * parameters.
+	 **/
+	void insert( FileInfo *	       subtree,
+		     const QString &   params,
+		     const ResultPtr & result )
+	{
+	    if ( ! subtree || ! result )
+		return;
+
+	    for ( int i = _entries.size() - 1; i >= 0; --i )
+	    {
+		if ( _entries.at( i ).subtree == subtree &&
+		     _entries.at( i ).params  == params )
+		{
+		    _entries.removeAt( i );
+		}
+	    }
+
+	    Entry entry;
+	    entry.subtree    = subtree;
+	    entry.generation = subtree->generation();
+	    entry.params     = params;
+	    entry.result     = result;
+
+	    _entries.prepend( entry );
+
+	    while ( _entries.size() > _maxEntries )
+		_entries.removeLast();
+	}
+
+	/**
+	 * Remove all results.
+	 **/
+	void clear() { _entries.clear(); }
+
+	/**
+	 * Return the number of stored results.
+	 **/
+	int size() const { return _entries.size(); }
+
+
+    protected:
+
+	struct Entry
+	{
+	    const FileInfo * subtree;
+	    quint64	     generation;
+	    QString	     params;
+	    ResultPtr	     result;
+	};
+
+	QList<Entry>	_entries;
+	int		_maxEntries;
+
+    };	// class MemoCache
+
+}	// namespace QDirStat
+
+
+#endif // ifndef MemoCache_h
@@ -33,7 +33,8 @@ MimeCategorizer * MimeCategorizer::instance()
 
 MimeCategorizer::MimeCategorizer():
     QObject( 0 ),
-    _mapsDirty( true )
+    _mapsDirty( true ),
+    _generation( 0 )
 {
     // logDebug() << "Creating MimeCategorizer" << endl;
     readSettings();
@@ -49,9 +50,12 @@ MimeCategorizer::~MimeCategorizer()
 
 void MimeCategorizer::clear()
 {
+    QMutexLocker locker( &_mutex );
+
     qDeleteAll( _categories );
     _categories.clear();
     _mapsDirty = true;
+    _generation++;
 }
 
 
@@ -68,6 +72,8 @@ MimeCategory * MimeCategorizer::category( FileInfo * item )
     CHECK_PTR  ( item );
     CHECK_MAGIC( item );
 
+    QMutexLocker locker( &_mutex );
+
     if ( item->isSymLink() )
     {
 	return matchCategoryName( CATEGORY_SYMLINKS );
@@ -96,6 +102,8 @@ MimeCategory * MimeCategorizer::category( const QString & filename,
     if ( filename.isEmpty() )
 	return 0;
 
+    QMutexLocker locker( &_mutex );
+
     // Build suffix maps for fast lookup
 
     if ( _mapsDirty )
@@ -179,8 +187,10 @@ void MimeCategorizer::add( MimeCategory * category )
 {
     CHECK_PTR( category );
 
+    QMutexLocker locker( &_mutex );
     _categories << category;
     _mapsDirty = true;
+    _generation++;
 }
 
 
@@ -188,9 +198,26 @@ void MimeCategorizer::remove( MimeCategory * category )
 {
     CHECK_PTR( category );
 
+    QMutexLocker locker( &_mutex );
     _categories.removeAll( category );
     delete category;
     _mapsDirty = true;
+    _generation++;
+}
+
+
+void MimeCategorizer::setPatterns( MimeCategory *      category,
+				   const QStringList & caseInsensitivePatterns,
+				   const QStringList & caseSensitivePatterns )
+{
+    CHECK_PTR( category );
+
+    QMutexLocker locker( &_mutex );
+    category->clear();
+    category->addPatterns( caseInsensitivePatterns, Qt::CaseInsensitive );
+    category->addPatterns( caseSensitivePatterns,   Qt::CaseSensitive	);
+    _mapsDirty = true;
+    _generation++;
 }
 
 
@@ -233,6 +260,7 @@ void MimeCategorizer::addSuffixes( QMap<QString, MimeCategory *> & suffixMap,
 
 void MimeCategorizer::readSettings()
 {
+    QMutexLocker locker( &_mutex );
     MimeCategorySettings settings;
     QStringList mimeCategoryGroups = settings.findGroups( settings.groupPrefix() );
 
@@ -269,6 +297,12 @@ void MimeCategorizer::readSettings()
 void MimeCategorizer::writeSettings()
 {
     // logDebug() << endl;
+
+    QMutexLocker locker( &_mutex );
+
+    // The categories might have been changed directly in the config dialog
+    _generation++;
+
     MimeCategorySettings settings;
 
     // Remove all leftover cleanup descriptions
@@ -11,6 +11,7 @@
 
 #include <QObject>
 #include <QMap>
+#include <QRecursiveMutex>
 
 #include "MimeCategory.h"
 
@@ -32,6 +33,12 @@ namespace QDirStat
      * This is a singleton class. Use instance() to get the instance. Remember
      * to call instance()->writeSettings() in an appropriate destructor in the
      * application to write the settings to disk.
+     *
+     * The category() lookups can also be used on other threads, e.g. for
+     * FileTypeStats: All methods that use or change the categories or the
+     * patterns are serialized with a mutex. Change the patterns of a
+     * category only with setPatterns() for that reason. The categories()
+     * list itself is only for the GUI thread.
      **/
     class MimeCategorizer: public QObject
     {
@@ -92,6 +99,14 @@ namespace QDirStat
 	 **/
 	void remove( MimeCategory * category );
 
+	/**
+	 * Replace the patterns of 'category' with 'caseInsensitivePatterns'
+	 * and 'caseSensitivePatterns'.
+	 **/
+	void setPatterns( MimeCategory *      category,
+			  const QStringList & caseInsensitivePatterns,
+			  const QStringList & caseSensitivePatterns );
+
 	/**
 	 * Return the number of MimeCategories.
 	 **/
@@ -107,6 +122,13 @@ namespace QDirStat
 	 **/
 	void clear();
 
+	/**
+	 * Return a number that changes whenever the categories might have
+	 * changed. Cached results that depend on the categories are only
+	 * valid as long as this stays the same.
+	 **/
+	quint32 generation() const { return _generation; }
+
 
     public slots:
 
@@ -166,7 +188,9 @@ namespace QDirStat
 
 	static MimeCategorizer *	_instance;
 
+	mutable QRecursiveMutex		_mutex;
 	bool				_mapsDirty;
+	quint32				_generation;
 	MimeCategoryList		_categories;
 
 	QMap<QString, MimeCategory *>	_caseInsensitiveSuffixMap;
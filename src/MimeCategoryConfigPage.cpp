@@ -174,12 +174,12 @@ void MimeCategoryConfigPage::save( void * value )
     if ( ! category || updatesLocked() )
 	return;
 
-    category->clear();
-    QString patterns = _ui->caseInsensitivePatternsTextEdit->toPlainText();
-    category->addPatterns( patterns.split( "\n" ), Qt::CaseInsensitive );
+    QString caseInsensitivePatterns = _ui->caseInsensitivePatternsTextEdit->toPlainText();
+    QString caseSensitivePatterns   = _ui->caseSensitivePatternsTextEdit->toPlainText();
 
-    patterns = _ui->caseSensitivePatternsTextEdit->toPlainText();
-    category->addPatterns( patterns.split( "\n" ), Qt::CaseSensitive );
+    _categorizer->setPatterns( category,
+			       caseInsensitivePatterns.split( "\n" ),
+			       caseSensitivePatterns.split( "\n" ) );
 }
 
 
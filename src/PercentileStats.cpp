@@ -13,8 +13,6 @@
 #include "PercentileStats.h"
 #include "Exception.h"
 
-#define VERBOSE_SORT_THRESHOLD	50000
-
 using namespace QDirStat;
 
 
@@ -42,14 +40,11 @@ void PercentileStats::clear()
 
 void PercentileStats::sort()
 {
-    if ( _data.size() > VERBOSE_SORT_THRESHOLD )
-	logDebug() << "Sorting " << _data.size() << " elements" << endl;
+    // No logging here: This is also used on worker threads (see
+    // FileSizeStatsWindow::collect()).
 
     std::sort( _data.begin(), _data.end() );
     _sorted = true;
-
-    if ( _data.size() > VERBOSE_SORT_THRESHOLD )
-	logDebug() << "Sorting done." << endl;
 }
 
 
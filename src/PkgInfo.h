@@ -120,6 +120,14 @@ namespace QDirStat
 	 **/
 	virtual QString url() const Q_DECL_OVERRIDE;
 
+	/**
+	 * Append the URL of this package to 'buffer'.
+	 *
+         * Reimplemented - inherited from FileInfo.
+	 **/
+	virtual void appendUrl( QString & buffer ) const Q_DECL_OVERRIDE
+	    { buffer += url(); }
+
         /**
          * Return 'true' if this is a package URL, i.e. it starts with "Pkg:".
          **/
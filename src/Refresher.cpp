@@ -30,6 +30,55 @@ Refresher::Refresher( const FileInfoSet items, QObject * parent ):
 
     if ( ! _items.isEmpty() )
 	_tree = _items.first()->tree();
+
+    if ( _tree )
+    {
+	connect( _tree, SIGNAL( deletingChild	   ( FileInfo * ) ),
+		 this,	SLOT  ( deletingChildNotify( FileInfo * ) ) );
+
+	connect( _tree, SIGNAL( clearingSubtree	     ( DirInfo * ) ),
+		 this,	SLOT  ( clearingSubtreeNotify( DirInfo * ) ) );
+
+	connect( _tree, SIGNAL( clearing()	 ),
+		 this,	SLOT  ( clearingNotify() ) );
+    }
+}
+
+
+void Refresher::deletingChildNotify( FileInfo * deletedChild )
+{
+    dropSubtree( deletedChild, true );
+}
+
+
+void Refresher::clearingSubtreeNotify( DirInfo * subtree )
+{
+    dropSubtree( subtree, false );
+}
+
+
+void Refresher::clearingNotify()
+{
+    _items.clear();
+}
+
+
+void Refresher::dropSubtree( FileInfo * subtree, bool includeSubtree )
+{
+    // This is called before the subtree is detached, so all remaining
+    // items are still part of the tree and can safely be checked.
+
+    FileInfoSet::iterator it = _items.begin();
+
+    while ( it != _items.end() )
+    {
+	FileInfo * item = *it;
+
+	if ( ( includeSubtree || item != subtree ) && item->isInSubtree( subtree ) )
+	    it = _items.erase( it );
+	else
+	    ++it;
+    }
 }
 
 
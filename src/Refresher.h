@@ -17,6 +17,8 @@
 namespace QDirStat
 {
     class FileInfo;
+    class DirInfo;
+    class DirTree;
 
 
     /**
@@ -26,6 +28,12 @@ namespace QDirStat
      * OutputWindow::lastProcessFinished()), trigger refreshing all stored
      * subtrees.
      *
+     * The items are only kept as long as they are part of the tree: Items
+     * that the tree deletes in the meantime (e.g. by another refresh) are
+     * dropped when the tree announces that, since they might be handed
+     * over to the reclaimer thread (see TreeReclaimer) and deleted at any
+     * time after that.
+     *
      * Do not hold on to pointers to instances of this class since each
      * instance will destroy itself at the end of refresh(). On the other hand,
      * if the signal triggering refresh() never arrives, this object will stay
@@ -61,7 +69,33 @@ namespace QDirStat
 	 **/
 	void refresh();
 
+    protected slots:
+
+	/**
+	 * Notification that 'deletedChild' is about to be deleted: Drop it
+	 * and all items in its subtree.
+	 **/
+	void deletingChildNotify( FileInfo * deletedChild );
+
+	/**
+	 * Notification that all children of 'subtree' are about to be
+	 * deleted: Drop all items below it.
+	 **/
+	void clearingSubtreeNotify( DirInfo * subtree );
+
+	/**
+	 * Notification that the whole tree is about to be cleared.
+	 **/
+	void clearingNotify();
+
     protected:
+
+	/**
+	 * Drop all items in the subtree of 'subtree' and, if
+	 * 'includeSubtree' is 'true', 'subtree' itself.
+	 **/
+	void dropSubtree( FileInfo * subtree, bool includeSubtree );
+
 	/**
 	 * Convert the items to string for logging.
 	 **/
@@ -0,0 +1,433 @@
+/*
+ *   File name: ScaleTest.cpp
+ *   Summary:	Synthetic huge directory tree to test 64 bit counters
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// S_IFDIR etc.
+#include <unistd.h>	// sysconf()
+#include <time.h>	// time()
+#include <limits.h>	// INT_MAX
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QLabel>
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include "ScaleTest.h"
+#include "AggregateInfo.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "DirTreeCache.h"
+#include "DirTreeModel.h"
+#include "DataColumns.h"
+#include "FileDetailsView.h"
+#include "FileInfoIterator.h"
+#include "TreeColumns.h"
+#include "FormatUtil.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Counts of a subtree that are collected without using any of the
+     * cached sums.
+     **/
+    struct Counts
+    {
+	Counts(): nodes( 0 ), pseudoDirs( 0 ), items( 0 ), files( 0 ), dirs( 0 ), size( 0 ) {}
+
+	FileCount nodes;	// Objects in memory; one for each aggregate
+	FileCount pseudoDirs;	// Dot entries and attics
+	FileCount items;	// Items like in FileInfo::totalItems()
+	FileCount files;
+	FileCount dirs;
+	FileSize  size;
+    };
+
+
+    /**
+     * Count all items below 'dir' (but not 'dir' itself) like
+     * DirInfo::recalc() does, but walking the complete subtree.
+     **/
+    void recount( FileInfo * dir, Counts & counts )
+    {
+	FileInfoIterator it( dir );
+
+	while ( *it )
+	{
+	    FileInfo * child = *it;
+	    FileCount  count = 1;
+
+	    if ( child->isAggregate() )
+		count = static_cast<AggregateInfo *>( child )->count();
+
+	    counts.nodes++;
+	    counts.items += count;
+
+	    if ( child->isPseudoDir() )
+		counts.pseudoDirs++;
+
+	    counts.size	 += child->size();
+
+	    if ( child->isDir() )
+		counts.dirs++;
+
+	    if ( child->isFile() )
+		counts.files += count;
+
+	    if ( child->isDirInfo() )
+		recount( child, counts );
+
+	    ++it;
+	}
+    }
+
+}	// namespace
+
+
+ScaleTest::ScaleTest( QTextStream * out ):
+    _out( out ),
+    _ok( true )
+{
+    CHECK_PTR( out );
+}
+
+
+ScaleTest::~ScaleTest()
+{
+    // NOP
+}
+
+
+bool ScaleTest::run( FileCount items )
+{
+    FileCount dirs	 = SCALE_TEST_DIRS + SCALE_TEST_DIRS * SCALE_TEST_DIRS;
+    FileCount realFiles	 = SCALE_TEST_DIRS * SCALE_TEST_DIRS * SCALE_TEST_FILES;
+    FileCount aggregated = qMax( items - dirs - realFiles, (FileCount) 0 );
+
+    _ok = true;
+    *_out << "# QDirStat scale test\n"
+	  << "# Items:            " << dirs + realFiles + aggregated << "\n"
+	  << "# Directories:      " << dirs << "\n"
+	  << "# Files:            " << realFiles << "\n"
+	  << "# Aggregated files: " << aggregated << "\n"
+	  << "#\n";
+
+    // The tree belongs to a model so the checks can also go through the
+    // model like the tree view does
+
+    DirTreeModel * model = new DirTreeModel();
+    CHECK_NEW( model );
+    DirTree * tree = model->tree();
+
+    qint64 memBefore = residentMemory();
+    QElapsedTimer timer;
+    timer.start();
+
+    DirInfo * top = new DirInfo( tree, tree->root(), "/scale-test",
+				 S_IFDIR | 0755, 4096,
+				 false, 0, 0,	// withUidGidPerm, uid, gid
+				 time( 0 ) );
+    CHECK_NEW( top );
+    tree->root()->insertChild( top );
+
+    build( tree, top, aggregated );
+    top->setReadState( DirFinished );
+
+    qint64 buildTime = timer.restart();
+    qint64 memAfter  = residentMemory();
+
+    // The sums that the tree caches in each directory against an
+    // independent count
+
+    Counts counts;
+    recount( top, counts );
+
+    check( "Total items",	  top->totalItems(),   counts.items );
+    check( "Total files",	  top->totalFiles(),   counts.files );
+    check( "Total files",	  top->totalFiles(),   realFiles + aggregated );
+    check( "Total subdirectories", top->totalSubDirs(), counts.dirs );
+    check( "Total size",	  top->totalSize(),    counts.size + top->size() );
+
+    if ( items > INT_MAX )
+	check( "Total items > 2^31", top->totalItems() > INT_MAX ? 1 : 0, 1 );
+
+    // Aggregates have only one row in a snapshot, so it needs one row per
+    // node in memory plus one for the toplevel directory, but no row for
+    // the dot entries.
+
+    TreeSnapshot snapshot = tree->snapshot( top );
+
+    check( "Snapshot too large", snapshot->isTooLarge() ? 1 : 0, 0 );
+
+    if ( ! snapshot->isTooLarge() )
+	check( "Snapshot rows", snapshot->rows(), counts.nodes - counts.pseudoDirs + 1 );
+
+    snapshot.clear();
+
+    // The places where the counts are displayed or written to
+
+    checkModel( model, top );
+    checkDetailsView( top );
+    checkCacheFile( tree, top );
+
+    qint64 checkTime = timer.elapsed();
+    qint64 memUsed   = memAfter - memBefore;
+
+    // Aggregated files don't have an object of their own, so only the
+    // memory per object is meaningful, not the memory per item.
+
+    *_out << "#\n"
+	  << "# Objects in memory:  " << counts.nodes << "\n"
+	  << "# Memory for objects: " << formatSize( memUsed ) << "\n";
+
+    if ( counts.nodes > 0 && memUsed > 0 )
+	*_out << "# Bytes per object:   " << memUsed / counts.nodes << "\n";
+
+    *_out << "# Build time:         " << formatMillisec( buildTime ) << "\n"
+	  << "# Check time:         " << formatMillisec( checkTime ) << "\n"
+	  << "#\n"
+	  << ( _ok ? "OK" : "FAILED" ) << "\n";
+
+    delete model;
+
+    return _ok;
+}
+
+
+void ScaleTest::build( DirTree * tree, FileInfo * top, FileCount aggregated )
+{
+    time_t	now	  = time( 0 );
+    FileCount	leaves	  = SCALE_TEST_DIRS * SCALE_TEST_DIRS;
+    FileCount	perLeaf	  = aggregated / leaves;
+    FileCount	remainder = aggregated % leaves;
+    DirInfo *	topDir	  = top->toDirInfo();
+
+    for ( int i=0; i < SCALE_TEST_DIRS; ++i )
+    {
+	DirInfo * dir = new DirInfo( tree, topDir, QString( "dir-%1" ).arg( i ),
+				     S_IFDIR | 0755, 4096, false, 0, 0, now );
+	CHECK_NEW( dir );
+	topDir->insertChild( dir );
+
+	for ( int j=0; j < SCALE_TEST_DIRS; ++j )
+	{
+	    DirInfo * leaf = new DirInfo( tree, dir, QString( "subdir-%1" ).arg( j ),
+					  S_IFDIR | 0755, 4096, false, 0, 0, now );
+	    CHECK_NEW( leaf );
+	    dir->insertChild( leaf );
+
+	    FileInfoList files;
+
+	    for ( int k=0; k < SCALE_TEST_FILES; ++k )
+	    {
+		FileInfo * file = new FileInfo( tree, leaf, QString( "file-%1.dat" ).arg( k ),
+						S_IFREG | 0644, SCALE_TEST_FILE_SIZE,
+						false, 0, 0, now,
+						-1, 1 );  // blocks, links
+		CHECK_NEW( file );
+		files << file;
+	    }
+
+	    FileCount count = perLeaf + ( remainder > 0 ? 1 : 0 );
+
+	    if ( remainder > 0 )
+		--remainder;
+
+	    if ( count > 0 )
+	    {
+		AggregateInfo * aggregate = new AggregateInfo( tree, leaf );
+		CHECK_NEW( aggregate );
+
+		aggregate->setSums( count,
+				    count * SCALE_TEST_FILE_SIZE,
+				    count * SCALE_TEST_FILE_SIZE,
+				    0,		// blocks
+				    now, now ); // oldest, newest mtime
+		files << aggregate;
+	    }
+
+	    leaf->insertChildren( files );
+	    leaf->setReadState( DirFinished );
+	}
+
+	dir->setReadState( DirFinished );
+    }
+}
+
+
+void ScaleTest::checkModel( DirTreeModel * model, DirInfo * top )
+{
+    int		col	 = DataColumns::toViewCol( TotalItemsCol );
+    QModelIndex topIndex = model->modelIndex( top, col );
+
+    check( "Model items text",
+	   model->data( topIndex, Qt::DisplayRole ).toString(),
+	   QString::number( top->totalItems() ) );
+
+    check( "Model items raw data",
+	   model->data( topIndex, RawDataRole ).toLongLong(),
+	   top->totalItems() );
+
+    // Sort by the number of items like a click on the column header and
+    // check the rows of the toplevel directory and of a bottom level one
+
+    model->sort( col, Qt::DescendingOrder );
+
+    QModelIndex parent = model->modelIndex( top );
+    check( "Model rows", model->rowCount( parent ), SCALE_TEST_DIRS );
+
+    FileCount unsorted = sortErrors( model, parent, col );
+    parent   = model->index( 0, 0, parent );
+    unsorted += sortErrors( model, parent, col );
+    parent   = model->index( 0, 0, parent );
+    unsorted += sortErrors( model, parent, col );
+
+    check( "Model rows out of order", unsorted, 0 );
+}
+
+
+FileCount ScaleTest::sortErrors( DirTreeModel *	     model,
+				 const QModelIndex & parent,
+				 int		     col )
+{
+    FileCount errors = 0;
+    int	      rows   = model->rowCount( parent );
+
+    for ( int row=1; row < rows; ++row )
+    {
+	QVariant previous = model->data( model->index( row - 1, col, parent ), RawDataRole );
+	QVariant current  = model->data( model->index( row,	col, parent ), RawDataRole );
+
+	if ( current.toLongLong() > previous.toLongLong() )
+	    ++errors;
+    }
+
+    return errors;
+}
+
+
+void ScaleTest::checkDetailsView( DirInfo * top )
+{
+    FileDetailsView view;
+    view.showDetails( top );
+
+    QLabel * itemCount = view.findChild<QLabel *>( "dirItemCountLabel" );
+    QLabel * fileCount = view.findChild<QLabel *>( "dirFileCountLabel" );
+
+    check( "Details view items", itemCount ? itemCount->text() : QString(),
+	   QString::number( top->totalItems() ) );
+
+    check( "Details view files", fileCount ? fileCount->text() : QString(),
+	   QString::number( top->totalFiles() ) );
+}
+
+
+void ScaleTest::checkCacheFile( DirTree * tree, DirInfo * top )
+{
+    QTemporaryFile cacheFile( QDir::tempPath() + "/qdirstat-scale-test-XXXXXX.cache.gz" );
+
+    if ( ! cacheFile.open() )
+    {
+	check( "Cache file created", 0, 1 );
+	return;
+    }
+
+    cacheFile.close();	// Only the name is needed
+
+    CacheWriter writer( cacheFile.fileName(), tree );
+
+    if ( ! check( "Cache file written", writer.ok() ? 1 : 0, 1 ) )
+	return;
+
+    // Read it back into another tree and compare the sums
+
+    DirTree copy;
+    CacheReader * reader = new CacheReader( cacheFile.fileName(), &copy );
+    CHECK_NEW( reader );
+
+    reader->read();
+    bool readOk = reader->ok();
+    delete reader;	// This finalizes the tree
+
+    FileInfo * copyTop = copy.firstToplevel();
+
+    if ( ! check( "Cache file read", readOk && copyTop ? 1 : 0, 1 ) )
+	return;
+
+    check( "Cache file total items",	  copyTop->totalItems(),   top->totalItems()   );
+    check( "Cache file total files",	  copyTop->totalFiles(),   top->totalFiles()   );
+    check( "Cache file total subdirectories", copyTop->totalSubDirs(), top->totalSubDirs() );
+    check( "Cache file total size",	  copyTop->totalSize(),	   top->totalSize()    );
+}
+
+
+bool ScaleTest::check( const char * what, FileCount actual, FileCount expected )
+{
+    bool ok = actual == expected;
+
+    *_out << ( ok ? "OK\t" : "ERROR\t" ) << what << ": " << actual;
+
+    if ( ! ok )
+    {
+	*_out << " (expected: " << expected << ")";
+	logError() << "Scale test: " << what << ": " << actual
+		   << " instead of " << expected << endl;
+    }
+
+    *_out << "\n";
+    _ok = _ok && ok;
+
+    return ok;
+}
+
+
+bool ScaleTest::check( const char *	   what,
+		       const QString & actual,
+		       const QString & expected )
+{
+    bool ok = actual == expected;
+
+    *_out << ( ok ? "OK\t" : "ERROR\t" ) << what << ": " << actual;
+
+    if ( ! ok )
+    {
+	*_out << " (expected: " << expected << ")";
+	logError() << "Scale test: " << what << ": " << actual
+		   << " instead of " << expected << endl;
+    }
+
+    *_out << "\n";
+    _ok = _ok && ok;
+
+    return ok;
+}
+
+
+qint64 ScaleTest::residentMemory()
+{
+    // The second field of /proc/self/statm is the resident set in pages
+
+    QFile statm( "/proc/self/statm" );
+
+    if ( ! statm.open( QIODevice::ReadOnly ) )
+	return 0;
+
+    QList<QByteArray> fields = statm.readAll().split( ' ' );
+
+    if ( fields.size() < 2 )
+	return 0;
+
+    return fields.at( 1 ).toLongLong() * sysconf( _SC_PAGESIZE );
+}
@@ -0,0 +1,149 @@
+/*
+ *   File name: ScaleTest.h
+ *   Summary:	Synthetic huge directory tree to test 64 bit counters
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScaleTest_h
+#define ScaleTest_h
+
+
+#include <QString>
+
+#include "FileSize.h"
+
+
+class QTextStream;
+class QModelIndex;
+
+
+// Number of subdirectories of the toplevel directory and of each of them
+
+#define SCALE_TEST_DIRS		32
+
+// Number of real files in each directory on the second level
+
+#define SCALE_TEST_FILES	64
+
+// Size of each file
+
+#define SCALE_TEST_FILE_SIZE	100
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirTreeModel;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Test with a synthetic directory tree with any number of items,
+     * including much more than 2^31: It is built in memory without reading
+     * anything from disk. Most of the files are in aggregates (see
+     * AggregateInfo) so even billions of items need only a few MB.
+     *
+     * The test checks the sums of the tree against an independent count
+     * and builds a snapshot (see TreeColumns) of it. It also checks the
+     * counts where they leave the tree: In the model's display and sort
+     * roles, in the details view and in a cache file written and read
+     * back. It writes the results and the memory needed per object in
+     * memory to an output stream.
+     *
+     * This is started with 'qdirstat --scale-test <items>'; see also
+     * test/util/scale-test. The details view needs a QApplication, so
+     * without a display this uses the "offscreen" platform.
+     **/
+    class ScaleTest
+    {
+    public:
+
+	/**
+	 * Constructor. The results are written to 'out'.
+	 **/
+	ScaleTest( QTextStream * out );
+
+	/**
+	 * Destructor.
+	 **/
+	~ScaleTest();
+
+	/**
+	 * Build a tree with 'items' items (at least the directories and
+	 * the real files) and check it.
+	 *
+	 * Return 'true' if all checks are OK, 'false' if not.
+	 **/
+	bool run( FileCount items );
+
+
+    protected:
+
+	/**
+	 * Build the tree below the toplevel directory 'top' with
+	 * 'aggregated' files in aggregates.
+	 **/
+	void build( DirTree * tree, FileInfo * top, FileCount aggregated );
+
+	/**
+	 * Check the number of items of 'top' in the data of 'model' and the
+	 * order of the rows after sorting by that number.
+	 **/
+	void checkModel( DirTreeModel * model, DirInfo * top );
+
+	/**
+	 * Return the number of rows below 'parent' that are not in
+	 * descending order of the raw data of column 'col' of 'model'.
+	 **/
+	FileCount sortErrors( DirTreeModel *	  model,
+			      const QModelIndex & parent,
+			      int		  col );
+
+	/**
+	 * Check the item and file counts of 'top' in a FileDetailsView.
+	 **/
+	void checkDetailsView( DirInfo * top );
+
+	/**
+	 * Write 'tree' to a temporary cache file, read it back into another
+	 * tree and compare its sums with those of 'top'.
+	 **/
+	void checkCacheFile( DirTree * tree, DirInfo * top );
+
+	/**
+	 * Compare 'actual' with 'expected' and write the result for 'what'.
+	 * Return 'true' if they are equal.
+	 **/
+	bool check( const char * what, FileCount actual, FileCount expected );
+
+	/**
+	 * Compare the texts 'actual' and 'expected' and write the result for
+	 * 'what'. Return 'true' if they are equal.
+	 **/
+	bool check( const char *    what,
+		    const QString & actual,
+		    const QString & expected );
+
+	/**
+	 * Return the resident memory of this process in bytes.
+	 **/
+	static qint64 residentMemory();
+
+
+	//
+	// Data members
+	//
+
+	QTextStream * _out;
+	bool	      _ok;
+
+    };	// class ScaleTest
+
+}	// namespace QDirStat
+
+
+#endif // ifndef ScaleTest_h
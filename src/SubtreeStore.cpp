@@ -0,0 +1,801 @@
+/*
+ *   File name: SubtreeStore.cpp
+ *   Summary:	Out-of-core storage for cold subtrees of a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy(), memset()
+
+#include <QDir>
+
+#include "SubtreeStore.h"
+#include "CacheIndex.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DotEntry.h"
+#include "Attic.h"
+#include "AggregateInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+// Record kinds in the store file
+
+#define SpillEnd	0	// End of a children block
+#define SpillFile	1	// FileInfo (file, symlink, special file)
+#define SpillDir	2	// DirInfo
+#define SpillDotEntry	3	// DotEntry, followed by its children block
+#define SpillAttic	4	// Attic, followed by its children block
+#define SpillAggregate	5	// AggregateInfo, followed by its sums
+
+// Record flags
+
+#define SpillIgnored	0x01
+#define SpillSparse	0x02
+#define SpillUidGidPerm 0x04
+#define SpillLocal	0x08
+#define SpillExcluded	0x10
+#define SpillMountPoint 0x20
+
+
+namespace QDirStat
+{
+    /**
+     * Fixed part of each record in the store file. This is followed by a
+     * SpillDirRecord for directories and pseudo directories or by a
+     * SpillAggregateRecord for aggregates, then by the name (UTF-8), then
+     * by the children block for directories.
+     *
+     * The store file is only used by this process, so there is no need to
+     * care about byte order or alignment between platforms; memcpy() takes
+     * care of alignment in the buffer.
+     **/
+    struct SpillRecord
+    {
+	quint8	kind;
+	quint8	flags;
+	quint8	readState;
+	quint8	reserved;
+	quint32 nameLen;
+	quint32 mode;
+	quint32 uid;
+	quint32 gid;
+	quint32 links;
+	qint64	device;
+	qint64	size;
+	qint64	blocks;
+	qint64	allocatedSize;
+	qint64	mtime;
+	qint64	childrenSize;	// Size of the children block or 0
+    };
+
+
+    /**
+     * The sums of a directory. Those are what a spilled directory keeps.
+     **/
+    struct SpillDirRecord
+    {
+	qint64	totalSize;
+	qint64	totalAllocatedSize;
+	qint64	totalBlocks;
+	qint64	totalItems;
+	qint64	totalSubDirs;
+	qint64	totalFiles;
+	qint64	totalIgnoredItems;
+	qint64	totalUnignoredItems;
+	qint64	errSubDirCount;
+	qint64	latestMtime;
+	qint64	oldestFileMtime;
+	qint32	directChildrenCount;
+	qint32	reserved;
+    };
+
+
+    /**
+     * The sums of an AggregateInfo that are not in the SpillRecord.
+     **/
+    struct SpillAggregateRecord
+    {
+	qint64	count;
+	qint64	oldestMtime;
+	qint64	histogram[ AggregateInfo::HistogramBuckets ];
+    };
+
+}	// namespace QDirStat
+
+
+
+SubtreeStore::SubtreeStore( DirTree * tree ):
+    _tree( tree ),
+    _spilledItems( 0 ),
+    _cacheIndex( 0 )
+{
+    _file.setFileTemplate( QDir::tempPath() + "/qdirstat-spill-XXXXXX" );
+}
+
+
+SubtreeStore::~SubtreeStore()
+{
+    if ( _file.isOpen() )
+    {
+	logDebug() << "Removing " << _file.fileName()
+		   << " (" << _file.size() << " bytes)" << endl;
+    }
+
+    // QTemporaryFile removes the file in its destructor
+
+    if ( _cacheIndex )
+	delete _cacheIndex;
+}
+
+
+bool SubtreeStore::open()
+{
+    if ( _file.isOpen() )
+	return true;
+
+    if ( ! _file.open() )
+    {
+	logError() << "Can't create subtree store file in "
+		   << QDir::tempPath() << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    logInfo() << "Created subtree store file " << _file.fileName() << endl;
+
+    return true;
+}
+
+
+bool SubtreeStore::spill( DirInfo * dir )
+{
+    CHECK_MAGIC( dir );
+
+    if ( dir->_isSpilled || ! dir->hasChildren() )
+	return false;
+
+    if ( ! open() )
+	return false;
+
+    // Make sure the sums are up to date: They are all that is left of this
+    // subtree in memory.
+
+    FileCount items = dir->totalItems();
+    dir->latestMtime();
+    dir->oldestFileMtime();
+
+    QByteArray buffer;
+    writeChildren( buffer, dir );
+
+    qint64 offset = _file.size();
+
+    if ( ! _file.seek( offset ) ||
+	 _file.write( buffer ) != buffer.size() ||
+	 ! _file.flush() )
+    {
+	logError() << "Can't write to " << _file.fileName() << ": "
+		   << _file.errorString() << endl;
+
+	_file.resize( offset ); // Cut off what was written, if anything
+	return false;
+    }
+
+    // This deletes all children without touching the sums. It also discards
+    // any spilled directories in the subtree; their children blocks were
+    // copied to the new block.
+
+    dir->deleteChildren();
+    dir->_summaryDirty = false;
+    dir->_isSpilled    = true;
+
+    _spilled.insert( dir, Range( offset, buffer.size() ) );
+    _spilledItems += items;
+
+    // logDebug() << "Spilled " << dir << ": " << items << " items" << endl;
+
+    return true;
+}
+
+
+void SubtreeStore::pageIn( DirInfo * dir )
+{
+    CHECK_MAGIC( dir );
+
+    if ( ! dir->_isSpilled )
+	return;
+
+    // Clear this first: Creating the dot entry or the attic below must not
+    // try to page in again.
+
+    dir->_isSpilled = false;
+
+    QHash<const DirInfo *, Range>::iterator it = _spilled.find( dir );
+
+    if ( it == _spilled.end() )
+    {
+	logError() << "No spilled subtree for " << dir << endl;
+	return;
+    }
+
+    Range range = it.value();
+    _spilled.erase( it );
+    _spilledItems -= dir->_totalItems;
+
+    if ( range.cacheDirNo >= 0 )
+    {
+	pageInCached( dir, range.cacheDirNo );
+	return;
+    }
+
+    uchar * data = _file.map( range.offset, range.size );
+
+    if ( ! data )
+    {
+	logError() << "Can't map " << _file.fileName() << ": "
+		   << _file.errorString() << endl;
+
+	dir->_readState = DirError;
+	return;
+    }
+
+    // logDebug() << "Paging in " << dir << endl;
+
+    readChildren( dir, data, data + range.size, data, range.offset );
+    _file.unmap( data );
+
+    // The sums of 'dir' didn't change, but the pseudo directories were
+    // created from scratch.
+
+    dir->_summaryDirty = false;
+
+    if ( dir->_dotEntry )
+	dir->_dotEntry->_summaryDirty = true;
+
+    if ( dir->_attic )
+	dir->_attic->_summaryDirty = true;
+}
+
+
+void SubtreeStore::discard( DirInfo * dir )
+{
+    if ( _spilled.remove( dir ) > 0 )
+	_spilledItems -= dir->_totalItems;
+}
+
+
+void SubtreeStore::discardSubtree( const FileInfo * subtree, bool includeSubtree )
+{
+    QHash<const DirInfo *, Range>::iterator it = _spilled.begin();
+
+    while ( it != _spilled.end() )
+    {
+	DirInfo * dir = const_cast<DirInfo *>( it.key() );
+
+	if ( ( includeSubtree || dir != subtree ) && dir->isInSubtree( subtree ) )
+	{
+	    _spilledItems  -= dir->_totalItems;
+	    dir->_isSpilled = false;
+	    it = _spilled.erase( it );
+	}
+	else
+	{
+	    ++it;
+	}
+    }
+}
+
+
+void SubtreeStore::writeChildren( QByteArray & buffer, DirInfo * dir )
+{
+    if ( dir->_isSpilled )
+    {
+	if ( _spilled.value( dir ).cacheDirNo < 0 )
+	{
+	    copySpilled( buffer, dir );
+	    return;
+	}
+
+	pageIn( dir );	// Not in the store file yet
+    }
+
+    for ( FileInfo * child = dir->_firstChild; child; child = child->next() )
+    {
+	int kind = SpillFile;
+
+	if ( child->isDirInfo() )
+	    kind = SpillDir;
+	else if ( child->isAggregate() )
+	    kind = SpillAggregate;
+
+	writeItem( buffer, child, kind );
+    }
+
+    if ( dir->_dotEntry )
+	writeItem( buffer, dir->_dotEntry, SpillDotEntry );
+
+    if ( dir->_attic )
+	writeItem( buffer, dir->_attic, SpillAttic );
+
+    SpillRecord end;
+    memset( &end, 0, sizeof( end ) );
+    end.kind = SpillEnd;
+    buffer.append( (const char *) &end, sizeof( end ) );
+}
+
+
+void SubtreeStore::writeItem( QByteArray & buffer, FileInfo * item, int kind )
+{
+    QByteArray name = item->name().toUtf8();
+
+    SpillRecord rec;
+    memset( &rec, 0, sizeof( rec ) );
+
+    rec.kind	      = kind;
+    rec.nameLen	      = name.size();
+    rec.mode	      = item->_mode;
+    rec.uid	      = item->_uid;
+    rec.gid	      = item->_gid;
+    rec.links	      = item->_links;
+    rec.device	      = item->_device;
+    rec.size	      = item->_size;
+    rec.blocks	      = item->_blocks;
+    rec.allocatedSize = item->_allocatedSize;
+    rec.mtime	      = item->_mtime;
+
+    if ( item->_isIgnored     ) rec.flags |= SpillIgnored;
+    if ( item->_isSparseFile  ) rec.flags |= SpillSparse;
+    if ( item->_hasUidGidPerm ) rec.flags |= SpillUidGidPerm;
+    if ( item->_isLocalFile   ) rec.flags |= SpillLocal;
+
+    int recPos = buffer.size();
+    buffer.append( (const char *) &rec, sizeof( rec ) );
+
+    if ( kind == SpillFile )
+    {
+	buffer.append( name );
+	return;
+    }
+
+    if ( kind == SpillAggregate )
+    {
+	AggregateInfo * aggregate = static_cast<AggregateInfo *>( item );
+
+	SpillAggregateRecord aggrRec;
+	memset( &aggrRec, 0, sizeof( aggrRec ) );
+
+	aggrRec.count	    = aggregate->count();
+	aggrRec.oldestMtime = aggregate->oldestMtime();
+
+	for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+	    aggrRec.histogram[ i ] = aggregate->histogram( i );
+
+	buffer.append( (const char *) &aggrRec, sizeof( aggrRec ) );
+	buffer.append( name );
+	return;
+    }
+
+    DirInfo * dir = item->toDirInfo();
+
+    if ( dir->_isExcluded   ) rec.flags |= SpillExcluded;
+    if ( dir->_isMountPoint ) rec.flags |= SpillMountPoint;
+
+    rec.readState = dir->_readState;
+
+    SpillDirRecord dirRec;
+    memset( &dirRec, 0, sizeof( dirRec ) );
+
+    dirRec.totalSize	       = dir->totalSize();
+    dirRec.totalAllocatedSize  = dir->totalAllocatedSize();
+    dirRec.totalBlocks	       = dir->totalBlocks();
+    dirRec.totalItems	       = dir->totalItems();
+    dirRec.totalSubDirs	       = dir->totalSubDirs();
+    dirRec.totalFiles	       = dir->totalFiles();
+    dirRec.totalIgnoredItems   = dir->totalIgnoredItems();
+    dirRec.totalUnignoredItems = dir->totalUnignoredItems();
+    dirRec.errSubDirCount      = dir->errSubDirCount();
+    dirRec.latestMtime	       = dir->latestMtime();
+    dirRec.oldestFileMtime     = dir->oldestFileMtime();
+    dirRec.directChildrenCount = dir->directChildrenCount();
+
+    buffer.append( (const char *) &dirRec, sizeof( dirRec ) );
+    buffer.append( name );
+
+    // Directories without any children don't get a children block; for
+    // pseudo directories it's always there.
+
+    if ( kind == SpillDir && ! dir->_isSpilled &&
+	 ! dir->_firstChild && ! dir->_dotEntry && ! dir->_attic )
+    {
+	memcpy( buffer.data() + recPos, &rec, sizeof( rec ) );
+	return;
+    }
+
+    int childrenStart = buffer.size();
+    writeChildren( buffer, dir );
+    rec.childrenSize = buffer.size() - childrenStart;
+
+    memcpy( buffer.data() + recPos, &rec, sizeof( rec ) );
+}
+
+
+void SubtreeStore::copySpilled( QByteArray & buffer, DirInfo * dir )
+{
+    Range range = _spilled.value( dir );
+    uchar * data = _file.map( range.offset, range.size );
+
+    if ( ! data )
+    {
+	THROW( FileException( _file.fileName(),
+			      QString( "Can't map %1: %2" )
+			      .arg( _file.fileName() )
+			      .arg( _file.errorString() ) ) );
+    }
+
+    // The offsets of spilled subdirectories are calculated relative to the
+    // position of their block when it is read, so the block can simply be
+    // copied.
+
+    buffer.append( (const char *) data, range.size );
+    _file.unmap( data );
+}
+
+
+const uchar * SubtreeStore::readChildren( DirInfo     * parent,
+					  const uchar * pos,
+					  const uchar * end,
+					  const uchar * base,
+					  qint64	baseOffset )
+{
+    FileInfo * last = 0;
+
+    while ( pos + sizeof( SpillRecord ) <= end )
+    {
+	SpillRecord rec;
+	memcpy( &rec, pos, sizeof( rec ) );
+	pos += sizeof( rec );
+
+	if ( rec.kind == SpillEnd )
+	    return pos;
+
+	SpillDirRecord	     dirRec;
+	SpillAggregateRecord aggrRec;
+
+	if ( rec.kind == SpillAggregate )
+	{
+	    memcpy( &aggrRec, pos, sizeof( aggrRec ) );
+	    pos += sizeof( aggrRec );
+	}
+	else if ( rec.kind != SpillFile )
+	{
+	    memcpy( &dirRec, pos, sizeof( dirRec ) );
+	    pos += sizeof( dirRec );
+	}
+
+	QString name = QString::fromUtf8( (const char *) pos, rec.nameLen );
+	pos += rec.nameLen;
+
+	const uchar * children = pos;
+	pos += rec.childrenSize;
+
+	if ( pos > end )
+	    break;
+
+	DirInfo * pseudoDir = 0;
+
+	switch ( rec.kind )
+	{
+	    case SpillFile:
+	    case SpillDir:
+	    case SpillAggregate:
+		{
+		    FileInfo * item = 0;
+
+		    if ( rec.kind == SpillFile )
+		    {
+			item = new FileInfo( _tree, parent );
+		    }
+		    else if ( rec.kind == SpillAggregate )
+		    {
+			AggregateInfo * aggregate = new AggregateInfo( _tree, parent );
+			CHECK_NEW( aggregate );
+
+			aggregate->setSums( aggrRec.count,
+					    rec.size,
+					    rec.allocatedSize,
+					    rec.blocks,
+					    aggrRec.oldestMtime,
+					    rec.mtime );
+
+			for ( int i=0; i < AggregateInfo::HistogramBuckets; ++i )
+			    aggregate->setHistogram( i, aggrRec.histogram[ i ] );
+
+			item = aggregate;
+		    }
+		    else
+		    {
+			DirInfo * dir = new DirInfo( _tree, parent );
+			CHECK_NEW( dir );
+
+			dir->_readState		  = (DirReadState) rec.readState;
+			dir->_isExcluded	  = rec.flags & SpillExcluded;
+			dir->_isMountPoint	  = rec.flags & SpillMountPoint;
+			dir->_totalSize		  = dirRec.totalSize;
+			dir->_totalAllocatedSize  = dirRec.totalAllocatedSize;
+			dir->_totalBlocks	  = dirRec.totalBlocks;
+			dir->_totalItems	  = dirRec.totalItems;
+			dir->_totalSubDirs	  = dirRec.totalSubDirs;
+			dir->_totalFiles	  = dirRec.totalFiles;
+			dir->_totalIgnoredItems	  = dirRec.totalIgnoredItems;
+			dir->_totalUnignoredItems = dirRec.totalUnignoredItems;
+			dir->_errSubDirCount	  = dirRec.errSubDirCount;
+			dir->_latestMtime	  = dirRec.latestMtime;
+			dir->_oldestFileMtime	  = dirRec.oldestFileMtime;
+			dir->_directChildrenCount = dirRec.directChildrenCount;
+			dir->_summaryDirty	  = false;
+
+			if ( rec.childrenSize > 0 )
+			{
+			    // Keep its children in the store until they are needed
+
+			    dir->_isSpilled = true;
+			    _spilled.insert( dir, Range( baseOffset + ( children - base ),
+							 rec.childrenSize ) );
+			    _spilledItems += dir->_totalItems;
+			}
+
+			item = dir;
+		    }
+
+		    CHECK_NEW( item );
+
+		    item->_name		 = name;
+		    item->_mode		 = rec.mode;
+		    item->_uid		 = rec.uid;
+		    item->_gid		 = rec.gid;
+		    item->_links	 = rec.links;
+		    item->_device	 = rec.device;
+		    item->_size		 = rec.size;
+		    item->_blocks	 = rec.blocks;
+		    item->_allocatedSize = rec.allocatedSize;
+		    item->_mtime	 = rec.mtime;
+		    item->_isIgnored	 = rec.flags & SpillIgnored;
+		    item->_isSparseFile	 = rec.flags & SpillSparse;
+		    item->_hasUidGidPerm = rec.flags & SpillUidGidPerm;
+		    item->_isLocalFile	 = rec.flags & SpillLocal;
+
+		    link( parent, item, last );
+		}
+		break;
+
+	    case SpillDotEntry:
+		pseudoDir = parent->ensureDotEntry();
+		break;
+
+	    case SpillAttic:
+		pseudoDir = parent->ensureAttic();
+		break;
+
+	    default:
+		logError() << "Bad record kind " << rec.kind
+			   << " in " << _file.fileName() << endl;
+		return end;
+	}
+
+	if ( pseudoDir )
+	{
+	    // Pseudo directories are always restored completely: Their
+	    // children are (mostly) files anyway.
+
+	    readChildren( pseudoDir, children, children + rec.childrenSize,
+			  base, baseOffset );
+	    pseudoDir->_summaryDirty = true;
+	}
+    }
+
+    logError() << "Unexpected end of spilled subtree in "
+	       << _file.fileName() << endl;
+
+    return end;
+}
+
+
+void SubtreeStore::link( DirInfo * parent, FileInfo * child, FileInfo *& last )
+{
+    // Append the child: The children have to come back in the order they
+    // were written. Unsorted views and cache files use that order.
+
+    if ( ! last )
+    {
+	last = parent->_firstChild;
+
+	while ( last && last->_next )
+	    last = last->_next;
+    }
+
+    child->_next = 0;
+
+    if ( last )
+	last->_next = child;
+    else
+	parent->_firstChild = child;
+
+    last = child;
+    parent->dropNameIndex();
+}
+
+
+void SubtreeStore::setCacheIndex( CacheIndex * index )
+{
+    if ( _cacheIndex && _cacheIndex != index )
+	delete _cacheIndex;
+
+    _cacheIndex = index;
+}
+
+
+QString SubtreeStore::cacheFileName() const
+{
+    return _cacheIndex ? _cacheIndex->fileName() : QString();
+}
+
+
+DirInfo * SubtreeStore::addCacheToplevel( DirInfo * parent )
+{
+    if ( ! _cacheIndex || _cacheIndex->dirCount() == 0 )
+	return 0;
+
+    DirInfo * toplevel = createCacheDir( parent, 0 );
+
+    if ( toplevel )
+    {
+	FileInfo * last = 0;
+	link( parent, toplevel, last );
+	parent->markSummaryDirty();
+    }
+
+    return toplevel;
+}
+
+
+DirInfo * SubtreeStore::createCacheDir( DirInfo * parent, int dirNo )
+{
+    CacheDirEntry entry;
+
+    if ( ! _cacheIndex->readDir( dirNo, entry ) )
+    {
+	logError() << "Invalid entry " << dirNo << " in the directory index of "
+		   << _cacheIndex->fileName() << endl;
+	return 0;
+    }
+
+    const CacheItem & item = entry.item;
+
+    // Like in CacheReader::insertItem(): Only the toplevel directory has
+    // its complete path as its name.
+
+    QString name = dirNo == 0 ? CacheReader::buildPath( item.path, item.name ) : item.name;
+
+    DirInfo * dir = new DirInfo( _tree, parent, name,
+				 item.mode, item.size,
+				 _cacheIndex->withUidGidPerm(), item.uid, item.gid,
+				 item.mtime );
+    CHECK_NEW( dir );
+
+    // The dot entry is created again when the files are read, if there
+    // are any.
+
+    delete dir->_dotEntry;
+    dir->_dotEntry = 0;
+
+    int subDirs = 0;
+
+    for ( int subDirNo = _cacheIndex->firstSubDir( dirNo );
+	  subDirNo >= 0;
+	  subDirNo = _cacheIndex->nextSubDir( subDirNo ) )
+    {
+	++subDirs;
+    }
+
+    dir->_readState	      = DirCached;
+    dir->_totalSize	      = entry.totalSize;
+    dir->_totalAllocatedSize  = entry.totalAllocatedSize;
+    dir->_totalBlocks	      = entry.totalBlocks;
+    dir->_totalItems	      = entry.totalItems;
+    dir->_totalSubDirs	      = entry.totalSubDirs;
+    dir->_totalFiles	      = entry.totalFiles;
+    dir->_totalIgnoredItems   = 0;
+    dir->_totalUnignoredItems = entry.totalUnignoredItems;
+    dir->_errSubDirCount      = 0;
+    dir->_latestMtime	      = entry.latestMtime;
+    dir->_oldestFileMtime     = entry.oldestFileMtime;
+    dir->_summaryDirty	      = false;
+    dir->_mtimeDirty	      = false;
+
+    if ( item.digest != 0 )
+    {
+	// The same digest that its children would give: No need to read
+	// them just for that
+
+	dir->_digest	       = item.digest;
+	dir->_digestGeneration = dir->_generation;
+    }
+
+    // The subdirectories and either the dot entry or the files
+
+    dir->_directChildrenCount = subDirs + ( subDirs > 0 ? qMin( entry.files, 1 ) : entry.files );
+
+    if ( subDirs > 0 || entry.files > 0 )
+    {
+	// Read its children from the cache file when they are needed
+
+	dir->_isSpilled = true;
+	_spilled.insert( dir, Range( 0, 0, dirNo ) );
+	_spilledItems += dir->_totalItems;
+    }
+
+    return dir;
+}
+
+
+void SubtreeStore::pageInCached( DirInfo * dir, int dirNo )
+{
+    QVector<CacheItem> files;
+
+    if ( ! _cacheIndex || ! _cacheIndex->readFiles( dirNo, files ) )
+    {
+	logError() << "Can't read the children of " << dir
+		   << " from the cache file" << endl;
+
+	dir->_readState = DirError;
+
+	if ( _cacheIndex && _cacheIndex->fileChanged() )
+	    _tree->cacheFileChanged();
+
+	return;
+    }
+
+    // logDebug() << "Reading " << dir << " from the cache file" << endl;
+
+    int firstSubDir = _cacheIndex->firstSubDir( dirNo );
+
+    // The same structure as after CacheReader::finalizeRecursive(): The
+    // files in the dot entry only if there are also subdirectories
+
+    DirInfo * fileParent = dir;
+
+    if ( firstSubDir >= 0 && ! files.isEmpty() )
+	fileParent = dir->ensureDotEntry();
+
+    FileInfo * lastFile = 0;
+    FileInfo * lastDir	= 0;
+
+    for ( int i=0; i < files.size(); ++i )
+    {
+	link( fileParent, CacheReader::createItem( _tree, fileParent, files.at( i ),
+						   _cacheIndex->withUidGidPerm() ),
+	      lastFile );
+    }
+
+    for ( int subDirNo = firstSubDir;
+	  subDirNo >= 0;
+	  subDirNo = _cacheIndex->nextSubDir( subDirNo ) )
+    {
+	DirInfo * subDir = createCacheDir( dir, subDirNo );
+
+	if ( subDir )
+	    link( dir, subDir, fileParent == dir ? lastFile : lastDir );
+    }
+
+    // The sums of 'dir' didn't change, but the dot entry is new.
+
+    dir->_summaryDirty = false;
+
+    if ( dir->_dotEntry )
+	dir->_dotEntry->_summaryDirty = true;
+}
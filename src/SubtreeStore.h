@@ -0,0 +1,234 @@
+/*
+ *   File name: SubtreeStore.h
+ *   Summary:	Out-of-core storage for cold subtrees of a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SubtreeStore_h
+#define SubtreeStore_h
+
+
+#include <QByteArray>
+#include <QHash>
+#include <QTemporaryFile>
+
+#include "FileSize.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+    class CacheIndex;
+
+
+    /**
+     * Storage for subtrees that were moved out of memory ("spilled") to a
+     * temporary file.
+     *
+     * When a directory is spilled, all its children (the complete subtree
+     * below it) are written to the store file in a compact binary format
+     * and then deleted. The directory itself stays in the tree with all its
+     * sums (total size, total items etc.), so the tree view and the parent
+     * directories don't see any difference.
+     *
+     * As soon as anybody accesses the children of a spilled directory (see
+     * DirInfo::firstChild()), they are transparently read back from the
+     * memory-mapped store file, but only one level: Subdirectories that have
+     * children of their own are again created as spilled directories that
+     * point to their part of the store file. So navigating in the tree or
+     * building the treemap only restores the directories that are actually
+     * used.
+     *
+     * The store file is append-only; if a directory is spilled again after
+     * it was restored, its subtree is written again. The file is removed
+     * when the store is deleted.
+     *
+     * This stores the same information as a cache file, plus the sums of
+     * each directory.
+     *
+     * Directories from a cache file with a directory index (see CacheIndex)
+     * work the same way, but they were never in memory in the first place:
+     * Their children are read from the cache file when they are needed.
+     **/
+    class SubtreeStore
+    {
+    public:
+
+	/**
+	 * Constructor. The store file is only created when it is needed.
+	 **/
+	SubtreeStore( DirTree * tree );
+
+	/**
+	 * Destructor. This removes the store file.
+	 **/
+	~SubtreeStore();
+
+	/**
+	 * Spill the subtree of 'dir' to the store file and delete all its
+	 * children. Return 'true' on success, 'false' on failure; in that
+	 * case, nothing is changed.
+	 *
+	 * Nobody may keep any pointers to items in that subtree.
+	 **/
+	bool spill( DirInfo * dir );
+
+	/**
+	 * Restore the direct children of a spilled directory from the store
+	 * file. Subdirectories with children are restored as spilled
+	 * directories.
+	 *
+	 * Normally this is called from DirInfo::pageIn().
+	 **/
+	void pageIn( DirInfo * dir );
+
+	/**
+	 * Notification that the spilled directory 'dir' is deleted.
+	 **/
+	void discard( DirInfo * dir );
+
+	/**
+	 * Discard all spilled directories in 'subtree' (including 'subtree'
+	 * itself if 'includeSubtree' is 'true') and mark them as no longer
+	 * spilled. This is used before the subtree is deleted somewhere where
+	 * this store may not be accessed.
+	 **/
+	void discardSubtree( const FileInfo * subtree, bool includeSubtree = true );
+
+	/**
+	 * Use 'index' for the directories from its cache file that are not
+	 * read yet (see addCacheToplevel()). This store takes over the
+	 * ownership of 'index'.
+	 **/
+	void setCacheIndex( CacheIndex * index );
+
+	/**
+	 * Add the toplevel directory of the cache index as a child of
+	 * 'parent' with the sums of its complete subtree, but without any
+	 * children: Like for spilled subtrees, pageIn() reads them from the
+	 * cache file one level at a time when they are needed.
+	 *
+	 * Return the new directory or 0 upon error.
+	 **/
+	DirInfo * addCacheToplevel( DirInfo * parent );
+
+	/**
+	 * Return the name of the cache file of the cache index or an empty
+	 * string if there is none.
+	 **/
+	QString cacheFileName() const;
+
+	/**
+	 * Return the total number of items in all spilled subtrees.
+	 **/
+	FileCount spilledItems() const { return _spilledItems; }
+
+	/**
+	 * Return the number of spilled directories.
+	 **/
+	int spilledDirs() const { return _spilled.size(); }
+
+	/**
+	 * Return the current size of the store file.
+	 **/
+	FileSize fileSize() const { return _file.size(); }
+
+
+    protected:
+
+	/**
+	 * The part of the store file with the children of a spilled
+	 * directory, or the directory in the cache index.
+	 **/
+	struct Range
+	{
+	    Range( qint64 offs = 0, qint64 len = 0, int dirNo = -1 ):
+		offset( offs ),
+		size( len ),
+		cacheDirNo( dirNo )
+		{}
+
+	    qint64 offset;
+	    qint64 size;
+	    int	   cacheDirNo;	// -1 if in the store file
+	};
+
+	/**
+	 * Create and open the store file if that is not done yet.
+	 * Return 'true' if successful.
+	 **/
+	bool open();
+
+	/**
+	 * Append the children block of 'dir' to 'buffer': All its children,
+	 * its dot entry and its attic (recursively), followed by an end
+	 * marker.
+	 **/
+	void writeChildren( QByteArray & buffer, DirInfo * dir );
+
+	/**
+	 * Append the record of 'item' to 'buffer'; for directories, also
+	 * their children block.
+	 **/
+	void writeItem( QByteArray & buffer, FileInfo * item, int kind );
+
+	/**
+	 * Append the children block of a spilled directory as it is.
+	 **/
+	void copySpilled( QByteArray & buffer, DirInfo * dir );
+
+	/**
+	 * Read a children block starting at 'pos' and create the items as
+	 * children of 'parent'. 'base' is the start of the mapped part of
+	 * the store file, and 'baseOffset' is its offset in the file.
+	 *
+	 * Return the position after the block.
+	 **/
+	const uchar * readChildren( DirInfo	* parent,
+				    const uchar * pos,
+				    const uchar * end,
+				    const uchar * base,
+				    qint64	  baseOffset );
+
+	/**
+	 * Append 'child' to the children list of 'parent'. 'last' is the last
+	 * child of that list; it is updated. If it is 0, the end of the list
+	 * is searched first.
+	 **/
+	void link( DirInfo * parent, FileInfo * child, FileInfo *& last );
+
+	/**
+	 * Create directory 'dirNo' of the cache index as a child of
+	 * 'parent' (but don't link it yet) with the sums from the index.
+	 * Return 0 upon error.
+	 **/
+	DirInfo * createCacheDir( DirInfo * parent, int dirNo );
+
+	/**
+	 * Read the files of directory 'dirNo' of the cache index from the
+	 * cache file and create its subdirectories with createCacheDir().
+	 **/
+	void pageInCached( DirInfo * dir, int dirNo );
+
+
+	//
+	// Data members
+	//
+
+	DirTree *			_tree;
+	QTemporaryFile			_file;
+	QHash<const DirInfo *, Range>	_spilled;
+	FileCount			_spilledItems;
+	CacheIndex *			_cacheIndex;
+
+    };	// class SubtreeStore
+
+}	// namespace QDirStat
+
+
+#endif // ifndef SubtreeStore_h
@@ -0,0 +1,498 @@
+/*
+ *   File name: TreeColumns.cpp
+ *   Summary:	Columnar snapshot of a subtree for analysis passes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>	// std::upper_bound()
+
+#include <QMutexLocker>
+
+#include "TreeColumns.h"
+#include "FileInfo.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+TreeColumns::TreeColumns( FileInfo * subtree ):
+    _subtree( 0 ),
+    _subtreeTotalSize( 0 ),
+    _epoch( 0 ),
+    _fileCount( 0 ),
+    _tooLarge( false ),
+    _hasSubtreeRow( false )
+{
+    if ( subtree )
+	build( subtree );
+}
+
+
+void TreeColumns::clear()
+{
+    _subtree	      = 0;
+    _subtreeTotalSize = 0;
+    _fileCount	      = 0;
+    _tooLarge	      = false;
+    _hasSubtreeRow    = false;
+
+    _flags.clear();
+    _size.clear();
+    _allocatedSize.clear();
+    _mtime.clear();
+    _mtimeYear.clear();
+    _mtimeMonth.clear();
+    _mode.clear();
+    _parentRow.clear();
+    _depth.clear();
+    _names.clear();
+
+    QMutexLocker locker( &_suffixMutex );
+    _suffixIds.clear();
+    _suffixes.clear();
+    _suffixIndex.clear();
+}
+
+
+void TreeColumns::build( FileInfo * subtree )
+{
+    clear();
+    CHECK_MAGIC( subtree );
+
+    _subtree	      = subtree;
+    _subtreeTotalSize = subtree->totalSize();
+    _hasSubtreeRow    = ! subtree->isPseudoDir();
+
+    reserve( subtree );
+    addRecursive( subtree, -1, 0 );
+
+    if ( _tooLarge )
+    {
+	logError() << subtree << " has more than " << TREE_COLUMNS_MAX_ROWS
+		   << " items; can't build a snapshot" << endl;
+	clear();
+	_tooLarge = true;
+	return;
+    }
+
+    // logDebug() << _subtree << ": " << rows() << " rows" << endl;
+}
+
+
+bool TreeColumns::update( const TreeColumns & old, const QSet<DirInfo *> & changedDirs )
+{
+    clear();
+
+    FileInfo * subtree = old.subtree();
+
+    if ( ! subtree || subtree->isPseudoDir() || old.rows() == 0 )
+	return false;
+
+    QVector<int>       starts;
+    QVector<int>       ends;
+    QVector<DirInfo *> dirs;
+
+    if ( ! old.findDirRows( changedDirs, starts, ends, dirs ) )
+	return false;
+
+    _subtree	      = subtree;
+    _subtreeTotalSize = subtree->totalSize();
+    _hasSubtreeRow    = true;
+
+    reserve( subtree );
+
+    // The suffix IDs of the copied rows can be copied as well if they are
+    // built already: The new rows just add to the suffix table.
+
+    QMutexLocker oldSuffixLocker( &old._suffixMutex );
+    bool withSuffixes = old._suffixIds.size() == old.rows();
+
+    if ( withSuffixes )
+    {
+	_suffixes    = old._suffixes;
+	_suffixIndex = old._suffixIndex;
+    }
+    else
+    {
+	oldSuffixLocker.unlock();
+    }
+
+    // Each changed directory replaces its old rows with new ones. Rows
+    // after that move by the difference; 'deltas' accumulates it for the
+    // rows from 'oldEnds' on.
+
+    QVector<int> oldEnds;
+    QVector<int> deltas;
+    int	 oldRow = 0;
+    int	 delta	= 0;
+
+    for ( int i=0; i < dirs.size(); ++i )
+    {
+	copyRows( old, oldRow, starts[ i ], oldEnds, deltas );
+
+	if ( withSuffixes )
+	    _suffixIds += old._suffixIds.mid( oldRow, starts[ i ] - oldRow );
+
+	int newStart  = rows();
+	int parentRow = old._parentRow[ starts[ i ] ];
+
+	// The parent is before any changed directory that is not also an
+	// ancestor, so only the ranges before it can move it.
+
+	int moved = std::upper_bound( oldEnds.constBegin(), oldEnds.constEnd(), parentRow ) - oldEnds.constBegin();
+
+	if ( moved > 0 )
+	    parentRow += deltas[ moved - 1 ];
+
+	addRecursive( dirs[ i ], parentRow, old._depth[ starts[ i ] ] );
+
+	if ( withSuffixes )
+	{
+	    for ( int row = newStart; row < rows(); ++row )
+		_suffixIds << addSuffix( _names[ row ] );
+	}
+
+	delta += ( rows() - newStart ) - ( ends[ i ] - starts[ i ] );
+	oldEnds << ends[ i ];
+	deltas	<< delta;
+	oldRow	 = ends[ i ];
+    }
+
+    copyRows( old, oldRow, old.rows(), oldEnds, deltas );
+
+    if ( withSuffixes )
+	_suffixIds += old._suffixIds.mid( oldRow );
+
+    if ( _tooLarge )	// build() reports this
+    {
+	clear();
+	return false;
+    }
+
+    // logDebug() << _subtree << ": " << rows() << " rows, "
+    //	       << dirs.size() << " directories updated" << endl;
+
+    return true;
+}
+
+
+bool TreeColumns::findDirRows( const QSet<DirInfo *> & changedDirs,
+			       QVector<int> &	       starts_ret,
+			       QVector<int> &	       ends_ret,
+			       QVector<DirInfo *> &    dirs_ret ) const
+{
+    // The snapshot has no pointers that could be compared, so this uses
+    // the names on the path from the subtree to each directory: They are
+    // unique among the subdirectories of a directory. The paths make a
+    // tree of nodes (node 0 is the subtree itself) that is matched against
+    // the rows in one pass.
+
+    struct PathNode
+    {
+	QHash<QString, int> children;
+	DirInfo *	    dir;
+    };
+
+    QVector<PathNode> nodes( 1 );
+    nodes[0].dir = 0;
+    int targets	 = 0;
+
+    foreach ( DirInfo * dir, changedDirs )
+    {
+	QStringList path;
+	bool	    covered = false;
+	FileInfo *  item    = dir;
+
+	while ( item && item != _subtree )
+	{
+	    if ( item != dir && changedDirs.contains( static_cast<DirInfo *>( item ) ) )
+	    {
+		covered = true;	// An ancestor is rebuilt anyway
+		break;
+	    }
+
+	    if ( ! item->isPseudoDir() )
+		path.prepend( item->name() );
+
+	    item = item->parent();
+	}
+
+	if ( covered )
+	    continue;
+
+	if ( ! item || path.isEmpty() )	// Not in the subtree or the subtree itself
+	    return false;
+
+	int node = 0;
+
+	foreach ( const QString & name, path )
+	{
+	    int child = nodes[ node ].children.value( name, -1 );
+
+	    if ( child < 0 )
+	    {
+		child = nodes.size();
+		nodes[ node ].children.insert( name, child );
+		nodes.resize( nodes.size() + 1 );
+		nodes[ child ].dir = 0;
+	    }
+
+	    node = child;
+	}
+
+	nodes[ node ].dir = dir;
+	++targets;
+    }
+
+    // Match the rows: 'ancestors' are the nodes of the ancestors of the
+    // current row, by depth.
+
+    QVector<int> ancestors;
+    ancestors << 0;
+    int row = 1;
+
+    while ( row < rows() )
+    {
+	short depth = _depth[ row ];
+	ancestors.resize( depth );
+	int node = -1;
+
+	if ( _flags[ row ] & DirRow )
+	    node = nodes[ ancestors.last() ].children.value( _names[ row ], -1 );
+
+	if ( node >= 0 && ! nodes[ node ].dir )
+	{
+	    // Something changed further below
+
+	    ancestors << node;
+	    ++row;
+	    continue;
+	}
+
+	int start = row++;
+
+	while ( row < rows() && _depth[ row ] > depth )	// Skip the descendants
+	    ++row;
+
+	if ( node >= 0 )
+	{
+	    starts_ret << start;
+	    ends_ret   << row;
+	    dirs_ret   << nodes[ node ].dir;
+	}
+    }
+
+    return dirs_ret.size() == targets;
+}
+
+
+void TreeColumns::copyRows( const TreeColumns  & old,
+			    int			 from,
+			    int			 to,
+			    const QVector<int> & oldEnds,
+			    const QVector<int> & deltas )
+{
+    if ( from >= to )
+	return;
+
+    int count = to - from;
+
+    if ( count > TREE_COLUMNS_MAX_ROWS - rows() )
+    {
+	_tooLarge = true;
+	return;
+    }
+
+    _flags	   += old._flags.mid	    ( from, count );
+    _size	   += old._size.mid	    ( from, count );
+    _allocatedSize += old._allocatedSize.mid( from, count );
+    _mtime	   += old._mtime.mid	    ( from, count );
+    _mtimeYear	   += old._mtimeYear.mid    ( from, count );
+    _mtimeMonth	   += old._mtimeMonth.mid   ( from, count );
+    _mode	   += old._mode.mid	    ( from, count );
+    _depth	   += old._depth.mid	    ( from, count );
+    _names	   += old._names.mid	    ( from, count );
+
+    // The parents of these rows are not in any of the changed ranges, but
+    // they might be after some of them.
+
+    for ( int row = from; row < to; ++row )
+    {
+	int parentRow = old._parentRow[ row ];
+	int moved     = std::upper_bound( oldEnds.constBegin(), oldEnds.constEnd(), parentRow ) - oldEnds.constBegin();
+
+	_parentRow << ( moved > 0 ? parentRow + deltas[ moved - 1 ] : parentRow );
+
+	if ( old._flags[ row ] & FileRow )
+	    ++_fileCount;
+    }
+}
+
+
+void TreeColumns::reserve( FileInfo * subtree )
+{
+    // totalItems() is cached in each DirInfo, so this is cheap and saves
+    // reallocating the columns over and over again for large trees. But it
+    // also counts the files of aggregates that don't get a row, so don't
+    // reserve more than a reasonable amount; the columns can still grow
+    // beyond that.
+
+    int capacity = (int) qMin( subtree->totalItems() + 1, (FileCount) TREE_COLUMNS_MAX_RESERVE );
+
+    _flags.reserve( capacity );
+    _size.reserve( capacity );
+    _allocatedSize.reserve( capacity );
+    _mtime.reserve( capacity );
+    _mtimeYear.reserve( capacity );
+    _mtimeMonth.reserve( capacity );
+    _mode.reserve( capacity );
+    _parentRow.reserve( capacity );
+    _depth.reserve( capacity );
+    _names.reserve( capacity );
+}
+
+
+void TreeColumns::addRecursive( FileInfo * item, int parentRow, short depth )
+{
+    if ( _tooLarge )
+	return;
+
+    int row = parentRow;
+
+    // Pseudo directories (dot entries, attics) don't get a row of their own;
+    // their children are added as children of the pseudo directory's parent.
+
+    if ( ! item->isPseudoDir() )
+    {
+	quint8 flags = 0;
+
+	// An aggregate is not one file with the size of all of them: That
+	// would distort any statistics about files.
+
+	if ( item->isAggregate() )
+	    flags |= AggregateRow;
+	else if ( item->isFile() )
+	{
+	    flags |= FileRow;
+	    ++_fileCount;
+	}
+	else if ( item->isDirInfo() )
+	    flags |= DirRow;
+	else if ( item->isSymLink() )
+	    flags |= SymLinkRow;
+	else if ( item->isSpecial() )
+	    flags |= SpecialRow;
+
+	if ( item->isIgnored() )
+	    flags |= IgnoredRow;
+
+	if ( _flags.size() >= TREE_COLUMNS_MAX_ROWS )
+	{
+	    _tooLarge = true;
+	    return;
+	}
+
+	row = _flags.size();
+
+	_flags		<< flags;
+	_size		<< item->size();
+	_allocatedSize	<< item->allocatedSize();
+	_mtime		<< item->mtime();
+	_mtimeYear	<< item->mtimeYear();
+	_mtimeMonth	<< item->mtimeMonth();
+	_mode		<< item->mode();
+	_parentRow	<< parentRow;
+	_depth		<< depth;
+	_names		<< item->name();
+
+	++depth;
+    }
+
+    if ( item->hasChildren() )
+    {
+	FileInfoIterator it( item );
+
+	while ( *it )
+	{
+	    addRecursive( *it, row, depth );
+	    ++it;
+	}
+    }
+}
+
+
+int TreeColumns::suffixId( int row ) const
+{
+    ensureSuffixes();
+
+    return _suffixIds[ row ];
+}
+
+
+int TreeColumns::suffixId( const QString & suffix ) const
+{
+    ensureSuffixes();
+
+    return _suffixIndex.value( suffix, -1 );
+}
+
+
+const QStringList & TreeColumns::suffixes() const
+{
+    ensureSuffixes();
+
+    return _suffixes;
+}
+
+
+void TreeColumns::ensureSuffixes() const
+{
+    // Several threads may share this snapshot. Once the suffix columns are
+    // complete, they don't change any more, so readers only need the lock
+    // until then.
+
+    QMutexLocker locker( &_suffixMutex );
+
+    if ( _suffixIds.size() != rows() )
+	buildSuffixes();
+}
+
+
+void TreeColumns::buildSuffixes() const
+{
+    _suffixIds.clear();
+    _suffixes.clear();
+    _suffixIndex.clear();
+    _suffixIds.reserve( rows() );
+
+    for ( int row = 0; row < rows(); ++row )
+	_suffixIds << addSuffix( _names[ row ] );
+}
+
+
+int TreeColumns::addSuffix( const QString & name ) const
+{
+    int dotPos = name.lastIndexOf( '.' );
+
+    if ( dotPos < 0 )
+	return -1;
+
+    QString suffix = name.mid( dotPos + 1 ).toLower();
+    QHash<QString, int>::const_iterator it = _suffixIndex.constFind( suffix );
+
+    if ( it != _suffixIndex.constEnd() )
+	return it.value();
+
+    int id = _suffixes.size();
+    _suffixes << suffix;
+    _suffixIndex.insert( suffix, id );
+
+    return id;
+}
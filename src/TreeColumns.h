@@ -0,0 +1,307 @@
+/*
+ *   File name: TreeColumns.h
+ *   Summary:	Columnar snapshot of a subtree for analysis passes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeColumns_h
+#define TreeColumns_h
+
+
+#include <sys/types.h>
+#include <limits.h>	// INT_MAX
+
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QMutex>
+#include <QSharedPointer>
+
+#include "FileSize.h"
+
+
+// Maximum number of rows of a snapshot: Rows are numbered with an int
+
+#define TREE_COLUMNS_MAX_ROWS	( INT_MAX - 1 )
+
+// Maximum number of rows to reserve in advance
+
+#define TREE_COLUMNS_MAX_RESERVE	( 16 * 1024 * 1024 )
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class DirInfo;
+    class TreeColumns;
+
+    /**
+     * Shared, read-only handle to a TreeColumns snapshot. The snapshot is
+     * deleted when the last handle to it goes away.
+     **/
+    typedef QSharedPointer<const TreeColumns> TreeSnapshot;
+
+
+    /**
+     * Structure-of-arrays snapshot of a subtree.
+     *
+     * The FileInfo / DirInfo tree is a pointer-linked structure of
+     * polymorphic objects with a lot of per-node overhead. That is fine for
+     * the tree view, but analysis passes that only need one or two numeric
+     * fields (file sizes for percentiles, mtimes for the file age
+     * statistics) spend most of their time chasing pointers and calling
+     * virtual methods.
+     *
+     * This class flattens a subtree into parallel arrays, one entry (row) per
+     * item in depth-first order (the subtree itself first), so those passes
+     * become tight loops over contiguous memory.
+     *
+     * Like FileInfoIterator, this includes the items of dot entries, but not
+     * those of an attic (i.e. ignored items that were moved to the attic).
+     * Pseudo directories themselves (dot entries) do not get a row.
+     *
+     * A snapshot does not follow changes in the tree. DirTree keeps the last
+     * one that was requested (see DirTree::snapshot()) together with the
+     * directories that changed since then, and the next request builds a
+     * new snapshot from the old one with update(): Only the rows of those
+     * directories are built from the tree again, all others are copied. So
+     * normally this class is used via that method.
+     *
+     * Once it is built, a snapshot is never changed (the suffix columns are
+     * built on demand, but under a mutex), and it does not refer to any
+     * item of the tree: There is intentionally no column with FileInfo
+     * pointers. So it can be handed to worker threads (as a TreeSnapshot)
+     * and analyzed there while the tree is read or changed on the GUI
+     * thread.
+     **/
+    class TreeColumns
+    {
+    public:
+
+	/**
+	 * Flags for each row.
+	 **/
+	enum RowFlags
+	{
+	    FileRow	 = 0x01,	// Regular file
+	    DirRow	 = 0x02,	// Directory
+	    SymLinkRow	 = 0x04,	// Symbolic link
+	    SpecialRow	 = 0x08,	// Block / char device, FIFO, socket
+	    IgnoredRow	 = 0x10,	// Item is ignored
+	    AggregateRow = 0x20		// Aggregated files (see AggregateInfo)
+	};
+
+	/**
+	 * Constructor. If 'subtree' is non-null, immediately build the
+	 * snapshot for that subtree.
+	 **/
+	TreeColumns( FileInfo * subtree = 0 );
+
+	/**
+	 * (Re-)build the snapshot for 'subtree'.
+	 *
+	 * If the subtree has more than TREE_COLUMNS_MAX_ROWS items, this
+	 * stops and leaves the snapshot empty; isTooLarge() returns 'true'
+	 * then.
+	 **/
+	void build( FileInfo * subtree );
+
+	/**
+	 * Build the snapshot from 'old', a snapshot of the same subtree, where
+	 * only the directories in 'changedDirs' and everything below them
+	 * changed: Build the rows for those directories from the tree again
+	 * and copy all other rows from 'old'. This is much faster than a
+	 * complete build() when only small parts of a large subtree changed,
+	 * e.g. after a cleanup or after refreshing a directory.
+	 *
+	 * Return 'false' if that is not possible, e.g. if one of those
+	 * directories is not in 'old'. Use build() in that case.
+	 **/
+	bool update( const TreeColumns & old, const QSet<DirInfo *> & changedDirs );
+
+	/**
+	 * Clear all data.
+	 **/
+	void clear();
+
+	/**
+	 * Return the subtree this snapshot was built for.
+	 *
+	 * Only use this pointer for comparing on other threads.
+	 **/
+	FileInfo * subtree() const { return _subtree; }
+
+	/**
+	 * Return the total size of the subtree at the time this snapshot was
+	 * built.
+	 **/
+	FileSize subtreeTotalSize() const { return _subtreeTotalSize; }
+
+	/**
+	 * Return the tree epoch (see DirTree::epoch()) at the time this
+	 * snapshot was built.
+	 **/
+	quint32 epoch() const { return _epoch; }
+
+	/**
+	 * Set the tree epoch. This is done by DirTree.
+	 **/
+	void setEpoch( quint32 epoch ) { _epoch = epoch; }
+
+	/**
+	 * Return the number of rows.
+	 **/
+	int rows() const { return _flags.size(); }
+
+	/**
+	 * Return 'true' if row 0 is the subtree itself, 'false' if the
+	 * subtree is a pseudo directory (which does not get a row).
+	 **/
+	bool hasSubtreeRow() const { return _hasSubtreeRow; }
+
+	/**
+	 * Return 'true' if the subtree has too many items for a snapshot.
+	 * The snapshot is empty in that case.
+	 **/
+	bool isTooLarge() const { return _tooLarge; }
+
+	/**
+	 * Return the number of rows with regular files.
+	 **/
+	int fileCount() const { return _fileCount; }
+
+	/**
+	 * Row accessors.
+	 **/
+	bool	   isFile	  ( int row ) const { return _flags[ row ] & FileRow; }
+	bool	   isDir	  ( int row ) const { return _flags[ row ] & DirRow;  }
+	quint8	   flags	  ( int row ) const { return _flags[ row ];		}
+	FileSize   size		  ( int row ) const { return _size[ row ];		}
+	FileSize   allocatedSize  ( int row ) const { return _allocatedSize[ row ];	}
+	time_t	   mtime	  ( int row ) const { return _mtime[ row ];		}
+	short	   mtimeYear	  ( int row ) const { return _mtimeYear[ row ];	}
+	short	   mtimeMonth	  ( int row ) const { return _mtimeMonth[ row ];	}
+	mode_t	   mode		  ( int row ) const { return _mode[ row ];		}
+	int	   parentRow	  ( int row ) const { return _parentRow[ row ];	}
+	short	   depth	  ( int row ) const { return _depth[ row ];		}
+	const QString & name	  ( int row ) const { return _names[ row ];		}
+
+	/**
+	 * Direct access to whole columns for tight loops.
+	 **/
+	const QVector<quint8>	& flagsColumn()	  const { return _flags;	}
+	const QVector<FileSize> & sizeColumn()	  const { return _size;		}
+	const QVector<time_t>	& mtimeColumn()	  const { return _mtime;	}
+
+	/**
+	 * Return the suffix ID of a row: An index into suffixes() for the
+	 * lowercase part of the item name after the last '.', or -1 if the
+	 * name has no '.'.
+	 *
+	 * The suffix column is only built when first needed.
+	 **/
+	int suffixId( int row ) const;
+
+	/**
+	 * Return the suffix ID for a lowercase 'suffix' (without the leading
+	 * '.') or -1 if there is no item with that suffix in this snapshot.
+	 **/
+	int suffixId( const QString & suffix ) const;
+
+	/**
+	 * Return the table of all suffixes (lowercase, without the leading
+	 * '.') in this snapshot.
+	 **/
+	const QStringList & suffixes() const;
+
+
+    protected:
+
+	/**
+	 * Reserve space for the rows of 'subtree'.
+	 **/
+	void reserve( FileInfo * subtree );
+
+	/**
+	 * Append the row for 'item' and then recursively the rows for its
+	 * children.
+	 **/
+	void addRecursive( FileInfo * item, int parentRow, short depth );
+
+	/**
+	 * Find the rows of 'changedDirs' in this snapshot: Return their first
+	 * rows in 'starts_ret' and the rows after their last descendants in
+	 * 'ends_ret', both in ascending order, and the directories themselves
+	 * in the same order in 'dirs_ret'. Directories below another one of
+	 * 'changedDirs' are left out since they are covered by that one.
+	 *
+	 * Return 'false' if any of them is not in this snapshot.
+	 **/
+	bool findDirRows( const QSet<DirInfo *> & changedDirs,
+			  QVector<int> &	  starts_ret,
+			  QVector<int> &	  ends_ret,
+			  QVector<DirInfo *> &	  dirs_ret ) const;
+
+	/**
+	 * Append rows 'from' up to (not including) 'to' of 'old'. The parent
+	 * rows are mapped with 'oldEnds' and 'deltas' (see update()).
+	 **/
+	void copyRows( const TreeColumns  & old,
+		       int		    from,
+		       int		    to,
+		       const QVector<int> & oldEnds,
+		       const QVector<int> & deltas );
+
+	/**
+	 * Return the ID for the suffix of 'name' and add that suffix to the
+	 * suffix table if it is not there yet.
+	 **/
+	int addSuffix( const QString & name ) const;
+
+	/**
+	 * Build the suffix column if that is not done yet.
+	 **/
+	void ensureSuffixes() const;
+
+	/**
+	 * Build the suffix column.
+	 **/
+	void buildSuffixes() const;
+
+
+	//
+	// Data members
+	//
+
+	FileInfo *		_subtree;
+	FileSize		_subtreeTotalSize;
+	quint32			_epoch;
+	int			_fileCount;
+	bool			_tooLarge;
+	bool			_hasSubtreeRow;
+
+	QVector<quint8>		_flags;
+	QVector<FileSize>	_size;
+	QVector<FileSize>	_allocatedSize;
+	QVector<time_t>		_mtime;
+	QVector<short>		_mtimeYear;
+	QVector<short>		_mtimeMonth;
+	QVector<mode_t>		_mode;
+	QVector<int>		_parentRow;
+	QVector<short>		_depth;
+	QVector<QString>	_names;
+
+	mutable QMutex			_suffixMutex;
+	mutable QVector<int>		_suffixIds;
+	mutable QStringList		_suffixes;
+	mutable QHash<QString, int>	_suffixIndex;
+
+    };	// class TreeColumns
+
+}	// namespace QDirStat
+
+#endif // ifndef TreeColumns_h
@@ -0,0 +1,92 @@
+/*
+ *   File name: TreeReclaimer.cpp
+ *   Summary:	Background deletion of detached subtrees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QMutexLocker>
+
+#include "TreeReclaimer.h"
+#include "FileInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+TreeReclaimer::TreeReclaimer():
+    QThread(),
+    _stop( false )
+{
+
+}
+
+
+TreeReclaimer::~TreeReclaimer()
+{
+    {
+	QMutexLocker locker( &_mutex );
+	_stop = true;
+	_wakeUp.wakeAll();
+    }
+
+    // The thread only stops when everything is deleted
+
+    wait();
+}
+
+
+void TreeReclaimer::reclaim( FileInfo * first )
+{
+    if ( ! first )
+	return;
+
+    {
+	QMutexLocker locker( &_mutex );
+	_queue << first;
+	_wakeUp.wakeAll();
+    }
+
+    if ( ! isRunning() )
+	start( QThread::LowestPriority );
+}
+
+
+int TreeReclaimer::pending() const
+{
+    QMutexLocker locker( &_mutex );
+
+    return _queue.size();
+}
+
+
+void TreeReclaimer::run()
+{
+    while ( true )
+    {
+	FileInfo * item = 0;
+
+	{
+	    QMutexLocker locker( &_mutex );
+
+	    while ( _queue.isEmpty() && ! _stop )
+		_wakeUp.wait( &_mutex );
+
+	    if ( _queue.isEmpty() )	// _stop and nothing left to do
+		return;
+
+	    item = _queue.takeFirst();
+	}
+
+	while ( item )
+	{
+	    FileInfo * next = item->next();
+	    delete item;
+	    item = next;
+	}
+    }
+}
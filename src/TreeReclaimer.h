@@ -0,0 +1,93 @@
+/*
+ *   File name: TreeReclaimer.h
+ *   Summary:	Background deletion of detached subtrees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeReclaimer_h
+#define TreeReclaimer_h
+
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+
+
+namespace QDirStat
+{
+    class FileInfo;
+
+
+    /**
+     * Thread that deletes subtrees that are no longer part of a DirTree.
+     *
+     * Deleting a tree with millions of items means millions of destructor
+     * calls and free() calls, which takes a long time. DirTree::clear() and
+     * DirTree::deleteSubtree() hand detached subtrees over to this thread
+     * (see DirTree::reclaim()) so the GUI can go on immediately, e.g. with
+     * reading the next directory tree.
+     *
+     * The items handed over must be completely detached: Nobody may refer
+     * to them any more, and deleting them must not access anything else,
+     * in particular not the DirTree (except for DirTree::nodeDeleted()). DirTree::releaseCaches() takes care of
+     * that.
+     *
+     * The thread runs with the lowest priority, and it is only started
+     * when there is something to delete.
+     **/
+    class TreeReclaimer: public QThread
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	TreeReclaimer();
+
+	/**
+	 * Destructor. This waits until all pending subtrees are deleted.
+	 **/
+	virtual ~TreeReclaimer();
+
+	/**
+	 * Delete 'first' and all its siblings (i.e. everything that can be
+	 * reached from it with FileInfo::next()) including all their
+	 * children in the background.
+	 **/
+	void reclaim( FileInfo * first );
+
+	/**
+	 * Return the number of subtree lists that are waiting to be deleted.
+	 **/
+	int pending() const;
+
+
+    protected:
+
+	/**
+	 * Thread main function.
+	 *
+	 * Reimplemented from QThread.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+
+	//
+	// Data members
+	//
+
+	mutable QMutex		_mutex;
+	QWaitCondition		_wakeUp;
+	QList<FileInfo *>	_queue;
+	bool			_stop;
+
+    };	// class TreeReclaimer
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreeReclaimer_h
@@ -12,6 +12,7 @@
 #include <QTimer>
 
 #include "TreemapView.h"
+#include "CacheDiff.h"
 #include "DirTree.h"
 #include "DirInfo.h"
 #include "FormatUtil.h"
@@ -44,6 +45,7 @@ TreemapView::TreemapView( QWidget * parent ):
     _selectionModel(0),
     _selectionModelProxy(0),
     _cleanupCollection(0),
+    _cacheDiff(0),
     _rebuilder(0),
     _rootTile(0),
     _currentItem(0),
@@ -130,6 +132,9 @@ void TreemapView::setDirTree( DirTree * newTree )
 
     connect( _tree, SIGNAL( finished()	     ),
 	     this,  SLOT  ( rebuildTreemap() ) );
+
+    connect( _tree, SIGNAL( exposedDirsNeeded() ),
+	     this,  SLOT  ( exposeDirs()	) );
 }
 
 
@@ -407,6 +412,24 @@ void TreemapView::rebuildTreemapDelayed()
 }
 
 
+void TreemapView::exposeDirs()
+{
+    if ( ! scene() || ! _tree )
+	return;
+
+    // A tile needs its item, so the item's parent must keep its children.
+    // A directory without tiles for its children can still lose them.
+
+    foreach ( QGraphicsItem * graphicsItem, scene()->items() )
+    {
+	TreemapTile * tile = dynamic_cast<TreemapTile *>( graphicsItem );
+
+	if ( tile && tile->orig() )
+	    _tree->exposeDir( tile->orig()->parent() );
+    }
+}
+
+
 void TreemapView::deleteNotify( FileInfo * )
 {
     if ( _rootTile )
@@ -660,6 +683,24 @@ QSize TreemapView::visibleSize()
 }
 
 
+QColor TreemapView::tileColor( FileInfo * file ) const
+{
+    if ( _useFixedColor )
+	return _fixedColor;
+
+    if ( _cacheDiff )
+    {
+	// Only what changed stands out
+
+	QColor color = _cacheDiff->color( file );
+
+	return color.isValid() ? color : QColor( 0xc8, 0xc8, 0xc8 );
+    }
+
+    return MimeCategorizer::instance()->color( file );
+}
+
+
 void TreemapView::setFixedColor( const QColor & color )
 {
     _fixedColor	   = color;
@@ -43,6 +43,7 @@ namespace QDirStat
     class SelectionModel;
     class SelectionModelProxy;
     class CleanupCollection;
+    class CacheDiff;
     class FileInfoSet;
     class DelayedRebuilder;
 
@@ -137,10 +138,11 @@ namespace QDirStat
 
 	/**
 	 * Returns a suitable color for 'file' based on a set of internal rules
-	 * (according to filename extension, MIME type or permissions).
+	 * (according to filename extension, MIME type or permissions), or
+	 * how it changed if the tree was compared with a cache file (see
+	 * setCacheDiff()).
 	 **/
-	QColor tileColor( FileInfo * file ) const
-		{ return _useFixedColor ? _fixedColor : MimeCategorizer::instance()->color( file ); }
+	QColor tileColor( FileInfo * file ) const;
 
 	/**
 	 * Use a fixed color for all tiles. To undo this, set an invalid QColor
@@ -158,6 +160,15 @@ namespace QDirStat
 
     public slots:
 
+	/**
+	 * Color the tiles by how they changed according to 'diff', the
+	 * result of comparing the tree with a cache file (see
+	 * DirTreeModel::cacheDiffChanged()). Use 0 to stop that. This does
+	 * not take over ownership of 'diff', and it does not rebuild the
+	 * treemap.
+	 **/
+	void setCacheDiff( const CacheDiff * diff ) { _cacheDiff = diff; }
+
 	/**
 	 * Update the selected items that have been selected in another view.
 	 **/
@@ -230,6 +241,12 @@ namespace QDirStat
 	 **/
 	void deleteNotify( FileInfo * node );
 
+	/**
+	 * Report the directories with children that have tiles to the tree
+	 * (see DirTree::exposedDirsNeeded()).
+	 **/
+	void exposeDirs();
+
 	/**
 	 * Sync the selected items and the current item to the selection model.
 	 **/
@@ -512,6 +529,7 @@ namespace QDirStat
 	SelectionModel	    * _selectionModel;
 	SelectionModelProxy * _selectionModelProxy;
 	CleanupCollection   * _cleanupCollection;
+	const CacheDiff	    * _cacheDiff;
         DelayedRebuilder    * _rebuilder;
 	TreemapTile	    * _rootTile;
 	TreemapTile	    * _currentItem;
@@ -8,12 +8,16 @@
 
 
 #include <iostream>	// cerr
+#include <string.h>	// strcmp()
 
 #include <QApplication>
 #include <QProcess>
 #include <QProcessEnvironment>
+#include <QTextStream>
 
 #include "QDirStatApp.h"
+#include "CacheDiff.h"
+#include "ScaleTest.h"
 #include "MainWindow.h"
 #include "DirTreeModel.h"
 #include "Settings.h"
@@ -38,6 +42,8 @@ void usage( const QStringList & argList )
 	 << "  " << progName << " unpkg:/dir\n"
 	 << "  " << progName << " --dont-ask|-d\n"
 	 << "  " << progName << " --cache|-c <cache-file-name>\n"
+	 << "  " << progName << " --cache-diff <old-cache-file> <new-cache-file>\n"
+	 << "  " << progName << " --scale-test <item-count>\n"
 	 << "  " << progName << " --fake-translations\n"
 	 << "  " << progName << " --help|-h\n"
 	 << "\n"
@@ -112,6 +118,65 @@ void logQtEnv()
 }
 
 
+/**
+ * Compare two cache files and write the differences to stdout.
+ * Return the exit code of the program.
+ **/
+int cacheDiff( const QString & oldFileName, const QString & newFileName )
+{
+    QTextStream out( stdout );
+
+    out << "# QDirStat cache diff\n"
+	<< "# Old: " << oldFileName << "\n"
+	<< "# New: " << newFileName << "\n"
+	<< "#\n"
+	<< "# Kind\tType\tSize delta\tItems delta\tOld size\tNew size\tPath\n";
+
+    QDirStat::CacheDiff diff;
+    diff.setOutput( &out );
+
+    if ( ! diff.diff( oldFileName, newFileName ) )
+    {
+	out.flush();
+	cerr << progName << ": Can't compare the cache files; see the log file for details."
+	     << std::endl;
+
+	return 1;
+    }
+
+    const QDirStat::CacheDiffItem & total = diff.total();
+
+    out << "#\n"
+	<< "# Total size:  " << total.oldSize  << " -> " << total.newSize  << "\n"
+	<< "# Total items: " << total.oldItems << " -> " << total.newItems << "\n";
+
+    return 0;
+}
+
+
+/**
+ * Build a synthetic tree with 'items' items in memory and check it (see
+ * ScaleTest). Write the results to stdout.
+ * Return the exit code of the program.
+ **/
+int scaleTest( const QString & items )
+{
+    bool ok = false;
+    FileCount count = items.toLongLong( &ok );
+
+    if ( ! ok || count < 0 )
+    {
+	cerr << progName << ": Bad item count: " << qPrintable( items ) << std::endl;
+	return 2;
+    }
+
+    QTextStream out( stdout );
+    QDirStat::ScaleTest test( &out );
+
+    return test.run( count ) ? 0 : 1;
+}
+
+
 int main( int argc, char *argv[] )
 {
     Logger logger( "/tmp/qdirstat-$USER", "qdirstat.log" );
@@ -121,6 +186,30 @@ int main( int argc, char *argv[] )
     QCoreApplication::setOrganizationName( "QDirStat" );
     QCoreApplication::setApplicationName ( "QDirStat" );
 
+    if ( argc == 4 && strcmp( argv[1], "--cache-diff" ) == 0 )
+    {
+	// No GUI at all for this, so it also works on a server without X11
+
+	QCoreApplication coreApp( argc, argv );
+	QStringList argList = QCoreApplication::arguments();
+
+	return cacheDiff( argList.at( 2 ), argList.at( 3 ) );
+    }
+
+    if ( argc == 3 && strcmp( argv[1], "--scale-test" ) == 0 )
+    {
+	// This also checks the details view, so it needs widgets; but no
+	// display, so it also works on a server without X11
+
+	if ( qgetenv( "QT_QPA_PLATFORM" ).isEmpty() )
+	    qputenv( "QT_QPA_PLATFORM", "offscreen" );
+
+	QApplication qtApp( argc, argv );
+	QStringList argList = QCoreApplication::arguments();
+
+	return scaleTest( argList.at( 2 ) );
+    }
+
     QApplication qtApp( argc, argv);
     QStringList argList = QCoreApplication::arguments();
     argList.removeFirst(); // Remove program name
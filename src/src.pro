@@ -17,7 +17,7 @@
 
 
 TEMPLATE	 = app
-QT		+= widgets
+QT		+= widgets concurrent
 
 # QRegExp
 QT		+= core5compat
@@ -31,6 +31,13 @@ MOC_DIR		 = .moc
 OBJECTS_DIR	 = .obj
 LIBS		+= -lz
 
+# Optional zstd compression for cache files if libzstd is available
+packagesExist( libzstd ) {
+    CONFIG	+= link_pkgconfig
+    PKGCONFIG	+= libzstd
+    DEFINES	+= HAVE_ZSTD=1
+}
+
 major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
 !isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
 isEmpty(INSTALL_PREFIX):INSTALL_PREFIX = /usr
@@ -48,11 +55,17 @@ SOURCES	  = main.cpp			\
             QDirStatApp.cpp             \
 	    ActionManager.cpp		\
 	    AdaptiveTimer.cpp		\
+	    AggregateInfo.cpp		\
             Attic.cpp			\
+	    BinaryCache.cpp		\
             BookmarksManager.cpp        \
 	    BreadcrumbNavigator.cpp	\
 	    BucketsTableModel.cpp	\
 	    BusyPopup.cpp		\
+	    CacheDiff.cpp		\
+	    CacheFile.cpp		\
+	    CacheIndex.cpp		\
+	    CacheJournal.cpp		\
 	    Cleanup.cpp			\
 	    CleanupCollection.cpp	\
 	    CleanupConfigPage.cpp	\
@@ -135,6 +148,7 @@ SOURCES	  = main.cpp			\
 	    ProcessStarter.cpp		\
 	    Refresher.cpp		\
 	    RpmPkgManager.cpp		\
+	    ScaleTest.cpp		\
 	    SearchFilter.cpp		\
 	    SelectionModel.cpp		\
 	    Settings.cpp		\
@@ -143,10 +157,13 @@ SOURCES	  = main.cpp			\
 	    SizeColDelegate.cpp		\
 	    StdCleanup.cpp		\
 	    Subtree.cpp			\
+	    SubtreeStore.cpp		\
 	    SysUtil.cpp			\
 	    SystemFileChecker.cpp	\
 	    Translator.cpp		\
 	    Trash.cpp			\
+	    TreeColumns.cpp		\
+	    TreeReclaimer.cpp		\
 	    TreeWalker.cpp		\
 	    TreemapTile.cpp		\
 	    TreemapView.cpp		\
@@ -158,12 +175,18 @@ HEADERS	  =				\
             QDirStatApp.h		\
 	    ActionManager.h		\
 	    AdaptiveTimer.h		\
+	    AggregateInfo.h		\
 	    Attic.h			\
+	    BinaryCache.h		\
             BookmarksManager.h          \
             BreadcrumbNavigator.h	\
             BrokenLibc.h                \
 	    BucketsTableModel.h		\
 	    BusyPopup.h			\
+	    CacheDiff.h			\
+	    CacheFile.h			\
+	    CacheIndex.h		\
+	    CacheJournal.h		\
 	    Cleanup.h			\
 	    CleanupCollection.h		\
 	    CleanupConfigPage.h		\
@@ -212,6 +235,7 @@ HEADERS	  =				\
 	    Logger.h			\
             LogStream.h                 \
 	    MainWindow.h		\
+	    MemoCache.h		\
 	    MessagePanel.h		\
 	    MimeCategorizer.h		\
 	    MimeCategory.h		\
@@ -235,6 +259,7 @@ HEADERS	  =				\
 	    ProcessStarter.h		\
 	    Refresher.h			\
 	    RpmPkgManager.h		\
+	    ScaleTest.h			\
 	    SearchFilter.h              \
 	    SelectionModel.h		\
 	    Settings.h			\
@@ -244,6 +269,7 @@ HEADERS	  =				\
 	    SizeColDelegate.h		\
 	    StdCleanup.h		\
 	    Subtree.h			\
+	    SubtreeStore.h		\
 	    SysUtil.h			\
 	    SystemFileChecker.h		\
 	    Translator.h		\
@@ -259,6 +285,8 @@ HEADERS	  =				\
 	    FormatUtil.h		\
 	    History.h			\
 	    HistoryButtons.h		\
+	    TreeColumns.h		\
+	    TreeReclaimer.h		\
 	    TreeWalker.h		\
 	    TreemapView.h		\
 	    Version.h